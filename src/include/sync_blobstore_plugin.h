@@ -0,0 +1,123 @@
+/*
+  This file is part of GNU Taler
+  Copyright (C) 2024 Taler Systems SA
+
+  Taler is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Lesser General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Taler is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  Taler; see the file COPYING.GPL.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file include/sync_blobstore_plugin.h
+ * @brief storage of backup data outside of the database
+ * @author Christian Grothoff
+ *
+ * Blob stores keep the (possibly large) backup data, addressed
+ * by the hash of the data.  The meta data (accounts, signatures,
+ * which backup references which blob) remains in the database,
+ * which is also responsible for deciding when a blob is no longer
+ * needed.
+ */
+#ifndef SYNC_BLOBSTORE_PLUGIN_H
+#define SYNC_BLOBSTORE_PLUGIN_H
+
+#include <gnunet/gnunet_util_lib.h>
+
+
+/**
+ * Handle to interact with a blob store.  Blob stores are not
+ * transactional, each call takes effect immediately.
+ */
+struct SYNC_BlobStorePlugin
+{
+
+  /**
+   * Closure for all callbacks.
+   */
+  void *cls;
+
+  /**
+   * Name of the library which generated this plugin.  Set by the
+   * plugin loader.
+   */
+  char *library_name;
+
+  /**
+   * Store a blob.  Storing a blob that already exists is not
+   * an error; as blobs are addressed by their hash, the data
+   * must be the same.
+   *
+   * @param cls closure
+   * @param blob_hash hash of @a blob
+   * @param blob_size number of bytes in @a blob
+   * @param blob data to store
+   * @return #GNUNET_OK on success
+   */
+  enum GNUNET_GenericReturnValue
+  (*put_blob)(void *cls,
+              const struct GNUNET_HashCode *blob_hash,
+              size_t blob_size,
+              const void *blob);
+
+  /**
+   * Retrieve a blob.
+   *
+   * @param cls closure
+   * @param blob_hash hash of the blob to retrieve
+   * @param[out] blob_size set to the number of bytes in @a blob
+   * @param[out] blob set to the data, caller MUST FREE
+   * @return #GNUNET_OK on success, #GNUNET_NO if we do not
+   *         have the blob, #GNUNET_SYSERR on errors
+   */
+  enum GNUNET_GenericReturnValue
+  (*get_blob)(void *cls,
+              const struct GNUNET_HashCode *blob_hash,
+              size_t *blob_size,
+              void **blob);
+
+  /**
+   * Retrieve part of a blob.  Optional, NULL if the blob store
+   * can only return whole blobs.
+   *
+   * @param cls closure
+   * @param blob_hash hash of the blob to retrieve
+   * @param offset offset of the first byte to retrieve
+   * @param length maximum number of bytes to retrieve
+   * @param[out] total_size set to the size of the whole blob
+   * @param[out] blob_size set to the number of bytes in @a blob,
+   *             0 if @a offset is beyond the end of the blob
+   * @param[out] blob set to the data, caller MUST FREE
+   * @return #GNUNET_OK on success, #GNUNET_NO if we do not
+   *         have the blob, #GNUNET_SYSERR on errors
+   */
+  enum GNUNET_GenericReturnValue
+  (*get_blob_range)(void *cls,
+                    const struct GNUNET_HashCode *blob_hash,
+                    uint64_t offset,
+                    uint64_t length,
+                    size_t *total_size,
+                    size_t *blob_size,
+                    void **blob);
+
+  /**
+   * Delete a blob.
+   *
+   * @param cls closure
+   * @param blob_hash hash of the blob to delete
+   * @return #GNUNET_OK on success, #GNUNET_NO if we do not
+   *         have the blob, #GNUNET_SYSERR on errors
+   */
+  enum GNUNET_GenericReturnValue
+  (*delete_blob)(void *cls,
+                 const struct GNUNET_HashCode *blob_hash);
+
+};
+
+
+#endif
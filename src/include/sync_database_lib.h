@@ -21,6 +21,7 @@
 
 #include <taler/taler_util.h>
 #include "sync_database_plugin.h"
+#include "sync_blobstore_plugin.h"
 
 /**
  * Initialize the plugin.
@@ -41,6 +42,28 @@ void
 SYNC_DB_plugin_unload (struct SYNC_DatabasePlugin *plugin);
 
 
+/**
+ * Initialize the blob store plugin @a name, i.e.
+ * "libsync_plugin_blobstore_$NAME".
+ *
+ * @param cfg configuration to use
+ * @param name name of the blob store, e.g. "file" or "s3"
+ * @return NULL on failure
+ */
+struct SYNC_BlobStorePlugin *
+SYNC_BLOBSTORE_plugin_load (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                            const char *name);
+
+
+/**
+ * Shutdown the blob store plugin.
+ *
+ * @param plugin plugin to unload
+ */
+void
+SYNC_BLOBSTORE_plugin_unload (struct SYNC_BlobStorePlugin *plugin);
+
+
 #endif  /* SYNC_DB_LIB_H */
 
 /* end of sync_database_lib.h */
@@ -87,6 +87,60 @@ typedef void
                                   const struct TALER_Amount *amount);
 
 
+/**
+ * Function called on backups found by a batch lookup.
+ *
+ * @param cls closure
+ * @param account_pub account the backup is stored under
+ * @param account_sig signature affirming storage request
+ * @param prev_hash hash of the previous backup, all zeros if none
+ * @param backup_hash hash of @a backup
+ * @param omitted true if the data was omitted to stay within the
+ *        size limit of the lookup; @a backup is then NULL
+ * @param backup_size number of bytes in @a backup
+ * @param backup raw backup data, NULL if the caller already
+ *        knows the backup with @a backup_hash or if @a omitted
+ */
+typedef void
+(*SYNC_DB_BackupIterator)(void *cls,
+                          const struct SYNC_AccountPublicKeyP *account_pub,
+                          const struct SYNC_AccountSignatureP *account_sig,
+                          const struct GNUNET_HashCode *prev_hash,
+                          const struct GNUNET_HashCode *backup_hash,
+                          bool omitted,
+                          size_t backup_size,
+                          const void *backup);
+
+
+/**
+ * Statistics about where the backup data is kept.
+ */
+struct SYNC_DB_StorageStats
+{
+  /**
+   * Number of blobs kept in the database.
+   */
+  uint64_t hot_blobs;
+
+  /**
+   * Number of bytes of backup data kept in the database.
+   */
+  uint64_t hot_bytes;
+
+  /**
+   * Number of blobs kept in the blob store.
+   */
+  uint64_t cold_blobs;
+
+  /**
+   * Number of bytes of backup data kept in the blob store.
+   * Does not include blobs stored before their size was
+   * recorded.
+   */
+  uint64_t cold_bytes;
+};
+
+
 /**
  * Handle to interact with the database.
  *
@@ -129,6 +183,20 @@ struct SYNC_DatabasePlugin
   enum GNUNET_GenericReturnValue
   (*create_tables)(void *cls);
 
+  /**
+   * Hash-partition the tables by account into @a num_partitions
+   * partitions.  Rewrites all tables, so no other process should
+   * use the database meanwhile.  Can be called again to change
+   * the number of partitions.
+   *
+   * @param cls closure
+   * @param num_partitions number of partitions to create
+   * @return #GNUNET_OK upon success; #GNUNET_SYSERR upon failure
+   */
+  enum GNUNET_GenericReturnValue
+  (*partition_tables)(void *cls,
+                      uint32_t num_partitions);
+
 
   /**
    * Do a pre-flight check that we are not in an uncommitted transaction.
@@ -163,6 +231,34 @@ struct SYNC_DatabasePlugin
         struct GNUNET_TIME_Absolute expire_pending_payments);
 
 
+  /**
+   * Move blobs that were not accessed since @a cutoff from the
+   * database to the blob store (the cold tier).  Blobs are moved
+   * back into the database when they are downloaded again.
+   *
+   * @param cls closure
+   * @param cutoff move blobs last accessed before this time
+   * @param limit maximum number of blobs to move
+   * @return transaction status, number of blobs moved on success
+   */
+  enum GNUNET_DB_QueryStatus
+  (*migrate_cold)(void *cls,
+                  struct GNUNET_TIME_Absolute cutoff,
+                  unsigned int limit);
+
+
+  /**
+   * Obtain statistics about where the backup data is kept.
+   *
+   * @param cls closure
+   * @param[out] stats set to the statistics
+   * @return transaction status
+   */
+  enum GNUNET_DB_QueryStatus
+  (*get_storage_stats)(void *cls,
+                       struct SYNC_DB_StorageStats *stats);
+
+
   /**
    * Store backup. Only applicable for the FIRST backup under
    * an @a account_pub. Use @e update_backup_TR to update an
@@ -248,12 +344,17 @@ struct SYNC_DatabasePlugin
    *
    * @param cls closure
    * @param account_pub account to store @a backup under
+   * @param expected_hash hash of the backup the caller expects;
+   *        if given, the lookup may be served by a read replica,
+   *        falling back to the primary if the replica returns a
+   *        different hash; NULL to always ask the primary
    * @param backup_hash[OUT] set to hash of @a backup
    * @return transaction status
    */
   enum SYNC_DB_QueryStatus
   (*lookup_account_TR)(void *cls,
                        const struct SYNC_AccountPublicKeyP *account_pub,
+                       const struct GNUNET_HashCode *expected_hash,
                        struct GNUNET_HashCode *backup_hash);
 
 
@@ -262,21 +363,110 @@ struct SYNC_DatabasePlugin
    *
    * @param cls closure
    * @param account_pub account to store @a backup under
+   * @param expected_hash hash of the backup the caller expects;
+   *        if given, the lookup may be served by a read replica,
+   *        falling back to the primary if the replica returns a
+   *        different hash; NULL to always ask the primary
    * @param account_sig[OUT] set to signature affirming storage request
    * @param prev_hash[OUT] set to hash of the previous @a backup (all zeros if none)
    * @param backup_hash[OUT] set to hash of @a backup
    * @param backup_size[OUT] set to number of bytes in @a backup
-   * @param backup[OUT] set to raw data to backup, caller MUST FREE
+   * @param backup[OUT] set to raw data to backup, caller MUST FREE;
+   *        NULL to only obtain the meta data (@a backup_size is then 0)
    */
   enum SYNC_DB_QueryStatus
   (*lookup_backup_TR)(void *cls,
                       const struct SYNC_AccountPublicKeyP *account_pub,
+                      const struct GNUNET_HashCode *expected_hash,
                       struct SYNC_AccountSignatureP *account_sig,
                       struct GNUNET_HashCode *prev_hash,
                       struct GNUNET_HashCode *backup_hash,
                       size_t *backup_size,
                       void **backup);
 
+
+  /**
+   * Obtain part of a backup.  Only the requested part is read
+   * from the storage.
+   *
+   * @param cls closure
+   * @param account_pub account the backup is stored under
+   * @param expected_hash hash of the backup the caller expects,
+   *        see @e lookup_backup_TR
+   * @param offset offset of the first byte to return
+   * @param length maximum number of bytes to return
+   * @param account_sig[OUT] set to signature affirming storage request
+   * @param prev_hash[OUT] set to hash of the previous @a backup (all zeros if none)
+   * @param backup_hash[OUT] set to hash of the whole backup
+   * @param total_size[OUT] set to number of bytes in the whole backup
+   * @param backup_size[OUT] set to number of bytes in @a backup,
+   *        0 if @a offset is beyond the end of the backup
+   * @param backup[OUT] set to the requested part, caller MUST FREE
+   */
+  enum SYNC_DB_QueryStatus
+  (*lookup_backup_range_TR)(void *cls,
+                            const struct SYNC_AccountPublicKeyP *account_pub,
+                            const struct GNUNET_HashCode *expected_hash,
+                            uint64_t offset,
+                            uint64_t length,
+                            struct SYNC_AccountSignatureP *account_sig,
+                            struct GNUNET_HashCode *prev_hash,
+                            struct GNUNET_HashCode *backup_hash,
+                            size_t *total_size,
+                            size_t *backup_size,
+                            void **backup);
+
+  /**
+   * Obtain a specific version of the backup of an account,
+   * which may be the current backup or one from the history.
+   *
+   * @param cls closure
+   * @param account_pub account the backup is stored under
+   * @param backup_hash hash of the version to look up
+   * @param account_sig[OUT] set to signature affirming storage request
+   * @param prev_hash[OUT] set to hash of the previous @a backup (all zeros if none)
+   * @param backup_size[OUT] set to number of bytes in @a backup
+   * @param backup[OUT] set to raw data to backup, caller MUST FREE
+   */
+  enum SYNC_DB_QueryStatus
+  (*lookup_backup_version_TR)(void *cls,
+                              const struct SYNC_AccountPublicKeyP *account_pub,
+                              const struct GNUNET_HashCode *backup_hash,
+                              struct SYNC_AccountSignatureP *account_sig,
+                              struct GNUNET_HashCode *prev_hash,
+                              size_t *backup_size,
+                              void **backup);
+
+  /**
+   * Obtain the backups of multiple accounts with a single query.
+   * Accounts without a backup are skipped.
+   *
+   * @param cls closure
+   * @param num_accounts length of the @a accounts and @a known_hashes
+   *        arrays; each account must only be given once
+   * @param accounts accounts to look up backups for
+   * @param known_hashes for each account, the hash of the backup the
+   *        caller already has, all zeros if it has none; if the
+   *        account's current backup has this hash, @a it is called
+   *        without the backup data
+   * @param max_total_size limit for the total size of the backup
+   *        data; once the backups (in the order of @a accounts)
+   *        exceed it, the data of all further backups is omitted,
+   *        except that the first backup is always returned
+   * @param it iterator to call on all backups found, in the order
+   *        of @a accounts
+   * @param it_cls closure for @a it
+   * @return transaction status
+   */
+  enum GNUNET_DB_QueryStatus
+  (*lookup_backups_TR)(void *cls,
+                       unsigned int num_accounts,
+                       const struct SYNC_AccountPublicKeyP *accounts,
+                       const struct GNUNET_HashCode *known_hashes,
+                       uint64_t max_total_size,
+                       SYNC_DB_BackupIterator it,
+                       void *it_cls);
+
   /**
    * Increment account lifetime and mark the associated payment
    * as successful.
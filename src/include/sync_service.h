@@ -89,6 +89,54 @@ struct SYNC_AccountSignatureP
   struct GNUNET_CRYPTO_EddsaSignature eddsa_sig;
 };
 
+
+/**
+ * Header of an entry in the reply to a "POST /backups:batch-get"
+ * request.  The reply is a sequence of such entries, each followed
+ * by @e backup_size bytes of backup data.
+ */
+struct SYNC_BatchGetEntryP
+{
+  /**
+   * Account the entry is about.
+   */
+  struct SYNC_AccountPublicKeyP account_pub;
+
+  /**
+   * Signature of the account over the backup, all zeros if
+   * @e http_status is #MHD_HTTP_NOT_FOUND.
+   */
+  struct SYNC_AccountSignatureP account_sig;
+
+  /**
+   * Hash of the previous backup, all zeros for none.
+   */
+  struct GNUNET_HashCode prev_hash;
+
+  /**
+   * Hash of the backup.
+   */
+  struct GNUNET_HashCode backup_hash;
+
+  /**
+   * Status for this account, in NBO: #MHD_HTTP_OK, #MHD_HTTP_NOT_MODIFIED
+   * if the client already knows @e backup_hash, #MHD_HTTP_NOT_FOUND, or
+   * #MHD_HTTP_PAYLOAD_TOO_LARGE if the backup did not fit into the
+   * reply and must be downloaded separately.
+   */
+  uint32_t http_status GNUNET_PACKED;
+
+  /**
+   * Always zero.
+   */
+  uint32_t reserved GNUNET_PACKED;
+
+  /**
+   * Number of bytes of backup data following this header, in NBO.
+   */
+  uint64_t backup_size GNUNET_PACKED;
+};
+
 GNUNET_NETWORK_STRUCT_END
 
 
@@ -309,6 +357,149 @@ SYNC_upload (struct GNUNET_CURL_Context *ctx,
              void *cb_cls);
 
 
+/**
+ * Upload a backup stored in file @a fd to a Sync server.  Like
+ * #SYNC_upload(), except that the backup is read from @a fd while
+ * it is being uploaded, so it never needs to be held in memory.
+ *
+ * @param ctx for HTTP client request processing
+ * @param base_url base URL of the Sync server
+ * @param priv private key of an account with the server
+ * @param prev_backup_hash hash of the previous backup, NULL for the first upload ever
+ * @param fd regular file with the encrypted backup (starting at offset
+ *        zero), must remain open and unchanged until we are done with
+ *        the operation!
+ * @param backup_hash hash of the backup in @a fd if known, NULL to
+ *        have it computed (by reading @a fd once before the upload)
+ * @param po payment options
+ * @param paid_order_id ID of an order we paid, or NULL
+ * @param cb function to call with the result
+ * @param cb_cls closure for @a cb
+ * @return handle for the operation, NULL if @a fd could not be read
+ */
+struct SYNC_UploadOperation *
+SYNC_upload_fd (struct GNUNET_CURL_Context *ctx,
+                const char *base_url,
+                struct SYNC_AccountPrivateKeyP *priv,
+                const struct GNUNET_HashCode *prev_backup_hash,
+                int fd,
+                const struct GNUNET_HashCode *backup_hash,
+                enum SYNC_PaymentOptions po,
+                const char *paid_order_id,
+                SYNC_UploadCallback cb,
+                void *cb_cls);
+
+
+/**
+ * Provider to upload to in #SYNC_upload_multi().
+ */
+struct SYNC_UploadTarget
+{
+
+  /**
+   * Base URL of the Sync server.
+   */
+  const char *base_url;
+
+  /**
+   * Hash of the previous backup at this provider, NULL for the
+   * first upload ever.
+   */
+  const struct GNUNET_HashCode *prev_backup_hash;
+
+  /**
+   * Payment options for this provider.
+   */
+  enum SYNC_PaymentOptions po;
+
+  /**
+   * ID of an order we paid at this provider, or NULL.
+   */
+  const char *paid_order_id;
+
+};
+
+
+/**
+ * Result of the upload to one provider in #SYNC_upload_multi().
+ */
+struct SYNC_UploadMultiResult
+{
+
+  /**
+   * Base URL of the Sync server.
+   */
+  const char *base_url;
+
+  /**
+   * Details about the upload to @e base_url.
+   */
+  struct SYNC_UploadDetails ud;
+
+};
+
+
+/**
+ * Function called with the results of a #SYNC_upload_multi().
+ *
+ * @param cls closure
+ * @param num_results length of the @a results array
+ * @param results results per provider, in the order in which
+ *        the providers were given to #SYNC_upload_multi()
+ */
+typedef void
+(*SYNC_UploadMultiCallback)(void *cls,
+                            unsigned int num_results,
+                            const struct SYNC_UploadMultiResult *results);
+
+
+/**
+ * Handle for an upload to multiple providers.
+ */
+struct SYNC_UploadMultiOperation;
+
+
+/**
+ * Upload a @a backup to several Sync servers in parallel.  Like
+ * calling #SYNC_upload() once per provider, except that the backup
+ * is hashed only once and signed only once per distinct previous
+ * backup hash, and that @a cb is called only once, after all
+ * uploads have finished.
+ *
+ * @param ctx for HTTP client request processing
+ * @param priv private key of the account at all of the servers
+ * @param num_targets length of the @a targets array, must not be zero
+ * @param targets providers to upload to
+ * @param backup_size number of bytes in @a backup
+ * @param backup the encrypted backup, must remain in
+ *         memory until we are done with the operation!
+ * @param cb function to call with the results
+ * @param cb_cls closure for @a cb
+ * @return handle for the operation, NULL on error
+ */
+struct SYNC_UploadMultiOperation *
+SYNC_upload_multi (struct GNUNET_CURL_Context *ctx,
+                   struct SYNC_AccountPrivateKeyP *priv,
+                   unsigned int num_targets,
+                   const struct SYNC_UploadTarget *targets,
+                   size_t backup_size,
+                   const void *backup,
+                   SYNC_UploadMultiCallback cb,
+                   void *cb_cls);
+
+
+/**
+ * Cancel an upload to multiple providers.  Uploads that are
+ * still running are cancelled, see #SYNC_upload_cancel().
+ * May also be called from the #SYNC_UploadMultiCallback, which
+ * has no effect as the operation is freed after it returns.
+ *
+ * @param umo operation to cancel
+ */
+void
+SYNC_upload_multi_cancel (struct SYNC_UploadMultiOperation *umo);
+
+
 /**
  * Cancel the upload.  Note that aborting an upload does NOT guarantee
  * that it did not complete, it is possible that the server did
@@ -359,18 +550,25 @@ struct SYNC_DownloadDetails
       struct GNUNET_HashCode curr_backup_hash;
 
       /**
-       * The backup we downloaded.
+       * The backup we downloaded, NULL if the backup was
+       * streamed to the application.
        */
       const void *backup;
 
       /**
-       * Number of bytes in @e backup.
+       * Number of bytes in @e backup (or streamed).
        */
       size_t backup_size;
     } ok;
 
   } details;
 
+  /**
+   * Taler error code.  Last member to keep the layout of the
+   * structure compatible with earlier versions of the library.
+   */
+  enum TALER_ErrorCode ec;
+
 };
 
 
@@ -409,6 +607,99 @@ SYNC_download (struct GNUNET_CURL_Context *ctx,
                void *cb_cls);
 
 
+/**
+ * Download the latest version of a backup for account @a pub,
+ * using a download cache in @a cache_dir.  If the cache has a
+ * copy of the backup, the server is asked to only return the
+ * backup if it changed.  If it did not, @a cb is called with the
+ * (verified) cached copy and status #MHD_HTTP_OK, just as if the
+ * backup had been downloaded.  Downloaded backups are added to
+ * the cache.
+ *
+ * @param ctx for HTTP client request processing
+ * @param base_url base URL of the Sync server
+ * @param pub account public key
+ * @param cache_dir directory for the download cache
+ * @param cb function to call with the backup
+ * @param cb_cls closure for @a cb
+ * @return handle for the operation
+ */
+struct SYNC_DownloadOperation *
+SYNC_download_cached (struct GNUNET_CURL_Context *ctx,
+                      const char *base_url,
+                      const struct SYNC_AccountPublicKeyP *pub,
+                      const char *cache_dir,
+                      SYNC_DownloadCallback cb,
+                      void *cb_cls);
+
+
+/**
+ * Function called with each chunk of a backup as it is being
+ * downloaded.  The data is not yet verified: the application must
+ * not use it unless the final #SYNC_DownloadCallback reports
+ * #MHD_HTTP_OK.
+ *
+ * @param cls closure
+ * @param data next chunk of the backup
+ * @param data_size number of bytes in @a data
+ * @return #GNUNET_OK to continue, #GNUNET_SYSERR to abort the download
+ */
+typedef enum GNUNET_GenericReturnValue
+(*SYNC_DownloadChunkCallback)(void *cls,
+                              const void *data,
+                              size_t data_size);
+
+
+/**
+ * Download the latest version of a backup for account @a pub,
+ * passing the backup to @a chunk_cb as it arrives instead of
+ * buffering it.  The backup is hashed incrementally and the
+ * signature is verified once the download is complete, at which
+ * point @a cb is called with the result (and without the backup).
+ *
+ * @param ctx for HTTP client request processing
+ * @param base_url base URL of the Sync server
+ * @param pub account public key
+ * @param chunk_cb function to call with each chunk of the backup
+ * @param chunk_cb_cls closure for @a chunk_cb
+ * @param cb function to call with the result
+ * @param cb_cls closure for @a cb
+ * @return handle for the operation, NULL on error
+ */
+struct SYNC_DownloadOperation *
+SYNC_download_stream (struct GNUNET_CURL_Context *ctx,
+                      const char *base_url,
+                      const struct SYNC_AccountPublicKeyP *pub,
+                      SYNC_DownloadChunkCallback chunk_cb,
+                      void *chunk_cb_cls,
+                      SYNC_DownloadCallback cb,
+                      void *cb_cls);
+
+
+/**
+ * Download the latest version of a backup for account @a pub,
+ * writing the backup to @a fd as it arrives.  If @a cb does not
+ * report #MHD_HTTP_OK, whatever was written to @a fd must be
+ * discarded.
+ *
+ * @param ctx for HTTP client request processing
+ * @param base_url base URL of the Sync server
+ * @param pub account public key
+ * @param fd file descriptor to write the backup to, must remain
+ *        open until @a cb was called or the download was cancelled
+ * @param cb function to call with the result
+ * @param cb_cls closure for @a cb
+ * @return handle for the operation, NULL on error
+ */
+struct SYNC_DownloadOperation *
+SYNC_download_fd (struct GNUNET_CURL_Context *ctx,
+                  const char *base_url,
+                  const struct SYNC_AccountPublicKeyP *pub,
+                  int fd,
+                  SYNC_DownloadCallback cb,
+                  void *cb_cls);
+
+
 /**
  * Cancel the download.
  *
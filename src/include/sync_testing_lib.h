@@ -178,6 +178,101 @@ SYNC_TESTING_cmd_backup_download (const char *label,
                                   const char *upload_ref);
 
 
+/**
+ * Make the "backup download" command using a download cache.
+ * The first download fills the cache; later downloads of the
+ * same backup are answered with "304 Not Modified" by the
+ * service and served from the cache, which the command
+ * reports as #MHD_HTTP_OK.
+ *
+ * @param label command label
+ * @param sync_url base URL of the sync serving
+ *        the policy store request.
+ * @param cache_dir directory of the download cache
+ * @param http_status expected HTTP status.
+ * @param upload_ref reference to upload command
+ * @return the command
+ */
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_download_cached (const char *label,
+                                         const char *sync_url,
+                                         const char *cache_dir,
+                                         unsigned int http_status,
+                                         const char *upload_ref);
+
+
+/**
+ * Make the "backup download" command using #SYNC_download_stream().
+ * The command checks that the chunks it got match the hash of the
+ * verified backup.
+ *
+ * @param label command label
+ * @param sync_url base URL of the sync serving
+ *        the policy store request.
+ * @param abort_download true to abort the download from the chunk
+ *        callback, the download must then fail with status 0
+ * @param http_status expected HTTP status.
+ * @param upload_ref reference to upload command
+ * @return the command
+ */
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_download_stream (const char *label,
+                                         const char *sync_url,
+                                         bool abort_download,
+                                         unsigned int http_status,
+                                         const char *upload_ref);
+
+
+/**
+ * Make the "backup download" command using #SYNC_download_fd()
+ * with a temporary file.  The command checks that the file
+ * matches the hash of the verified backup.
+ *
+ * @param label command label
+ * @param sync_url base URL of the sync serving
+ *        the policy store request.
+ * @param http_status expected HTTP status.
+ * @param upload_ref reference to upload command
+ * @return the command
+ */
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_download_fd (const char *label,
+                                     const char *sync_url,
+                                     unsigned int http_status,
+                                     const char *upload_ref);
+
+
+/**
+ * Make the "backup get" command, which requests the current
+ * backup of an account with conditional or range headers and
+ * checks the reply without verifying it.
+ *
+ * @param label command label
+ * @param sync_url base URL of the sync serving
+ *        the policy store request.
+ * @param upload_ref reference to an upload command of the account
+ * @param range value of the "Range" header, NULL for none
+ * @param if_range_ref reference to the upload command whose hash
+ *        to send in the "If-Range" header, NULL for none
+ * @param if_none_match_ref reference to the upload command whose
+ *        hash to send in the "If-None-Match" header, NULL for none
+ * @param http_status expected HTTP status.
+ * @param body expected body of the reply, NULL to not check it
+ * @param body_size number of bytes in @a body
+ * @return the command
+ */
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_get (const char *label,
+                             const char *sync_url,
+                             const char *upload_ref,
+                             const char *range,
+                             const char *if_range_ref,
+                             const char *if_none_match_ref,
+                             unsigned int http_status,
+                             const void *body,
+                             size_t body_size);
+
+
 /**
  * Types of options for performing the upload. Used as a bitmask.
  */
@@ -202,7 +297,12 @@ enum SYNC_TESTING_UploadOption
   /**
    * Reference payment order ID from linked previous upload.
    */
-  SYNC_TESTING_UO_REFERENCE_ORDER_ID = 4
+  SYNC_TESTING_UO_REFERENCE_ORDER_ID = 4,
+
+  /**
+   * Upload from a temporary file with #SYNC_upload_fd().
+   */
+  SYNC_TESTING_UO_FROM_FILE = 8
 
 
 };
@@ -234,4 +334,31 @@ SYNC_TESTING_cmd_backup_upload (const char *label,
                                 const void *backup_data,
                                 size_t backup_data_size);
 
+
+/**
+ * Make the "backup upload multi" command, which uploads an update
+ * of the backup of @a prev_upload to two providers at once and
+ * cancels the operation from within its callback.
+ *
+ * @param label command label
+ * @param sync_url base URL of the first provider
+ * @param other_url base URL of the second provider
+ * @param prev_upload reference to the previous upload we are
+ *        supposed to update at both providers
+ * @param http_status expected HTTP status from @a sync_url
+ * @param other_http_status expected HTTP status from @a other_url
+ * @param backup_data data to upload
+ * @param backup_data_size number of bytes in @a backup_data
+ * @return the command
+ */
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_upload_multi (const char *label,
+                                      const char *sync_url,
+                                      const char *other_url,
+                                      const char *prev_upload,
+                                      unsigned int http_status,
+                                      unsigned int other_http_status,
+                                      const void *backup_data,
+                                      size_t backup_data_size);
+
 #endif
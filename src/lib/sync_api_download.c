@@ -29,10 +29,45 @@
 #include <gnunet/gnunet_util_lib.h>
 #include <gnunet/gnunet_curl_lib.h>
 #include <taler/taler_signatures.h>
+#include <taler/taler_json_lib.h>
 #include "sync_service.h"
 #include "sync_api_curl_defaults.h"
 
 
+/**
+ * How much of the body of a reply other than #MHD_HTTP_OK do
+ * we keep when streaming?  Error replies are small JSON objects.
+ */
+#define MAX_ERROR_BODY (16 * 1024)
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a backup in the download cache, followed by the
+ * backup itself.
+ */
+struct CacheHeaderP
+{
+  /**
+   * Signature of the account over the backup.
+   */
+  struct SYNC_AccountSignatureP account_sig;
+
+  /**
+   * Hash of the previous backup.
+   */
+  struct GNUNET_HashCode prev_hash;
+
+  /**
+   * Hash of the backup.
+   */
+  struct GNUNET_HashCode backup_hash;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
 /**
  * @brief Handle for a download operation.
  */
@@ -82,9 +117,208 @@ struct SYNC_DownloadOperation
    */
   struct GNUNET_HashCode sync_previous;
 
+  /**
+   * Function to call with each chunk of the backup, NULL if
+   * we are not streaming the backup.
+   */
+  SYNC_DownloadChunkCallback chunk_cb;
+
+  /**
+   * Closure for @e chunk_cb.
+   */
+  void *chunk_cb_cls;
+
+  /**
+   * Curl handle of the download, only set if streaming.
+   */
+  CURL *eh;
+
+  /**
+   * Body of a reply other than #MHD_HTTP_OK, only used if
+   * streaming.  Truncated to #MAX_ERROR_BODY bytes.
+   */
+  struct GNUNET_Buffer reply;
+
+  /**
+   * Hash context over the backup, only used if streaming.
+   */
+  struct GNUNET_HashContext *hash_ctx;
+
+  /**
+   * Number of bytes of the backup streamed so far.
+   */
+  size_t streamed;
+
+  /**
+   * File descriptor to write the backup to, for #SYNC_download_fd().
+   */
+  int fd;
+
+  /**
+   * Name of the file in the download cache for this account,
+   * NULL if we are not using a cache.
+   */
+  char *cache_fn;
+
+  /**
+   * Cached copy of the backup, NULL if none.
+   */
+  void *cached;
+
+  /**
+   * Number of bytes in @e cached.
+   */
+  size_t cached_size;
+
+  /**
+   * Meta data of the backup in @e cached.
+   */
+  struct CacheHeaderP cached_hdr;
+
+  /**
+   * Set to true if @e chunk_cb asked us to abort the download.
+   */
+  bool aborted;
+
 };
 
 
+/**
+ * Store the backup we just downloaded (and verified) in
+ * the download cache.  We write the header and then @a data
+ * directly to a temporary file, which replaces the cache
+ * entry once complete.
+ *
+ * @param download the download operation
+ * @param backup_hash hash of the backup
+ * @param data the backup
+ * @param data_size number of bytes in @a data
+ */
+static void
+store_in_cache (const struct SYNC_DownloadOperation *download,
+                const struct GNUNET_HashCode *backup_hash,
+                const void *data,
+                size_t data_size)
+{
+  struct CacheHeaderP hdr = {
+    .account_sig = download->account_sig,
+    .prev_hash = download->sync_previous,
+    .backup_hash = *backup_hash
+  };
+  struct GNUNET_DISK_FileHandle *fh;
+  char *tmp;
+  bool ok;
+
+  GNUNET_asprintf (&tmp,
+                   "%s.tmp",
+                   download->cache_fn);
+  fh = GNUNET_DISK_file_open (tmp,
+                              GNUNET_DISK_OPEN_WRITE
+                              | GNUNET_DISK_OPEN_CREATE
+                              | GNUNET_DISK_OPEN_TRUNCATE,
+                              GNUNET_DISK_PERM_USER_READ
+                              | GNUNET_DISK_PERM_USER_WRITE);
+  if (NULL == fh)
+  {
+    GNUNET_free (tmp);
+    return;
+  }
+  ok = ( ((ssize_t) sizeof (hdr) ==
+          GNUNET_DISK_file_write (fh,
+                                  &hdr,
+                                  sizeof (hdr))) &&
+         ( (0 == data_size) ||
+           (data_size ==
+            (size_t) GNUNET_DISK_file_write (fh,
+                                             data,
+                                             data_size)) ) );
+  if (GNUNET_OK !=
+      GNUNET_DISK_file_close (fh))
+    ok = false;
+  if ( (! ok) ||
+       (0 != rename (tmp,
+                     download->cache_fn)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "write",
+                              download->cache_fn);
+    if (0 != unlink (tmp))
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_DEBUG,
+                                "unlink",
+                                tmp);
+  }
+  GNUNET_free (tmp);
+}
+
+
+/**
+ * Load the cached backup of the account of @a download, if any.
+ * The backup is read directly into @e cached.
+ *
+ * @param[in,out] download operation to load the cache for
+ */
+static void
+load_from_cache (struct SYNC_DownloadOperation *download)
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  off_t fsize;
+  size_t size;
+
+  if (GNUNET_YES !=
+      GNUNET_DISK_file_test (download->cache_fn))
+    return;
+  fh = GNUNET_DISK_file_open (download->cache_fn,
+                              GNUNET_DISK_OPEN_READ,
+                              GNUNET_DISK_PERM_NONE);
+  if (NULL == fh)
+    return;
+  if ( (GNUNET_OK !=
+        GNUNET_DISK_file_handle_size (fh,
+                                      &fsize)) ||
+       (fsize < (off_t) sizeof (struct CacheHeaderP)) ||
+       ((uint64_t) fsize > SIZE_MAX) )
+  {
+    GNUNET_break (0);
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (fh));
+    return;
+  }
+  size = (size_t) fsize - sizeof (struct CacheHeaderP);
+  download->cached = GNUNET_malloc_large (GNUNET_MAX (1,
+                                                      size));
+  if (NULL == download->cached)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "malloc");
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (fh));
+    return;
+  }
+  if ( ((ssize_t) sizeof (struct CacheHeaderP) !=
+        GNUNET_DISK_file_read (fh,
+                               &download->cached_hdr,
+                               sizeof (struct CacheHeaderP))) ||
+       ( (0 != size) &&
+         (size !=
+          (size_t) GNUNET_DISK_file_read (fh,
+                                          download->cached,
+                                          size)) ) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "read",
+                              download->cache_fn);
+    GNUNET_free (download->cached);
+    download->cached = NULL;
+  }
+  else
+  {
+    download->cached_size = size;
+  }
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_file_close (fh));
+}
+
+
 /**
  * Function called when we're done processing the
  * HTTP /backup request.
@@ -101,14 +335,32 @@ handle_download_finished (void *cls,
 {
   struct SYNC_DownloadOperation *download = cls;
   struct SYNC_DownloadDetails dd = {
-    .http_status = (unsigned int) response_code
+    .http_status = (unsigned int) response_code,
+    .ec = TALER_EC_INVALID
   };
+  bool from_cache = false;
 
   download->job = NULL;
   switch (response_code)
   {
   case 0:
     break;
+  case MHD_HTTP_NOT_MODIFIED:
+    if (NULL == download->cached)
+    {
+      /* we did not send If-None-Match, server is buggy */
+      GNUNET_break_op (0);
+      dd.http_status = 0;
+      break;
+    }
+    /* return cached copy, but verify it just like a download */
+    from_cache = true;
+    download->account_sig = download->cached_hdr.account_sig;
+    download->sync_previous = download->cached_hdr.prev_hash;
+    data = download->cached;
+    data_size = download->cached_size;
+    dd.http_status = MHD_HTTP_OK;
+  /* fall through */
   case MHD_HTTP_OK:
     {
       struct SYNC_UploadSignaturePS usp = {
@@ -117,9 +369,28 @@ handle_download_finished (void *cls,
         .old_backup_hash = download->sync_previous
       };
 
-      GNUNET_CRYPTO_hash (data,
-                          data_size,
-                          &usp.new_backup_hash);
+      if (download->aborted)
+      {
+        dd.http_status = 0;
+        break;
+      }
+      if (NULL != download->chunk_cb)
+      {
+        /* backup was streamed to the application */
+        if (NULL == download->hash_ctx)
+          download->hash_ctx = GNUNET_CRYPTO_hash_context_start ();
+        GNUNET_CRYPTO_hash_context_finish (download->hash_ctx,
+                                           &usp.new_backup_hash);
+        download->hash_ctx = NULL;
+        data = NULL;
+        data_size = download->streamed;
+      }
+      else
+      {
+        GNUNET_CRYPTO_hash (data,
+                            data_size,
+                            &usp.new_backup_hash);
+      }
       if (GNUNET_OK !=
           GNUNET_CRYPTO_eddsa_verify (TALER_SIGNATURE_SYNC_BACKUP_UPLOAD,
                                       &usp,
@@ -128,9 +399,21 @@ handle_download_finished (void *cls,
       {
         GNUNET_break_op (0);
         dd.http_status = 0;
+        if (from_cache &&
+            (0 != unlink (download->cache_fn)) )
+          GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                    "unlink",
+                                    download->cache_fn);
         break;
       }
+      if ( (NULL != download->cache_fn) &&
+           (! from_cache) )
+        store_in_cache (download,
+                        &usp.new_backup_hash,
+                        data,
+                        data_size);
       /* Success, call callback with all details! */
+      dd.ec = TALER_EC_NONE;
       dd.details.ok.sig = download->account_sig;
       dd.details.ok.prev_backup_hash = download->sync_previous;
       dd.details.ok.curr_backup_hash = usp.new_backup_hash;
@@ -145,13 +428,24 @@ handle_download_finished (void *cls,
   case MHD_HTTP_BAD_REQUEST:
     /* This should never happen, either us or the sync server is buggy
        (or API version conflict); just pass JSON reply to the application */
+    dd.ec = TALER_JSON_get_error_code2 (data,
+                                        data_size);
     break;
   case MHD_HTTP_NOT_FOUND:
-    /* Nothing really to verify */
+    /* Nothing really to verify, but drop stale cache entry */
+    if ( (NULL != download->cached) &&
+         (0 != unlink (download->cache_fn)) )
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "unlink",
+                                download->cache_fn);
+    dd.ec = TALER_JSON_get_error_code2 (data,
+                                        data_size);
     break;
   case MHD_HTTP_INTERNAL_SERVER_ERROR:
     /* Server had an internal issue; we should retry, but this API
        leaves this to the application */
+    dd.ec = TALER_JSON_get_error_code2 (data,
+                                        data_size);
     break;
   default:
     /* unexpected response code */
@@ -248,27 +542,81 @@ handle_header (char *buffer,
 
 
 /**
- * Download the latest version of a backup for account @a pub.
+ * Handle backup data received by curl.  Passes the data on
+ * to the application and hashes it.
+ *
+ * @param buffer backup data
+ * @param size size of an item
+ * @param nitems number of items passed
+ * @param userdata our `struct SYNC_DownloadOperation *`
+ * @return `size * nitems`, 0 to abort the download
+ */
+static size_t
+handle_data (char *buffer,
+             size_t size,
+             size_t nitems,
+             void *userdata)
+{
+  struct SYNC_DownloadOperation *download = userdata;
+  size_t total = size * nitems;
+  long response_code = 0;
+
+  GNUNET_break (CURLE_OK ==
+                curl_easy_getinfo (download->eh,
+                                   CURLINFO_RESPONSE_CODE,
+                                   &response_code));
+  if (MHD_HTTP_OK != response_code)
+  {
+    /* not a backup, keep (the start of) the body for the error code */
+    if (download->reply.position < MAX_ERROR_BODY)
+      GNUNET_buffer_write (&download->reply,
+                           buffer,
+                           GNUNET_MIN (total,
+                                       MAX_ERROR_BODY
+                                       - download->reply.position));
+    return total;
+  }
+  if (NULL == download->hash_ctx)
+    download->hash_ctx = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (download->hash_ctx,
+                                   buffer,
+                                   total);
+  download->streamed += total;
+  if (GNUNET_OK !=
+      download->chunk_cb (download->chunk_cb_cls,
+                          buffer,
+                          total))
+  {
+    download->aborted = true;
+    return 0;
+  }
+  return total;
+}
+
+
+/**
+ * Setup a download of the latest version of a backup for
+ * account @a pub, but do not yet start the request.
  *
- * @param ctx for HTTP client request processing
  * @param base_url base URL of the Sync server
  * @param pub account public key
  * @param cb function to call with the backup
  * @param cb_cls closure for @a cb
+ * @param[out] eh set to the curl handle for the download
  * @return handle for the operation
  */
-struct SYNC_DownloadOperation *
-SYNC_download (struct GNUNET_CURL_Context *ctx,
-               const char *base_url,
-               const struct SYNC_AccountPublicKeyP *pub,
-               SYNC_DownloadCallback cb,
-               void *cb_cls)
+static struct SYNC_DownloadOperation *
+setup_download (const char *base_url,
+                const struct SYNC_AccountPublicKeyP *pub,
+                SYNC_DownloadCallback cb,
+                void *cb_cls,
+                CURL **eh)
 {
   struct SYNC_DownloadOperation *download;
   char *pub_str;
-  CURL *eh;
 
   download = GNUNET_new (struct SYNC_DownloadOperation);
+  download->fd = -1;
   download->account_pub = *pub;
   pub_str = GNUNET_STRINGS_data_to_string_alloc (pub,
                                                  sizeof (*pub));
@@ -280,17 +628,46 @@ SYNC_download (struct GNUNET_CURL_Context *ctx,
                    : "/",
                    pub_str);
   GNUNET_free (pub_str);
-  eh = SYNC_curl_easy_get_ (download->url);
+  *eh = SYNC_curl_easy_get_ (download->url);
   GNUNET_assert (CURLE_OK ==
-                 curl_easy_setopt (eh,
+                 curl_easy_setopt (*eh,
                                    CURLOPT_HEADERFUNCTION,
                                    &handle_header));
   GNUNET_assert (CURLE_OK ==
-                 curl_easy_setopt (eh,
+                 curl_easy_setopt (*eh,
                                    CURLOPT_HEADERDATA,
                                    download));
   download->cb = cb;
   download->cb_cls = cb_cls;
+  return download;
+}
+
+
+/**
+ * Download the latest version of a backup for account @a pub.
+ *
+ * @param ctx for HTTP client request processing
+ * @param base_url base URL of the Sync server
+ * @param pub account public key
+ * @param cb function to call with the backup
+ * @param cb_cls closure for @a cb
+ * @return handle for the operation
+ */
+struct SYNC_DownloadOperation *
+SYNC_download (struct GNUNET_CURL_Context *ctx,
+               const char *base_url,
+               const struct SYNC_AccountPublicKeyP *pub,
+               SYNC_DownloadCallback cb,
+               void *cb_cls)
+{
+  struct SYNC_DownloadOperation *download;
+  CURL *eh;
+
+  download = setup_download (base_url,
+                             pub,
+                             cb,
+                             cb_cls,
+                             &eh);
   download->job = GNUNET_CURL_job_add_raw (ctx,
                                            eh,
                                            NULL,
@@ -300,6 +677,208 @@ SYNC_download (struct GNUNET_CURL_Context *ctx,
 }
 
 
+/**
+ * Function called when we're done processing a streamed
+ * HTTP /backup request.
+ *
+ * @param cls the `struct SYNC_DownloadOperation`
+ * @param response_code HTTP response code, 0 on error
+ * @param data ignored, the body went to #handle_data()
+ * @param data_size ignored
+ */
+static void
+handle_stream_finished (void *cls,
+                        long response_code,
+                        const void *data,
+                        size_t data_size)
+{
+  struct SYNC_DownloadOperation *download = cls;
+
+  (void) data;
+  (void) data_size;
+  handle_download_finished (download,
+                            response_code,
+                            download->reply.mem,
+                            download->reply.position);
+}
+
+
+struct SYNC_DownloadOperation *
+SYNC_download_stream (struct GNUNET_CURL_Context *ctx,
+                      const char *base_url,
+                      const struct SYNC_AccountPublicKeyP *pub,
+                      SYNC_DownloadChunkCallback chunk_cb,
+                      void *chunk_cb_cls,
+                      SYNC_DownloadCallback cb,
+                      void *cb_cls)
+{
+  struct SYNC_DownloadOperation *download;
+  CURL *eh;
+
+  download = setup_download (base_url,
+                             pub,
+                             cb,
+                             cb_cls,
+                             &eh);
+  download->chunk_cb = chunk_cb;
+  download->chunk_cb_cls = chunk_cb_cls;
+  download->eh = eh;
+  download->job = GNUNET_CURL_job_add_raw (ctx,
+                                           eh,
+                                           NULL,
+                                           &handle_stream_finished,
+                                           download);
+  if (NULL == download->job)
+  {
+    GNUNET_break (0);
+    SYNC_download_cancel (download);
+    return NULL;
+  }
+  /* The job always installs its own buffering write function.
+     Adding the handle does not start the transfer, which only
+     happens once the scheduler runs the context, so we can still
+     replace it here before any data arrives. */
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_WRITEFUNCTION,
+                                   &handle_data));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_WRITEDATA,
+                                   download));
+  return download;
+}
+
+
+struct SYNC_DownloadOperation *
+SYNC_download_cached (struct GNUNET_CURL_Context *ctx,
+                      const char *base_url,
+                      const struct SYNC_AccountPublicKeyP *pub,
+                      const char *cache_dir,
+                      SYNC_DownloadCallback cb,
+                      void *cb_cls)
+{
+  struct SYNC_DownloadOperation *download;
+  struct curl_slist *job_headers = NULL;
+  char *pub_str;
+  CURL *eh;
+
+  download = setup_download (base_url,
+                             pub,
+                             cb,
+                             cb_cls,
+                             &eh);
+  pub_str = GNUNET_STRINGS_data_to_string_alloc (pub,
+                                                 sizeof (*pub));
+  GNUNET_asprintf (&download->cache_fn,
+                   "%s/%s.sync",
+                   cache_dir,
+                   pub_str);
+  GNUNET_free (pub_str);
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create_for_file (download->cache_fn))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "mkdir",
+                              cache_dir);
+    GNUNET_free (download->cache_fn);
+  }
+  else
+  {
+    load_from_cache (download);
+  }
+  if (NULL != download->cached)
+  {
+    char *etag;
+    char *hdr;
+
+    etag = GNUNET_STRINGS_data_to_string_alloc (
+      &download->cached_hdr.backup_hash,
+      sizeof (download->cached_hdr.backup_hash));
+    GNUNET_asprintf (&hdr,
+                     "%s: \"%s\"",
+                     MHD_HTTP_HEADER_IF_NONE_MATCH,
+                     etag);
+    GNUNET_free (etag);
+    job_headers = curl_slist_append (NULL,
+                                     hdr);
+    GNUNET_free (hdr);
+    GNUNET_break (NULL != job_headers);
+  }
+  download->job = GNUNET_CURL_job_add_raw (ctx,
+                                           eh,
+                                           job_headers,
+                                           &handle_download_finished,
+                                           download);
+  curl_slist_free_all (job_headers);
+  return download;
+}
+
+
+/**
+ * Write a chunk of a backup to the file descriptor of
+ * a #SYNC_download_fd() operation.
+ *
+ * @param cls our `struct SYNC_DownloadOperation`
+ * @param data chunk of the backup
+ * @param data_size number of bytes in @a data
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+write_to_fd (void *cls,
+             const void *data,
+             size_t data_size)
+{
+  struct SYNC_DownloadOperation *download = cls;
+  const char *pos = data;
+
+  while (0 < data_size)
+  {
+    ssize_t ret;
+
+    ret = write (download->fd,
+                 pos,
+                 data_size);
+    if (-1 == ret)
+    {
+      if (EINTR == errno)
+        continue;
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "write");
+      return GNUNET_SYSERR;
+    }
+    pos += ret;
+    data_size -= ret;
+  }
+  return GNUNET_OK;
+}
+
+
+struct SYNC_DownloadOperation *
+SYNC_download_fd (struct GNUNET_CURL_Context *ctx,
+                  const char *base_url,
+                  const struct SYNC_AccountPublicKeyP *pub,
+                  int fd,
+                  SYNC_DownloadCallback cb,
+                  void *cb_cls)
+{
+  struct SYNC_DownloadOperation *download;
+
+  download = SYNC_download_stream (ctx,
+                                   base_url,
+                                   pub,
+                                   &write_to_fd,
+                                   NULL,
+                                   cb,
+                                   cb_cls);
+  if (NULL == download)
+    return NULL;
+  download->fd = fd;
+  download->chunk_cb_cls = download;
+  return download;
+}
+
+
 /**
  * Cancel the download.
  *
@@ -313,6 +892,14 @@ SYNC_download_cancel (struct SYNC_DownloadOperation *download)
     GNUNET_CURL_job_cancel (download->job);
     download->job = NULL;
   }
+  GNUNET_buffer_clear (&download->reply);
+  if (NULL != download->hash_ctx)
+  {
+    GNUNET_CRYPTO_hash_context_abort (download->hash_ctx);
+    download->hash_ctx = NULL;
+  }
+  GNUNET_free (download->cached);
+  GNUNET_free (download->cache_fn);
   GNUNET_free (download->url);
   GNUNET_free (download);
 }
@@ -74,9 +74,25 @@ struct SYNC_UploadOperation
    * Hash of the data we are uploading.
    */
   struct GNUNET_HashCode new_upload_hash;
+
+  /**
+   * File we are uploading from, -1 if uploading from memory.
+   */
+  int fd;
+
+  /**
+   * Offset in @e fd of the next byte to upload.
+   */
+  off_t fd_off;
 };
 
 
+/**
+ * Block size we use when reading backups from a file.
+ */
+#define FD_BLOCK_SIZE (64 * 1024)
+
+
 /**
  * Function called when we're done processing the
  * HTTP /backup request.
@@ -233,35 +249,67 @@ handle_header (char *buffer,
 }
 
 
-struct SYNC_UploadOperation *
-SYNC_upload (struct GNUNET_CURL_Context *ctx,
-             const char *base_url,
-             struct SYNC_AccountPrivateKeyP *priv,
+/**
+ * Sign the upload of a backup with hash @a backup_hash.
+ *
+ * @param priv private key of an account with the server
+ * @param prev_backup_hash hash of the previous backup, NULL for the first upload ever
+ * @param backup_hash hash of the backup to upload
+ * @param[out] account_sig set to the signature over the upload
+ */
+static void
+sign_upload (const struct SYNC_AccountPrivateKeyP *priv,
              const struct GNUNET_HashCode *prev_backup_hash,
-             size_t backup_size,
-             const void *backup,
-             enum SYNC_PaymentOptions po,
-             const char *paid_order_id,
-             SYNC_UploadCallback cb,
-             void *cb_cls)
+             const struct GNUNET_HashCode *backup_hash,
+             struct SYNC_AccountSignatureP *account_sig)
 {
-  struct SYNC_AccountSignatureP account_sig;
-  struct SYNC_UploadOperation *uo;
-  CURL *eh;
-  struct curl_slist *job_headers;
   struct SYNC_UploadSignaturePS usp = {
     .purpose.purpose = htonl (TALER_SIGNATURE_SYNC_BACKUP_UPLOAD),
-    .purpose.size = htonl (sizeof (usp))
+    .purpose.size = htonl (sizeof (usp)),
+    .new_backup_hash = *backup_hash
   };
 
   if (NULL != prev_backup_hash)
     usp.old_backup_hash = *prev_backup_hash;
-  GNUNET_CRYPTO_hash (backup,
-                      backup_size,
-                      &usp.new_backup_hash);
   GNUNET_CRYPTO_eddsa_sign (&priv->eddsa_priv,
                             &usp,
-                            &account_sig.eddsa_sig);
+                            &account_sig->eddsa_sig);
+}
+
+
+/**
+ * Setup an upload of a backup with hash @a backup_hash to a Sync
+ * server: prepare the request, but do not yet provide the body or
+ * start the request.
+ *
+ * @param base_url base URL of the Sync server
+ * @param pub public key of an account with the server
+ * @param account_sig signature over the upload, see #sign_upload()
+ * @param prev_backup_hash hash of the previous backup, NULL for the first upload ever
+ * @param backup_hash hash of the backup to upload
+ * @param po payment options
+ * @param paid_order_id ID of an order we paid, or NULL
+ * @param cb function to call with the result
+ * @param cb_cls closure for @a cb
+ * @param[out] job_headers_p set to the headers for the request
+ * @param[out] eh set to the curl handle for the request
+ * @return handle for the operation, NULL on error
+ */
+static struct SYNC_UploadOperation *
+setup_upload (const char *base_url,
+              const struct SYNC_AccountPublicKeyP *pub,
+              const struct SYNC_AccountSignatureP *account_sig,
+              const struct GNUNET_HashCode *prev_backup_hash,
+              const struct GNUNET_HashCode *backup_hash,
+              enum SYNC_PaymentOptions po,
+              const char *paid_order_id,
+              SYNC_UploadCallback cb,
+              void *cb_cls,
+              struct curl_slist **job_headers_p,
+              CURL **eh)
+{
+  struct SYNC_UploadOperation *uo;
+  struct curl_slist *job_headers;
 
   /* setup our HTTP headers */
   job_headers = NULL;
@@ -271,8 +319,8 @@ SYNC_upload (struct GNUNET_CURL_Context *ctx,
     char *hdr;
 
     /* Set Sync-Signature header */
-    val = GNUNET_STRINGS_data_to_string_alloc (&account_sig,
-                                               sizeof (account_sig));
+    val = GNUNET_STRINGS_data_to_string_alloc (account_sig,
+                                               sizeof (*account_sig));
     GNUNET_asprintf (&hdr,
                      "Sync-Signature: %s",
                      val);
@@ -289,7 +337,7 @@ SYNC_upload (struct GNUNET_CURL_Context *ctx,
     job_headers = ext;
 
     /* set If-None-Match header */
-    val = GNUNET_STRINGS_data_to_string_alloc (&usp.new_backup_hash,
+    val = GNUNET_STRINGS_data_to_string_alloc (backup_hash,
                                                sizeof (struct GNUNET_HashCode));
     GNUNET_asprintf (&hdr,
                      "%s: \"%s\"",
@@ -310,7 +358,7 @@ SYNC_upload (struct GNUNET_CURL_Context *ctx,
     /* Setup If-Match header */
     if (NULL != prev_backup_hash)
     {
-      val = GNUNET_STRINGS_data_to_string_alloc (&usp.old_backup_hash,
+      val = GNUNET_STRINGS_data_to_string_alloc (prev_backup_hash,
                                                  sizeof (struct
                                                          GNUNET_HashCode));
       GNUNET_asprintf (&hdr,
@@ -328,20 +376,29 @@ SYNC_upload (struct GNUNET_CURL_Context *ctx,
       }
       job_headers = ext;
     }
+
+    /* Have the service check our preconditions before we send the body */
+    ext = curl_slist_append (job_headers,
+                             "Expect: 100-continue");
+    if (NULL == ext)
+    {
+      GNUNET_break (0);
+      curl_slist_free_all (job_headers);
+      return NULL;
+    }
+    job_headers = ext;
   }
   /* Finished setting up headers */
 
   uo = GNUNET_new (struct SYNC_UploadOperation);
-  uo->new_upload_hash = usp.new_backup_hash;
+  uo->fd = -1;
+  uo->new_upload_hash = *backup_hash;
   {
     char *path;
     char *account_s;
-    struct SYNC_AccountPublicKeyP pub;
 
-    GNUNET_CRYPTO_eddsa_key_get_public (&priv->eddsa_priv,
-                                        &pub.eddsa_pub);
-    account_s = GNUNET_STRINGS_data_to_string_alloc (&pub,
-                                                     sizeof (pub));
+    account_s = GNUNET_STRINGS_data_to_string_alloc (pub,
+                                                     sizeof (*pub));
     GNUNET_asprintf (&path,
                      "backups/%s",
                      account_s);
@@ -393,10 +450,41 @@ SYNC_upload (struct GNUNET_CURL_Context *ctx,
 
     GNUNET_free (path);
   }
-  uo->ctx = ctx;
   uo->cb = cb;
   uo->cb_cls = cb_cls;
-  eh = SYNC_curl_easy_get_ (uo->url);
+  *eh = SYNC_curl_easy_get_ (uo->url);
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (*eh,
+                                   CURLOPT_HEADERFUNCTION,
+                                   &handle_header));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (*eh,
+                                   CURLOPT_HEADERDATA,
+                                   uo));
+  *job_headers_p = job_headers;
+  return uo;
+}
+
+
+/**
+ * Start uploading @a backup from memory.
+ *
+ * @param ctx for HTTP client request processing
+ * @param uo operation prepared by #setup_upload()
+ * @param eh curl handle prepared by #setup_upload()
+ * @param[in] job_headers headers prepared by #setup_upload()
+ * @param backup_size number of bytes in @a backup
+ * @param backup the encrypted backup
+ */
+static void
+start_upload (struct GNUNET_CURL_Context *ctx,
+              struct SYNC_UploadOperation *uo,
+              CURL *eh,
+              struct curl_slist *job_headers,
+              size_t backup_size,
+              const void *backup)
+{
+  uo->ctx = ctx;
   GNUNET_assert (CURLE_OK ==
                  curl_easy_setopt (eh,
                                    CURLOPT_POSTFIELDS,
@@ -405,13 +493,517 @@ SYNC_upload (struct GNUNET_CURL_Context *ctx,
                  curl_easy_setopt (eh,
                                    CURLOPT_POSTFIELDSIZE,
                                    (long) backup_size));
+  uo->job = GNUNET_CURL_job_add_raw (ctx,
+                                     eh,
+                                     job_headers,
+                                     &handle_upload_finished,
+                                     uo);
+  curl_slist_free_all (job_headers);
+}
+
+
+struct SYNC_UploadOperation *
+SYNC_upload (struct GNUNET_CURL_Context *ctx,
+             const char *base_url,
+             struct SYNC_AccountPrivateKeyP *priv,
+             const struct GNUNET_HashCode *prev_backup_hash,
+             size_t backup_size,
+             const void *backup,
+             enum SYNC_PaymentOptions po,
+             const char *paid_order_id,
+             SYNC_UploadCallback cb,
+             void *cb_cls)
+{
+  struct SYNC_UploadOperation *uo;
+  struct SYNC_AccountPublicKeyP pub;
+  struct SYNC_AccountSignatureP account_sig;
+  struct GNUNET_HashCode backup_hash;
+  struct curl_slist *job_headers;
+  CURL *eh;
+
+  GNUNET_CRYPTO_hash (backup,
+                      backup_size,
+                      &backup_hash);
+  GNUNET_CRYPTO_eddsa_key_get_public (&priv->eddsa_priv,
+                                      &pub.eddsa_pub);
+  sign_upload (priv,
+               prev_backup_hash,
+               &backup_hash,
+               &account_sig);
+  uo = setup_upload (base_url,
+                     &pub,
+                     &account_sig,
+                     prev_backup_hash,
+                     &backup_hash,
+                     po,
+                     paid_order_id,
+                     cb,
+                     cb_cls,
+                     &job_headers,
+                     &eh);
+  if (NULL == uo)
+    return NULL;
+  start_upload (ctx,
+                uo,
+                eh,
+                job_headers,
+                backup_size,
+                backup);
+  return uo;
+}
+
+
+/**
+ * State we keep per provider in a multi-provider upload.
+ */
+struct MultiTarget
+{
+
+  /**
+   * Operation this target belongs to.
+   */
+  struct SYNC_UploadMultiOperation *umo;
+
+  /**
+   * Upload to this provider, NULL once done.
+   */
+  struct SYNC_UploadOperation *uo;
+
+  /**
+   * Payment URI returned by this provider, or NULL.
+   */
+  char *pay_uri;
+
+  /**
+   * Backup returned by this provider on conflict, or NULL.
+   */
+  void *existing_backup;
+
+};
+
+
+/**
+ * @brief Handle for an upload to multiple providers.
+ */
+struct SYNC_UploadMultiOperation
+{
+
+  /**
+   * Function to call with the results.
+   */
+  SYNC_UploadMultiCallback cb;
+
+  /**
+   * Closure for @e cb.
+   */
+  void *cb_cls;
+
+  /**
+   * Array of @e num_targets targets.
+   */
+  struct MultiTarget *targets;
+
+  /**
+   * Array of @e num_targets results, in the same order as @e targets.
+   */
+  struct SYNC_UploadMultiResult *results;
+
+  /**
+   * Hash of the backup we are uploading.
+   */
+  struct GNUNET_HashCode backup_hash;
+
+  /**
+   * Length of the @e targets and @e results arrays.
+   */
+  unsigned int num_targets;
+
+  /**
+   * Number of uploads that are still running.
+   */
+  unsigned int pending;
+
+  /**
+   * True while we are calling @e cb; cancelling the operation
+   * then only happens once @e cb returns.
+   */
+  bool in_cb;
+
+};
+
+
+/**
+ * Function called with the result of the upload to one provider
+ * of a multi-provider upload.  Stores the result, and calls the
+ * application once all uploads are done.
+ *
+ * @param cls a `struct MultiTarget`
+ * @param ud details about the upload
+ */
+static void
+multi_upload_cb (void *cls,
+                 const struct SYNC_UploadDetails *ud)
+{
+  struct MultiTarget *mt = cls;
+  struct SYNC_UploadMultiOperation *umo = mt->umo;
+  struct SYNC_UploadDetails *res = &umo->results[mt - umo->targets].ud;
+
+  mt->uo = NULL;
+  *res = *ud;
+  /* details point into the upload operation, which is about
+     to be freed, so we must keep our own copies */
+  switch (ud->http_status)
+  {
+  case MHD_HTTP_NO_CONTENT:
+    res->details.success.curr_backup_hash = &umo->backup_hash;
+    break;
+  case MHD_HTTP_NOT_MODIFIED:
+    res->details.not_modified.curr_backup_hash = &umo->backup_hash;
+    break;
+  case MHD_HTTP_PAYMENT_REQUIRED:
+    if (NULL != ud->details.payment_required.payment_request)
+      mt->pay_uri = GNUNET_strdup (
+        ud->details.payment_required.payment_request);
+    res->details.payment_required.payment_request = mt->pay_uri;
+    break;
+  case MHD_HTTP_CONFLICT:
+    if (0 != ud->details.recovered_backup.existing_backup_size)
+      mt->existing_backup = GNUNET_memdup (
+        ud->details.recovered_backup.existing_backup,
+        ud->details.recovered_backup.existing_backup_size);
+    res->details.recovered_backup.existing_backup = mt->existing_backup;
+    break;
+  default:
+    break;
+  }
+  GNUNET_assert (umo->pending > 0);
+  umo->pending--;
+  if (0 != umo->pending)
+    return;
+  umo->in_cb = true;
+  umo->cb (umo->cb_cls,
+           umo->num_targets,
+           umo->results);
+  umo->in_cb = false;
+  SYNC_upload_multi_cancel (umo);
+}
+
+
+struct SYNC_UploadMultiOperation *
+SYNC_upload_multi (struct GNUNET_CURL_Context *ctx,
+                   struct SYNC_AccountPrivateKeyP *priv,
+                   unsigned int num_targets,
+                   const struct SYNC_UploadTarget *targets,
+                   size_t backup_size,
+                   const void *backup,
+                   SYNC_UploadMultiCallback cb,
+                   void *cb_cls)
+{
+  struct SYNC_UploadMultiOperation *umo;
+  struct SYNC_AccountPublicKeyP pub;
+  struct SYNC_AccountSignatureP sigs[GNUNET_NZL (num_targets)];
+  struct curl_slist *job_headers[GNUNET_NZL (num_targets)];
+  CURL *ehs[GNUNET_NZL (num_targets)];
+
+  GNUNET_assert (0 != num_targets);
+  umo = GNUNET_new (struct SYNC_UploadMultiOperation);
+  umo->cb = cb;
+  umo->cb_cls = cb_cls;
+  umo->num_targets = num_targets;
+  umo->targets = GNUNET_new_array (num_targets,
+                                   struct MultiTarget);
+  umo->results = GNUNET_new_array (num_targets,
+                                   struct SYNC_UploadMultiResult);
+  /* hash once for all providers */
+  GNUNET_CRYPTO_hash (backup,
+                      backup_size,
+                      &umo->backup_hash);
+  GNUNET_CRYPTO_eddsa_key_get_public (&priv->eddsa_priv,
+                                      &pub.eddsa_pub);
+  /* prepare all uploads before starting any, so that we never
+     call the application from within this function */
+  for (unsigned int i = 0; i<num_targets; i++)
+  {
+    const struct SYNC_UploadTarget *t = &targets[i];
+    struct MultiTarget *mt = &umo->targets[i];
+    bool signed_already = false;
+
+    /* the signature only depends on the previous backup, so
+       sign once per distinct previous backup */
+    for (unsigned int j = 0; j<i; j++)
+    {
+      const struct GNUNET_HashCode *pj = targets[j].prev_backup_hash;
+
+      if ( (pj == t->prev_backup_hash) ||
+           ( (NULL != pj) &&
+             (NULL != t->prev_backup_hash) &&
+             (0 == GNUNET_memcmp (pj,
+                                  t->prev_backup_hash)) ) )
+      {
+        sigs[i] = sigs[j];
+        signed_already = true;
+        break;
+      }
+    }
+    if (! signed_already)
+      sign_upload (priv,
+                   t->prev_backup_hash,
+                   &umo->backup_hash,
+                   &sigs[i]);
+    mt->umo = umo;
+    umo->results[i].base_url = t->base_url;
+    mt->uo = setup_upload (t->base_url,
+                           &pub,
+                           &sigs[i],
+                           t->prev_backup_hash,
+                           &umo->backup_hash,
+                           t->po,
+                           t->paid_order_id,
+                           &multi_upload_cb,
+                           mt,
+                           &job_headers[i],
+                           &ehs[i]);
+    if (NULL == mt->uo)
+    {
+      for (unsigned int j = 0; j<i; j++)
+      {
+        curl_easy_cleanup (ehs[j]);
+        curl_slist_free_all (job_headers[j]);
+      }
+      umo->pending = 0;
+      SYNC_upload_multi_cancel (umo);
+      return NULL;
+    }
+  }
+  umo->pending = num_targets;
+  for (unsigned int i = 0; i<num_targets; i++)
+    start_upload (ctx,
+                  umo->targets[i].uo,
+                  ehs[i],
+                  job_headers[i],
+                  backup_size,
+                  backup);
+  return umo;
+}
+
+
+void
+SYNC_upload_multi_cancel (struct SYNC_UploadMultiOperation *umo)
+{
+  if (umo->in_cb)
+    return; /* freed by multi_upload_cb() once the callback returns */
+  for (unsigned int i = 0; i<umo->num_targets; i++)
+  {
+    struct MultiTarget *mt = &umo->targets[i];
+
+    if (NULL != mt->uo)
+    {
+      SYNC_upload_cancel (mt->uo);
+      mt->uo = NULL;
+    }
+    GNUNET_free (mt->pay_uri);
+    GNUNET_free (mt->existing_backup);
+  }
+  GNUNET_free (umo->targets);
+  GNUNET_free (umo->results);
+  GNUNET_free (umo);
+}
+
+
+/**
+ * Hash the backup stored in @a fd.
+ *
+ * @param fd file to hash, from offset zero
+ * @param[out] backup_hash set to the hash of the file
+ * @param[out] backup_size set to the size of the file
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+hash_fd (int fd,
+         struct GNUNET_HashCode *backup_hash,
+         off_t *backup_size)
+{
+  struct GNUNET_HashContext *hc;
+  char buf[FD_BLOCK_SIZE];
+  off_t off = 0;
+
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  while (1)
+  {
+    ssize_t ret;
+
+    ret = pread (fd,
+                 buf,
+                 sizeof (buf),
+                 off);
+    if (-1 == ret)
+    {
+      if (EINTR == errno)
+        continue;
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "pread");
+      GNUNET_CRYPTO_hash_context_abort (hc);
+      return GNUNET_SYSERR;
+    }
+    if (0 == ret)
+      break;
+    GNUNET_CRYPTO_hash_context_read (hc,
+                                     buf,
+                                     ret);
+    off += ret;
+  }
+  GNUNET_CRYPTO_hash_context_finish (hc,
+                                     backup_hash);
+  *backup_size = off;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Provide the next chunk of the backup to curl.
+ *
+ * @param buffer where to write the data
+ * @param size size of an item
+ * @param nitems number of items that fit into @a buffer
+ * @param userdata our `struct SYNC_UploadOperation *`
+ * @return number of bytes written to @a buffer, 0 at the end
+ */
+static size_t
+read_fd (char *buffer,
+         size_t size,
+         size_t nitems,
+         void *userdata)
+{
+  struct SYNC_UploadOperation *uo = userdata;
+  ssize_t ret;
+
+  do {
+    ret = pread (uo->fd,
+                 buffer,
+                 size * nitems,
+                 uo->fd_off);
+  } while ( (-1 == ret) &&
+            (EINTR == errno) );
+  if (-1 == ret)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "pread");
+    return CURL_READFUNC_ABORT;
+  }
+  uo->fd_off += ret;
+  return (size_t) ret;
+}
+
+
+/**
+ * Curl wants to rewind the upload, say because it follows
+ * a redirect.
+ *
+ * @param userdata our `struct SYNC_UploadOperation *`
+ * @param offset offset to seek to
+ * @param origin must be SEEK_SET
+ * @return #CURL_SEEKFUNC_OK on success
+ */
+static int
+seek_fd (void *userdata,
+         curl_off_t offset,
+         int origin)
+{
+  struct SYNC_UploadOperation *uo = userdata;
+
+  if (SEEK_SET != origin)
+    return CURL_SEEKFUNC_CANTSEEK;
+  uo->fd_off = (off_t) offset;
+  return CURL_SEEKFUNC_OK;
+}
+
+
+struct SYNC_UploadOperation *
+SYNC_upload_fd (struct GNUNET_CURL_Context *ctx,
+                const char *base_url,
+                struct SYNC_AccountPrivateKeyP *priv,
+                const struct GNUNET_HashCode *prev_backup_hash,
+                int fd,
+                const struct GNUNET_HashCode *backup_hash,
+                enum SYNC_PaymentOptions po,
+                const char *paid_order_id,
+                SYNC_UploadCallback cb,
+                void *cb_cls)
+{
+  struct SYNC_UploadOperation *uo;
+  struct SYNC_AccountPublicKeyP pub;
+  struct SYNC_AccountSignatureP account_sig;
+  struct GNUNET_HashCode h;
+  struct curl_slist *job_headers;
+  off_t backup_size;
+  CURL *eh;
+
+  if (NULL == backup_hash)
+  {
+    if (GNUNET_OK !=
+        hash_fd (fd,
+                 &h,
+                 &backup_size))
+      return NULL;
+    backup_hash = &h;
+  }
+  else
+  {
+    struct stat sbuf;
+
+    if (0 != fstat (fd,
+                    &sbuf))
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "fstat");
+      return NULL;
+    }
+    backup_size = sbuf.st_size;
+  }
+  GNUNET_CRYPTO_eddsa_key_get_public (&priv->eddsa_priv,
+                                      &pub.eddsa_pub);
+  sign_upload (priv,
+               prev_backup_hash,
+               backup_hash,
+               &account_sig);
+  uo = setup_upload (base_url,
+                     &pub,
+                     &account_sig,
+                     prev_backup_hash,
+                     backup_hash,
+                     po,
+                     paid_order_id,
+                     cb,
+                     cb_cls,
+                     &job_headers,
+                     &eh);
+  if (NULL == uo)
+    return NULL;
+  uo->ctx = ctx;
+  uo->fd = fd;
   GNUNET_assert (CURLE_OK ==
                  curl_easy_setopt (eh,
-                                   CURLOPT_HEADERFUNCTION,
-                                   &handle_header));
+                                   CURLOPT_POST,
+                                   1L));
   GNUNET_assert (CURLE_OK ==
                  curl_easy_setopt (eh,
-                                   CURLOPT_HEADERDATA,
+                                   CURLOPT_POSTFIELDSIZE_LARGE,
+                                   (curl_off_t) backup_size));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_READFUNCTION,
+                                   &read_fd));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_READDATA,
+                                   uo));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_SEEKFUNCTION,
+                                   &seek_fd));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_SEEKDATA,
                                    uo));
   uo->job = GNUNET_CURL_job_add_raw (ctx,
                                      eh,
@@ -27,6 +27,11 @@
 #include "sync_database_lib.h"
 #include "sync-httpd_backup.h"
 #include "sync-httpd_config.h"
+#include "sync-httpd_breaker.h"
+#include "sync-httpd_order_pool.h"
+#include "sync-httpd_order_status.h"
+#include "sync-httpd_ratelimit.h"
+#include "sync-httpd_workers.h"
 
 /**
  * Backlog for listen operation on unix-domain sockets.
@@ -44,6 +49,11 @@ static int SH_sync_connection_close;
  */
 unsigned long long int SH_upload_limit_mb;
 
+/**
+ * Limits we impose on HTTP connections.
+ */
+struct SH_ConnectionLimits SH_limits;
+
 /**
  * Annual fee for the backup account.
  */
@@ -84,6 +94,16 @@ static int result;
  */
 static struct MHD_Daemon *mhd;
 
+/**
+ * Epoll file descriptor of #mhd, NULL if we do not use epoll.
+ */
+static struct GNUNET_NETWORK_Handle *mhd_epoll;
+
+/**
+ * Should MHD use epoll?
+ */
+static bool use_epoll;
+
 /**
  * Connection handle to the our database
  */
@@ -125,6 +145,170 @@ static char *keypass;
  */
 struct TALER_Amount SH_insurance;
 
+/**
+ * Number of worker processes to run, 0 or 1 to serve
+ * requests directly from this process.
+ */
+static unsigned int num_workers;
+
+/**
+ * Command line we were started with, used to start workers.
+ */
+static char *const *sync_argv;
+
+
+/**
+ * Find the handler for the request and run it.
+ *
+ * @param connection the connection the request is for
+ * @param url the requested url
+ * @param method the HTTP method used
+ * @param upload_data the data being uploaded
+ * @param[in,out] upload_data_size number of bytes in @a upload_data
+ * @param[in,out] con_cls request-specific state of the handler
+ * @return MHD result code
+ */
+static MHD_RESULT
+dispatch_request (struct MHD_Connection *connection,
+                  const char *url,
+                  const char *method,
+                  const char *upload_data,
+                  size_t *upload_data_size,
+                  void **con_cls)
+{
+  static struct SH_RequestHandler handlers[] = {
+    /* Landing page, tell humans to go away. */
+    { "/", MHD_HTTP_METHOD_GET, "text/plain",
+      "Hello, I'm sync. This HTTP server is not for humans.\n", 0,
+      &SH_MHD_handler_static_response, MHD_HTTP_OK },
+    { "/agpl", MHD_HTTP_METHOD_GET, "text/plain",
+      NULL, 0,
+      &SH_handler_config, MHD_HTTP_FOUND },
+    { "/config", MHD_HTTP_METHOD_GET, "text/json",
+      NULL, 0,
+      &SH_handler_config, MHD_HTTP_OK },
+    { "/backups:batch-get", MHD_HTTP_METHOD_POST, "application/octet-stream",
+      NULL, 0,
+      &SH_backup_batch_get, MHD_HTTP_OK },
+    {NULL, NULL, NULL, NULL, 0, 0 }
+  };
+  static struct SH_RequestHandler h404 = {
+    "", NULL, "text/html",
+    "<html><title>404: not found</title></html>", 0,
+    &SH_MHD_handler_static_response, MHD_HTTP_NOT_FOUND
+  };
+
+  struct SYNC_AccountPublicKeyP account_pub;
+
+  if (0 == strncmp (url,
+                    "/backups/",
+                    strlen ("/backups/")))
+  {
+    const char *ac = &url[strlen ("/backups/")];
+    const char *sub = strchr (ac,
+                              '/');
+
+    if (GNUNET_OK !=
+        GNUNET_CRYPTO_eddsa_public_key_from_string (ac,
+                                                    (NULL == sub)
+                                                    ? strlen (ac)
+                                                    : (size_t) (sub - ac),
+                                                    &account_pub.eddsa_pub))
+    {
+      GNUNET_break_op (0);
+      return TALER_MHD_reply_with_error (connection,
+                                         MHD_HTTP_BAD_REQUEST,
+                                         TALER_EC_GENERIC_PARAMETER_MALFORMED,
+                                         ac);
+    }
+    if (0 == strcasecmp (method,
+                         MHD_HTTP_METHOD_OPTIONS))
+    {
+      return TALER_MHD_reply_cors_preflight (connection);
+    }
+    if (NULL != sub)
+    {
+      if ( (0 == strcmp (sub,
+                         "/payment")) &&
+           (0 == strcasecmp (method,
+                             MHD_HTTP_METHOD_GET)) )
+        return SH_backup_payment_get (connection,
+                                      con_cls,
+                                      &account_pub);
+      if ( (0 == strncmp (sub,
+                          "/versions/",
+                          strlen ("/versions/"))) &&
+           (0 == strcasecmp (method,
+                             MHD_HTTP_METHOD_GET)) )
+        return SH_backup_version_get (connection,
+                                      &account_pub,
+                                      &sub[strlen ("/versions/")]);
+      return SH_MHD_handler_static_response (&h404,
+                                             connection,
+                                             con_cls,
+                                             upload_data,
+                                             upload_data_size);
+    }
+    if (0 == strcasecmp (method,
+                         MHD_HTTP_METHOD_GET))
+    {
+      return SH_backup_get (connection,
+                            &account_pub);
+    }
+    if (0 == strcasecmp (method,
+                         MHD_HTTP_METHOD_POST))
+    {
+      return SH_backup_post (connection,
+                             con_cls,
+                             &account_pub,
+                             upload_data,
+                             upload_data_size);
+    }
+  }
+  for (unsigned int i = 0; NULL != handlers[i].url; i++)
+  {
+    struct SH_RequestHandler *rh = &handlers[i];
+
+    if (0 == strcmp (url,
+                     rh->url))
+    {
+      if (0 == strcasecmp (method,
+                           MHD_HTTP_METHOD_OPTIONS))
+      {
+        return TALER_MHD_reply_cors_preflight (connection);
+      }
+      if ( (NULL == rh->method) ||
+           (0 == strcasecmp (method,
+                             rh->method)) )
+      {
+        return rh->handler (rh,
+                            connection,
+                            con_cls,
+                            upload_data,
+                            upload_data_size);
+      }
+    }
+  }
+  return SH_MHD_handler_static_response (&h404,
+                                         connection,
+                                         con_cls,
+                                         upload_data,
+                                         upload_data_size);
+}
+
+
+/**
+ * Clean up a context that we only allocated to keep
+ * the trace of a request.
+ *
+ * @param hc context to clean up
+ */
+static void
+cleanup_trace_context (struct TM_HandlerContext *hc)
+{
+  GNUNET_free (hc);
+}
+
 
 /**
  * A client has requested the given url using the given method
@@ -175,29 +359,10 @@ url_handler (void *cls,
              size_t *upload_data_size,
              void **con_cls)
 {
-  static struct SH_RequestHandler handlers[] = {
-    /* Landing page, tell humans to go away. */
-    { "/", MHD_HTTP_METHOD_GET, "text/plain",
-      "Hello, I'm sync. This HTTP server is not for humans.\n", 0,
-      &SH_MHD_handler_static_response, MHD_HTTP_OK },
-    { "/agpl", MHD_HTTP_METHOD_GET, "text/plain",
-      NULL, 0,
-      &SH_handler_config, MHD_HTTP_FOUND },
-    { "/config", MHD_HTTP_METHOD_GET, "text/json",
-      NULL, 0,
-      &SH_handler_config, MHD_HTTP_OK },
-    {NULL, NULL, NULL, NULL, 0, 0 }
-  };
-  static struct SH_RequestHandler h404 = {
-    "", NULL, "text/html",
-    "<html><title>404: not found</title></html>", 0,
-    &SH_MHD_handler_static_response, MHD_HTTP_NOT_FOUND
-  };
-
   struct TM_HandlerContext *hc = *con_cls;
   struct GNUNET_AsyncScopeId aid;
   const char *correlation_id = NULL;
-  struct SYNC_AccountPublicKeyP account_pub;
+  MHD_RESULT ret;
 
   (void) cls;
   (void) version;
@@ -221,6 +386,12 @@ url_handler (void *cls,
     aid = hc->async_scope_id;
   }
   GNUNET_SCHEDULER_begin_async_scope (&aid);
+  SH_trace_current = (NULL == hc)
+    ? SH_trace_start (method,
+                      url,
+                      correlation_id,
+                      &aid)
+    : hc->trace;
 
   if (NULL != correlation_id)
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
@@ -234,93 +405,31 @@ url_handler (void *cls,
                 method,
                 url);
 
-  if (0 == strncmp (url,
-                    "/backups/",
-                    strlen ("/backups/")))
+  ret = dispatch_request (connection,
+                          url,
+                          method,
+                          upload_data,
+                          upload_data_size,
+                          con_cls);
+  hc = *con_cls;
+  if ( (NULL == hc) &&
+       (NULL != SH_trace_current) )
   {
-    const char *ac = &url[strlen ("/backups/")];
-
-    if (GNUNET_OK !=
-        GNUNET_CRYPTO_eddsa_public_key_from_string (ac,
-                                                    strlen (ac),
-                                                    &account_pub.eddsa_pub))
-    {
-      GNUNET_break_op (0);
-      return TALER_MHD_reply_with_error (connection,
-                                         MHD_HTTP_BAD_REQUEST,
-                                         TALER_EC_GENERIC_PARAMETER_MALFORMED,
-                                         ac);
-    }
-    if (0 == strcasecmp (method,
-                         MHD_HTTP_METHOD_OPTIONS))
-    {
-      return TALER_MHD_reply_cors_preflight (connection);
-    }
-    if (0 == strcasecmp (method,
-                         MHD_HTTP_METHOD_GET))
-    {
-      return SH_backup_get (connection,
-                            &account_pub);
-    }
-    if (0 == strcasecmp (method,
-                         MHD_HTTP_METHOD_POST))
-    {
-      int ret;
-
-      ret = SH_backup_post (connection,
-                            con_cls,
-                            &account_pub,
-                            upload_data,
-                            upload_data_size);
-      hc = *con_cls;
-      if (NULL != hc)
-      {
-        /* Store the async context ID, so we can restore it if
-         * we get another callback for this request. */
-        hc->async_scope_id = aid;
-      }
-      return ret;
-    }
+    /* Handler keeps no state, but we need a context to
+       finish the trace once the request is done. */
+    hc = GNUNET_new (struct TM_HandlerContext);
+    hc->cc = &cleanup_trace_context;
+    *con_cls = hc;
   }
-  for (unsigned int i = 0; NULL != handlers[i].url; i++)
+  if (NULL != hc)
   {
-    struct SH_RequestHandler *rh = &handlers[i];
-
-    if (0 == strcmp (url,
-                     rh->url))
-    {
-      if (0 == strcasecmp (method,
-                           MHD_HTTP_METHOD_OPTIONS))
-      {
-        return TALER_MHD_reply_cors_preflight (connection);
-      }
-      if ( (NULL == rh->method) ||
-           (0 == strcasecmp (method,
-                             rh->method)) )
-      {
-        MHD_RESULT ret;
-
-        ret = rh->handler (rh,
-                           connection,
-                           con_cls,
-                           upload_data,
-                           upload_data_size);
-        hc = *con_cls;
-        if (NULL != hc)
-        {
-          /* Store the async context ID, so we can restore it if
-           * we get another callback for this request. */
-          hc->async_scope_id = aid;
-        }
-        return ret;
-      }
-    }
+    /* Store the async context ID and trace, so we can restore
+     * them if we get another callback for this request. */
+    hc->async_scope_id = aid;
+    hc->trace = SH_trace_current;
   }
-  return SH_MHD_handler_static_response (&h404,
-                                         connection,
-                                         con_cls,
-                                         upload_data,
-                                         upload_data_size);
+  SH_trace_current = NULL;
+  return ret;
 }
 
 
@@ -333,7 +442,12 @@ static void
 do_shutdown (void *cls)
 {
   (void) cls;
+  SH_workers_stop ();
   SH_resume_all_bc ();
+  SH_resume_all_pc ();
+  SH_order_pool_done ();
+  SH_order_status_done ();
+  SH_ratelimit_done ();
   if (NULL != mhd_task)
   {
     GNUNET_SCHEDULER_cancel (mhd_task);
@@ -349,6 +463,12 @@ do_shutdown (void *cls)
     GNUNET_CURL_gnunet_rc_destroy (rc);
     rc = NULL;
   }
+  if (NULL != mhd_epoll)
+  {
+    /* MHD owns the descriptor, only free our wrapper */
+    GNUNET_NETWORK_socket_free_memory_only_ (mhd_epoll);
+    mhd_epoll = NULL;
+  }
   if (NULL != mhd)
   {
     MHD_stop_daemon (mhd);
@@ -359,6 +479,7 @@ do_shutdown (void *cls)
     SYNC_DB_plugin_unload (db);
     db = NULL;
   }
+  SH_trace_done ();
 }
 
 
@@ -385,12 +506,29 @@ handle_mhd_completion_callback (void *cls,
   struct TM_HandlerContext *hc = *con_cls;
 
   (void) cls;
-  (void) connection;
   if (NULL == hc)
     return;
   GNUNET_log (GNUNET_ERROR_TYPE_INFO,
               "Finished handling request with status %d\n",
               (int) toe);
+  if (NULL != hc->trace)
+  {
+    unsigned int http_status = 0;
+#if MHD_VERSION >= 0x00097600
+    const union MHD_ConnectionInfo *ci;
+
+    ci = MHD_get_connection_info (connection,
+                                  MHD_CONNECTION_INFO_HTTP_STATUS);
+    if (NULL != ci)
+      http_status = ci->http_status;
+#else
+    (void) connection;
+#endif
+    SH_trace_end (hc->trace,
+                  http_status,
+                  toe);
+    hc->trace = NULL;
+  }
   hc->cc (hc);
   *con_cls = NULL;
 }
@@ -481,6 +619,22 @@ prepare_daemon (void)
   int haveto;
   struct GNUNET_TIME_Relative tv;
 
+  haveto = MHD_get_timeout (mhd, &timeout);
+  if (haveto == MHD_YES)
+    tv.rel_value_us = (uint64_t) timeout * 1000LL;
+  else
+    tv = GNUNET_TIME_UNIT_FOREVER_REL;
+  if (NULL != mhd_epoll)
+  {
+    /* MHD tracks all connections in its epoll set, so we only
+       need to wait for that single descriptor */
+    return GNUNET_SCHEDULER_add_read_net_with_priority (
+      tv,
+      GNUNET_SCHEDULER_PRIORITY_HIGH,
+      mhd_epoll,
+      &run_daemon,
+      NULL);
+  }
   FD_ZERO (&rs);
   FD_ZERO (&ws);
   FD_ZERO (&es);
@@ -493,11 +647,6 @@ prepare_daemon (void)
                                 &ws,
                                 &es,
                                 &max));
-  haveto = MHD_get_timeout (mhd, &timeout);
-  if (haveto == MHD_YES)
-    tv.rel_value_us = (uint64_t) timeout * 1000LL;
-  else
-    tv = GNUNET_TIME_UNIT_FOREVER_REL;
   GNUNET_NETWORK_fdset_copy_native (wrs, &rs, max + 1);
   GNUNET_NETWORK_fdset_copy_native (wws, &ws, max + 1);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -514,6 +663,131 @@ prepare_daemon (void)
 }
 
 
+/**
+ * Load the limits on HTTP connections from @a cfg.
+ *
+ * @param cfg configuration to use
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+load_limits (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  struct
+  {
+    const char *option;
+    unsigned long long *val;
+  } numbers[] = {
+    { "CONNECTION_LIMIT", &SH_limits.connection_limit },
+    { "PER_IP_CONNECTION_LIMIT", &SH_limits.per_ip_connection_limit },
+    { "LISTEN_BACKLOG", &SH_limits.listen_backlog },
+    { NULL, NULL }
+  };
+  struct
+  {
+    const char *option;
+    struct GNUNET_TIME_Relative *val;
+  } times[] = {
+    { "CONNECTION_TIMEOUT", &SH_limits.idle_timeout },
+    { "UPLOAD_TIMEOUT", &SH_limits.upload_timeout },
+    { NULL, NULL }
+  };
+
+  /* historic default */
+  SH_limits.idle_timeout = GNUNET_TIME_relative_multiply (
+    GNUNET_TIME_UNIT_SECONDS,
+    10);
+  for (unsigned int i = 0; NULL != numbers[i].option; i++)
+  {
+    if (GNUNET_YES !=
+        GNUNET_CONFIGURATION_have_value (cfg,
+                                         "sync",
+                                         numbers[i].option))
+      continue;
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_number (cfg,
+                                               "sync",
+                                               numbers[i].option,
+                                               numbers[i].val))
+    {
+      GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                                 "sync",
+                                 numbers[i].option,
+                                 "must be a number");
+      return GNUNET_SYSERR;
+    }
+  }
+  for (unsigned int i = 0; NULL != times[i].option; i++)
+  {
+    if (GNUNET_YES !=
+        GNUNET_CONFIGURATION_have_value (cfg,
+                                         "sync",
+                                         times[i].option))
+      continue;
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_time (cfg,
+                                             "sync",
+                                             times[i].option,
+                                             times[i].val))
+    {
+      GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                                 "sync",
+                                 times[i].option,
+                                 "must be a relative time");
+      return GNUNET_SYSERR;
+    }
+    /* MHD takes timeouts in seconds and treats 0 as "no timeout" */
+    if ( (GNUNET_TIME_relative_cmp (*times[i].val,
+                                    <,
+                                    GNUNET_TIME_UNIT_SECONDS)) ||
+         (GNUNET_TIME_relative_is_forever (*times[i].val)) ||
+         (times[i].val->rel_value_us / GNUNET_TIME_UNIT_SECONDS.rel_value_us
+          >= UINT_MAX) )
+    {
+      GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                                 "sync",
+                                 times[i].option,
+                                 "must be at least one second and finite");
+      return GNUNET_SYSERR;
+    }
+    /* round up to full seconds */
+    *times[i].val = GNUNET_TIME_relative_multiply (
+      GNUNET_TIME_UNIT_SECONDS,
+      (times[i].val->rel_value_us
+       + GNUNET_TIME_UNIT_SECONDS.rel_value_us - 1)
+      / GNUNET_TIME_UNIT_SECONDS.rel_value_us);
+  }
+  if ( (GNUNET_YES ==
+        GNUNET_CONFIGURATION_have_value (cfg,
+                                         "sync",
+                                         "CONNECTION_MEMORY_LIMIT")) &&
+       (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_size (cfg,
+                                             "sync",
+                                             "CONNECTION_MEMORY_LIMIT",
+                                             &SH_limits.connection_memory_limit)) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "sync",
+                               "CONNECTION_MEMORY_LIMIT",
+                               "must be a size");
+    return GNUNET_SYSERR;
+  }
+  /* limits of 0 leave the libmicrohttpd defaults in place,
+     an upload timeout of 0 means the idle timeout applies */
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Connection limits: idle timeout %llu s, upload timeout %llu s, %llu connections, %llu per IP, %llu bytes per connection, backlog %llu\n",
+              (unsigned long long) (SH_limits.idle_timeout.rel_value_us
+                                    / GNUNET_TIME_UNIT_SECONDS.rel_value_us),
+              (unsigned long long) (SH_limits.upload_timeout.rel_value_us
+                                    / GNUNET_TIME_UNIT_SECONDS.rel_value_us),
+              SH_limits.connection_limit,
+              SH_limits.per_ip_connection_limit,
+              SH_limits.connection_memory_limit,
+              SH_limits.listen_backlog);
+  return GNUNET_OK;
+}
+
+
 /**
  * Main function that will be run by the scheduler.
  *
@@ -603,6 +877,60 @@ run (void *cls,
     return;
   }
 
+  if (GNUNET_OK !=
+      load_limits (config))
+  {
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  use_epoll = (GNUNET_YES ==
+               GNUNET_CONFIGURATION_get_value_yesno (config,
+                                                     "sync",
+                                                     "USE_EPOLL"));
+  if ( (use_epoll) &&
+       (MHD_YES != MHD_is_feature_supported (MHD_FEATURE_EPOLL)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "USE_EPOLL requested, but libmicrohttpd lacks epoll support\n");
+    use_epoll = false;
+  }
+
+  if ( (1 < num_workers) &&
+       (! SH_workers_is_worker ()) )
+  {
+    /* We are the supervisor: bind (if we can) and pass the listen
+       socket to the workers; otherwise each worker binds the port
+       itself using SO_REUSEPORT. */
+    fh = TALER_MHD_bind (config,
+                         "sync",
+                         &port);
+    if ( (0 == port) &&
+         (-1 == fh) )
+    {
+      result = EXIT_NOPERMISSION;
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    if (GNUNET_OK !=
+        SH_workers_start (num_workers,
+                          fh,
+                          sync_argv))
+    {
+      result = EXIT_FAILURE;
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    result = EXIT_SUCCESS;
+    return;
+  }
+
+  if (GNUNET_OK !=
+      SH_trace_init (config))
+  {
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+
   /* setup HTTP client event loop */
   SH_ctx = GNUNET_CURL_init (&GNUNET_CURL_gnunet_scheduler_reschedule,
                              &rc);
@@ -654,26 +982,83 @@ run (void *cls,
     GNUNET_SCHEDULER_shutdown ();
     return;
   }
-  fh = TALER_MHD_bind (config,
-                       "sync",
-                       &port);
-  if ( (0 == port) &&
-       (-1 == fh) )
+  if ( (GNUNET_OK !=
+        SH_breaker_init (config)) ||
+       (GNUNET_OK !=
+        SH_order_pool_init (config)) ||
+       (GNUNET_OK !=
+        SH_ratelimit_init (config)) )
   {
-    result = EXIT_NOPERMISSION;
     GNUNET_SCHEDULER_shutdown ();
     return;
   }
-  mhd = MHD_start_daemon (MHD_USE_SUSPEND_RESUME | MHD_USE_DUAL_STACK,
-                          port,
-                          NULL, NULL,
-                          &url_handler, NULL,
-                          MHD_OPTION_LISTEN_SOCKET, fh,
-                          MHD_OPTION_NOTIFY_COMPLETED,
-                          &handle_mhd_completion_callback, NULL,
-                          MHD_OPTION_CONNECTION_TIMEOUT,
-                          (unsigned int) 10 /* 10s */,
-                          MHD_OPTION_END);
+  fh = SH_workers_get_listen_socket ();
+  if (-1 == fh)
+  {
+    fh = TALER_MHD_bind (config,
+                         "sync",
+                         &port);
+    if ( (0 == port) &&
+         (-1 == fh) )
+    {
+      result = EXIT_NOPERMISSION;
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+  }
+  else
+  {
+    port = 0;
+  }
+  {
+    struct MHD_OptionItem limits[5];
+    unsigned int off = 0;
+    unsigned int flags = MHD_USE_SUSPEND_RESUME | MHD_USE_DUAL_STACK;
+
+    if (use_epoll)
+      flags |= MHD_USE_EPOLL;
+
+    /* only override MHD's defaults for limits that are configured */
+    if (0 != SH_limits.connection_limit)
+      limits[off++] = (struct MHD_OptionItem) {
+        .option = MHD_OPTION_CONNECTION_LIMIT,
+        .value = (intptr_t) SH_limits.connection_limit
+      };
+    if (0 != SH_limits.per_ip_connection_limit)
+      limits[off++] = (struct MHD_OptionItem) {
+        .option = MHD_OPTION_PER_IP_CONNECTION_LIMIT,
+        .value = (intptr_t) SH_limits.per_ip_connection_limit
+      };
+    if (0 != SH_limits.connection_memory_limit)
+      limits[off++] = (struct MHD_OptionItem) {
+        .option = MHD_OPTION_CONNECTION_MEMORY_LIMIT,
+        .value = (intptr_t) SH_limits.connection_memory_limit
+      };
+    if (0 != SH_limits.listen_backlog)
+      limits[off++] = (struct MHD_OptionItem) {
+        .option = MHD_OPTION_LISTEN_BACKLOG_SIZE,
+        .value = (intptr_t) SH_limits.listen_backlog
+      };
+    limits[off] = (struct MHD_OptionItem) {
+      .option = MHD_OPTION_END
+    };
+    mhd = MHD_start_daemon (flags,
+                            port,
+                            NULL, NULL,
+                            &url_handler, NULL,
+                            MHD_OPTION_LISTEN_SOCKET, fh,
+                            /* workers binding themselves share the port */
+                            MHD_OPTION_LISTENING_ADDRESS_REUSE,
+                            (unsigned int) (SH_workers_is_worker () ? 1 : 0),
+                            MHD_OPTION_NOTIFY_COMPLETED,
+                            &handle_mhd_completion_callback, NULL,
+                            MHD_OPTION_CONNECTION_TIMEOUT,
+                            (unsigned int) (SH_limits.idle_timeout.rel_value_us
+                                            / GNUNET_TIME_UNIT_SECONDS.
+                                            rel_value_us),
+                            MHD_OPTION_ARRAY, limits,
+                            MHD_OPTION_END);
+  }
   if (NULL == mhd)
   {
     result = EXIT_FAILURE;
@@ -682,6 +1067,15 @@ run (void *cls,
     GNUNET_SCHEDULER_shutdown ();
     return;
   }
+  if (use_epoll)
+  {
+    const union MHD_DaemonInfo *di;
+
+    di = MHD_get_daemon_info (mhd,
+                              MHD_DAEMON_INFO_EPOLL_FD);
+    GNUNET_assert (NULL != di);
+    mhd_epoll = GNUNET_NETWORK_socket_box_native (di->epoll_fd);
+  }
   result = EXIT_SUCCESS;
   mhd_task = prepare_daemon ();
 }
@@ -723,6 +1117,11 @@ main (int argc,
                                  "CERTTYPE",
                                  "type of the TLS client certificate, defaults to PEM if not specified",
                                  &certtype),
+    GNUNET_GETOPT_option_uint ('w',
+                               "workers",
+                               "N",
+                               "run N worker processes sharing the listen port",
+                               &num_workers),
     GNUNET_GETOPT_OPTION_END
   };
   enum GNUNET_GenericReturnValue ret;
@@ -732,6 +1131,7 @@ main (int argc,
      the SYNC defaults to be used! */
   (void) TALER_project_data_default ();
   GNUNET_OS_init (SYNC_project_data_default ());
+  sync_argv = argv;
   ret = GNUNET_PROGRAM_run (argc, argv,
                             "sync-httpd",
                             "sync HTTP interface",
@@ -26,6 +26,7 @@
 #include <taler/taler_mhd_lib.h>
 #include "sync_database_lib.h"
 #include <gnunet/gnunet_mhd_compat.h>
+#include "sync-httpd_trace.h"
 
 /**
  * @brief Struct describing an URL and the handler for it.
@@ -120,6 +121,51 @@ struct TM_HandlerContext
    * Asynchronous request context id.
    */
   struct GNUNET_AsyncScopeId async_scope_id;
+
+  /**
+   * Latency trace of the request, NULL if tracing is disabled.
+   */
+  struct SH_Trace *trace;
+};
+
+
+/**
+ * Limits we impose on HTTP connections.  Zero values mean that
+ * MHD's defaults are used.
+ */
+struct SH_ConnectionLimits
+{
+
+  /**
+   * How long may a connection be idle?
+   */
+  struct GNUNET_TIME_Relative idle_timeout;
+
+  /**
+   * How long may a connection uploading a backup be idle?
+   */
+  struct GNUNET_TIME_Relative upload_timeout;
+
+  /**
+   * Maximum number of concurrent connections.
+   */
+  unsigned long long connection_limit;
+
+  /**
+   * Maximum number of concurrent connections per IP address.
+   */
+  unsigned long long per_ip_connection_limit;
+
+  /**
+   * Memory to use per connection for headers and buffers.
+   */
+  unsigned long long connection_memory_limit;
+
+  /**
+   * Size of the listen backlog.
+   */
+  unsigned long long listen_backlog;
+
 };
 
 
@@ -128,6 +174,11 @@ struct TM_HandlerContext
  */
 extern struct SYNC_DatabasePlugin *db;
 
+/**
+ * Limits we impose on HTTP connections.
+ */
+extern struct SH_ConnectionLimits SH_limits;
+
 /**
  * Upload limit to the service, in megabytes.
  */
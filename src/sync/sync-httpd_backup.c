@@ -24,6 +24,397 @@
 #include "sync-httpd_backup.h"
 
 
+/**
+ * Number of characters needed to base32-encode @a n bytes.
+ */
+#define ENCODED_SIZE(n) (((n) * 8 + 4) / 5)
+
+
+/**
+ * Base32-encode @a size bytes of @a data into @a buf, which must
+ * have room for #ENCODED_SIZE(@a size) characters plus the
+ * terminator.
+ *
+ * @param data data to encode
+ * @param size number of bytes in @a data
+ * @param[out] buf where to write the 0-terminated encoding
+ * @param buf_size number of bytes available in @a buf
+ * @return pointer to the 0-terminator in @a buf
+ */
+static char *
+encode (const void *data,
+        size_t size,
+        char *buf,
+        size_t buf_size)
+{
+  char *end;
+
+  end = GNUNET_STRINGS_data_to_string (data,
+                                       size,
+                                       buf,
+                                       buf_size - 1);
+  GNUNET_assert (NULL != end);
+  *end = '\0';
+  return end;
+}
+
+
+/**
+ * Size of the buffer for a quoted, base32-encoded ETag.
+ */
+#define ETAG_SIZE (ENCODED_SIZE (sizeof (struct GNUNET_HashCode)) + 3)
+
+
+/**
+ * Build the (quoted) ETag for the backup with @a backup_hash.
+ *
+ * @param backup_hash hash of the backup
+ * @param[out] etagq where to write the 0-terminated ETag
+ */
+static void
+make_etag (const struct GNUNET_HashCode *backup_hash,
+           char etagq[ETAG_SIZE])
+{
+  char *end;
+
+  etagq[0] = '"';
+  end = encode (backup_hash,
+                sizeof (*backup_hash),
+                &etagq[1],
+                ETAG_SIZE - 2);
+  end[0] = '"';
+  end[1] = '\0';
+}
+
+
+/**
+ * Add the headers with the meta data of a backup to @a resp.
+ * The values are encoded into buffers on the stack, as this
+ * runs for every download.
+ *
+ * @param[in,out] resp response to add headers to
+ * @param account_sig signature of the account over the backup
+ * @param prev_hash hash of the previous backup
+ * @param backup_hash hash of the backup, used as ETag
+ */
+static void
+add_backup_headers (struct MHD_Response *resp,
+                    const struct SYNC_AccountSignatureP *account_sig,
+                    const struct GNUNET_HashCode *prev_hash,
+                    const struct GNUNET_HashCode *backup_hash)
+{
+  char sig_s[ENCODED_SIZE (sizeof (*account_sig)) + 1];
+  char prev_s[ENCODED_SIZE (sizeof (*prev_hash)) + 1];
+  char etagq[ETAG_SIZE];
+
+  encode (account_sig,
+          sizeof (*account_sig),
+          sig_s,
+          sizeof (sig_s));
+  encode (prev_hash,
+          sizeof (*prev_hash),
+          prev_s,
+          sizeof (prev_s));
+  make_etag (backup_hash,
+             etagq);
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         "Sync-Signature",
+                                         sig_s));
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         "Sync-Previous",
+                                         prev_s));
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         MHD_HTTP_HEADER_ETAG,
+                                         etagq));
+}
+
+
+/**
+ * Reply to a request for which looking up the backup with
+ * status @a qs failed.
+ *
+ * @param connection MHD connection to use
+ * @param qs status of the failed lookup
+ * @return MHD result code
+ */
+static MHD_RESULT
+reply_lookup_failed (struct MHD_Connection *connection,
+                     enum SYNC_DB_QueryStatus qs)
+{
+  switch (qs)
+  {
+  case SYNC_DB_OLD_BACKUP_MISSING:
+    GNUNET_break (0);
+    return TALER_MHD_reply_with_error (connection,
+                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                       TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE,
+                                       "unexpected return status (backup missing)");
+  case SYNC_DB_OLD_BACKUP_MISMATCH:
+    GNUNET_break (0);
+    return TALER_MHD_reply_with_error (connection,
+                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                       TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE,
+                                       "unexpected return status (backup mismatch)");
+  case SYNC_DB_PAYMENT_REQUIRED:
+    GNUNET_break (0);
+    return TALER_MHD_reply_with_error (connection,
+                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                       TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE,
+                                       "unexpected return status (payment required)");
+  case SYNC_DB_HARD_ERROR:
+    GNUNET_break (0);
+    return TALER_MHD_reply_with_error (connection,
+                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                       TALER_EC_GENERIC_DB_FETCH_FAILED,
+                                       NULL);
+  case SYNC_DB_SOFT_ERROR:
+    GNUNET_break (0);
+    return TALER_MHD_reply_with_error (connection,
+                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                       TALER_EC_GENERIC_DB_SOFT_FAILURE,
+                                       NULL);
+  case SYNC_DB_NO_RESULTS:
+    GNUNET_break (0);
+    /* Note: can theoretically happen due to non-transactional nature if
+       the backup expired / was gc'ed JUST between the two SQL calls.
+       But too rare to handle properly, as doing a transaction would be
+       expensive. Just admit to failure ;-) */
+    return TALER_MHD_reply_with_error (connection,
+                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                       TALER_EC_GENERIC_DB_INVARIANT_FAILURE,
+                                       NULL);
+  case SYNC_DB_ONE_RESULT:
+    break;
+  }
+  GNUNET_assert (0);
+  return MHD_NO;
+}
+
+
+/**
+ * Range of a backup requested by the client.
+ */
+struct ByteRange
+{
+  /**
+   * Offset of the first byte.
+   */
+  uint64_t start;
+
+  /**
+   * Offset of the last byte, UINT64_MAX for the end of the backup.
+   */
+  uint64_t end;
+};
+
+
+/**
+ * Parse a decimal number at @a *pos and advance @a *pos.
+ *
+ * @param[in,out] pos where to parse
+ * @param[out] val set to the number
+ * @return true on success
+ */
+static bool
+parse_number (const char **pos,
+              uint64_t *val)
+{
+  char *end;
+  unsigned long long v;
+
+  if ( ('0' > **pos) ||
+       ('9' < **pos) )
+    return false;
+  errno = 0;
+  v = strtoull (*pos,
+                &end,
+                10);
+  if (0 != errno)
+    return false;
+  *val = (uint64_t) v;
+  *pos = end;
+  return true;
+}
+
+
+/**
+ * Check for a "Range" header we can satisfy for the backup
+ * with @a backup_hash.  We only support a single range given
+ * as "bytes=first-" or "bytes=first-last", which is what
+ * resumed downloads use.  Anything else is ignored and the
+ * whole backup is returned, as permitted by RFC 9110.  The
+ * same happens if an "If-Range" header does not match.
+ *
+ * @param connection the MHD connection with the request
+ * @param backup_hash hash of the current backup
+ * @param[out] range set to the requested range
+ * @return true if @a range was set
+ */
+static bool
+parse_range (struct MHD_Connection *connection,
+             const struct GNUNET_HashCode *backup_hash,
+             struct ByteRange *range)
+{
+  const char *hdr;
+  const char *ir;
+  const char *pos;
+
+  hdr = MHD_lookup_connection_value (connection,
+                                     MHD_HEADER_KIND,
+                                     MHD_HTTP_HEADER_RANGE);
+  if (NULL == hdr)
+    return false;
+  ir = MHD_lookup_connection_value (connection,
+                                    MHD_HEADER_KIND,
+                                    MHD_HTTP_HEADER_IF_RANGE);
+  if (NULL != ir)
+  {
+    char etagq[ETAG_SIZE];
+
+    make_etag (backup_hash,
+               etagq);
+    if (0 != strcmp (ir,
+                     etagq))
+      return false; /* backup changed, send all of it */
+  }
+  if (0 != strncmp (hdr,
+                    "bytes=",
+                    strlen ("bytes=")))
+    return false;
+  pos = hdr + strlen ("bytes=");
+  if (! parse_number (&pos,
+                      &range->start))
+    return false;
+  if ('-' != *pos)
+    return false;
+  pos++;
+  if ('\0' == *pos)
+  {
+    range->end = UINT64_MAX;
+    return true;
+  }
+  if (! parse_number (&pos,
+                      &range->end))
+    return false;
+  return ( ('\0' == *pos) &&
+           (range->start <= range->end) );
+}
+
+
+/**
+ * Return part of the current backup of @a account on
+ * @a connection with a 206 status.
+ *
+ * @param connection MHD connection to use
+ * @param account account to query
+ * @param expected_hash hash of the current backup, as the
+ *  @a range was checked against it
+ * @param range part of the backup to return
+ * @return MHD result code
+ */
+static MHD_RESULT
+return_backup_range (struct MHD_Connection *connection,
+                     const struct SYNC_AccountPublicKeyP *account,
+                     const struct GNUNET_HashCode *expected_hash,
+                     const struct ByteRange *range)
+{
+  enum SYNC_DB_QueryStatus qs;
+  struct MHD_Response *resp;
+  MHD_RESULT ret;
+  struct SYNC_AccountSignatureP account_sig;
+  struct GNUNET_HashCode backup_hash;
+  struct GNUNET_HashCode prev_hash;
+  size_t total_size;
+  size_t backup_size;
+  void *backup;
+  char *content_range;
+  struct GNUNET_TIME_Absolute start;
+
+  start = GNUNET_TIME_absolute_get ();
+  qs = db->lookup_backup_range_TR (db->cls,
+                                   account,
+                                   expected_hash,
+                                   range->start,
+                                   (UINT64_MAX == range->end)
+                                   ? UINT64_MAX
+                                   : range->end - range->start + 1,
+                                   &account_sig,
+                                   &prev_hash,
+                                   &backup_hash,
+                                   &total_size,
+                                   &backup_size,
+                                   &backup);
+  SH_trace_db (SH_trace_current,
+               "lookup_backup_range",
+               start);
+  if (SYNC_DB_ONE_RESULT != qs)
+    return reply_lookup_failed (connection,
+                                qs);
+  if (0 != GNUNET_memcmp (expected_hash,
+                          &backup_hash))
+  {
+    /* backup changed just now, the range is meaningless */
+    GNUNET_free (backup);
+    return SH_return_backup (connection,
+                             account,
+                             MHD_HTTP_OK,
+                             NULL,
+                             NULL);
+  }
+  if (range->start >= total_size)
+  {
+    GNUNET_free (backup);
+    resp = MHD_create_response_from_buffer (0,
+                                            NULL,
+                                            MHD_RESPMEM_PERSISTENT);
+    TALER_MHD_add_global_headers (resp);
+    GNUNET_asprintf (&content_range,
+                     "bytes */%llu",
+                     (unsigned long long) total_size);
+    GNUNET_break (MHD_YES ==
+                  MHD_add_response_header (resp,
+                                           MHD_HTTP_HEADER_CONTENT_RANGE,
+                                           content_range));
+    GNUNET_free (content_range);
+    ret = MHD_queue_response (connection,
+                              MHD_HTTP_RANGE_NOT_SATISFIABLE,
+                              resp);
+    MHD_destroy_response (resp);
+    return ret;
+  }
+  GNUNET_asprintf (&content_range,
+                   "bytes %llu-%llu/%llu",
+                   (unsigned long long) range->start,
+                   (unsigned long long) (range->start + backup_size - 1),
+                   (unsigned long long) total_size);
+  resp = MHD_create_response_from_buffer (backup_size,
+                                          backup,
+                                          MHD_RESPMEM_MUST_FREE);
+  TALER_MHD_add_global_headers (resp);
+  add_backup_headers (resp,
+                      &account_sig,
+                      &prev_hash,
+                      &backup_hash);
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         MHD_HTTP_HEADER_ACCEPT_RANGES,
+                                         "bytes"));
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         MHD_HTTP_HEADER_CONTENT_RANGE,
+                                         content_range));
+  GNUNET_free (content_range);
+  ret = MHD_queue_response (connection,
+                            MHD_HTTP_PARTIAL_CONTENT,
+                            resp);
+  MHD_destroy_response (resp);
+  return ret;
+}
+
+
 /**
  * Handle request on @a connection for retrieval of the latest
  * backup of @a account.
@@ -37,12 +428,49 @@ SH_backup_get (struct MHD_Connection *connection,
                const struct SYNC_AccountPublicKeyP *account)
 {
   struct GNUNET_HashCode backup_hash;
+  struct GNUNET_HashCode inm_h;
+  bool have_inm = false;
   enum SYNC_DB_QueryStatus qs;
   MHD_RESULT ret;
+  struct GNUNET_TIME_Absolute start;
+
+  {
+    const char *inm;
 
+    inm = MHD_lookup_connection_value (connection,
+                                       MHD_HEADER_KIND,
+                                       MHD_HTTP_HEADER_IF_NONE_MATCH);
+    if ( (NULL != inm) &&
+         (2 < strlen (inm)) &&
+         ('"' == inm[0]) &&
+         ('"' == inm[strlen (inm) - 1]) )
+    {
+      if (GNUNET_OK !=
+          GNUNET_STRINGS_string_to_data (inm + 1,
+                                         strlen (inm) - 2,
+                                         &inm_h,
+                                         sizeof (inm_h)))
+      {
+        GNUNET_break_op (0);
+        return TALER_MHD_reply_with_error (connection,
+                                           MHD_HTTP_BAD_REQUEST,
+                                           TALER_EC_SYNC_BAD_IF_NONE_MATCH,
+                                           "Etag does not include a base32-encoded SHA-512 hash");
+      }
+      have_inm = true;
+    }
+  }
+  start = GNUNET_TIME_absolute_get ();
+  /* A polling client that is up to date can be answered by a
+     replica; if the replica has a different backup, it may lag
+     behind, and the lookup falls back to the primary. */
   qs = db->lookup_account_TR (db->cls,
                               account,
+                              have_inm ? &inm_h : NULL,
                               &backup_hash);
+  SH_trace_db (SH_trace_current,
+               "lookup_account",
+               start);
   switch (qs)
   {
   case SYNC_DB_OLD_BACKUP_MISSING:
@@ -88,54 +516,43 @@ SH_backup_get (struct MHD_Connection *connection,
     }
     return ret;
   case SYNC_DB_ONE_RESULT:
+    if ( (have_inm) &&
+         (0 == GNUNET_memcmp (&inm_h,
+                              &backup_hash)) )
     {
-      const char *inm;
-
-      inm = MHD_lookup_connection_value (connection,
-                                         MHD_HEADER_KIND,
-                                         MHD_HTTP_HEADER_IF_NONE_MATCH);
-      if ( (NULL != inm) &&
-           (2 < strlen (inm)) &&
-           ('"' == inm[0]) &&
-           ('=' == inm[strlen (inm) - 1]) )
-      {
-        struct GNUNET_HashCode inm_h;
-
-        if (GNUNET_OK !=
-            GNUNET_STRINGS_string_to_data (inm + 1,
-                                           strlen (inm) - 2,
-                                           &inm_h,
-                                           sizeof (inm_h)))
-        {
-          GNUNET_break_op (0);
-          return TALER_MHD_reply_with_error (connection,
-                                             MHD_HTTP_BAD_REQUEST,
-                                             TALER_EC_SYNC_BAD_IF_NONE_MATCH,
-                                             "Etag does not include a base32-encoded SHA-512 hash");
-        }
-        if (0 == GNUNET_memcmp (&inm_h,
-                                &backup_hash))
-        {
-          struct MHD_Response *resp;
-
-          resp = MHD_create_response_from_buffer (0,
-                                                  NULL,
-                                                  MHD_RESPMEM_PERSISTENT);
-          TALER_MHD_add_global_headers (resp);
-          ret = MHD_queue_response (connection,
-                                    MHD_HTTP_NOT_MODIFIED,
-                                    resp);
-          MHD_destroy_response (resp);
-          return ret;
-        }
-      }
+      struct MHD_Response *resp;
+
+      resp = MHD_create_response_from_buffer (0,
+                                              NULL,
+                                              MHD_RESPMEM_PERSISTENT);
+      TALER_MHD_add_global_headers (resp);
+      ret = MHD_queue_response (connection,
+                                MHD_HTTP_NOT_MODIFIED,
+                                resp);
+      MHD_destroy_response (resp);
+      return ret;
     }
     /* We have a result, should fetch and return it! */
     break;
   }
+  {
+    struct ByteRange range;
+
+    if (parse_range (connection,
+                     &backup_hash,
+                     &range))
+      return return_backup_range (connection,
+                                  account,
+                                  &backup_hash,
+                                  &range);
+  }
+  /* the (large) backup itself may come from a replica,
+     as long as it matches what the primary told us */
   return SH_return_backup (connection,
                            account,
-                           MHD_HTTP_OK);
+                           MHD_HTTP_OK,
+                           NULL,
+                           &backup_hash);
 }
 
 
@@ -147,12 +564,18 @@ SH_backup_get (struct MHD_Connection *connection,
  * @param account account to query
  * @param default_http_status HTTP status to queue response
  *  with on success (#MHD_HTTP_OK or #MHD_HTTP_CONFLICT)
+ * @param known_hash hash of a backup the client already has,
+ *  NULL if none
+ * @param expected_hash hash we expect the current backup to have,
+ *  allows serving the backup from a read replica; NULL if unknown
  * @return MHD result code
  */
 MHD_RESULT
 SH_return_backup (struct MHD_Connection *connection,
                   const struct SYNC_AccountPublicKeyP *account,
-                  unsigned int default_http_status)
+                  unsigned int default_http_status,
+                  const struct GNUNET_HashCode *known_hash,
+                  const struct GNUNET_HashCode *expected_hash)
 {
   enum SYNC_DB_QueryStatus qs;
   struct MHD_Response *resp;
@@ -162,36 +585,119 @@ SH_return_backup (struct MHD_Connection *connection,
   struct GNUNET_HashCode prev_hash;
   size_t backup_size;
   void *backup;
+  struct GNUNET_TIME_Absolute start;
 
-  qs = db->lookup_backup_TR (db->cls,
-                             account,
-                             &account_sig,
-                             &prev_hash,
-                             &backup_hash,
-                             &backup_size,
-                             &backup);
+  backup = NULL;
+  backup_size = 0;
+  if (NULL != known_hash)
+  {
+    /* check the meta data first, the client may have the backup already */
+    start = GNUNET_TIME_absolute_get ();
+    qs = db->lookup_backup_TR (db->cls,
+                               account,
+                               expected_hash,
+                               &account_sig,
+                               &prev_hash,
+                               &backup_hash,
+                               &backup_size,
+                               NULL);
+    SH_trace_db (SH_trace_current,
+                 "lookup_backup_meta",
+                 start);
+    if (SYNC_DB_ONE_RESULT != qs)
+      return reply_lookup_failed (connection,
+                                  qs);
+  }
+  if ( (NULL == known_hash) ||
+       (0 != GNUNET_memcmp (known_hash,
+                            &backup_hash)) )
+  {
+    start = GNUNET_TIME_absolute_get ();
+    qs = db->lookup_backup_TR (db->cls,
+                               account,
+                               expected_hash,
+                               &account_sig,
+                               &prev_hash,
+                               &backup_hash,
+                               &backup_size,
+                               &backup);
+    SH_trace_db (SH_trace_current,
+                 "lookup_backup",
+                 start);
+    if (SYNC_DB_ONE_RESULT != qs)
+      return reply_lookup_failed (connection,
+                                  qs);
+  }
+  resp = MHD_create_response_from_buffer (backup_size,
+                                          backup,
+                                          MHD_RESPMEM_MUST_FREE);
+  TALER_MHD_add_global_headers (resp);
+  add_backup_headers (resp,
+                      &account_sig,
+                      &prev_hash,
+                      &backup_hash);
+  if (MHD_HTTP_OK == default_http_status)
+    GNUNET_break (MHD_YES ==
+                  MHD_add_response_header (resp,
+                                           MHD_HTTP_HEADER_ACCEPT_RANGES,
+                                           "bytes"));
+  ret = MHD_queue_response (connection,
+                            default_http_status,
+                            resp);
+  MHD_destroy_response (resp);
+  return ret;
+}
+
+
+MHD_RESULT
+SH_backup_version_get (struct MHD_Connection *connection,
+                       const struct SYNC_AccountPublicKeyP *account,
+                       const char *version)
+{
+  enum SYNC_DB_QueryStatus qs;
+  struct MHD_Response *resp;
+  MHD_RESULT ret;
+  struct SYNC_AccountSignatureP account_sig;
+  struct GNUNET_HashCode backup_hash;
+  struct GNUNET_HashCode prev_hash;
+  size_t backup_size;
+  void *backup;
+  struct GNUNET_TIME_Absolute start;
+
+  if (GNUNET_OK !=
+      GNUNET_STRINGS_string_to_data (version,
+                                     strlen (version),
+                                     &backup_hash,
+                                     sizeof (backup_hash)))
+  {
+    GNUNET_break_op (0);
+    return TALER_MHD_reply_with_error (connection,
+                                       MHD_HTTP_BAD_REQUEST,
+                                       TALER_EC_GENERIC_PARAMETER_MALFORMED,
+                                       "version");
+  }
+  start = GNUNET_TIME_absolute_get ();
+  qs = db->lookup_backup_version_TR (db->cls,
+                                     account,
+                                     &backup_hash,
+                                     &account_sig,
+                                     &prev_hash,
+                                     &backup_size,
+                                     &backup);
+  SH_trace_db (SH_trace_current,
+               "lookup_backup_version",
+               start);
   switch (qs)
   {
   case SYNC_DB_OLD_BACKUP_MISSING:
-    GNUNET_break (0);
-    return TALER_MHD_reply_with_error (connection,
-                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
-                                       TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE,
-                                       "unexpected return status (backup missing)");
   case SYNC_DB_OLD_BACKUP_MISMATCH:
-    GNUNET_break (0);
-    return TALER_MHD_reply_with_error (connection,
-                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
-                                       TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE,
-                                       "unexpected return status (backup mismatch)");
   case SYNC_DB_PAYMENT_REQUIRED:
     GNUNET_break (0);
     return TALER_MHD_reply_with_error (connection,
                                        MHD_HTTP_INTERNAL_SERVER_ERROR,
                                        TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE,
-                                       "unexpected return status (payment required)");
+                                       "unexpected return status");
   case SYNC_DB_HARD_ERROR:
-    GNUNET_break (0);
     return TALER_MHD_reply_with_error (connection,
                                        MHD_HTTP_INTERNAL_SERVER_ERROR,
                                        TALER_EC_GENERIC_DB_FETCH_FAILED,
@@ -203,57 +709,24 @@ SH_return_backup (struct MHD_Connection *connection,
                                        TALER_EC_GENERIC_DB_SOFT_FAILURE,
                                        NULL);
   case SYNC_DB_NO_RESULTS:
-    GNUNET_break (0);
-    /* Note: can theoretically happen due to non-transactional nature if
-       the backup expired / was gc'ed JUST between the two SQL calls.
-       But too rare to handle properly, as doing a transaction would be
-       expensive. Just admit to failure ;-) */
+    /* never existed, or dropped from the history */
     return TALER_MHD_reply_with_error (connection,
-                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
-                                       TALER_EC_GENERIC_DB_INVARIANT_FAILURE,
-                                       NULL);
+                                       MHD_HTTP_NOT_FOUND,
+                                       TALER_EC_SYNC_PREVIOUS_BACKUP_UNKNOWN,
+                                       version);
   case SYNC_DB_ONE_RESULT:
-    /* interesting case below */
     break;
   }
   resp = MHD_create_response_from_buffer (backup_size,
                                           backup,
                                           MHD_RESPMEM_MUST_FREE);
   TALER_MHD_add_global_headers (resp);
-  {
-    char *sig_s;
-    char *prev_s;
-    char *etag;
-    char *etagq;
-
-    sig_s = GNUNET_STRINGS_data_to_string_alloc (&account_sig,
-                                                 sizeof (account_sig));
-    prev_s = GNUNET_STRINGS_data_to_string_alloc (&prev_hash,
-                                                  sizeof (prev_hash));
-    etag = GNUNET_STRINGS_data_to_string_alloc (&backup_hash,
-                                                sizeof (backup_hash));
-    GNUNET_break (MHD_YES ==
-                  MHD_add_response_header (resp,
-                                           "Sync-Signature",
-                                           sig_s));
-    GNUNET_break (MHD_YES ==
-                  MHD_add_response_header (resp,
-                                           "Sync-Previous",
-                                           prev_s));
-    GNUNET_asprintf (&etagq,
-                     "\"%s\"",
-                     etag);
-    GNUNET_break (MHD_YES ==
-                  MHD_add_response_header (resp,
-                                           MHD_HTTP_HEADER_ETAG,
-                                           etagq));
-    GNUNET_free (etagq);
-    GNUNET_free (etag);
-    GNUNET_free (prev_s);
-    GNUNET_free (sig_s);
-  }
+  add_backup_headers (resp,
+                      &account_sig,
+                      &prev_hash,
+                      &backup_hash);
   ret = MHD_queue_response (connection,
-                            default_http_status,
+                            MHD_HTTP_OK,
                             resp);
   MHD_destroy_response (resp);
   return ret;
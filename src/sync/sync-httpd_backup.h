@@ -29,6 +29,40 @@ void
 SH_resume_all_bc (void);
 
 
+/**
+ * Service is shutting down, resume all MHD connections waiting
+ * for payments NOW.
+ */
+void
+SH_resume_all_pc (void);
+
+
+/**
+ * Create a payment request for @a order_id.
+ *
+ * @param order_id our backend's order ID
+ * @param token the claim token generated by the merchant (NULL if
+ *        it wasn't generated).
+ * @return MHD response to use
+ */
+struct MHD_Response *
+SH_make_payment_request (const char *order_id,
+                         const struct TALER_ClaimTokenP *token);
+
+
+/**
+ * Parse the "timeout_ms" argument of a long-polling request.
+ *
+ * @param connection the MHD connection with the request
+ * @param[out] timeout set to the timeout, zero if not given
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the argument
+ *         is malformed
+ */
+enum GNUNET_GenericReturnValue
+SH_parse_timeout_ms (struct MHD_Connection *connection,
+                     struct GNUNET_TIME_Relative *timeout);
+
+
 /**
  * Return the current backup of @a account on @a connection
  * using @a default_http_status on success.
@@ -37,12 +71,36 @@ SH_resume_all_bc (void);
  * @param account account to query
  * @param default_http_status HTTP status to queue response
  *  with on success (#MHD_HTTP_OK or #MHD_HTTP_CONFLICT)
+ * @param known_hash hash of a backup the client already has,
+ *  NULL if none; if it matches the current backup, we only
+ *  return the headers and omit the body
+ * @param expected_hash hash we expect the current backup to have,
+ *  NULL if unknown; if given, the backup may be served from a
+ *  read replica (falling back to the primary if it lags behind)
  * @return MHD result code
  */
 MHD_RESULT
 SH_return_backup (struct MHD_Connection *connection,
                   const struct SYNC_AccountPublicKeyP *account,
-                  unsigned int default_http_status);
+                  unsigned int default_http_status,
+                  const struct GNUNET_HashCode *known_hash,
+                  const struct GNUNET_HashCode *expected_hash);
+
+
+/**
+ * Handle request on @a connection for retrieval of a specific
+ * version of the backup of @a account, which may be the current
+ * backup or one kept in the history.
+ *
+ * @param connection the MHD connection to handle
+ * @param account public key of the account the request is for
+ * @param version hash of the requested version, base32-encoded
+ * @return MHD result code
+ */
+MHD_RESULT
+SH_backup_version_get (struct MHD_Connection *connection,
+                       const struct SYNC_AccountPublicKeyP *account,
+                       const char *version);
 
 
 /**
@@ -74,4 +132,40 @@ SH_backup_post (struct MHD_Connection *connection,
                 size_t *upload_data_size);
 
 
+/**
+ * Handle a client waiting for the payment for @a account to
+ * be confirmed, possibly long-polling.  Replies with
+ * #MHD_HTTP_OK and a JSON body once the payment was made,
+ * with #MHD_HTTP_PAYMENT_REQUIRED while it is still open and
+ * with #MHD_HTTP_NO_CONTENT if no payment is pending at all.
+ *
+ * @param connection the MHD connection to handle
+ * @param[in,out] con_cls the connection's closure (can be updated)
+ * @param account public key of the account the request is for
+ * @return MHD result code
+ */
+MHD_RESULT
+SH_backup_payment_get (struct MHD_Connection *connection,
+                       void **con_cls,
+                       const struct SYNC_AccountPublicKeyP *account);
+
+
+/**
+ * Handle a client POSTing a list of accounts to /backups:batch-get.
+ *
+ * @param rh context of the handler
+ * @param connection the MHD connection to handle
+ * @param[in,out] connection_cls the connection's closure (can be updated)
+ * @param upload_data upload data
+ * @param[in,out] upload_data_size number of bytes (left) in @a upload_data
+ * @return MHD result code
+ */
+MHD_RESULT
+SH_backup_batch_get (struct SH_RequestHandler *rh,
+                     struct MHD_Connection *connection,
+                     void **connection_cls,
+                     const char *upload_data,
+                     size_t *upload_data_size);
+
+
 #endif
@@ -0,0 +1,369 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_backup_batch.c
+ * @brief functions to handle batch downloads of backups
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "sync-httpd.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <gnunet/gnunet_json_lib.h>
+#include "sync-httpd_backup.h"
+
+
+/**
+ * Maximum number of accounts a client may ask for in one batch.
+ */
+#define MAX_BATCH_SIZE 128
+
+/**
+ * Soft limit on the size of a batch reply.  Once the reply exceeds
+ * this size, further backups are returned with a status of
+ * #MHD_HTTP_PAYLOAD_TOO_LARGE and must be fetched separately.
+ */
+#define MAX_BATCH_REPLY_SIZE (64 * 1024 * 1024)
+
+
+/**
+ * Context for a batch download.
+ */
+struct BatchContext
+{
+
+  /**
+   * Context for cleanup logic.
+   */
+  struct TM_HandlerContext hc;
+
+  /**
+   * Opaque post parsing context.
+   */
+  void *json_parse_context;
+
+};
+
+
+/**
+ * Closure for #batch_cb.
+ */
+struct BatchResult
+{
+
+  /**
+   * Accounts the client asked for.
+   */
+  const struct SYNC_AccountPublicKeyP *accounts;
+
+  /**
+   * Array of length @e num_accounts, set to true for accounts we
+   * found in the database.
+   */
+  bool *found;
+
+  /**
+   * Reply we are building.
+   */
+  struct GNUNET_Buffer reply;
+
+  /**
+   * Length of the @e accounts and @e found arrays.
+   */
+  unsigned int num_accounts;
+
+};
+
+
+/**
+ * Function called to clean up a batch context.
+ *
+ * @param hc a `struct BatchContext`
+ */
+static void
+cleanup_batch_ctx (struct TM_HandlerContext *hc)
+{
+  struct BatchContext *bc = (struct BatchContext *) hc;
+
+  TALER_MHD_parse_post_cleanup_callback (bc->json_parse_context);
+  GNUNET_free (bc);
+}
+
+
+/**
+ * Append an entry to the batch reply.
+ *
+ * @param[in,out] br reply to append to
+ * @param be header of the entry
+ * @param backup_size number of bytes in @a backup
+ * @param backup backup data, NULL for none
+ */
+static void
+append_entry (struct BatchResult *br,
+              const struct SYNC_BatchGetEntryP *be,
+              size_t backup_size,
+              const void *backup)
+{
+  GNUNET_buffer_write (&br->reply,
+                       (const char *) be,
+                       sizeof (*be));
+  if (NULL == backup)
+    return;
+  GNUNET_buffer_write (&br->reply,
+                       backup,
+                       backup_size);
+}
+
+
+/**
+ * Function called on backups found by a batch lookup.
+ *
+ * @param cls our `struct BatchResult`
+ * @param account_pub account the backup is stored under
+ * @param account_sig signature affirming storage request
+ * @param prev_hash hash of the previous backup, all zeros if none
+ * @param backup_hash hash of @a backup
+ * @param omitted true if the backup does not fit into the reply
+ * @param backup_size number of bytes in @a backup
+ * @param backup raw backup data, NULL if the client knows it
+ *        or if @a omitted
+ */
+static void
+batch_cb (void *cls,
+          const struct SYNC_AccountPublicKeyP *account_pub,
+          const struct SYNC_AccountSignatureP *account_sig,
+          const struct GNUNET_HashCode *prev_hash,
+          const struct GNUNET_HashCode *backup_hash,
+          bool omitted,
+          size_t backup_size,
+          const void *backup)
+{
+  struct BatchResult *br = cls;
+  struct SYNC_BatchGetEntryP be = {
+    .account_pub = *account_pub,
+    .account_sig = *account_sig,
+    .prev_hash = *prev_hash,
+    .backup_hash = *backup_hash,
+    .http_status = htonl (omitted
+                          ? MHD_HTTP_PAYLOAD_TOO_LARGE
+                          : (NULL == backup)
+                          ? MHD_HTTP_NOT_MODIFIED
+                          : MHD_HTTP_OK),
+    .backup_size = GNUNET_htonll ((NULL == backup)
+                                  ? 0
+                                  : backup_size)
+  };
+
+  for (unsigned int i = 0; i<br->num_accounts; i++)
+    if (0 == GNUNET_memcmp (account_pub,
+                            &br->accounts[i]))
+    {
+      br->found[i] = true;
+      break;
+    }
+  append_entry (br,
+                &be,
+                backup_size,
+                backup);
+}
+
+
+/**
+ * Handle a client POSTing a list of accounts to /backups:batch-get.
+ *
+ * The body is a JSON object with an "accounts" array, each entry
+ * giving an "account_pub" and optionally a "known_hash" of the
+ * backup the client already has.  The reply is a sequence of
+ * `struct SYNC_BatchGetEntryP`, each followed by the backup data.
+ *
+ * @param rh context of the handler
+ * @param connection the MHD connection to handle
+ * @param[in,out] connection_cls the connection's closure (can be updated)
+ * @param upload_data upload data
+ * @param[in,out] upload_data_size number of bytes (left) in @a upload_data
+ * @return MHD result code
+ */
+MHD_RESULT
+SH_backup_batch_get (struct SH_RequestHandler *rh,
+                     struct MHD_Connection *connection,
+                     void **connection_cls,
+                     const char *upload_data,
+                     size_t *upload_data_size)
+{
+  struct BatchContext *bc = *connection_cls;
+  enum GNUNET_GenericReturnValue res;
+  json_t *json;
+  const json_t *jaccounts;
+  unsigned int num_accounts;
+
+  if (NULL == bc)
+  {
+    bc = GNUNET_new (struct BatchContext);
+    bc->hc.cc = &cleanup_batch_ctx;
+    *connection_cls = bc;
+  }
+  res = TALER_MHD_parse_post_json (connection,
+                                   &bc->json_parse_context,
+                                   upload_data,
+                                   upload_data_size,
+                                   &json);
+  if (GNUNET_SYSERR == res)
+    return MHD_NO;
+  if ( (GNUNET_NO == res) ||
+       (NULL == json) )
+    return MHD_YES;
+  {
+    struct GNUNET_JSON_Specification spec[] = {
+      GNUNET_JSON_spec_array_const ("accounts",
+                                    &jaccounts),
+      GNUNET_JSON_spec_end ()
+    };
+
+    res = TALER_MHD_parse_json_data (connection,
+                                     json,
+                                     spec);
+    if (GNUNET_OK != res)
+    {
+      json_decref (json);
+      return (GNUNET_NO == res) ? MHD_YES : MHD_NO;
+    }
+  }
+  num_accounts = (unsigned int) json_array_size (jaccounts);
+  if ( (0 == num_accounts) ||
+       (MAX_BATCH_SIZE < num_accounts) )
+  {
+    GNUNET_break_op (0);
+    json_decref (json);
+    return TALER_MHD_reply_with_error (connection,
+                                       MHD_HTTP_BAD_REQUEST,
+                                       TALER_EC_GENERIC_PARAMETER_MALFORMED,
+                                       "accounts");
+  }
+  {
+    struct SYNC_AccountPublicKeyP accounts[num_accounts];
+    struct GNUNET_HashCode known_hashes[num_accounts];
+    bool found[num_accounts];
+    unsigned int num_unique = 0;
+    struct BatchResult br = {
+      .accounts = accounts,
+      .found = found
+    };
+    enum GNUNET_DB_QueryStatus qs;
+    struct GNUNET_TIME_Absolute start;
+    struct MHD_Response *resp;
+    MHD_RESULT ret;
+    void *body;
+    size_t body_size;
+
+    memset (found,
+            0,
+            sizeof (found));
+    memset (known_hashes,
+            0,
+            sizeof (known_hashes));
+    for (unsigned int i = 0; i<num_accounts; i++)
+    {
+      bool no_known;
+      bool dup = false;
+      struct GNUNET_JSON_Specification ispec[] = {
+        GNUNET_JSON_spec_fixed_auto ("account_pub",
+                                     &accounts[num_unique]),
+        GNUNET_JSON_spec_mark_optional (
+          GNUNET_JSON_spec_fixed_auto ("known_hash",
+                                       &known_hashes[num_unique]),
+          &no_known),
+        GNUNET_JSON_spec_end ()
+      };
+
+      res = TALER_MHD_parse_json_array (connection,
+                                        jaccounts,
+                                        ispec,
+                                        i,
+                                        -1);
+      if (GNUNET_OK != res)
+      {
+        json_decref (json);
+        return (GNUNET_NO == res) ? MHD_YES : MHD_NO;
+      }
+      /* if the client listed an account twice, the first entry wins */
+      for (unsigned int j = 0; j<num_unique; j++)
+        if (0 == GNUNET_memcmp (&accounts[j],
+                                &accounts[num_unique]))
+          dup = true;
+      if (dup)
+      {
+        memset (&known_hashes[num_unique],
+                0,
+                sizeof (known_hashes[num_unique]));
+        continue;
+      }
+      num_unique++;
+    }
+    json_decref (json);
+    br.num_accounts = num_unique;
+
+    start = GNUNET_TIME_absolute_get ();
+    qs = db->lookup_backups_TR (db->cls,
+                                num_unique,
+                                accounts,
+                                known_hashes,
+                                MAX_BATCH_REPLY_SIZE,
+                                &batch_cb,
+                                &br);
+    SH_trace_db (SH_trace_current,
+                 "lookup_backups",
+                 start);
+    if (qs < 0)
+    {
+      GNUNET_buffer_clear (&br.reply);
+      return TALER_MHD_reply_with_error (connection,
+                                         MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                         TALER_EC_GENERIC_DB_FETCH_FAILED,
+                                         "lookup_backups");
+    }
+    for (unsigned int i = 0; i<num_unique; i++)
+    {
+      struct SYNC_BatchGetEntryP be = {
+        .account_pub = accounts[i],
+        .http_status = htonl (MHD_HTTP_NOT_FOUND)
+      };
+
+      if (found[i])
+        continue;
+      append_entry (&br,
+                    &be,
+                    0,
+                    NULL);
+    }
+    body = GNUNET_buffer_reap (&br.reply,
+                               &body_size);
+    resp = MHD_create_response_from_buffer (body_size,
+                                            body,
+                                            MHD_RESPMEM_MUST_FREE);
+    TALER_MHD_add_global_headers (resp);
+    GNUNET_break (MHD_YES ==
+                  MHD_add_response_header (resp,
+                                           MHD_HTTP_HEADER_CONTENT_TYPE,
+                                           rh->mime_type));
+    ret = MHD_queue_response (connection,
+                              MHD_HTTP_OK,
+                              resp);
+    MHD_destroy_response (resp);
+    return ret;
+  }
+}
+
+
+/* end of sync-httpd_backup_batch.c */
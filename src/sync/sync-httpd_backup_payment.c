@@ -0,0 +1,401 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_backup_payment.c
+ * @brief functions to handle clients waiting for payments
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "sync-httpd.h"
+#include <gnunet/gnunet_util_lib.h>
+#include "sync-httpd_backup.h"
+#include "sync-httpd_order_status.h"
+#include <taler/taler_json_lib.h>
+
+
+/**
+ * Maximum time we allow clients to long-poll for a payment.
+ */
+#define MAX_PAYMENT_TIMEOUT GNUNET_TIME_relative_multiply ( \
+    GNUNET_TIME_UNIT_MINUTES, 30)
+
+
+/**
+ * Context for a client waiting for a payment.
+ */
+struct PaymentContext
+{
+
+  /**
+   * Context for cleanup logic.
+   */
+  struct TM_HandlerContext hc;
+
+  /**
+   * Kept in DLL for shutdown handling while suspended.
+   */
+  struct PaymentContext *next;
+
+  /**
+   * Kept in DLL for shutdown handling while suspended.
+   */
+  struct PaymentContext *prev;
+
+  /**
+   * Used while suspended for resumption.
+   */
+  struct MHD_Connection *con;
+
+  /**
+   * Used while we are waiting for the payment.
+   */
+  struct SH_OrderStatusRequest *osr;
+
+  /**
+   * Response to return on resume, if non-NULL.
+   */
+  struct MHD_Response *resp;
+
+  /**
+   * Most recent pending order of the account, NULL if none.
+   */
+  char *order_id;
+
+  /**
+   * Public key of the account holder.
+   */
+  struct SYNC_AccountPublicKeyP account;
+
+  /**
+   * Claim token of @e order_id, all zeros if not known.
+   */
+  struct TALER_ClaimTokenP token;
+
+  /**
+   * Timestamp of @e order_id.
+   */
+  struct GNUNET_TIME_Timestamp order_timestamp;
+
+  /**
+   * When did we start the current request to the merchant backend?
+   */
+  struct GNUNET_TIME_Absolute merchant_start;
+
+  /**
+   * HTTP response code to use on resume, if @e resp is set.
+   */
+  unsigned int response_code;
+
+};
+
+
+/**
+ * Kept in DLL for shutdown handling while suspended.
+ */
+static struct PaymentContext *pc_head;
+
+/**
+ * Kept in DLL for shutdown handling while suspended.
+ */
+static struct PaymentContext *pc_tail;
+
+
+enum GNUNET_GenericReturnValue
+SH_parse_timeout_ms (struct MHD_Connection *connection,
+                     struct GNUNET_TIME_Relative *timeout)
+{
+  const char *ts;
+  unsigned long long tms;
+  char dummy;
+
+  *timeout = GNUNET_TIME_UNIT_ZERO;
+  ts = MHD_lookup_connection_value (connection,
+                                    MHD_GET_ARGUMENT_KIND,
+                                    "timeout_ms");
+  if (NULL == ts)
+    return GNUNET_OK;
+  if (1 != sscanf (ts,
+                   "%llu%c",
+                   &tms,
+                   &dummy))
+    return GNUNET_SYSERR;
+  *timeout = GNUNET_TIME_relative_min (
+    GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                   tms),
+    MAX_PAYMENT_TIMEOUT);
+  return GNUNET_OK;
+}
+
+
+void
+SH_resume_all_pc ()
+{
+  struct PaymentContext *pc;
+
+  while (NULL != (pc = pc_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (pc_head,
+                                 pc_tail,
+                                 pc);
+    MHD_resume_connection (pc->con);
+    if (NULL != pc->osr)
+    {
+      SH_order_status_cancel (pc->osr);
+      pc->osr = NULL;
+    }
+  }
+}
+
+
+/**
+ * Function called to clean up a payment context.
+ *
+ * @param hc a `struct PaymentContext`
+ */
+static void
+cleanup_payment_ctx (struct TM_HandlerContext *hc)
+{
+  struct PaymentContext *pc = (struct PaymentContext *) hc;
+
+  if (NULL != pc->osr)
+    SH_order_status_cancel (pc->osr);
+  if (NULL != pc->resp)
+    MHD_destroy_response (pc->resp);
+  GNUNET_free (pc->order_id);
+  GNUNET_free (pc);
+}
+
+
+/**
+ * Function called on all pending payments for the account.
+ * Remembers the most recent order for the current annual fee.
+ *
+ * @param cls closure, our `struct PaymentContext`
+ * @param timestamp for how long have we been waiting
+ * @param order_id order id in the backend
+ * @param token claim token to use (or NULL for none)
+ * @param amount how much is the order for
+ */
+static void
+pending_payment_cb (void *cls,
+                    struct GNUNET_TIME_Timestamp timestamp,
+                    const char *order_id,
+                    const struct TALER_ClaimTokenP *token,
+                    const struct TALER_Amount *amount)
+{
+  struct PaymentContext *pc = cls;
+
+  if (0 != TALER_amount_cmp (amount,
+                             &SH_annual_fee))
+    return; /* fees changed, client will get a fresh order */
+  if ( (NULL == pc->order_id) ||
+       (GNUNET_TIME_timestamp_cmp (pc->order_timestamp,
+                                   <,
+                                   timestamp)) )
+  {
+    GNUNET_free (pc->order_id);
+    pc->order_id = GNUNET_strdup (order_id);
+    pc->order_timestamp = timestamp;
+    if (NULL != token)
+      pc->token = *token;
+  }
+}
+
+
+/**
+ * Callback with the status of the order we are waiting on.
+ *
+ * @param cls our `struct PaymentContext`
+ * @param os order status
+ */
+static void
+payment_status_cb (void *cls,
+                   const struct SH_OrderStatus *os)
+{
+  struct PaymentContext *pc = cls;
+
+  pc->osr = NULL;
+  SH_trace_merchant (pc->hc.trace,
+                     "order_get",
+                     pc->merchant_start,
+                     os->http_status);
+  GNUNET_CONTAINER_DLL_remove (pc_head,
+                               pc_tail,
+                               pc);
+  MHD_resume_connection (pc->con);
+  SH_trigger_daemon ();
+  switch (os->http_status)
+  {
+  case 0:
+    pc->response_code = MHD_HTTP_GATEWAY_TIMEOUT;
+    pc->resp = TALER_MHD_make_error (
+      TALER_EC_SYNC_GENERIC_BACKEND_TIMEOUT,
+      NULL);
+    return;
+  case MHD_HTTP_OK:
+    break;
+  default:
+    pc->response_code = MHD_HTTP_BAD_GATEWAY;
+    pc->resp = TALER_MHD_MAKE_JSON_PACK (
+      TALER_JSON_pack_ec (TALER_EC_SYNC_GENERIC_BACKEND_ERROR),
+      GNUNET_JSON_pack_uint64 ("backend-ec",
+                               (json_int_t) os->ec),
+      GNUNET_JSON_pack_uint64 ("backend-http-status",
+                               (json_int_t) os->http_status),
+      GNUNET_JSON_pack_allow_null (
+        GNUNET_JSON_pack_object_incref ("backend-reply",
+                                        (json_t *) os->reply)));
+    return;
+  }
+  switch (os->status)
+  {
+  case TALER_MERCHANT_OSC_PAID:
+    {
+      enum SYNC_DB_QueryStatus qs;
+      struct GNUNET_TIME_Absolute start;
+
+      start = GNUNET_TIME_absolute_get ();
+      qs = db->increment_lifetime_TR (db->cls,
+                                      &pc->account,
+                                      pc->order_id,
+                                      GNUNET_TIME_UNIT_YEARS); /* always annual */
+      SH_trace_db (pc->hc.trace,
+                   "increment_lifetime",
+                   start);
+      if (0 > qs)
+      {
+        GNUNET_break (0);
+        pc->resp = TALER_MHD_make_error (TALER_EC_GENERIC_DB_STORE_FAILED,
+                                         "increment lifetime");
+        pc->response_code = MHD_HTTP_INTERNAL_SERVER_ERROR;
+        return;
+      }
+      /* distinct from the 204 we return if nothing is pending */
+      pc->resp = TALER_MHD_MAKE_JSON_PACK (
+        GNUNET_JSON_pack_string ("status",
+                                 "paid"),
+        GNUNET_JSON_pack_string ("order_id",
+                                 pc->order_id));
+      pc->response_code = MHD_HTTP_OK;
+      return;
+    }
+  case TALER_MERCHANT_OSC_UNPAID:
+  case TALER_MERCHANT_OSC_CLAIMED:
+    break;
+  }
+  /* still unpaid, repeat payment request */
+  pc->resp = SH_make_payment_request (pc->order_id,
+                                      (GNUNET_YES ==
+                                       GNUNET_is_zero (&pc->token))
+                                      ? NULL
+                                      : &pc->token);
+  GNUNET_assert (NULL != pc->resp);
+  pc->response_code = MHD_HTTP_PAYMENT_REQUIRED;
+}
+
+
+MHD_RESULT
+SH_backup_payment_get (struct MHD_Connection *connection,
+                       void **con_cls,
+                       const struct SYNC_AccountPublicKeyP *account)
+{
+  struct PaymentContext *pc = *con_cls;
+  struct GNUNET_TIME_Relative timeout;
+
+  if (NULL != pc)
+  {
+    MHD_RESULT ret;
+
+    /* resumed, return the response we generated */
+    GNUNET_assert (NULL != pc->resp);
+    ret = MHD_queue_response (connection,
+                              pc->response_code,
+                              pc->resp);
+    MHD_destroy_response (pc->resp);
+    pc->resp = NULL;
+    return ret;
+  }
+  if (GNUNET_OK !=
+      SH_parse_timeout_ms (connection,
+                           &timeout))
+  {
+    GNUNET_break_op (0);
+    return TALER_MHD_reply_with_error (connection,
+                                       MHD_HTTP_BAD_REQUEST,
+                                       TALER_EC_GENERIC_PARAMETER_MALFORMED,
+                                       "timeout_ms");
+  }
+  pc = GNUNET_new (struct PaymentContext);
+  pc->hc.cc = &cleanup_payment_ctx;
+  pc->con = connection;
+  pc->account = *account;
+  *con_cls = pc;
+  {
+    enum GNUNET_DB_QueryStatus qs;
+    struct GNUNET_TIME_Absolute start;
+
+    start = GNUNET_TIME_absolute_get ();
+    qs = db->lookup_pending_payments_by_account_TR (db->cls,
+                                                    account,
+                                                    &pending_payment_cb,
+                                                    pc);
+    SH_trace_db (SH_trace_current,
+                 "lookup_pending_payments",
+                 start);
+    if (qs < 0)
+    {
+      GNUNET_break (0);
+      return TALER_MHD_reply_with_error (connection,
+                                         MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                         TALER_EC_GENERIC_DB_FETCH_FAILED,
+                                         "pending payments");
+    }
+  }
+  if (NULL == pc->order_id)
+  {
+    /* no payment pending, nothing to wait for */
+    struct MHD_Response *resp;
+    MHD_RESULT ret;
+
+    resp = MHD_create_response_from_buffer (0,
+                                            NULL,
+                                            MHD_RESPMEM_PERSISTENT);
+    TALER_MHD_add_global_headers (resp);
+    ret = MHD_queue_response (connection,
+                              MHD_HTTP_NO_CONTENT,
+                              resp);
+    MHD_destroy_response (resp);
+    return ret;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Waiting up to %s for payment of order `%s'\n",
+              GNUNET_TIME_relative2s (timeout,
+                                      true),
+              pc->order_id);
+  GNUNET_CONTAINER_DLL_insert (pc_head,
+                               pc_tail,
+                               pc);
+  MHD_suspend_connection (connection);
+  pc->merchant_start = GNUNET_TIME_absolute_get ();
+  pc->osr = SH_order_status_get (pc->order_id,
+                                 timeout,
+                                 &payment_status_cb,
+                                 pc);
+  return MHD_YES;
+}
+
+
+/* end of sync-httpd_backup_payment.c */
@@ -22,6 +22,10 @@
 #include "sync-httpd.h"
 #include <gnunet/gnunet_util_lib.h>
 #include "sync-httpd_backup.h"
+#include "sync-httpd_breaker.h"
+#include "sync-httpd_order_pool.h"
+#include "sync-httpd_order_status.h"
+#include "sync-httpd_ratelimit.h"
 #include <taler/taler_json_lib.h>
 #include <taler/taler_merchant_service.h>
 #include <taler/taler_signatures.h>
@@ -67,6 +71,13 @@ struct BackupContext
    */
   struct GNUNET_HashCode new_backup_hash;
 
+  /**
+   * Hash of a backup the client already has, used to avoid
+   * sending it again on conflicts.  Only valid if
+   * @e have_known_hash is set.
+   */
+  struct GNUNET_HashCode known_backup_hash;
+
   /**
    * Claim token, all zeros if not known. Only set if @e existing_order_id is non-NULL.
    */
@@ -105,7 +116,7 @@ struct BackupContext
   /**
    * Used while we are waiting payment.
    */
-  struct TALER_MERCHANT_OrderMerchantGetHandle *omgh;
+  struct SH_OrderStatusRequest *osr;
 
   /**
    * HTTP response code to use on resume, if non-NULL.
@@ -129,6 +140,17 @@ struct BackupContext
    */
   struct GNUNET_TIME_Timestamp existing_order_timestamp;
 
+  /**
+   * When did we start the current request to the merchant backend?
+   */
+  struct GNUNET_TIME_Absolute merchant_start;
+
+  /**
+   * How long is the client willing to wait for an existing order
+   * to be paid?  Zero for no long polling.
+   */
+  struct GNUNET_TIME_Relative timeout;
+
   /**
    * Expected total upload size.
    */
@@ -148,6 +170,12 @@ struct BackupContext
    * Do not look for an existing order, force a fresh order to be created.
    */
   bool force_fresh_order;
+
+  /**
+   * Did the client tell us about a backup it has in
+   * @e known_backup_hash?
+   */
+  bool have_known_hash;
 };
 
 
@@ -179,12 +207,13 @@ SH_resume_all_bc ()
     if (NULL != bc->po)
     {
       TALER_MERCHANT_orders_post_cancel (bc->po);
+      SH_breaker_request_cancel (false);
       bc->po = NULL;
     }
-    if (NULL != bc->omgh)
+    if (NULL != bc->osr)
     {
-      TALER_MERCHANT_merchant_order_get_cancel (bc->omgh);
-      bc->omgh = NULL;
+      SH_order_status_cancel (bc->osr);
+      bc->osr = NULL;
     }
   }
 }
@@ -201,7 +230,12 @@ cleanup_ctx (struct TM_HandlerContext *hc)
   struct BackupContext *bc = (struct BackupContext *) hc;
 
   if (NULL != bc->po)
+  {
     TALER_MERCHANT_orders_post_cancel (bc->po);
+    SH_breaker_request_cancel (false);
+  }
+  if (NULL != bc->osr)
+    SH_order_status_cancel (bc->osr);
   if (NULL != bc->hash_ctx)
     GNUNET_CRYPTO_hash_context_abort (bc->hash_ctx);
   if (NULL != bc->resp)
@@ -212,18 +246,9 @@ cleanup_ctx (struct TM_HandlerContext *hc)
 }
 
 
-/**
- * Transmit a payment request for @a order_id on @a connection
- *
- * @param connection MHD connection
- * @param order_id our backend's order ID
- * @param token the claim token generated by the merchant (NULL if
- *        it wasn't generated).
- * @return MHD response to use
- */
-static struct MHD_Response *
-make_payment_request (const char *order_id,
-                      const struct TALER_ClaimTokenP *token)
+struct MHD_Response *
+SH_make_payment_request (const char *order_id,
+                         const struct TALER_ClaimTokenP *token)
 {
   struct MHD_Response *resp;
 
@@ -303,8 +328,15 @@ proposal_cb (void *cls,
 {
   struct BackupContext *bc = cls;
   enum SYNC_DB_QueryStatus qs;
+  struct GNUNET_TIME_Absolute start;
 
   bc->po = NULL;
+  SH_breaker_request_done (false,
+                           por->hr.http_status);
+  SH_trace_merchant (bc->hc.trace,
+                     "orders_post",
+                     bc->merchant_start,
+                     por->hr.http_status);
   GNUNET_CONTAINER_DLL_remove (bc_head,
                                bc_tail,
                                bc);
@@ -335,11 +367,15 @@ proposal_cb (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_INFO,
               "Storing payment request for order `%s'\n",
               por->details.ok.order_id);
+  start = GNUNET_TIME_absolute_get ();
   qs = db->store_payment_TR (db->cls,
                              &bc->account,
                              por->details.ok.order_id,
                              por->details.ok.token,
                              &SH_annual_fee);
+  SH_trace_db (bc->hc.trace,
+               "store_payment",
+               start);
   if (0 >= qs)
   {
     GNUNET_break (0);
@@ -352,8 +388,8 @@ proposal_cb (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_INFO,
               "Obtained fresh order `%s'\n",
               por->details.ok.order_id);
-  bc->resp = make_payment_request (por->details.ok.order_id,
-                                   por->details.ok.token);
+  bc->resp = SH_make_payment_request (por->details.ok.order_id,
+                                      por->details.ok.token);
   GNUNET_assert (NULL != bc->resp);
   bc->response_code = MHD_HTTP_PAYMENT_REQUIRED;
 }
@@ -397,26 +433,29 @@ ongoing_payment_cb (void *cls,
 
 
 /**
- * Callback to process a GET /check-payment request
+ * Callback to process the status of the order we are checking.
  *
  * @param cls our `struct BackupContext`
- * @param osr order status
+ * @param os order status
  */
 static void
 check_payment_cb (void *cls,
-                  const struct TALER_MERCHANT_OrderStatusResponse *osr)
+                  const struct SH_OrderStatus *os)
 {
   struct BackupContext *bc = cls;
-  const struct TALER_MERCHANT_HttpResponse *hr = &osr->hr;
 
   /* refunds are not supported, verify */
-  bc->omgh = NULL;
+  bc->osr = NULL;
+  SH_trace_merchant (bc->hc.trace,
+                     "order_get",
+                     bc->merchant_start,
+                     os->http_status);
   GNUNET_CONTAINER_DLL_remove (bc_head,
                                bc_tail,
                                bc);
   MHD_resume_connection (bc->con);
   SH_trigger_daemon ();
-  switch (hr->http_status)
+  switch (os->http_status)
   {
   case 0:
     /* Likely timeout, complain! */
@@ -437,29 +476,34 @@ check_payment_cb (void *cls,
                                TALER_ErrorCode_get_hint (
                                  TALER_EC_SYNC_GENERIC_BACKEND_ERROR)),
       GNUNET_JSON_pack_uint64 ("backend-ec",
-                               (json_int_t) hr->ec),
+                               (json_int_t) os->ec),
       GNUNET_JSON_pack_uint64 ("backend-http-status",
-                               (json_int_t) hr->http_status),
+                               (json_int_t) os->http_status),
       GNUNET_JSON_pack_allow_null (
         GNUNET_JSON_pack_object_incref ("backend-reply",
-                                        (json_t *) hr->reply)));
+                                        (json_t *) os->reply)));
     return;
   }
 
-  GNUNET_assert (MHD_HTTP_OK == hr->http_status);
+  GNUNET_assert (MHD_HTTP_OK == os->http_status);
   GNUNET_log (GNUNET_ERROR_TYPE_INFO,
               "Payment status checked: %d\n",
-              osr->details.ok.status);
-  switch (osr->details.ok.status)
+              os->status);
+  switch (os->status)
   {
   case TALER_MERCHANT_OSC_PAID:
     {
       enum SYNC_DB_QueryStatus qs;
+      struct GNUNET_TIME_Absolute start;
 
+      start = GNUNET_TIME_absolute_get ();
       qs = db->increment_lifetime_TR (db->cls,
                                       &bc->account,
                                       bc->order_id,
                                       GNUNET_TIME_UNIT_YEARS); /* always annual */
+      SH_trace_db (bc->hc.trace,
+                   "increment_lifetime",
+                   start);
       if (0 <= qs)
         return; /* continue as planned */
       GNUNET_break (0);
@@ -478,10 +522,11 @@ check_payment_cb (void *cls,
     /* repeat payment request */
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
                 "Repeating payment request\n");
-    bc->resp = make_payment_request (bc->existing_order_id,
-                                     (GNUNET_YES == GNUNET_is_zero (&bc->token))
-                                     ? NULL
-                                     : &bc->token);
+    bc->resp = SH_make_payment_request (bc->existing_order_id,
+                                        (GNUNET_YES ==
+                                         GNUNET_is_zero (&bc->token))
+                                        ? NULL
+                                        : &bc->token);
     GNUNET_assert (NULL != bc->resp);
     bc->response_code = MHD_HTTP_PAYMENT_REQUIRED;
     return;
@@ -513,15 +558,67 @@ await_payment (struct BackupContext *bc,
                                bc);
   MHD_suspend_connection (bc->con);
   bc->order_id = order_id;
-  bc->omgh = TALER_MERCHANT_merchant_order_get (SH_ctx,
-                                                SH_backend_url,
-                                                order_id,
-                                                NULL /* our payments are NOT session-bound */,
-                                                false,
-                                                timeout,
-                                                &check_payment_cb,
-                                                bc);
-  SH_trigger_curl ();
+  bc->merchant_start = GNUNET_TIME_absolute_get ();
+  bc->osr = SH_order_status_get (order_id,
+                                 timeout,
+                                 &check_payment_cb,
+                                 bc);
+}
+
+
+/**
+ * Bind the pre-created order @a order_id to the account of @a bc
+ * and immediately request payment for it.  If that fails, the
+ * order goes back into the pool.
+ *
+ * @param bc context to begin payment for
+ * @param order_id order from the pool
+ * @param token claim token of the order, NULL for none
+ * @param created when the order was created
+ * @return MHD status code
+ */
+static MHD_RESULT
+use_pooled_order (struct BackupContext *bc,
+                  const char *order_id,
+                  const struct TALER_ClaimTokenP *token,
+                  struct GNUNET_TIME_Absolute created)
+{
+  enum SYNC_DB_QueryStatus qs;
+  struct GNUNET_TIME_Absolute start;
+  struct MHD_Response *resp;
+  MHD_RESULT ret;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Storing payment request for pooled order `%s'\n",
+              order_id);
+  start = GNUNET_TIME_absolute_get ();
+  qs = db->store_payment_TR (db->cls,
+                             &bc->account,
+                             order_id,
+                             token,
+                             &SH_annual_fee);
+  SH_trace_db (SH_trace_current,
+               "store_payment",
+               start);
+  if (0 >= qs)
+  {
+    GNUNET_break (0);
+    SH_order_pool_return (order_id,
+                          token,
+                          created);
+    return TALER_MHD_reply_with_error (bc->con,
+                                       MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                       TALER_EC_GENERIC_DB_STORE_FAILED,
+                                       "Failed to persist payment request in sync database");
+  }
+  resp = SH_make_payment_request (order_id,
+                                  token);
+  GNUNET_assert (NULL != resp);
+  ret = MHD_queue_response (bc->con,
+                            MHD_HTTP_PAYMENT_REQUIRED,
+                            resp);
+  MHD_destroy_response (resp);
+  return ret;
 }
 
 
@@ -546,11 +643,16 @@ begin_payment (struct BackupContext *bc,
   if (! bc->force_fresh_order)
   {
     enum GNUNET_DB_QueryStatus qs;
+    struct GNUNET_TIME_Absolute start;
 
+    start = GNUNET_TIME_absolute_get ();
     qs = db->lookup_pending_payments_by_account_TR (db->cls,
                                                     &bc->account,
                                                     &ongoing_payment_cb,
                                                     bc);
+    SH_trace_db (SH_trace_current,
+                 "lookup_pending_payments",
+                 start);
     if (qs < 0)
     {
       struct MHD_Response *resp;
@@ -571,11 +673,42 @@ begin_payment (struct BackupContext *bc,
                   "Have existing order, waiting for `%s' to complete\n",
                   bc->existing_order_id);
       await_payment (bc,
-                     GNUNET_TIME_UNIT_ZERO /* no long polling */,
+                     bc->timeout,
                      bc->existing_order_id);
       return MHD_YES;
     }
   }
+  {
+    char *order_id;
+    struct TALER_ClaimTokenP token;
+    bool have_token;
+    struct GNUNET_TIME_Absolute created;
+
+    if (SH_order_pool_take (&order_id,
+                            &token,
+                            &have_token,
+                            &created))
+    {
+      MHD_RESULT ret;
+
+      ret = use_pooled_order (bc,
+                              order_id,
+                              have_token ? &token : NULL,
+                              created);
+      GNUNET_free (order_id);
+      return ret;
+    }
+  }
+  if (! SH_breaker_request_start (false))
+  {
+    /* fail fast instead of piling up suspended connections */
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Merchant backend unavailable, not creating order\n");
+    return TALER_MHD_reply_with_error (bc->con,
+                                       MHD_HTTP_BAD_GATEWAY,
+                                       TALER_EC_SYNC_PAYMENT_CREATE_BACKEND_ERROR,
+                                       "merchant backend unavailable");
+  }
   GNUNET_CONTAINER_DLL_insert (bc_head,
                                bc_tail,
                                bc);
@@ -590,6 +723,7 @@ begin_payment (struct BackupContext *bc,
                              "annual fee for sync service"),
     GNUNET_JSON_pack_string ("fulfillment_url",
                              SH_fulfillment_url));
+  bc->merchant_start = GNUNET_TIME_absolute_get ();
   bc->po = TALER_MERCHANT_orders_post2 (SH_ctx,
                                         SH_backend_url,
                                         order,
@@ -635,7 +769,11 @@ handle_database_error (struct BackupContext *bc,
                 "Conflict detected, returning existing backup\n");
     return SH_return_backup (bc->con,
                              &bc->account,
-                             MHD_HTTP_CONFLICT);
+                             MHD_HTTP_CONFLICT,
+                             bc->have_known_hash
+                             ? &bc->known_backup_hash
+                             : NULL,
+                             NULL);
   case SYNC_DB_PAYMENT_REQUIRED:
     {
       const char *order_id;
@@ -683,6 +821,43 @@ handle_database_error (struct BackupContext *bc,
 }
 
 
+/**
+ * Tell the client that it exceeded its upload rate limit.
+ *
+ * @param connection connection to reply on
+ * @param retry_after when may the client try again
+ * @return MHD result code
+ */
+static MHD_RESULT
+reply_rate_limited (struct MHD_Connection *connection,
+                    struct GNUNET_TIME_Relative retry_after)
+{
+  struct MHD_Response *resp;
+  MHD_RESULT ret;
+  char ra[32];
+
+  GNUNET_snprintf (ra,
+                   sizeof (ra),
+                   "%llu",
+                   (unsigned long long)
+                   (1 + retry_after.rel_value_us
+                    / GNUNET_TIME_UNIT_SECONDS.rel_value_us));
+  resp = MHD_create_response_from_buffer (0,
+                                          NULL,
+                                          MHD_RESPMEM_PERSISTENT);
+  TALER_MHD_add_global_headers (resp);
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         MHD_HTTP_HEADER_RETRY_AFTER,
+                                         ra));
+  ret = MHD_queue_response (connection,
+                            MHD_HTTP_TOO_MANY_REQUESTS,
+                            resp);
+  MHD_destroy_response (resp);
+  return ret;
+}
+
+
 /**
  * Handle a client POSTing a backup to us.
  *
@@ -720,6 +895,41 @@ SH_backup_post (struct MHD_Connection *connection,
         bc->force_fresh_order = true;
     }
     *con_cls = bc;
+    if (! GNUNET_TIME_relative_is_zero (SH_limits.upload_timeout))
+    {
+      /* uploads from slow (mobile) clients may need more time
+         than other requests */
+      GNUNET_break (MHD_YES ==
+                    MHD_set_connection_option (
+                      connection,
+                      MHD_CONNECTION_OPTION_TIMEOUT,
+                      (unsigned int) (SH_limits.upload_timeout.rel_value_us
+                                      / GNUNET_TIME_UNIT_SECONDS.rel_value_us)));
+    }
+    if (GNUNET_OK !=
+        SH_parse_timeout_ms (connection,
+                             &bc->timeout))
+    {
+      GNUNET_break_op (0);
+      return TALER_MHD_reply_with_error (connection,
+                                         MHD_HTTP_BAD_REQUEST,
+                                         TALER_EC_GENERIC_PARAMETER_MALFORMED,
+                                         "timeout_ms");
+    }
+    {
+      const union MHD_ConnectionInfo *ci;
+      struct GNUNET_TIME_Relative retry_after;
+
+      /* check before we allocate a buffer for the upload */
+      ci = MHD_get_connection_info (connection,
+                                    MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+      if (! SH_ratelimit_check_ip ((NULL == ci)
+                                   ? NULL
+                                   : ci->client_addr,
+                                   &retry_after))
+        return reply_rate_limited (connection,
+                                   retry_after);
+    }
 
     /* now setup 'bc' */
     {
@@ -752,17 +962,9 @@ SH_backup_post (struct MHD_Connection *connection,
                                            TALER_EC_SYNC_EXCESSIVE_CONTENT_LENGTH,
                                            NULL);
       }
-      bc->upload = GNUNET_malloc_large (len);
-      if (NULL == bc->upload)
-      {
-        GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
-                             "malloc");
-        return TALER_MHD_reply_with_error (connection,
-                                           MHD_HTTP_PAYLOAD_TOO_LARGE,
-                                           TALER_EC_SYNC_OUT_OF_MEMORY_ON_CONTENT_LENGTH,
-                                           NULL);
-      }
       bc->upload_size = (size_t) len;
+      SH_trace_body_size (SH_trace_current,
+                          bc->upload_size);
     }
     {
       const char *im;
@@ -832,6 +1034,29 @@ SH_backup_post (struct MHD_Connection *connection,
                                            NULL);
       }
     }
+    {
+      const char *kh;
+
+      kh = MHD_lookup_connection_value (connection,
+                                        MHD_HEADER_KIND,
+                                        "Sync-Known-Hash");
+      if (NULL != kh)
+      {
+        if (GNUNET_OK !=
+            GNUNET_STRINGS_string_to_data (kh,
+                                           strlen (kh),
+                                           &bc->known_backup_hash,
+                                           sizeof (bc->known_backup_hash)))
+        {
+          GNUNET_break_op (0);
+          return TALER_MHD_reply_with_error (connection,
+                                             MHD_HTTP_BAD_REQUEST,
+                                             TALER_EC_GENERIC_PARAMETER_MALFORMED,
+                                             "Sync-Known-Hash");
+        }
+        bc->have_known_hash = true;
+      }
+    }
     /* validate signature */
     {
       struct SYNC_UploadSignaturePS usp = {
@@ -854,6 +1079,18 @@ SH_backup_post (struct MHD_Connection *connection,
                                            NULL);
       }
     }
+    SH_trace_stage (SH_trace_current,
+                    "signature_verified");
+    {
+      struct GNUNET_TIME_Relative retry_after;
+
+      /* only now, as otherwise anyone could use up the
+         uploads of the account */
+      if (! SH_ratelimit_check_account (account,
+                                        &retry_after))
+        return reply_rate_limited (connection,
+                                   retry_after);
+    }
     /* get ready to hash (done here as we may go async for payments next) */
     bc->hash_ctx = GNUNET_CRYPTO_hash_context_start ();
 
@@ -861,10 +1098,19 @@ SH_backup_post (struct MHD_Connection *connection,
     {
       struct GNUNET_HashCode hc;
       enum SYNC_DB_QueryStatus qs;
+      struct GNUNET_TIME_Absolute start;
 
+      start = GNUNET_TIME_absolute_get ();
+      /* A lagging replica can only make us accept an upload
+         that the (conditional) update on the primary rejects
+         later, so it is fine to check against the replica here. */
       qs = db->lookup_account_TR (db->cls,
                                   account,
+                                  &bc->old_backup_hash,
                                   &hc);
+      SH_trace_db (SH_trace_current,
+                   "lookup_account",
+                   start);
       if (qs < 0)
         return handle_database_error (bc,
                                       qs);
@@ -896,9 +1142,27 @@ SH_backup_post (struct MHD_Connection *connection,
                     "Conflict detected, returning existing backup\n");
         return SH_return_backup (connection,
                                  account,
-                                 MHD_HTTP_CONFLICT);
+                                 MHD_HTTP_CONFLICT,
+                                 bc->have_known_hash
+                                 ? &bc->known_backup_hash
+                                 : NULL,
+                                 &hc);
       }
     }
+    /* Preconditions hold, only now allocate the buffer.  As we did
+       not queue a response so far, MHD will only now send a
+       "100 Continue" to clients that asked for it with "Expect". */
+    bc->upload = GNUNET_malloc_large (bc->upload_size);
+    if ( (NULL == bc->upload) &&
+         (0 != bc->upload_size) )
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "malloc");
+      return TALER_MHD_reply_with_error (connection,
+                                         MHD_HTTP_PAYLOAD_TOO_LARGE,
+                                         TALER_EC_SYNC_OUT_OF_MEMORY_ON_CONTENT_LENGTH,
+                                         NULL);
+    }
     /* check if the client insists on paying */
     {
       const char *order_req;
@@ -960,12 +1224,16 @@ SH_backup_post (struct MHD_Connection *connection,
   }
 
   /* finished with upload, check hash */
+  SH_trace_stage (SH_trace_current,
+                  "body_received");
   {
     struct GNUNET_HashCode our_hash;
 
     GNUNET_CRYPTO_hash_context_finish (bc->hash_ctx,
                                        &our_hash);
     bc->hash_ctx = NULL;
+    SH_trace_stage (SH_trace_current,
+                    "hash_finished");
     if (0 != GNUNET_memcmp (&our_hash,
                             &bc->new_backup_hash))
     {
@@ -980,7 +1248,9 @@ SH_backup_post (struct MHD_Connection *connection,
   /* store backup to database */
   {
     enum SYNC_DB_QueryStatus qs;
+    struct GNUNET_TIME_Absolute start;
 
+    start = GNUNET_TIME_absolute_get ();
     if (GNUNET_YES == GNUNET_is_zero (&bc->old_backup_hash))
     {
       GNUNET_log (GNUNET_ERROR_TYPE_INFO,
@@ -1004,6 +1274,9 @@ SH_backup_post (struct MHD_Connection *connection,
                                  bc->upload_size,
                                  bc->upload);
     }
+    SH_trace_db (SH_trace_current,
+                 "store_backup",
+                 start);
     if (qs < 0)
       return handle_database_error (bc,
                                     qs);
@@ -1033,6 +1306,8 @@ SH_backup_post (struct MHD_Connection *connection,
     struct MHD_Response *resp;
     MHD_RESULT ret;
 
+    SH_trace_stage (SH_trace_current,
+                    "response_queued");
     resp = MHD_create_response_from_buffer (0,
                                             NULL,
                                             MHD_RESPMEM_PERSISTENT);
@@ -0,0 +1,295 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_breaker.c
+ * @brief circuit breaker for requests to the merchant backend
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <microhttpd.h>
+#include "sync-httpd_breaker.h"
+
+
+/**
+ * States of the circuit breaker.
+ */
+enum BreakerState
+{
+  /**
+   * Backend is healthy, requests pass.
+   */
+  BS_CLOSED = 0,
+
+  /**
+   * Backend failed repeatedly, requests fail fast.
+   */
+  BS_OPEN,
+
+  /**
+   * Retry delay expired, one probe request may pass.
+   */
+  BS_HALF_OPEN
+};
+
+
+/**
+ * Current state of the breaker.
+ */
+static enum BreakerState state;
+
+/**
+ * Until when do we fail requests if @e state is #BS_OPEN?
+ */
+static struct GNUNET_TIME_Absolute open_until;
+
+/**
+ * How long do we fail requests after the breaker opened?
+ */
+static struct GNUNET_TIME_Relative retry_delay;
+
+/**
+ * Number of consecutive failed requests.
+ */
+static unsigned long long failures;
+
+/**
+ * After how many consecutive failures do we open the breaker?
+ */
+static unsigned long long failure_threshold;
+
+/**
+ * Number of requests (other than long polls) that are running.
+ */
+static unsigned long long active;
+
+/**
+ * Maximum value for #active, 0 for no limit.
+ */
+static unsigned long long max_active;
+
+/**
+ * Number of long polls that are running.
+ */
+static unsigned long long active_long_polls;
+
+/**
+ * Maximum value for #active_long_polls, 0 for no limit.
+ */
+static unsigned long long max_long_polls;
+
+/**
+ * Is a probe request running while #BS_HALF_OPEN?
+ */
+static bool probe_running;
+
+
+/**
+ * Read number @a option from the "[sync]" section of @a cfg,
+ * leaving @a val unchanged if the option is not set.
+ *
+ * @param cfg configuration to use
+ * @param option name of the option
+ * @param[in,out] val where to store the value
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+load_number (const struct GNUNET_CONFIGURATION_Handle *cfg,
+             const char *option,
+             unsigned long long *val)
+{
+  if (GNUNET_YES !=
+      GNUNET_CONFIGURATION_have_value (cfg,
+                                       "sync",
+                                       option))
+    return GNUNET_OK;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "sync",
+                                             option,
+                                             val))
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "sync",
+                               option,
+                               "must be a number");
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+enum GNUNET_GenericReturnValue
+SH_breaker_init (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  failure_threshold = 5;
+  max_active = 0;
+  max_long_polls = 0;
+  retry_delay = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS,
+                                               30);
+  if ( (GNUNET_OK !=
+        load_number (cfg,
+                     "MERCHANT_FAILURE_THRESHOLD",
+                     &failure_threshold)) ||
+       (GNUNET_OK !=
+        load_number (cfg,
+                     "MERCHANT_MAX_REQUESTS",
+                     &max_active)) ||
+       (GNUNET_OK !=
+        load_number (cfg,
+                     "MERCHANT_MAX_LONG_POLLS",
+                     &max_long_polls)) )
+    return GNUNET_SYSERR;
+  if ( (GNUNET_YES ==
+        GNUNET_CONFIGURATION_have_value (cfg,
+                                         "sync",
+                                         "MERCHANT_RETRY_DELAY")) &&
+       (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_time (cfg,
+                                             "sync",
+                                             "MERCHANT_RETRY_DELAY",
+                                             &retry_delay)) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "sync",
+                               "MERCHANT_RETRY_DELAY",
+                               "must be a relative time");
+    return GNUNET_SYSERR;
+  }
+  if (0 == failure_threshold)
+    failure_threshold = 1;
+  return GNUNET_OK;
+}
+
+
+bool
+SH_breaker_request_start (bool long_poll)
+{
+  if ( (BS_OPEN == state) &&
+       GNUNET_TIME_absolute_is_past (open_until) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Probing merchant backend\n");
+    state = BS_HALF_OPEN;
+  }
+  switch (state)
+  {
+  case BS_CLOSED:
+    break;
+  case BS_OPEN:
+    return false;
+  case BS_HALF_OPEN:
+    if ( (long_poll) ||
+         (probe_running) )
+      return false;
+    probe_running = true;
+    break;
+  }
+  if (long_poll)
+  {
+    /* long polls are mostly idle, so they have their own limit */
+    if ( (0 != max_long_polls) &&
+         (active_long_polls >= max_long_polls) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Too many concurrent long polls at merchant backend (%llu)\n",
+                  active_long_polls);
+      return false;
+    }
+    active_long_polls++;
+    return true;
+  }
+  if ( (0 != max_active) &&
+       (active >= max_active) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Too many concurrent requests to merchant backend (%llu)\n",
+                active);
+    if (BS_HALF_OPEN == state)
+      probe_running = false;
+    return false;
+  }
+  active++;
+  return true;
+}
+
+
+void
+SH_breaker_request_done (bool long_poll,
+                         unsigned int http_status)
+{
+  bool failed = ( (0 == http_status) ||
+                  (http_status >= MHD_HTTP_INTERNAL_SERVER_ERROR) );
+
+  if (long_poll)
+  {
+    GNUNET_assert (active_long_polls > 0);
+    active_long_polls--;
+  }
+  else
+  {
+    GNUNET_assert (active > 0);
+    active--;
+  }
+  if (! failed)
+  {
+    if (BS_CLOSED != state)
+      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                  "Merchant backend is back\n");
+    state = BS_CLOSED;
+    probe_running = false;
+    failures = 0;
+    return;
+  }
+  failures++;
+  if ( (BS_HALF_OPEN == state) ||
+       ( (BS_CLOSED == state) &&
+         (failures >= failure_threshold) ) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Merchant backend failed %llu times in a row (last status: %u), failing requests for %s\n",
+                failures,
+                http_status,
+                GNUNET_TIME_relative2s (retry_delay,
+                                        true));
+    state = BS_OPEN;
+    probe_running = false;
+    open_until = GNUNET_TIME_relative_to_absolute (retry_delay);
+  }
+}
+
+
+void
+SH_breaker_request_cancel (bool long_poll)
+{
+  if (long_poll)
+  {
+    GNUNET_assert (active_long_polls > 0);
+    active_long_polls--;
+  }
+  else
+  {
+    GNUNET_assert (active > 0);
+    active--;
+  }
+  /* let another request probe the backend */
+  if ( (BS_HALF_OPEN == state) &&
+       (! long_poll) )
+    probe_running = false;
+}
+
+
+/* end of sync-httpd_breaker.c */
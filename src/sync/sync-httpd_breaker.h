@@ -0,0 +1,75 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_breaker.h
+ * @brief circuit breaker for requests to the merchant backend
+ * @author Christian Grothoff
+ */
+#ifndef SYNC_HTTPD_BREAKER_H
+#define SYNC_HTTPD_BREAKER_H
+
+#include <gnunet/gnunet_util_lib.h>
+
+
+/**
+ * Initialize the circuit breaker based on the "MERCHANT_MAX_REQUESTS",
+ * "MERCHANT_MAX_LONG_POLLS", "MERCHANT_FAILURE_THRESHOLD" and
+ * "MERCHANT_RETRY_DELAY" options in the "[sync]" section of @a cfg.
+ *
+ * @param cfg configuration to use
+ * @return #GNUNET_OK on success
+ */
+enum GNUNET_GenericReturnValue
+SH_breaker_init (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Check if we may send a request to the merchant backend.  If
+ * this returns true, the caller must later call either
+ * #SH_breaker_request_done() or #SH_breaker_request_cancel().
+ *
+ * @param long_poll true if the request is a long poll; long polls
+ *        count against their own limit on concurrent requests
+ *        and are never used to probe the backend
+ * @return false if the backend is considered down or too busy,
+ *         so the caller should fail the request right away
+ */
+bool
+SH_breaker_request_start (bool long_poll);
+
+
+/**
+ * A request to the merchant backend completed.
+ *
+ * @param long_poll value given to #SH_breaker_request_start()
+ * @param http_status HTTP status returned by the backend, 0 if
+ *        it did not respond
+ */
+void
+SH_breaker_request_done (bool long_poll,
+                         unsigned int http_status);
+
+
+/**
+ * A request to the merchant backend was cancelled.
+ *
+ * @param long_poll value given to #SH_breaker_request_start()
+ */
+void
+SH_breaker_request_cancel (bool long_poll);
+
+
+#endif
@@ -29,6 +29,15 @@
  * 0: original design
  * 1: adds ?fresh=y to POST backup operation to force fresh contract
  *    to be created
+ * 3: adds POST /backups:batch-get to download multiple backups
+ *    in one request
+ * 4: adds long polling for payments, via ?timeout_ms= on POST
+ *    /backups/$ACCOUNT and GET /backups/$ACCOUNT/payment, which
+ *    returns 200 once paid and 204 if no payment is pending
+ * 5: adds the Sync-Known-Hash header to POST /backups/$ACCOUNT,
+ *    omitting the body of a 409 reply if the client has the backup
+ * 6: adds GET /backups/$ACCOUNT/versions/$HASH to download previous
+ *    versions of a backup, if the provider keeps a history
  */
 
 /**
@@ -61,7 +70,7 @@ SH_handler_config (struct SH_RequestHandler *rh,
     TALER_JSON_pack_amount ("annual_fee",
                             &SH_annual_fee),
     GNUNET_JSON_pack_string ("version",
-                             "2:0:0"));
+                             "6:0:4"));
 }
 
 
@@ -0,0 +1,376 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_order_pool.c
+ * @brief pool of pre-created orders for the annual fee
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "sync-httpd.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <taler/taler_json_lib.h>
+#include <taler/taler_merchant_service.h>
+#include "sync-httpd_breaker.h"
+#include "sync-httpd_order_pool.h"
+#include "sync-httpd_trace.h"
+
+
+/**
+ * How long do we keep orders in the pool?  Orders older than
+ * this are discarded, as the merchant backend may consider them
+ * expired by the time the client gets to pay.
+ */
+#define MAX_ORDER_AGE GNUNET_TIME_UNIT_HOURS
+
+
+/**
+ * Order in the pool.
+ */
+struct PoolEntry
+{
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PoolEntry *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PoolEntry *prev;
+
+  /**
+   * ID of the order.
+   */
+  char *order_id;
+
+  /**
+   * Claim token of the order, only valid if @e have_token.
+   */
+  struct TALER_ClaimTokenP token;
+
+  /**
+   * When was the order created?
+   */
+  struct GNUNET_TIME_Absolute created;
+
+  /**
+   * Did the merchant give us a claim token?
+   */
+  bool have_token;
+};
+
+
+/**
+ * Head of the pool, oldest order first.
+ */
+static struct PoolEntry *pool_head;
+
+/**
+ * Tail of the pool, newest order last.
+ */
+static struct PoolEntry *pool_tail;
+
+/**
+ * Number of orders in the pool.
+ */
+static unsigned long long pool_length;
+
+/**
+ * Number of orders we try to keep in the pool, 0 if disabled.
+ */
+static unsigned long long pool_size;
+
+/**
+ * Request to create an order for the pool, NULL if none is running.
+ */
+static struct TALER_MERCHANT_PostOrdersHandle *po;
+
+/**
+ * When did we start #po?
+ */
+static struct GNUNET_TIME_Absolute po_start;
+
+/**
+ * Task to retry filling the pool after a failure.
+ */
+static struct GNUNET_SCHEDULER_Task *retry_task;
+
+/**
+ * How long do we wait after a failure to create an order?
+ */
+static struct GNUNET_TIME_Relative retry_backoff;
+
+
+/**
+ * Free pool entry @a pe, removing it from the pool.
+ *
+ * @param[in] pe entry to free
+ */
+static void
+free_entry (struct PoolEntry *pe)
+{
+  GNUNET_CONTAINER_DLL_remove (pool_head,
+                               pool_tail,
+                               pe);
+  pool_length--;
+  GNUNET_free (pe->order_id);
+  GNUNET_free (pe);
+}
+
+
+/**
+ * Start filling the pool, if it is not full and we are
+ * not already doing so.
+ */
+static void
+fill_pool (void);
+
+
+/**
+ * Task run to retry filling the pool.
+ *
+ * @param cls NULL
+ */
+static void
+retry_fill (void *cls)
+{
+  (void) cls;
+  retry_task = NULL;
+  fill_pool ();
+}
+
+
+/**
+ * Callback with the result of creating an order for the pool.
+ *
+ * @param cls NULL
+ * @param por response details
+ */
+static void
+pool_order_cb (void *cls,
+               const struct TALER_MERCHANT_PostOrdersReply *por)
+{
+  struct PoolEntry *pe;
+
+  (void) cls;
+  po = NULL;
+  SH_trace_merchant (NULL,
+                     "pool_order",
+                     po_start,
+                     por->hr.http_status);
+  SH_breaker_request_done (false,
+                           por->hr.http_status);
+  if (MHD_HTTP_OK != por->hr.http_status)
+  {
+    retry_backoff = GNUNET_TIME_STD_BACKOFF (retry_backoff);
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Failed to create order for pool: %u/%u, retrying in %s\n",
+                por->hr.http_status,
+                (unsigned int) por->hr.ec,
+                GNUNET_TIME_relative2s (retry_backoff,
+                                        true));
+    retry_task = GNUNET_SCHEDULER_add_delayed (retry_backoff,
+                                               &retry_fill,
+                                               NULL);
+    return;
+  }
+  retry_backoff = GNUNET_TIME_UNIT_ZERO;
+  pe = GNUNET_new (struct PoolEntry);
+  pe->order_id = GNUNET_strdup (por->details.ok.order_id);
+  pe->created = GNUNET_TIME_absolute_get ();
+  if (NULL != por->details.ok.token)
+  {
+    pe->token = *por->details.ok.token;
+    pe->have_token = true;
+  }
+  GNUNET_CONTAINER_DLL_insert_tail (pool_head,
+                                    pool_tail,
+                                    pe);
+  pool_length++;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Added order `%s' to pool (%llu/%llu)\n",
+              pe->order_id,
+              pool_length,
+              pool_size);
+  fill_pool ();
+}
+
+
+static void
+fill_pool (void)
+{
+  static const char *no_uuids[1] = { NULL };
+  json_t *order;
+
+  if ( (NULL != po) ||
+       (NULL != retry_task) ||
+       (pool_length >= pool_size) )
+    return;
+  if (! SH_breaker_request_start (false))
+  {
+    /* backend down or busy, client requests take precedence */
+    retry_backoff = GNUNET_TIME_STD_BACKOFF (retry_backoff);
+    retry_task = GNUNET_SCHEDULER_add_delayed (retry_backoff,
+                                               &retry_fill,
+                                               NULL);
+    return;
+  }
+  order = GNUNET_JSON_PACK (
+    TALER_JSON_pack_amount ("amount",
+                            &SH_annual_fee),
+    GNUNET_JSON_pack_string ("summary",
+                             "annual fee for sync service"),
+    GNUNET_JSON_pack_string ("fulfillment_url",
+                             SH_fulfillment_url));
+  po_start = GNUNET_TIME_absolute_get ();
+  po = TALER_MERCHANT_orders_post2 (SH_ctx,
+                                    SH_backend_url,
+                                    order,
+                                    GNUNET_TIME_UNIT_ZERO,
+                                    NULL, /* no payment target */
+                                    0,
+                                    NULL, /* no inventory products */
+                                    0,
+                                    no_uuids, /* no uuids */
+                                    false, /* do NOT require claim token */
+                                    &pool_order_cb,
+                                    NULL);
+  json_decref (order);
+  if (NULL == po)
+  {
+    GNUNET_break (0);
+    SH_breaker_request_cancel (false);
+    retry_backoff = GNUNET_TIME_STD_BACKOFF (retry_backoff);
+    retry_task = GNUNET_SCHEDULER_add_delayed (retry_backoff,
+                                               &retry_fill,
+                                               NULL);
+    return;
+  }
+  SH_trigger_curl ();
+}
+
+
+enum GNUNET_GenericReturnValue
+SH_order_pool_init (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  if (GNUNET_YES !=
+      GNUNET_CONFIGURATION_have_value (cfg,
+                                       "sync",
+                                       "ORDER_POOL_SIZE"))
+    return GNUNET_OK;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "sync",
+                                             "ORDER_POOL_SIZE",
+                                             &pool_size))
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "sync",
+                               "ORDER_POOL_SIZE",
+                               "must be a number");
+    return GNUNET_SYSERR;
+  }
+  fill_pool ();
+  return GNUNET_OK;
+}
+
+
+void
+SH_order_pool_done (void)
+{
+  if (NULL != po)
+  {
+    TALER_MERCHANT_orders_post_cancel (po);
+    SH_breaker_request_cancel (false);
+    po = NULL;
+  }
+  if (NULL != retry_task)
+  {
+    GNUNET_SCHEDULER_cancel (retry_task);
+    retry_task = NULL;
+  }
+  while (NULL != pool_head)
+    free_entry (pool_head);
+  pool_size = 0;
+}
+
+
+bool
+SH_order_pool_take (char **order_id,
+                    struct TALER_ClaimTokenP *token,
+                    bool *have_token,
+                    struct GNUNET_TIME_Absolute *created)
+{
+  struct PoolEntry *pe;
+
+  /* discard orders that are too old */
+  while ( (NULL != (pe = pool_head)) &&
+          GNUNET_TIME_relative_cmp (GNUNET_TIME_absolute_get_duration (
+                                      pe->created),
+                                    >,
+                                    MAX_ORDER_AGE) )
+    free_entry (pe);
+  pe = pool_head;
+  if (NULL == pe)
+  {
+    fill_pool ();
+    return false;
+  }
+  /* hand out the oldest order first, so orders are used before
+     they get too old */
+  *order_id = pe->order_id;
+  pe->order_id = NULL;
+  *token = pe->token;
+  *have_token = pe->have_token;
+  *created = pe->created;
+  free_entry (pe);
+  fill_pool ();
+  return true;
+}
+
+
+void
+SH_order_pool_return (const char *order_id,
+                      const struct TALER_ClaimTokenP *token,
+                      struct GNUNET_TIME_Absolute created)
+{
+  struct PoolEntry *pe;
+
+  if (0 == pool_size)
+    return; /* pool disabled or shut down */
+  pe = GNUNET_new (struct PoolEntry);
+  pe->order_id = GNUNET_strdup (order_id);
+  pe->created = created;
+  if (NULL != token)
+  {
+    pe->token = *token;
+    pe->have_token = true;
+  }
+  /* it is at least as old as any order we created since */
+  GNUNET_CONTAINER_DLL_insert (pool_head,
+                               pool_tail,
+                               pe);
+  pool_length++;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Returned order `%s' to pool (%llu/%llu)\n",
+              pe->order_id,
+              pool_length,
+              pool_size);
+}
+
+
+/* end of sync-httpd_order_pool.c */
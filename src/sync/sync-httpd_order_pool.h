@@ -0,0 +1,81 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_order_pool.h
+ * @brief pool of pre-created orders for the annual fee
+ * @author Christian Grothoff
+ */
+#ifndef SYNC_HTTPD_ORDER_POOL_H
+#define SYNC_HTTPD_ORDER_POOL_H
+
+#include <gnunet/gnunet_util_lib.h>
+#include <taler/taler_util.h>
+
+
+/**
+ * Initialize the order pool based on the "ORDER_POOL_SIZE" option
+ * in the "[sync]" section of @a cfg, and start filling it.
+ * Must be called after #SH_ctx has been initialized.
+ *
+ * @param cfg configuration to use
+ * @return #GNUNET_OK on success (including if the pool is disabled)
+ */
+enum GNUNET_GenericReturnValue
+SH_order_pool_init (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Shutdown the order pool, cancelling pending requests to
+ * the merchant backend.
+ */
+void
+SH_order_pool_done (void);
+
+
+/**
+ * Take an order for the annual fee out of the pool.  Triggers
+ * refilling the pool in the background.
+ *
+ * @param[out] order_id set to the ID of the order, to be freed
+ *        by the caller
+ * @param[out] token set to the claim token of the order
+ * @param[out] have_token set to true if @a token was set
+ * @param[out] created set to when the order was created
+ * @return true if we got an order, false if the pool is empty
+ *         (or disabled)
+ */
+bool
+SH_order_pool_take (char **order_id,
+                    struct TALER_ClaimTokenP *token,
+                    bool *have_token,
+                    struct GNUNET_TIME_Absolute *created);
+
+
+/**
+ * Put an order we took with #SH_order_pool_take() but could
+ * not use back into the pool.
+ *
+ * @param order_id ID of the order
+ * @param token claim token of the order, NULL for none
+ * @param created when the order was created
+ */
+void
+SH_order_pool_return (const char *order_id,
+                      const struct TALER_ClaimTokenP *token,
+                      struct GNUNET_TIME_Absolute created);
+
+
+#endif
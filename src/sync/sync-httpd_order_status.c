@@ -0,0 +1,551 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_order_status.c
+ * @brief cache for the status of orders at the merchant backend
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "sync-httpd.h"
+#include <gnunet/gnunet_util_lib.h>
+#include "sync-httpd_breaker.h"
+#include "sync-httpd_order_status.h"
+
+
+/**
+ * How long do we consider the status of an order fresh?
+ */
+#define CACHE_TTL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
+/**
+ * If a request has less than this much time left when a poll
+ * returns an unpaid order, we return that status instead of
+ * polling again.
+ */
+#define MIN_REPOLL GNUNET_TIME_UNIT_SECONDS
+
+
+struct Entry;
+struct Poll;
+
+
+/**
+ * Request for the status of an order.
+ */
+struct SH_OrderStatusRequest
+{
+
+  /**
+   * Kept in a DLL per poll.
+   */
+  struct SH_OrderStatusRequest *next;
+
+  /**
+   * Kept in a DLL per poll.
+   */
+  struct SH_OrderStatusRequest *prev;
+
+  /**
+   * Poll we are waiting on, NULL if answered from the cache.
+   */
+  struct Poll *poll;
+
+  /**
+   * Function to call with the result.
+   */
+  SH_OrderStatusCallback cb;
+
+  /**
+   * Closure for @e cb.
+   */
+  void *cb_cls;
+
+  /**
+   * Task returning a cached result, NULL if none.
+   */
+  struct GNUNET_SCHEDULER_Task *task;
+
+  /**
+   * Cached result to return from @e task.
+   */
+  struct SH_OrderStatus os;
+
+  /**
+   * When does the request time out?
+   */
+  struct GNUNET_TIME_Absolute deadline;
+
+};
+
+
+/**
+ * Request to the merchant backend for the status of an order.
+ */
+struct Poll
+{
+
+  /**
+   * Kept in a DLL per entry.
+   */
+  struct Poll *next;
+
+  /**
+   * Kept in a DLL per entry.
+   */
+  struct Poll *prev;
+
+  /**
+   * Entry this poll is for.
+   */
+  struct Entry *e;
+
+  /**
+   * Requests waiting for this poll.
+   */
+  struct SH_OrderStatusRequest *r_head;
+
+  /**
+   * Requests waiting for this poll.
+   */
+  struct SH_OrderStatusRequest *r_tail;
+
+  /**
+   * Request to the merchant backend.
+   */
+  struct TALER_MERCHANT_OrderMerchantGetHandle *omgh;
+
+  /**
+   * When does the merchant backend stop long-polling?
+   */
+  struct GNUNET_TIME_Absolute deadline;
+
+  /**
+   * Is this a long poll?
+   */
+  bool long_poll;
+
+};
+
+
+/**
+ * Cache entry for an order.
+ */
+struct Entry
+{
+
+  /**
+   * Polls running for this order.
+   */
+  struct Poll *p_head;
+
+  /**
+   * Polls running for this order.
+   */
+  struct Poll *p_tail;
+
+  /**
+   * Task to remove the entry once the cached status expired.
+   */
+  struct GNUNET_SCHEDULER_Task *gc_task;
+
+  /**
+   * ID of the order.
+   */
+  char *order_id;
+
+  /**
+   * Key of the entry in #entries.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Last status we got, only valid if @e expiration is in the future.
+   */
+  struct SH_OrderStatus cached;
+
+  /**
+   * When does @e cached expire?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+};
+
+
+/**
+ * Map from hashes of order IDs to `struct Entry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *entries;
+
+
+/**
+ * Free entry @a e.
+ *
+ * @param[in] e entry without polls to free
+ */
+static void
+free_entry (struct Entry *e)
+{
+  GNUNET_assert (NULL == e->p_head);
+  if (NULL != e->gc_task)
+  {
+    GNUNET_SCHEDULER_cancel (e->gc_task);
+    e->gc_task = NULL;
+  }
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (entries,
+                                                       &e->key,
+                                                       e));
+  GNUNET_free (e->order_id);
+  GNUNET_free (e);
+}
+
+
+/**
+ * Free entry @a e if it is no longer needed, otherwise
+ * make sure it is freed once it is no longer needed.
+ *
+ * @param e entry to check
+ */
+static void
+maybe_gc (struct Entry *e);
+
+
+/**
+ * Task run to check if an entry is still needed.
+ *
+ * @param cls a `struct Entry`
+ */
+static void
+gc_entry (void *cls)
+{
+  struct Entry *e = cls;
+
+  e->gc_task = NULL;
+  maybe_gc (e);
+}
+
+
+static void
+maybe_gc (struct Entry *e)
+{
+  if (NULL != e->p_head)
+    return;
+  if (GNUNET_TIME_absolute_is_past (e->expiration))
+  {
+    free_entry (e);
+    return;
+  }
+  if (NULL == e->gc_task)
+    e->gc_task = GNUNET_SCHEDULER_add_at (e->expiration,
+                                          &gc_entry,
+                                          e);
+}
+
+
+/**
+ * Task returning a cached order status.
+ *
+ * @param cls a `struct SH_OrderStatusRequest`
+ */
+static void
+return_cached (void *cls)
+{
+  struct SH_OrderStatusRequest *r = cls;
+
+  r->task = NULL;
+  r->cb (r->cb_cls,
+         &r->os);
+  GNUNET_free (r);
+}
+
+
+/**
+ * Status we return if the merchant backend is considered down.
+ */
+static const struct SH_OrderStatus backend_down = {
+  .http_status = MHD_HTTP_BAD_GATEWAY,
+  .ec = TALER_EC_SYNC_GENERIC_BACKEND_ERROR
+};
+
+
+/**
+ * Have request @a r wait for a poll of entry @a e, starting
+ * a new poll if no suitable poll is running.
+ *
+ * @param e entry to poll
+ * @param r request to wait
+ * @return false if we cannot poll as the merchant backend
+ *         is considered down
+ */
+static bool
+join_poll (struct Entry *e,
+           struct SH_OrderStatusRequest *r);
+
+
+/**
+ * Callback with the result of a poll.
+ *
+ * @param cls a `struct Poll`
+ * @param osr order status returned by the merchant backend
+ */
+static void
+poll_cb (void *cls,
+         const struct TALER_MERCHANT_OrderStatusResponse *osr)
+{
+  struct Poll *p = cls;
+  struct Entry *e = p->e;
+  struct SH_OrderStatusRequest *r;
+  struct SH_OrderStatus os = {
+    .http_status = osr->hr.http_status,
+    .ec = osr->hr.ec,
+    .reply = osr->hr.reply
+  };
+
+  p->omgh = NULL;
+  SH_breaker_request_done (p->long_poll,
+                           os.http_status);
+  GNUNET_CONTAINER_DLL_remove (e->p_head,
+                               e->p_tail,
+                               p);
+  if (MHD_HTTP_OK == os.http_status)
+  {
+    os.status = osr->details.ok.status;
+    os.reply = NULL;
+    e->cached = os;
+    e->expiration = GNUNET_TIME_relative_to_absolute (CACHE_TTL);
+  }
+  while (NULL != (r = p->r_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (p->r_head,
+                                 p->r_tail,
+                                 r);
+    r->poll = NULL;
+    if ( (MHD_HTTP_OK == os.http_status) &&
+         (TALER_MERCHANT_OSC_PAID != os.status) &&
+         (GNUNET_TIME_relative_cmp (GNUNET_TIME_absolute_get_remaining (
+                                      r->deadline),
+                                    >,
+                                    MIN_REPOLL)) )
+    {
+      /* not paid yet, but the client is willing to wait longer */
+      if (join_poll (e,
+                     r))
+        continue;
+      r->cb (r->cb_cls,
+             &backend_down);
+      GNUNET_free (r);
+      continue;
+    }
+    r->cb (r->cb_cls,
+           &os);
+    GNUNET_free (r);
+  }
+  GNUNET_free (p);
+  maybe_gc (e);
+}
+
+
+static bool
+join_poll (struct Entry *e,
+           struct SH_OrderStatusRequest *r)
+{
+  struct Poll *best = NULL;
+
+  /* join the poll that returns last, but not after the deadline */
+  for (struct Poll *p = e->p_head; NULL != p; p = p->next)
+  {
+    if (GNUNET_TIME_absolute_cmp (p->deadline,
+                                  >,
+                                  r->deadline))
+      continue;
+    if ( (NULL == best) ||
+         (GNUNET_TIME_absolute_cmp (p->deadline,
+                                    >,
+                                    best->deadline)) )
+      best = p;
+  }
+  if (NULL == best)
+  {
+    struct GNUNET_TIME_Relative timeout
+      = GNUNET_TIME_absolute_get_remaining (r->deadline);
+    bool long_poll = ! GNUNET_TIME_relative_is_zero (timeout);
+
+    if (! SH_breaker_request_start (long_poll))
+      return false;
+    best = GNUNET_new (struct Poll);
+    best->e = e;
+    best->deadline = r->deadline;
+    best->long_poll = long_poll;
+    best->omgh = TALER_MERCHANT_merchant_order_get (
+      SH_ctx,
+      SH_backend_url,
+      e->order_id,
+      NULL /* our payments are NOT session-bound */,
+      false,
+      timeout,
+      &poll_cb,
+      best);
+    GNUNET_assert (NULL != best->omgh);
+    GNUNET_CONTAINER_DLL_insert (e->p_head,
+                                 e->p_tail,
+                                 best);
+    SH_trigger_curl ();
+  }
+  r->poll = best;
+  GNUNET_CONTAINER_DLL_insert (best->r_head,
+                               best->r_tail,
+                               r);
+  return true;
+}
+
+
+struct SH_OrderStatusRequest *
+SH_order_status_get (const char *order_id,
+                     struct GNUNET_TIME_Relative timeout,
+                     SH_OrderStatusCallback cb,
+                     void *cb_cls)
+{
+  struct SH_OrderStatusRequest *r;
+  struct GNUNET_HashCode key;
+  struct Entry *e;
+
+  if (NULL == entries)
+    entries = GNUNET_CONTAINER_multihashmap_create (128,
+                                                    GNUNET_NO);
+  r = GNUNET_new (struct SH_OrderStatusRequest);
+  r->cb = cb;
+  r->cb_cls = cb_cls;
+  r->deadline = GNUNET_TIME_relative_to_absolute (timeout);
+  GNUNET_CRYPTO_hash (order_id,
+                      strlen (order_id),
+                      &key);
+  e = GNUNET_CONTAINER_multihashmap_get (entries,
+                                         &key);
+  if (NULL == e)
+  {
+    e = GNUNET_new (struct Entry);
+    e->key = key;
+    e->order_id = GNUNET_strdup (order_id);
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (
+                     entries,
+                     &e->key,
+                     e,
+                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  if ( (! GNUNET_TIME_absolute_is_past (e->expiration)) &&
+       ( (TALER_MERCHANT_OSC_PAID == e->cached.status) ||
+         (GNUNET_TIME_relative_is_zero (timeout)) ) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Returning cached status of order `%s'\n",
+                order_id);
+    r->os = e->cached;
+    r->task = GNUNET_SCHEDULER_add_now (&return_cached,
+                                        r);
+    return r;
+  }
+  if (! join_poll (e,
+                   r))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Merchant backend unavailable, not checking order `%s'\n",
+                order_id);
+    r->os = backend_down;
+    r->task = GNUNET_SCHEDULER_add_now (&return_cached,
+                                        r);
+    maybe_gc (e);
+  }
+  return r;
+}
+
+
+void
+SH_order_status_cancel (struct SH_OrderStatusRequest *r)
+{
+  struct Poll *p = r->poll;
+
+  if (NULL != r->task)
+  {
+    GNUNET_SCHEDULER_cancel (r->task);
+    r->task = NULL;
+  }
+  if (NULL != p)
+  {
+    struct Entry *e = p->e;
+
+    GNUNET_CONTAINER_DLL_remove (p->r_head,
+                                 p->r_tail,
+                                 r);
+    /* p->omgh is NULL if we are called from within poll_cb() */
+    if ( (NULL == p->r_head) &&
+         (NULL != p->omgh) )
+    {
+      TALER_MERCHANT_merchant_order_get_cancel (p->omgh);
+      SH_breaker_request_cancel (p->long_poll);
+      GNUNET_CONTAINER_DLL_remove (e->p_head,
+                                   e->p_tail,
+                                   p);
+      GNUNET_free (p);
+      maybe_gc (e);
+    }
+  }
+  GNUNET_free (r);
+}
+
+
+/**
+ * Free entry at shutdown.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value a `struct Entry`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static enum GNUNET_GenericReturnValue
+free_entry_cb (void *cls,
+               const struct GNUNET_HashCode *key,
+               void *value)
+{
+  struct Entry *e = value;
+
+  (void) cls;
+  (void) key;
+  if (NULL != e->p_head)
+  {
+    /* all requests should have been cancelled */
+    GNUNET_break (0);
+    return GNUNET_OK;
+  }
+  free_entry (e);
+  return GNUNET_OK;
+}
+
+
+void
+SH_order_status_done (void)
+{
+  if (NULL == entries)
+    return;
+  GNUNET_CONTAINER_multihashmap_iterate (entries,
+                                         &free_entry_cb,
+                                         NULL);
+  GNUNET_CONTAINER_multihashmap_destroy (entries);
+  entries = NULL;
+}
+
+
+/* end of sync-httpd_order_status.c */
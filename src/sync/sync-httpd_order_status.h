@@ -0,0 +1,113 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_order_status.h
+ * @brief cache for the status of orders at the merchant backend
+ * @author Christian Grothoff
+ */
+#ifndef SYNC_HTTPD_ORDER_STATUS_H
+#define SYNC_HTTPD_ORDER_STATUS_H
+
+#include <gnunet/gnunet_util_lib.h>
+#include <taler/taler_merchant_service.h>
+
+
+/**
+ * Status of an order at the merchant backend.
+ */
+struct SH_OrderStatus
+{
+
+  /**
+   * HTTP status returned by the merchant backend, 0 on timeout,
+   * #MHD_HTTP_BAD_GATEWAY if we did not even try as the backend
+   * is considered down.
+   */
+  unsigned int http_status;
+
+  /**
+   * Error code returned by the merchant backend.
+   */
+  enum TALER_ErrorCode ec;
+
+  /**
+   * Reply of the merchant backend if @e http_status is not
+   * #MHD_HTTP_OK, can be NULL.
+   */
+  const json_t *reply;
+
+  /**
+   * Status of the order, only valid if @e http_status is #MHD_HTTP_OK.
+   */
+  enum TALER_MERCHANT_OrderStatusCode status;
+
+};
+
+
+/**
+ * Function called with the status of an order.
+ *
+ * @param cls closure
+ * @param os status of the order
+ */
+typedef void
+(*SH_OrderStatusCallback)(void *cls,
+                          const struct SH_OrderStatus *os);
+
+
+/**
+ * Handle for a request for the status of an order.
+ */
+struct SH_OrderStatusRequest;
+
+
+/**
+ * Obtain the status of order @a order_id.  Recent results are
+ * returned from the cache, and concurrent requests for the same
+ * order share one request to the merchant backend.
+ *
+ * @param order_id order to check
+ * @param timeout how long to wait for the order to be paid
+ * @param cb function to call with the result, never called
+ *        from within this function
+ * @param cb_cls closure for @a cb
+ * @return handle for the request
+ */
+struct SH_OrderStatusRequest *
+SH_order_status_get (const char *order_id,
+                     struct GNUNET_TIME_Relative timeout,
+                     SH_OrderStatusCallback cb,
+                     void *cb_cls);
+
+
+/**
+ * Cancel request for the status of an order.
+ *
+ * @param[in] osr request to cancel
+ */
+void
+SH_order_status_cancel (struct SH_OrderStatusRequest *osr);
+
+
+/**
+ * Shutdown the order status cache.  All requests must have
+ * been cancelled.
+ */
+void
+SH_order_status_done (void);
+
+
+#endif
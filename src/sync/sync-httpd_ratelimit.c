@@ -0,0 +1,563 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_ratelimit.c
+ * @brief rate limiting of uploads per account and per IP address
+ * @author Christian Grothoff
+ *
+ * We use a token bucket per account and per IP address (per /64
+ * network for IPv6).  Buckets that filled up again are removed
+ * periodically, so the table only holds recently active clients.
+ * The IP limit is checked before anything else, the account limit
+ * only once the signature of the upload was verified.
+ *
+ * The IP limit only sees the address of the peer of the TCP
+ * connection: it does nothing for connections over a UNIX domain
+ * socket, and behind a reverse proxy it applies to the proxy, that
+ * is to all clients together.
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include "sync-httpd_ratelimit.h"
+
+
+/**
+ * How often do we remove buckets that filled up again?
+ */
+#define CLEANUP_FREQUENCY GNUNET_TIME_UNIT_MINUTES
+
+/**
+ * Maximum number of buckets we track.  If the table is full,
+ * uploads from clients without a bucket are allowed.
+ */
+#define MAX_BUCKETS (1024 * 1024)
+
+
+/**
+ * A token bucket.
+ */
+struct Bucket
+{
+
+  /**
+   * Key of the bucket in #buckets.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * When did we last update @e tokens?
+   */
+  struct GNUNET_TIME_Absolute last_update;
+
+  /**
+   * Number of tokens in the bucket as of @e last_update.
+   */
+  double tokens;
+
+};
+
+
+/**
+ * Limits for one kind of bucket.
+ */
+struct Limit
+{
+
+  /**
+   * Tokens added per second, 0 if this limit is disabled.
+   */
+  double rate;
+
+  /**
+   * Maximum number of tokens in a bucket.
+   */
+  double burst;
+
+};
+
+
+/**
+ * Map from keys to `struct Bucket`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *buckets;
+
+/**
+ * Task removing buckets that filled up again.
+ */
+static struct GNUNET_SCHEDULER_Task *cleanup_task;
+
+/**
+ * Limit on uploads per account.
+ */
+static struct Limit account_limit;
+
+/**
+ * Limit on uploads per IP address.
+ */
+static struct Limit ip_limit;
+
+/**
+ * Number of uploads we did not limit as the table was full.
+ */
+static unsigned long long unlimited;
+
+/**
+ * When may we next warn about the table being full?
+ */
+static struct GNUNET_TIME_Absolute next_full_warning;
+
+
+/**
+ * Bring the number of tokens in @a b up to date.
+ *
+ * @param[in,out] b bucket to update
+ * @param l limit of the bucket
+ * @param now current time
+ */
+static void
+refill (struct Bucket *b,
+        const struct Limit *l,
+        struct GNUNET_TIME_Absolute now)
+{
+  struct GNUNET_TIME_Relative delta;
+
+  delta = GNUNET_TIME_absolute_get_difference (b->last_update,
+                                               now);
+  b->tokens += l->rate * delta.rel_value_us / 1000000.0;
+  if (b->tokens > l->burst)
+    b->tokens = l->burst;
+  b->last_update = now;
+}
+
+
+/**
+ * Find (or create) the bucket for @a key, and check if it has
+ * a token to spare.
+ *
+ * @param key key of the bucket
+ * @param l limit of the bucket
+ * @param now current time
+ * @param[out] retry_after set to how long until a token is available
+ * @return bucket with a token, NULL if the bucket is empty
+ *         (or if we have no bucket, in which case @a retry_after
+ *         is set to zero)
+ */
+static struct Bucket *
+check_bucket (const struct GNUNET_HashCode *key,
+              const struct Limit *l,
+              struct GNUNET_TIME_Absolute now,
+              struct GNUNET_TIME_Relative *retry_after)
+{
+  struct Bucket *b;
+
+  *retry_after = GNUNET_TIME_UNIT_ZERO;
+  b = GNUNET_CONTAINER_multihashmap_get (buckets,
+                                         key);
+  if (NULL == b)
+  {
+    if (GNUNET_CONTAINER_multihashmap_size (buckets) >= MAX_BUCKETS)
+    {
+      /* warn at most once per cleanup period, not per request */
+      unlimited++;
+      if (GNUNET_TIME_absolute_is_past (next_full_warning))
+      {
+        GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                    "Rate limit table full, not limiting new clients (%llu so far)\n",
+                    unlimited);
+        next_full_warning
+          = GNUNET_TIME_relative_to_absolute (CLEANUP_FREQUENCY);
+      }
+      return NULL;
+    }
+    b = GNUNET_new (struct Bucket);
+    b->key = *key;
+    b->last_update = now;
+    b->tokens = l->burst;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (
+                     buckets,
+                     &b->key,
+                     b,
+                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  refill (b,
+          l,
+          now);
+  if (b->tokens >= 1.0)
+    return b;
+  retry_after->rel_value_us
+    = (uint64_t) ((1.0 - b->tokens) / l->rate * 1000000.0);
+  return NULL;
+}
+
+
+/**
+ * Compute the key of the bucket for an IPv4 address.
+ *
+ * @param a4 address of a client, in network byte order
+ * @param[out] key set to the key
+ */
+static void
+ip4_key (const void *a4,
+         struct GNUNET_HashCode *key)
+{
+  struct GNUNET_HashContext *hc;
+
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   "ip4",
+                                   strlen ("ip4"));
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   a4,
+                                   sizeof (struct in_addr));
+  GNUNET_CRYPTO_hash_context_finish (hc,
+                                     key);
+}
+
+
+/**
+ * Compute the key of the bucket for @a addr.
+ *
+ * @param addr address of a client
+ * @param[out] key set to the key
+ * @return false if we do not rate limit clients of this
+ *         address family
+ */
+static bool
+ip_key (const struct sockaddr *addr,
+        struct GNUNET_HashCode *key)
+{
+  switch (addr->sa_family)
+  {
+  case AF_INET:
+    {
+      const struct sockaddr_in *s4 = (const struct sockaddr_in *) addr;
+
+      ip4_key (&s4->sin_addr,
+               key);
+      return true;
+    }
+  case AF_INET6:
+    {
+      const struct sockaddr_in6 *s6 = (const struct sockaddr_in6 *) addr;
+      struct GNUNET_HashContext *hc;
+
+      /* with a dual-stack socket, IPv4 clients show up as
+         ::ffff:a.b.c.d and must not share the ::ffff:0:0/64 bucket */
+      if (IN6_IS_ADDR_V4MAPPED (&s6->sin6_addr))
+      {
+        ip4_key (&s6->sin6_addr.s6_addr[12],
+                 key);
+        return true;
+      }
+      /* clients typically control a whole /64 */
+      hc = GNUNET_CRYPTO_hash_context_start ();
+      GNUNET_CRYPTO_hash_context_read (hc,
+                                       "ip6",
+                                       strlen ("ip6"));
+      GNUNET_CRYPTO_hash_context_read (hc,
+                                       &s6->sin6_addr,
+                                       8);
+      GNUNET_CRYPTO_hash_context_finish (hc,
+                                         key);
+      return true;
+    }
+  default:
+    /* UNIX domain sockets and the like carry no client address */
+    return false;
+  }
+}
+
+
+/**
+ * Check bucket @a key against limit @a l and, if it has a token
+ * to spare, take it.
+ *
+ * @param key key of the bucket
+ * @param l limit of the bucket
+ * @param[out] retry_after set to how long the client should wait
+ *        before trying again if the upload is not allowed
+ * @return true if the upload is allowed
+ */
+static bool
+take_token (const struct GNUNET_HashCode *key,
+            const struct Limit *l,
+            struct GNUNET_TIME_Relative *retry_after)
+{
+  struct Bucket *b;
+
+  b = check_bucket (key,
+                    l,
+                    GNUNET_TIME_absolute_get (),
+                    retry_after);
+  if (NULL != b)
+  {
+    b->tokens -= 1.0;
+    return true;
+  }
+  return GNUNET_TIME_relative_is_zero (*retry_after);
+}
+
+
+bool
+SH_ratelimit_check_ip (const struct sockaddr *addr,
+                       struct GNUNET_TIME_Relative *retry_after)
+{
+  struct GNUNET_HashCode key;
+
+  *retry_after = GNUNET_TIME_UNIT_ZERO;
+  if ( (NULL == buckets) ||
+       (0 == ip_limit.rate) ||
+       (NULL == addr) ||
+       (! ip_key (addr,
+                  &key)) )
+    return true;
+  return take_token (&key,
+                     &ip_limit,
+                     retry_after);
+}
+
+
+bool
+SH_ratelimit_check_account (const struct SYNC_AccountPublicKeyP *account,
+                            struct GNUNET_TIME_Relative *retry_after)
+{
+  struct GNUNET_HashContext *hc;
+  struct GNUNET_HashCode key;
+
+  *retry_after = GNUNET_TIME_UNIT_ZERO;
+  if ( (NULL == buckets) ||
+       (0 == account_limit.rate) )
+    return true;
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   "account",
+                                   strlen ("account"));
+  GNUNET_CRYPTO_hash_context_read (hc,
+                                   account,
+                                   sizeof (*account));
+  GNUNET_CRYPTO_hash_context_finish (hc,
+                                     &key);
+  return take_token (&key,
+                     &account_limit,
+                     retry_after);
+}
+
+
+/**
+ * Remove a bucket if it filled up again.
+ *
+ * @param cls pointer to the current time
+ * @param key key of the bucket
+ * @param value a `struct Bucket`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static enum GNUNET_GenericReturnValue
+cleanup_bucket (void *cls,
+                const struct GNUNET_HashCode *key,
+                void *value)
+{
+  const struct GNUNET_TIME_Absolute *now = cls;
+  struct Bucket *b = value;
+  struct GNUNET_TIME_Relative idle;
+  double max_rate;
+
+  /* we do not remember which limit a bucket is for, so use the
+     slower rate: we may keep buckets a bit longer than needed */
+  max_rate = account_limit.rate;
+  if ( (0 != ip_limit.rate) &&
+       ( (0 == max_rate) ||
+         (ip_limit.rate < max_rate) ) )
+    max_rate = ip_limit.rate;
+  idle = GNUNET_TIME_absolute_get_difference (b->last_update,
+                                              *now);
+  if (b->tokens + max_rate * idle.rel_value_us / 1000000.0
+      < GNUNET_MAX (account_limit.burst,
+                    ip_limit.burst))
+    return GNUNET_OK;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (buckets,
+                                                       key,
+                                                       b));
+  GNUNET_free (b);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Task removing buckets that filled up again.
+ *
+ * @param cls NULL
+ */
+static void
+do_cleanup (void *cls)
+{
+  struct GNUNET_TIME_Absolute now = GNUNET_TIME_absolute_get ();
+
+  (void) cls;
+  GNUNET_CONTAINER_multihashmap_iterate (buckets,
+                                         &cleanup_bucket,
+                                         &now);
+  cleanup_task = GNUNET_SCHEDULER_add_delayed (CLEANUP_FREQUENCY,
+                                               &do_cleanup,
+                                               NULL);
+}
+
+
+/**
+ * Load limit @a l from the options @a rate_option (in uploads
+ * per minute) and @a burst_option of the "[sync]" section of @a cfg.
+ *
+ * @param cfg configuration to use
+ * @param rate_option name of the option with the rate
+ * @param burst_option name of the option with the burst size
+ * @param[out] l set to the limit
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+load_limit (const struct GNUNET_CONFIGURATION_Handle *cfg,
+            const char *rate_option,
+            const char *burst_option,
+            struct Limit *l)
+{
+  unsigned long long rate;
+  unsigned long long burst;
+
+  memset (l,
+          0,
+          sizeof (*l));
+  if (GNUNET_YES !=
+      GNUNET_CONFIGURATION_have_value (cfg,
+                                       "sync",
+                                       rate_option))
+    return GNUNET_OK;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "sync",
+                                             rate_option,
+                                             &rate))
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "sync",
+                               rate_option,
+                               "must be a number");
+    return GNUNET_SYSERR;
+  }
+  burst = rate;
+  if ( (GNUNET_YES ==
+        GNUNET_CONFIGURATION_have_value (cfg,
+                                         "sync",
+                                         burst_option)) &&
+       (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_number (cfg,
+                                               "sync",
+                                               burst_option,
+                                               &burst)) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "sync",
+                               burst_option,
+                               "must be a number");
+    return GNUNET_SYSERR;
+  }
+  if (0 == rate)
+    return GNUNET_OK;
+  l->rate = rate / 60.0;
+  l->burst = GNUNET_MAX (1, burst);
+  return GNUNET_OK;
+}
+
+
+enum GNUNET_GenericReturnValue
+SH_ratelimit_init (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  if ( (GNUNET_OK !=
+        load_limit (cfg,
+                    "ACCOUNT_UPLOADS_PER_MINUTE",
+                    "ACCOUNT_UPLOAD_BURST",
+                    &account_limit)) ||
+       (GNUNET_OK !=
+        load_limit (cfg,
+                    "IP_UPLOADS_PER_MINUTE",
+                    "IP_UPLOAD_BURST",
+                    &ip_limit)) )
+    return GNUNET_SYSERR;
+  if (0 != ip_limit.rate)
+  {
+    char *serve = NULL;
+
+    if ( (GNUNET_OK ==
+          GNUNET_CONFIGURATION_get_value_string (cfg,
+                                                 "sync",
+                                                 "SERVE",
+                                                 &serve)) &&
+         (0 == strcasecmp (serve,
+                           "unix")) )
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "IP_UPLOADS_PER_MINUTE has no effect when serving over a UNIX domain socket\n");
+    GNUNET_free (serve);
+  }
+  if ( (0 == account_limit.rate) &&
+       (0 == ip_limit.rate) )
+    return GNUNET_OK;
+  buckets = GNUNET_CONTAINER_multihashmap_create (1024,
+                                                  GNUNET_NO);
+  cleanup_task = GNUNET_SCHEDULER_add_delayed (CLEANUP_FREQUENCY,
+                                               &do_cleanup,
+                                               NULL);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Free a bucket.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value a `struct Bucket`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static enum GNUNET_GenericReturnValue
+free_bucket (void *cls,
+             const struct GNUNET_HashCode *key,
+             void *value)
+{
+  (void) cls;
+  (void) key;
+  GNUNET_free (value);
+  return GNUNET_OK;
+}
+
+
+void
+SH_ratelimit_done (void)
+{
+  if (NULL != cleanup_task)
+  {
+    GNUNET_SCHEDULER_cancel (cleanup_task);
+    cleanup_task = NULL;
+  }
+  if (NULL == buckets)
+    return;
+  GNUNET_CONTAINER_multihashmap_iterate (buckets,
+                                         &free_bucket,
+                                         NULL);
+  GNUNET_CONTAINER_multihashmap_destroy (buckets);
+  buckets = NULL;
+}
+
+
+/* end of sync-httpd_ratelimit.c */
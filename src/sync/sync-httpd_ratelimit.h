@@ -0,0 +1,77 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_ratelimit.h
+ * @brief rate limiting of uploads per account and per IP address
+ * @author Christian Grothoff
+ */
+#ifndef SYNC_HTTPD_RATELIMIT_H
+#define SYNC_HTTPD_RATELIMIT_H
+
+#include <gnunet/gnunet_util_lib.h>
+#include "sync_service.h"
+
+
+/**
+ * Initialize rate limiting based on the "ACCOUNT_UPLOADS_PER_MINUTE",
+ * "ACCOUNT_UPLOAD_BURST", "IP_UPLOADS_PER_MINUTE" and
+ * "IP_UPLOAD_BURST" options in the "[sync]" section of @a cfg.
+ *
+ * @param cfg configuration to use
+ * @return #GNUNET_OK on success (including if rate limiting is disabled)
+ */
+enum GNUNET_GenericReturnValue
+SH_ratelimit_init (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Shutdown rate limiting.
+ */
+void
+SH_ratelimit_done (void);
+
+
+/**
+ * Check if an upload from @a addr is allowed, and if so,
+ * account for it.
+ *
+ * @param addr address of the client, NULL if unknown
+ * @param[out] retry_after set to how long the client should wait
+ *        before trying again if the upload is not allowed
+ * @return true if the upload is allowed
+ */
+bool
+SH_ratelimit_check_ip (const struct sockaddr *addr,
+                       struct GNUNET_TIME_Relative *retry_after);
+
+
+/**
+ * Check if an upload to @a account is allowed, and if so,
+ * account for it.  Must only be called once the upload was
+ * signed by the account, as otherwise anyone could use up
+ * the uploads of the account.
+ *
+ * @param account account the upload is for
+ * @param[out] retry_after set to how long the client should wait
+ *        before trying again if the upload is not allowed
+ * @return true if the upload is allowed
+ */
+bool
+SH_ratelimit_check_account (const struct SYNC_AccountPublicKeyP *account,
+                            struct GNUNET_TIME_Relative *retry_after);
+
+
+#endif
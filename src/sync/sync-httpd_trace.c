@@ -0,0 +1,647 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_trace.c
+ * @brief per-request latency tracing and slow request logging
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <gnunet/gnunet_json_lib.h>
+#include "sync-httpd_trace.h"
+
+
+/**
+ * Maximum number of events we record per request.  Further
+ * events are counted, but not recorded.
+ */
+#define MAX_EVENTS 32
+
+/**
+ * Size of the I/O buffer for the trace file.  Each trace line
+ * should fit, so that it is written with a single write(),
+ * which keeps lines from multiple workers from interleaving.
+ */
+#define TRACE_BUFFER_SIZE (64 * 1024)
+
+
+/**
+ * Types of events in a trace.
+ */
+enum EventType
+{
+  /**
+   * Request reached a processing stage.
+   */
+  ET_STAGE,
+
+  /**
+   * Database operation.
+   */
+  ET_DB,
+
+  /**
+   * Request to the merchant backend.
+   */
+  ET_MERCHANT
+};
+
+
+/**
+ * Event recorded in a trace.
+ */
+struct Event
+{
+  /**
+   * Name of the event, a static string.
+   */
+  const char *name;
+
+  /**
+   * Time of the event (for spans: start time) relative to
+   * the start of the request.
+   */
+  struct GNUNET_TIME_Relative at;
+
+  /**
+   * Duration of the span, zero for stages.
+   */
+  struct GNUNET_TIME_Relative duration;
+
+  /**
+   * HTTP status for #ET_MERCHANT events.
+   */
+  unsigned int http_status;
+
+  /**
+   * Type of the event.
+   */
+  enum EventType type;
+};
+
+
+/**
+ * Trace of a single request.
+ */
+struct SH_Trace
+{
+  /**
+   * When did we start processing the request?
+   */
+  struct GNUNET_TIME_Absolute start;
+
+  /**
+   * Request ID, either the correlation ID or the async scope ID.
+   */
+  char *request_id;
+
+  /**
+   * HTTP method.
+   */
+  char *method;
+
+  /**
+   * URL of the request.
+   */
+  char *url;
+
+  /**
+   * Events recorded so far.
+   */
+  struct Event events[MAX_EVENTS];
+
+  /**
+   * Number of events recorded (or attempted to be recorded).
+   */
+  unsigned int num_events;
+
+  /**
+   * Size of the request body.
+   */
+  uint64_t body_size;
+};
+
+
+struct SH_Trace *SH_trace_current;
+
+/**
+ * File we write traces to, NULL if tracing is disabled.
+ */
+static FILE *trace_file;
+
+/**
+ * Requests taking longer than this are logged, zero if disabled.
+ */
+static struct GNUNET_TIME_Relative slow_request;
+
+/**
+ * Database operations taking longer than this are logged, zero if
+ * disabled.
+ */
+static struct GNUNET_TIME_Relative slow_query;
+
+
+/**
+ * Load threshold @a option (in milliseconds) from @a cfg.
+ *
+ * @param cfg configuration to use
+ * @param option name of the option
+ * @param[out] threshold set to the threshold, zero if not configured
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+load_threshold (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                const char *option,
+                struct GNUNET_TIME_Relative *threshold)
+{
+  unsigned long long ms;
+
+  *threshold = GNUNET_TIME_UNIT_ZERO;
+  if (GNUNET_YES !=
+      GNUNET_CONFIGURATION_have_value (cfg,
+                                       "sync",
+                                       option))
+    return GNUNET_OK;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "sync",
+                                             option,
+                                             &ms))
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "sync",
+                               option,
+                               "number of milliseconds expected");
+    return GNUNET_SYSERR;
+  }
+  *threshold = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                              ms);
+  return GNUNET_OK;
+}
+
+
+enum GNUNET_GenericReturnValue
+SH_trace_init (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  char *fn;
+
+  if ( (GNUNET_OK !=
+        load_threshold (cfg,
+                        "SLOW_REQUEST_MS",
+                        &slow_request)) ||
+       (GNUNET_OK !=
+        load_threshold (cfg,
+                        "SLOW_QUERY_MS",
+                        &slow_query)) )
+    return GNUNET_SYSERR;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                               "sync",
+                                               "TRACE_FILE",
+                                               &fn))
+    return GNUNET_OK;
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create_for_file (fn))
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "sync",
+                               "TRACE_FILE",
+                               "cannot create directory");
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  trace_file = fopen (fn,
+                      "a");
+  if (NULL == trace_file)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "fopen",
+                              fn);
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (fn);
+  /* we flush after each line */
+  GNUNET_break (0 ==
+                setvbuf (trace_file,
+                         NULL,
+                         _IOFBF,
+                         TRACE_BUFFER_SIZE));
+  return GNUNET_OK;
+}
+
+
+void
+SH_trace_done (void)
+{
+  if (NULL == trace_file)
+    return;
+  GNUNET_break (0 == fclose (trace_file));
+  trace_file = NULL;
+}
+
+
+struct SH_Trace *
+SH_trace_start (const char *method,
+                const char *url,
+                const char *correlation_id,
+                const struct GNUNET_AsyncScopeId *aid)
+{
+  struct SH_Trace *trace;
+
+  if ( (NULL == trace_file) &&
+       (GNUNET_TIME_relative_is_zero (slow_request)) &&
+       (GNUNET_TIME_relative_is_zero (slow_query)) )
+    return NULL;
+  trace = GNUNET_new (struct SH_Trace);
+  trace->start = GNUNET_TIME_absolute_get ();
+  trace->method = GNUNET_strdup (method);
+  trace->url = GNUNET_strdup (url);
+  if (NULL != correlation_id)
+    trace->request_id = GNUNET_strdup (correlation_id);
+  else
+    trace->request_id = GNUNET_STRINGS_data_to_string_alloc (aid,
+                                                             sizeof (*aid));
+  SH_trace_stage (trace,
+                  "headers_parsed");
+  return trace;
+}
+
+
+/**
+ * Add an event to @a trace.
+ *
+ * @param[in,out] trace trace to update
+ * @param type type of the event
+ * @param name name of the event
+ * @param start start time of the event
+ * @param http_status HTTP status, if applicable
+ */
+static void
+add_event (struct SH_Trace *trace,
+           enum EventType type,
+           const char *name,
+           struct GNUNET_TIME_Absolute start,
+           unsigned int http_status)
+{
+  struct Event *ev;
+
+  if (MAX_EVENTS <= trace->num_events++)
+    return;
+  ev = &trace->events[trace->num_events - 1];
+  ev->type = type;
+  ev->name = name;
+  ev->at = GNUNET_TIME_absolute_get_difference (trace->start,
+                                                start);
+  ev->duration = (ET_STAGE == type)
+    ? GNUNET_TIME_UNIT_ZERO
+    : GNUNET_TIME_absolute_get_duration (start);
+  ev->http_status = http_status;
+}
+
+
+void
+SH_trace_stage (struct SH_Trace *trace,
+                const char *stage)
+{
+  if (NULL == trace)
+    return;
+  add_event (trace,
+             ET_STAGE,
+             stage,
+             GNUNET_TIME_absolute_get (),
+             0);
+}
+
+
+/**
+ * Describe the request of @a trace for the log, without the
+ * full account public key.
+ *
+ * @param trace request to describe
+ * @param[out] route set to the route of the request
+ * @param route_size number of bytes in @a route
+ * @param[out] account set to the prefix of the account, "-" if none
+ * @param account_size number of bytes in @a account
+ */
+static void
+describe_request (const struct SH_Trace *trace,
+                  char *route,
+                  size_t route_size,
+                  char *account,
+                  size_t account_size)
+{
+  static const char *prefix = "/backups/";
+
+  /* do not log full account public keys, the prefix suffices */
+  if (0 == strncmp (trace->url,
+                    prefix,
+                    strlen (prefix)))
+  {
+    const char *ac = &trace->url[strlen (prefix)];
+    const char *rest = strchr (ac,
+                               '/');
+
+    GNUNET_snprintf (account,
+                     account_size,
+                     "%s",
+                     ac);
+    GNUNET_snprintf (route,
+                     route_size,
+                     "%s$ACCOUNT%s",
+                     prefix,
+                     (NULL == rest) ? "" : rest);
+  }
+  else
+  {
+    GNUNET_snprintf (account,
+                     account_size,
+                     "-");
+    GNUNET_snprintf (route,
+                     route_size,
+                     "%s",
+                     trace->url);
+  }
+}
+
+
+void
+SH_trace_db (struct SH_Trace *trace,
+             const char *name,
+             struct GNUNET_TIME_Absolute start)
+{
+  struct GNUNET_TIME_Relative duration;
+  char route[64];
+  char account[9];
+
+  if (NULL != trace)
+    add_event (trace,
+               ET_DB,
+               name,
+               start,
+               0);
+  if (GNUNET_TIME_relative_is_zero (slow_query))
+    return;
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  if (GNUNET_TIME_relative_cmp (duration,
+                                <,
+                                slow_query))
+    return;
+  if (NULL == trace)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Slow query: %s took %s (not part of a request)\n",
+                name,
+                GNUNET_TIME_relative2s (duration,
+                                        true));
+    return;
+  }
+  describe_request (trace,
+                    route,
+                    sizeof (route),
+                    account,
+                    sizeof (account));
+  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+              "Slow query: %s took %s (%s %s, account %s, %llu bytes, id %s)\n",
+              name,
+              GNUNET_TIME_relative2s (duration,
+                                      true),
+              trace->method,
+              route,
+              account,
+              (unsigned long long) trace->body_size,
+              trace->request_id);
+}
+
+
+void
+SH_trace_merchant (struct SH_Trace *trace,
+                   const char *name,
+                   struct GNUNET_TIME_Absolute start,
+                   unsigned int http_status)
+{
+  struct GNUNET_TIME_Relative duration;
+
+  if (NULL != trace)
+  {
+    add_event (trace,
+               ET_MERCHANT,
+               name,
+               start,
+               http_status);
+    return;
+  }
+  /* not part of a request, so no slow request would cover it */
+  if (GNUNET_TIME_relative_is_zero (slow_request))
+    return;
+  duration = GNUNET_TIME_absolute_get_duration (start);
+  if (GNUNET_TIME_relative_cmp (duration,
+                                <,
+                                slow_request))
+    return;
+  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+              "Slow merchant request: %s returned %u after %s (not part of a request)\n",
+              name,
+              http_status,
+              GNUNET_TIME_relative2s (duration,
+                                      true));
+}
+
+
+void
+SH_trace_body_size (struct SH_Trace *trace,
+                    uint64_t body_size)
+{
+  if (NULL == trace)
+    return;
+  trace->body_size = body_size;
+}
+
+
+/**
+ * Log @a trace as a slow request.
+ *
+ * @param trace the slow request
+ * @param total how long did the request take
+ * @param http_status HTTP status we returned
+ */
+static void
+log_slow_request (const struct SH_Trace *trace,
+                  struct GNUNET_TIME_Relative total,
+                  unsigned int http_status)
+{
+  struct GNUNET_Buffer stages = { 0 };
+  char route[64];
+  char account[9];
+  char *s;
+
+  describe_request (trace,
+                    route,
+                    sizeof (route),
+                    account,
+                    sizeof (account));
+  for (unsigned int i = 0;
+       i < GNUNET_MIN (trace->num_events,
+                       MAX_EVENTS);
+       i++)
+  {
+    const struct Event *ev = &trace->events[i];
+
+    if (ET_STAGE == ev->type)
+      GNUNET_buffer_write_fstr (&stages,
+                                " %s@%llums",
+                                ev->name,
+                                (unsigned long long)
+                                (ev->at.rel_value_us / 1000LL));
+    else
+      GNUNET_buffer_write_fstr (&stages,
+                                " %s@%llums+%llums",
+                                ev->name,
+                                (unsigned long long)
+                                (ev->at.rel_value_us / 1000LL),
+                                (unsigned long long)
+                                (ev->duration.rel_value_us / 1000LL));
+  }
+  s = GNUNET_buffer_reap_str (&stages);
+  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+              "Slow request: %s %s (account %s, %llu bytes) returned %u after %s (id %s):%s\n",
+              trace->method,
+              route,
+              account,
+              (unsigned long long) trace->body_size,
+              http_status,
+              GNUNET_TIME_relative2s (total,
+                                      true),
+              trace->request_id,
+              (NULL == s) ? "" : s);
+  GNUNET_free (s);
+}
+
+
+/**
+ * Convert @a ev to JSON.
+ *
+ * @param ev event to convert
+ * @return JSON representation of @a ev
+ */
+static json_t *
+event_to_json (const struct Event *ev)
+{
+  static const char *types[] = {
+    [ET_STAGE] = "stage",
+    [ET_DB] = "db",
+    [ET_MERCHANT] = "merchant"
+  };
+
+  return GNUNET_JSON_PACK (
+    GNUNET_JSON_pack_string ("type",
+                             types[ev->type]),
+    GNUNET_JSON_pack_string ("name",
+                             ev->name),
+    GNUNET_JSON_pack_uint64 ("at_us",
+                             ev->at.rel_value_us),
+    GNUNET_JSON_pack_uint64 ("duration_us",
+                             ev->duration.rel_value_us),
+    GNUNET_JSON_pack_uint64 ("http_status",
+                             ev->http_status));
+}
+
+
+/**
+ * Free @a trace.
+ *
+ * @param[in] trace trace to free
+ */
+static void
+free_trace (struct SH_Trace *trace)
+{
+  GNUNET_free (trace->request_id);
+  GNUNET_free (trace->method);
+  GNUNET_free (trace->url);
+  GNUNET_free (trace);
+}
+
+
+void
+SH_trace_end (struct SH_Trace *trace,
+              unsigned int http_status,
+              enum MHD_RequestTerminationCode toe)
+{
+  struct GNUNET_TIME_Relative total;
+  json_t *events;
+  json_t *j;
+
+  if (NULL == trace)
+    return;
+  total = GNUNET_TIME_absolute_get_duration (trace->start);
+  if ( (! GNUNET_TIME_relative_is_zero (slow_request)) &&
+       (GNUNET_TIME_relative_cmp (total,
+                                  >=,
+                                  slow_request)) )
+    log_slow_request (trace,
+                      total,
+                      http_status);
+  if (NULL == trace_file)
+  {
+    free_trace (trace);
+    return;
+  }
+  events = json_array ();
+  GNUNET_assert (NULL != events);
+  for (unsigned int i = 0;
+       i < GNUNET_MIN (trace->num_events,
+                       MAX_EVENTS);
+       i++)
+    GNUNET_assert (0 ==
+                   json_array_append_new (events,
+                                          event_to_json (&trace->events[i])));
+  j = GNUNET_JSON_PACK (
+    GNUNET_JSON_pack_string ("request_id",
+                             trace->request_id),
+    GNUNET_JSON_pack_string ("method",
+                             trace->method),
+    GNUNET_JSON_pack_string ("url",
+                             trace->url),
+    GNUNET_JSON_pack_uint64 ("start_us",
+                             trace->start.abs_value_us),
+    GNUNET_JSON_pack_uint64 ("total_us",
+                             total.rel_value_us),
+    GNUNET_JSON_pack_uint64 ("http_status",
+                             http_status),
+    GNUNET_JSON_pack_uint64 ("termination",
+                             toe),
+    GNUNET_JSON_pack_uint64 ("body_size",
+                             trace->body_size),
+    GNUNET_JSON_pack_uint64 ("dropped_events",
+                             trace->num_events
+                             - GNUNET_MIN (trace->num_events,
+                                           MAX_EVENTS)),
+    GNUNET_JSON_pack_array_steal ("events",
+                                  events));
+  if ( (0 != json_dumpf (j,
+                         trace_file,
+                         JSON_COMPACT)) ||
+       (EOF == fputc ('\n',
+                      trace_file)) ||
+       (0 != fflush (trace_file)) )
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "write");
+  json_decref (j);
+  free_trace (trace);
+}
+
+
+/* end of sync-httpd_trace.c */
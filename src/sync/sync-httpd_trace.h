@@ -0,0 +1,149 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_trace.h
+ * @brief per-request latency tracing and slow request logging
+ * @author Christian Grothoff
+ */
+#ifndef SYNC_HTTPD_TRACE_H
+#define SYNC_HTTPD_TRACE_H
+
+#include <gnunet/gnunet_util_lib.h>
+#include <microhttpd.h>
+
+
+/**
+ * Trace of a single request.  All functions operating on
+ * traces accept NULL, which is what we use if tracing is off.
+ */
+struct SH_Trace;
+
+
+/**
+ * Trace of the request we are currently processing in the
+ * MHD access handler, NULL if none.  Set by the main loop
+ * for the duration of each handler invocation.
+ */
+extern struct SH_Trace *SH_trace_current;
+
+
+/**
+ * Initialize tracing subsystem based on the "TRACE_FILE",
+ * "SLOW_REQUEST_MS" and "SLOW_QUERY_MS" options in the "[sync]"
+ * section of @a cfg.
+ *
+ * @param cfg configuration to use
+ * @return #GNUNET_OK on success (including if tracing is disabled)
+ */
+enum GNUNET_GenericReturnValue
+SH_trace_init (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Shutdown tracing subsystem, flushing the trace file.
+ */
+void
+SH_trace_done (void);
+
+
+/**
+ * Start tracing a request.
+ *
+ * @param method HTTP method of the request
+ * @param url URL of the request
+ * @param correlation_id correlation ID given by the client, or NULL
+ * @param aid async scope of the request, used as request ID if
+ *        @a correlation_id is NULL
+ * @return NULL if tracing and slow request logging are disabled
+ */
+struct SH_Trace *
+SH_trace_start (const char *method,
+                const char *url,
+                const char *correlation_id,
+                const struct GNUNET_AsyncScopeId *aid);
+
+
+/**
+ * Record that the request reached processing stage @a stage.
+ *
+ * @param trace trace to update, can be NULL
+ * @param stage name of the stage, must be a static string
+ */
+void
+SH_trace_stage (struct SH_Trace *trace,
+                const char *stage);
+
+
+/**
+ * Record a database call that started at @a start and just
+ * completed.  Logs the call if it exceeded the slow query
+ * threshold, together with the request it was made for.
+ *
+ * @param trace trace to update, NULL if the call is not
+ *        part of a (traced) request
+ * @param name name of the database operation, must be a static string
+ * @param start when did the operation start
+ */
+void
+SH_trace_db (struct SH_Trace *trace,
+             const char *name,
+             struct GNUNET_TIME_Absolute start);
+
+
+/**
+ * Record a request to the merchant backend that started at
+ * @a start and just completed.  If it is not part of a request,
+ * logs it if it exceeded the slow request threshold.
+ *
+ * @param trace trace to update, NULL if the call is not
+ *        part of a (traced) request
+ * @param name name of the merchant operation, must be a static string
+ * @param start when did the operation start
+ * @param http_status HTTP status returned by the merchant backend
+ */
+void
+SH_trace_merchant (struct SH_Trace *trace,
+                   const char *name,
+                   struct GNUNET_TIME_Absolute start,
+                   unsigned int http_status);
+
+
+/**
+ * Record the size of the request body.
+ *
+ * @param trace trace to update, can be NULL
+ * @param body_size number of bytes in the request body
+ */
+void
+SH_trace_body_size (struct SH_Trace *trace,
+                    uint64_t body_size);
+
+
+/**
+ * Finish tracing a request, write the trace out and free it.
+ * Logs the request if it exceeded the slow request threshold.
+ *
+ * @param[in] trace trace to finish, can be NULL
+ * @param http_status HTTP status we returned, 0 if unknown
+ * @param toe reason for request termination
+ */
+void
+SH_trace_end (struct SH_Trace *trace,
+              unsigned int http_status,
+              enum MHD_RequestTerminationCode toe);
+
+
+#endif
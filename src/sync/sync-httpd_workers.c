@@ -0,0 +1,304 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_workers.c
+ * @brief supervisor running multiple sync-httpd worker processes
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include "sync-httpd_workers.h"
+
+
+/**
+ * Environment variable we set for the worker processes
+ * started by the supervisor.
+ */
+#define SYNC_WORKER_ENV "SYNC_HTTPD_WORKER"
+
+/**
+ * If a worker ran for at least this long before dying,
+ * we restart it immediately (and reset the backoff).
+ */
+#define STABLE_RUNTIME GNUNET_TIME_UNIT_MINUTES
+
+
+/**
+ * State we keep per worker process.
+ */
+struct Worker
+{
+
+  /**
+   * The worker process, NULL if not running.
+   */
+  struct GNUNET_OS_Process *proc;
+
+  /**
+   * Handle to wait for the worker to terminate.
+   */
+  struct GNUNET_ChildWaitHandle *cwh;
+
+  /**
+   * Task to restart the worker, NULL if not pending.
+   */
+  struct GNUNET_SCHEDULER_Task *restart_task;
+
+  /**
+   * When did we last start the worker?
+   */
+  struct GNUNET_TIME_Absolute start_time;
+
+  /**
+   * How long do we wait before the next restart?
+   */
+  struct GNUNET_TIME_Relative backoff;
+
+  /**
+   * Index of the worker, for logging.
+   */
+  unsigned int off;
+};
+
+
+/**
+ * Array of workers we supervise.
+ */
+static struct Worker *workers;
+
+/**
+ * Length of the #workers array.
+ */
+static unsigned int num_workers;
+
+/**
+ * Listen sockets to pass to the workers, terminated by -1.
+ */
+static int lsocks[2] = { -1, -1 };
+
+/**
+ * Command line to start workers with.
+ */
+static char *const *worker_argv;
+
+
+bool
+SH_workers_is_worker (void)
+{
+  return (NULL != getenv (SYNC_WORKER_ENV));
+}
+
+
+int
+SH_workers_get_listen_socket (void)
+{
+  const char *listen_pid;
+  const char *listen_fds;
+
+  listen_pid = getenv ("LISTEN_PID");
+  listen_fds = getenv ("LISTEN_FDS");
+  if ( (NULL == listen_pid) ||
+       (NULL == listen_fds) )
+    return -1;
+  if (getpid () != strtol (listen_pid,
+                           NULL,
+                           10))
+    return -1;
+  if (1 != strtoul (listen_fds,
+                    NULL,
+                    10))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Expected exactly one listen socket, got `%s', ignoring\n",
+                listen_fds);
+    return -1;
+  }
+  /* first systemd-style socket is always FD 3 */
+  return 3;
+}
+
+
+/**
+ * Start (or restart) the worker @a cls.
+ *
+ * @param cls a `struct Worker`
+ */
+static void
+start_worker (void *cls);
+
+
+/**
+ * Function called when a worker process terminated.
+ *
+ * @param cls a `struct Worker`
+ * @param type how did the process terminate
+ * @param exit_code exit code or signal number of the worker
+ */
+static void
+worker_died (void *cls,
+             enum GNUNET_OS_ProcessStatusType type,
+             long unsigned int exit_code)
+{
+  struct Worker *w = cls;
+  struct GNUNET_TIME_Relative runtime;
+
+  w->cwh = NULL;
+  GNUNET_OS_process_destroy (w->proc);
+  w->proc = NULL;
+  if ( (GNUNET_OS_PROCESS_EXITED == type) &&
+       ( (EXIT_NOTCONFIGURED == exit_code) ||
+         (EXIT_NOTINSTALLED == exit_code) ||
+         (EXIT_NOPERMISSION == exit_code) ||
+         (EXIT_INVALIDARGUMENT == exit_code) ) )
+  {
+    /* restarting will not help, give up */
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Worker %u failed with exit code %lu, shutting down\n",
+                w->off,
+                exit_code);
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  runtime = GNUNET_TIME_absolute_get_duration (w->start_time);
+  if (GNUNET_TIME_relative_cmp (runtime,
+                                >=,
+                                STABLE_RUNTIME))
+    w->backoff = GNUNET_TIME_UNIT_ZERO;
+  else
+    w->backoff = GNUNET_TIME_STD_BACKOFF (w->backoff);
+  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+              "Worker %u terminated (status %d/%lu), restarting in %s\n",
+              w->off,
+              (int) type,
+              exit_code,
+              GNUNET_TIME_relative2s (w->backoff,
+                                      true));
+  w->restart_task = GNUNET_SCHEDULER_add_delayed (w->backoff,
+                                                  &start_worker,
+                                                  w);
+}
+
+
+static void
+start_worker (void *cls)
+{
+  struct Worker *w = cls;
+
+  w->restart_task = NULL;
+  w->start_time = GNUNET_TIME_absolute_get ();
+  w->proc = GNUNET_OS_start_process_v (GNUNET_OS_INHERIT_STD_ALL,
+                                       (-1 == lsocks[0])
+                                       ? NULL
+                                       : lsocks,
+                                       worker_argv[0],
+                                       worker_argv);
+  if (NULL == w->proc)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to start worker %u\n",
+                w->off);
+    w->backoff = GNUNET_TIME_STD_BACKOFF (w->backoff);
+    w->restart_task = GNUNET_SCHEDULER_add_delayed (w->backoff,
+                                                    &start_worker,
+                                                    w);
+    return;
+  }
+  w->cwh = GNUNET_wait_child (w->proc,
+                              &worker_died,
+                              w);
+}
+
+
+enum GNUNET_GenericReturnValue
+SH_workers_start (unsigned int n,
+                  int listen_fd,
+                  char *const *argv)
+{
+  GNUNET_assert (NULL == workers);
+  if (0 != setenv (SYNC_WORKER_ENV,
+                   "1",
+                   1))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "setenv");
+    return GNUNET_SYSERR;
+  }
+  worker_argv = argv;
+  lsocks[0] = listen_fd;
+  num_workers = n;
+  workers = GNUNET_new_array (num_workers,
+                              struct Worker);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Starting %u worker processes\n",
+              num_workers);
+  for (unsigned int i = 0; i<num_workers; i++)
+  {
+    workers[i].off = i;
+    start_worker (&workers[i]);
+  }
+  return GNUNET_OK;
+}
+
+
+void
+SH_workers_stop (void)
+{
+  if (NULL == workers)
+    return;
+  for (unsigned int i = 0; i<num_workers; i++)
+  {
+    struct Worker *w = &workers[i];
+
+    if (NULL != w->restart_task)
+    {
+      GNUNET_SCHEDULER_cancel (w->restart_task);
+      w->restart_task = NULL;
+    }
+    if (NULL != w->cwh)
+    {
+      GNUNET_wait_child_cancel (w->cwh);
+      w->cwh = NULL;
+    }
+    if (NULL == w->proc)
+      continue;
+    if (0 != GNUNET_OS_process_kill (w->proc,
+                                     SIGTERM))
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "kill");
+  }
+  /* kill all first, then wait, so workers shut down in parallel */
+  for (unsigned int i = 0; i<num_workers; i++)
+  {
+    struct Worker *w = &workers[i];
+
+    if (NULL == w->proc)
+      continue;
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_OS_process_wait (w->proc));
+    GNUNET_OS_process_destroy (w->proc);
+    w->proc = NULL;
+  }
+  GNUNET_free (workers);
+  num_workers = 0;
+  if (-1 != lsocks[0])
+  {
+    GNUNET_break (0 == close (lsocks[0]));
+    lsocks[0] = -1;
+  }
+}
+
+
+/* end of sync-httpd_workers.c */
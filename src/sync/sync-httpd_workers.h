@@ -0,0 +1,73 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file sync-httpd_workers.h
+ * @brief supervisor running multiple sync-httpd worker processes
+ * @author Christian Grothoff
+ */
+#ifndef SYNC_HTTPD_WORKERS_H
+#define SYNC_HTTPD_WORKERS_H
+
+#include <gnunet/gnunet_util_lib.h>
+
+
+/**
+ * Check if this process was started as a worker by
+ * a sync-httpd supervisor.
+ *
+ * @return true if we are a worker process
+ */
+bool
+SH_workers_is_worker (void);
+
+
+/**
+ * Obtain the listen socket passed to us systemd-style
+ * (via "LISTEN_PID" and "LISTEN_FDS"), either by our
+ * supervisor or by systemd socket activation.
+ *
+ * @return the listen socket, -1 if none was passed
+ */
+int
+SH_workers_get_listen_socket (void);
+
+
+/**
+ * Start @a num_workers worker processes and supervise them,
+ * restarting workers that crash.  Workers are started by
+ * re-executing @a argv.
+ *
+ * @param num_workers number of worker processes to run
+ * @param listen_fd listen socket to pass to the workers, -1 to have
+ *        each worker bind the port itself using SO_REUSEPORT
+ * @param argv command line to use to start the workers, must
+ *        remain valid until #SH_workers_stop() is called
+ * @return #GNUNET_OK on success
+ */
+enum GNUNET_GenericReturnValue
+SH_workers_start (unsigned int num_workers,
+                  int listen_fd,
+                  char *const *argv);
+
+
+/**
+ * Terminate all worker processes and stop supervising them.
+ */
+void
+SH_workers_stop (void);
+
+
+#endif
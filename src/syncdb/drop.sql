@@ -17,7 +17,13 @@
 -- Everything in one big transaction
 BEGIN;
 
--- Unregister patch (0001.sql)
+-- Unregister patches
+SELECT _v.unregister_patch('sync-0007');
+SELECT _v.unregister_patch('sync-0006');
+SELECT _v.unregister_patch('sync-0005');
+SELECT _v.unregister_patch('sync-0004');
+SELECT _v.unregister_patch('sync-0003');
+SELECT _v.unregister_patch('sync-0002');
 SELECT _v.unregister_patch('sync-0001');
 DROP SCHEMA sync CASCADE;
 
@@ -0,0 +1,638 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Lesser General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/plugin_syncblob_file.c
+ * @brief blob store keeping backups in files in a local directory
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include "sync_blobstore_plugin.h"
+
+
+/**
+ * Suffix of files with compressed blobs.
+ */
+#define COMPRESSED_SUFFIX ".z"
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a file with a compressed blob.
+ */
+struct CompressedHeaderP
+{
+  /**
+   * Size of the blob after decompression, in NBO.
+   */
+  uint64_t size GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * Type of the "cls" argument given to each of the functions in
+ * our API.
+ */
+struct FileClosure
+{
+  /**
+   * Directory we store the blobs in.
+   */
+  char *dir;
+
+  /**
+   * Should we try to compress blobs?
+   */
+  bool compress;
+};
+
+
+/**
+ * Get the name of the file for the blob with @a blob_hash.
+ * Blobs are spread over 1024 subdirectories by the first
+ * two characters of the encoded hash, to keep directories small.
+ *
+ * @param fc plugin context
+ * @param blob_hash hash of the blob
+ * @param compressed true for the name of the compressed file
+ * @return file name, to be freed by the caller
+ */
+static char *
+get_filename (struct FileClosure *fc,
+              const struct GNUNET_HashCode *blob_hash,
+              bool compressed)
+{
+  struct GNUNET_CRYPTO_HashAsciiEncoded hs;
+  char *fn;
+
+  GNUNET_CRYPTO_hash_to_enc (blob_hash,
+                             &hs);
+  GNUNET_asprintf (&fn,
+                   "%s/%.2s/%s%s",
+                   fc->dir,
+                   (const char *) hs.encoding,
+                   (const char *) hs.encoding,
+                   compressed ? COMPRESSED_SUFFIX : "");
+  return fn;
+}
+
+
+/**
+ * Write all of @a data to @a fd.
+ *
+ * @param fd file to write to
+ * @param data data to write
+ * @param size number of bytes in @a data
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+write_all (int fd,
+           const void *data,
+           size_t size)
+{
+  const char *pos = data;
+
+  while (0 < size)
+  {
+    ssize_t ret;
+
+    ret = write (fd,
+                 pos,
+                 size);
+    if (-1 == ret)
+    {
+      if (EINTR == errno)
+        continue;
+      return GNUNET_SYSERR;
+    }
+    pos += ret;
+    size -= ret;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Store a blob.  The data is first written to a temporary file
+ * which is then renamed, so readers never see partial blobs.
+ *
+ * @param cls closure
+ * @param blob_hash hash of @a blob
+ * @param blob_size number of bytes in @a blob
+ * @param blob data to store
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+file_put_blob (void *cls,
+               const struct GNUNET_HashCode *blob_hash,
+               size_t blob_size,
+               const void *blob)
+{
+  struct FileClosure *fc = cls;
+  struct CompressedHeaderP ch;
+  char *cdata = NULL;
+  size_t csize;
+  bool compressed;
+  char *fn;
+  char *tmp;
+  int fd;
+
+  compressed = fc->compress &&
+               (GNUNET_YES ==
+                GNUNET_try_compression (blob,
+                                        blob_size,
+                                        &cdata,
+                                        &csize));
+  fn = get_filename (fc,
+                     blob_hash,
+                     compressed);
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create_for_file (fn))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "mkdir",
+                              fn);
+    GNUNET_free (cdata);
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_asprintf (&tmp,
+                   "%s.XXXXXX",
+                   fn);
+  fd = mkstemp (tmp);
+  if (-1 == fd)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "mkstemp",
+                              tmp);
+    GNUNET_free (cdata);
+    GNUNET_free (tmp);
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  ch.size = GNUNET_htonll (blob_size);
+  if ( (compressed &&
+        ( (GNUNET_OK !=
+           write_all (fd,
+                      &ch,
+                      sizeof (ch))) ||
+          (GNUNET_OK !=
+           write_all (fd,
+                      cdata,
+                      csize)) ) ) ||
+       ( (! compressed) &&
+         (GNUNET_OK !=
+          write_all (fd,
+                     blob,
+                     blob_size)) ) ||
+       (0 != fsync (fd)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "write",
+                              tmp);
+    GNUNET_break (0 == close (fd));
+    GNUNET_break (0 == unlink (tmp));
+    GNUNET_free (cdata);
+    GNUNET_free (tmp);
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (cdata);
+  if ( (0 != close (fd)) ||
+       (0 != rename (tmp,
+                     fn)) )
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "rename",
+                              tmp);
+    GNUNET_break (0 == unlink (tmp));
+    GNUNET_free (tmp);
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (tmp);
+  GNUNET_free (fn);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Read the file @a fn.
+ *
+ * @param fn name of the file to read
+ * @param[out] size set to the number of bytes in @a data
+ * @param[out] data set to the file contents, caller MUST FREE
+ * @return #GNUNET_OK on success, #GNUNET_NO if the file
+ *         does not exist, #GNUNET_SYSERR on errors
+ */
+static enum GNUNET_GenericReturnValue
+read_file (const char *fn,
+           size_t *size,
+           void **data)
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  enum GNUNET_GenericReturnValue ret = GNUNET_OK;
+  off_t fsize;
+
+  fh = GNUNET_DISK_file_open (fn,
+                              GNUNET_DISK_OPEN_READ,
+                              GNUNET_DISK_PERM_NONE);
+  if (NULL == fh)
+  {
+    if (ENOENT == errno)
+      return GNUNET_NO;
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "open",
+                              fn);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK !=
+      GNUNET_DISK_file_handle_size (fh,
+                                    &fsize))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "fstat",
+                              fn);
+    ret = GNUNET_SYSERR;
+  }
+  else
+  {
+    *size = (size_t) fsize;
+    *data = GNUNET_malloc_large (GNUNET_MAX (*size, 1));
+    if (NULL == *data)
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "malloc");
+      ret = GNUNET_SYSERR;
+    }
+    else if (fsize !=
+             GNUNET_DISK_file_read (fh,
+                                    *data,
+                                    *size))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "read",
+                                fn);
+      GNUNET_free (*data);
+      ret = GNUNET_SYSERR;
+    }
+  }
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_file_close (fh));
+  return ret;
+}
+
+
+/**
+ * Retrieve a blob.  Blobs may have been stored compressed
+ * even if compression is now disabled, so we look for both.
+ *
+ * @param cls closure
+ * @param blob_hash hash of the blob to retrieve
+ * @param[out] blob_size set to the number of bytes in @a blob
+ * @param[out] blob set to the data, caller MUST FREE
+ * @return #GNUNET_OK on success, #GNUNET_NO if we do not
+ *         have the blob, #GNUNET_SYSERR on errors
+ */
+static enum GNUNET_GenericReturnValue
+file_get_blob (void *cls,
+               const struct GNUNET_HashCode *blob_hash,
+               size_t *blob_size,
+               void **blob)
+{
+  struct FileClosure *fc = cls;
+  enum GNUNET_GenericReturnValue ret;
+  struct CompressedHeaderP ch;
+  size_t size;
+  void *data;
+  char *fn;
+
+  fn = get_filename (fc,
+                     blob_hash,
+                     false);
+  ret = read_file (fn,
+                   blob_size,
+                   blob);
+  GNUNET_free (fn);
+  if (GNUNET_NO != ret)
+    return ret;
+  fn = get_filename (fc,
+                     blob_hash,
+                     true);
+  ret = read_file (fn,
+                   &size,
+                   &data);
+  if (GNUNET_OK != ret)
+  {
+    GNUNET_free (fn);
+    return ret;
+  }
+  if (size < sizeof (ch))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "File `%s' is truncated\n",
+                fn);
+    GNUNET_free (data);
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  memcpy (&ch,
+          data,
+          sizeof (ch));
+  *blob_size = (size_t) GNUNET_ntohll (ch.size);
+  *blob = GNUNET_decompress (((const char *) data) + sizeof (ch),
+                             size - sizeof (ch),
+                             *blob_size);
+  GNUNET_free (data);
+  if (NULL == *blob)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to decompress `%s'\n",
+                fn);
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (fn);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Retrieve part of a blob.  Only reads the requested part,
+ * unless the blob is compressed.
+ *
+ * @param cls closure
+ * @param blob_hash hash of the blob to retrieve
+ * @param offset offset of the first byte to retrieve
+ * @param length maximum number of bytes to retrieve
+ * @param[out] total_size set to the size of the whole blob
+ * @param[out] blob_size set to the number of bytes in @a blob,
+ *             0 if @a offset is beyond the end of the blob
+ * @param[out] blob set to the data, caller MUST FREE
+ * @return #GNUNET_OK on success, #GNUNET_NO if we do not
+ *         have the blob, #GNUNET_SYSERR on errors
+ */
+static enum GNUNET_GenericReturnValue
+file_get_blob_range (void *cls,
+                     const struct GNUNET_HashCode *blob_hash,
+                     uint64_t offset,
+                     uint64_t length,
+                     size_t *total_size,
+                     size_t *blob_size,
+                     void **blob)
+{
+  struct FileClosure *fc = cls;
+  struct stat st;
+  char *pos;
+  size_t left;
+  char *fn;
+  int fd;
+
+  fn = get_filename (fc,
+                     blob_hash,
+                     false);
+  fd = open (fn,
+             O_RDONLY);
+  if (-1 == fd)
+  {
+    enum GNUNET_GenericReturnValue ret;
+    void *data;
+
+    if (ENOENT != errno)
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "open",
+                                fn);
+      GNUNET_free (fn);
+      return GNUNET_SYSERR;
+    }
+    GNUNET_free (fn);
+    /* compressed blobs can only be decompressed as a whole */
+    ret = file_get_blob (cls,
+                         blob_hash,
+                         total_size,
+                         &data);
+    if (GNUNET_OK != ret)
+      return ret;
+    if (offset >= *total_size)
+    {
+      *blob_size = 0;
+      *blob = NULL;
+    }
+    else
+    {
+      *blob_size = (size_t) GNUNET_MIN (length,
+                                        *total_size - offset);
+      *blob = GNUNET_memdup (((const char *) data) + offset,
+                             *blob_size);
+    }
+    GNUNET_free (data);
+    return GNUNET_OK;
+  }
+  if (0 != fstat (fd,
+                  &st))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "fstat",
+                              fn);
+    GNUNET_break (0 == close (fd));
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  *total_size = (size_t) st.st_size;
+  *blob_size = (offset >= *total_size)
+    ? 0
+    : (size_t) GNUNET_MIN (length,
+                           *total_size - offset);
+  *blob = GNUNET_malloc_large (GNUNET_MAX (*blob_size, 1));
+  if (NULL == *blob)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "malloc");
+    GNUNET_break (0 == close (fd));
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  pos = *blob;
+  left = *blob_size;
+  while (0 < left)
+  {
+    ssize_t ret;
+
+    ret = pread (fd,
+                 pos,
+                 left,
+                 (off_t) offset);
+    if (-1 == ret)
+    {
+      if (EINTR == errno)
+        continue;
+      break;
+    }
+    if (0 == ret)
+      break; /* truncated meanwhile? */
+    pos += ret;
+    left -= ret;
+    offset += ret;
+  }
+  if (0 != left)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "pread",
+                              fn);
+    GNUNET_free (*blob);
+    GNUNET_break (0 == close (fd));
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_break (0 == close (fd));
+  GNUNET_free (fn);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Delete the file @a fn.
+ *
+ * @param fn name of the file to delete
+ * @return #GNUNET_OK on success, #GNUNET_NO if the file
+ *         does not exist, #GNUNET_SYSERR on errors
+ */
+static enum GNUNET_GenericReturnValue
+delete_file (const char *fn)
+{
+  if (0 == unlink (fn))
+    return GNUNET_OK;
+  if (ENOENT == errno)
+    return GNUNET_NO;
+  GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                            "unlink",
+                            fn);
+  return GNUNET_SYSERR;
+}
+
+
+/**
+ * Delete a blob.
+ *
+ * @param cls closure
+ * @param blob_hash hash of the blob to delete
+ * @return #GNUNET_OK on success, #GNUNET_NO if we do not
+ *         have the blob, #GNUNET_SYSERR on errors
+ */
+static enum GNUNET_GenericReturnValue
+file_delete_blob (void *cls,
+                  const struct GNUNET_HashCode *blob_hash)
+{
+  struct FileClosure *fc = cls;
+  enum GNUNET_GenericReturnValue ret;
+  enum GNUNET_GenericReturnValue cret;
+  char *fn;
+
+  fn = get_filename (fc,
+                     blob_hash,
+                     false);
+  ret = delete_file (fn);
+  GNUNET_free (fn);
+  fn = get_filename (fc,
+                     blob_hash,
+                     true);
+  cret = delete_file (fn);
+  GNUNET_free (fn);
+  if ( (GNUNET_SYSERR == ret) ||
+       (GNUNET_SYSERR == cret) )
+    return GNUNET_SYSERR;
+  if ( (GNUNET_OK == ret) ||
+       (GNUNET_OK == cret) )
+    return GNUNET_OK;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Initialize file blob store plugin.
+ *
+ * @param cls a configuration instance
+ * @return NULL on error, otherwise a `struct SYNC_BlobStorePlugin`
+ */
+void *
+libsync_plugin_blobstore_file_init (void *cls)
+{
+  const struct GNUNET_CONFIGURATION_Handle *cfg = cls;
+  struct FileClosure *fc;
+  struct SYNC_BlobStorePlugin *plugin;
+
+  fc = GNUNET_new (struct FileClosure);
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                               "syncdb-blobstore-file",
+                                               "DIRECTORY",
+                                               &fc->dir))
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
+                               "syncdb-blobstore-file",
+                               "DIRECTORY");
+    GNUNET_free (fc);
+    return NULL;
+  }
+  fc->compress = (GNUNET_YES ==
+                  GNUNET_CONFIGURATION_get_value_yesno (cfg,
+                                                        "syncdb-blobstore-file",
+                                                        "COMPRESS"));
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create (fc->dir))
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "syncdb-blobstore-file",
+                               "DIRECTORY",
+                               "cannot create directory");
+    GNUNET_free (fc->dir);
+    GNUNET_free (fc);
+    return NULL;
+  }
+  plugin = GNUNET_new (struct SYNC_BlobStorePlugin);
+  plugin->cls = fc;
+  plugin->put_blob = &file_put_blob;
+  plugin->get_blob = &file_get_blob;
+  plugin->get_blob_range = &file_get_blob_range;
+  plugin->delete_blob = &file_delete_blob;
+  return plugin;
+}
+
+
+/**
+ * Shutdown file blob store plugin.
+ *
+ * @param cls the plugin
+ * @return NULL (always)
+ */
+void *
+libsync_plugin_blobstore_file_done (void *cls)
+{
+  struct SYNC_BlobStorePlugin *plugin = cls;
+  struct FileClosure *fc = plugin->cls;
+
+  GNUNET_free (fc->dir);
+  GNUNET_free (fc);
+  GNUNET_free (plugin);
+  return NULL;
+}
+
+
+/* end of plugin_syncblob_file.c */
@@ -0,0 +1,570 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Lesser General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/plugin_syncblob_s3.c
+ * @brief blob store keeping backups in an S3-compatible object store
+ * @author Christian Grothoff
+ *
+ * Uses path-style requests ($ENDPOINT/$BUCKET/$KEY) signed with
+ * AWS signature version 4, which is what MinIO and most other
+ * S3-compatible stores support.
+ *
+ * Requests are synchronous, just like the database plugin using us,
+ * so while a request runs, sync-httpd does not serve any other
+ * connection.  We therefore keep the TIMEOUT short, and after the
+ * object store failed to answer, fail requests immediately for
+ * #S3_RETRY_DELAY instead of blocking on each of them.  Deployments
+ * should use COLD_AFTER, so that only downloads of rarely used
+ * backups reach the object store, and multiple --workers.
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <curl/curl.h>
+#include "sync_blobstore_plugin.h"
+#include "syncblob_s3_sign.h"
+
+
+/**
+ * How long do we wait for the object store to answer a request
+ * by default?
+ */
+#define S3_DEFAULT_TIMEOUT GNUNET_TIME_relative_multiply ( \
+    GNUNET_TIME_UNIT_SECONDS, 5)
+
+/**
+ * How long do we wait for a connection to the object store?
+ */
+#define S3_CONNECT_TIMEOUT_MS 1000L
+
+/**
+ * How long do we fail requests without trying after the object
+ * store did not answer?
+ */
+#define S3_RETRY_DELAY GNUNET_TIME_relative_multiply ( \
+    GNUNET_TIME_UNIT_SECONDS, 10)
+
+
+/**
+ * Type of the "cls" argument given to each of the functions in
+ * our API.
+ */
+struct S3Closure
+{
+  /**
+   * Handle we use for all requests, so that curl can keep the
+   * connection to the object store open.
+   */
+  CURL *eh;
+
+  /**
+   * Base URL of the object store, without trailing "/".
+   */
+  char *endpoint;
+
+  /**
+   * Host (and port) part of @e endpoint, for the signature.
+   */
+  char *host;
+
+  /**
+   * Bucket we store the blobs in.
+   */
+  char *bucket;
+
+  /**
+   * Region of the bucket.
+   */
+  char *region;
+
+  /**
+   * Access key ID for the signature.
+   */
+  char *access_key;
+
+  /**
+   * Secret access key for the signature.
+   */
+  char *secret_key;
+
+  /**
+   * How long may a request take?
+   */
+  struct GNUNET_TIME_Relative timeout;
+
+  /**
+   * Until when do we fail requests without trying, as the object
+   * store did not answer?
+   */
+  struct GNUNET_TIME_Absolute retry_after;
+};
+
+
+/**
+ * Function called by curl with data of the reply.
+ *
+ * @param ptr data received
+ * @param size always 1
+ * @param nmemb number of bytes at @a ptr
+ * @param userdata a `struct GNUNET_Buffer` to append to
+ * @return number of bytes processed
+ */
+static size_t
+reply_cb (char *ptr,
+          size_t size,
+          size_t nmemb,
+          void *userdata)
+{
+  struct GNUNET_Buffer *buf = userdata;
+
+  GNUNET_buffer_write (buf,
+                       ptr,
+                       size * nmemb);
+  return size * nmemb;
+}
+
+
+/**
+ * Run a signed request against the object store.
+ *
+ * @param sc plugin context
+ * @param method HTTP method to use
+ * @param blob_hash hash of the blob the request is about
+ * @param body request body, NULL for none
+ * @param body_size number of bytes in @a body
+ * @param[out] reply where to store the body of the reply
+ * @return HTTP status of the reply, 0 if the request failed
+ */
+static long
+s3_request (struct S3Closure *sc,
+            const char *method,
+            const struct GNUNET_HashCode *blob_hash,
+            const void *body,
+            size_t body_size,
+            struct GNUNET_Buffer *reply)
+{
+  struct GNUNET_CRYPTO_HashAsciiEncoded key;
+  char amz_date[sizeof ("YYYYMMDDTHHMMSSZ")];
+  char payload_hash[SYNC_S3_HEX_SIZE];
+  char signature[SYNC_S3_HEX_SIZE];
+  struct curl_slist *headers = NULL;
+  char *path;
+  char *hdr;
+  CURLcode ec;
+  long http_status = 0;
+
+  if (GNUNET_TIME_absolute_is_future (sc->retry_after))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Object store unavailable, failing %s without trying\n",
+                method);
+    return 0;
+  }
+  GNUNET_CRYPTO_hash_to_enc (blob_hash,
+                             &key);
+  {
+    time_t now = time (NULL);
+    struct tm tm;
+
+    GNUNET_assert (NULL != gmtime_r (&now,
+                                     &tm));
+    GNUNET_assert (0 != strftime (amz_date,
+                                  sizeof (amz_date),
+                                  "%Y%m%dT%H%M%SZ",
+                                  &tm));
+  }
+  SYNC_S3_sha256_hex ((NULL == body) ? "" : body,
+                      body_size,
+                      payload_hash);
+  GNUNET_asprintf (&path,
+                   "/%s/%s",
+                   sc->bucket,
+                   (const char *) key.encoding);
+  SYNC_S3_sign (method,
+                path,
+                "",
+                sc->host,
+                payload_hash,
+                amz_date,
+                sc->region,
+                sc->secret_key,
+                signature);
+
+  GNUNET_asprintf (&hdr,
+                   "Host: %s",
+                   sc->host);
+  headers = curl_slist_append (headers,
+                               hdr);
+  GNUNET_free (hdr);
+  GNUNET_asprintf (&hdr,
+                   "x-amz-content-sha256: %s",
+                   payload_hash);
+  headers = curl_slist_append (headers,
+                               hdr);
+  GNUNET_free (hdr);
+  GNUNET_asprintf (&hdr,
+                   "x-amz-date: %s",
+                   amz_date);
+  headers = curl_slist_append (headers,
+                               hdr);
+  GNUNET_free (hdr);
+  GNUNET_asprintf (&hdr,
+                   "Authorization: AWS4-HMAC-SHA256"
+                   " Credential=%s/%.8s/%s/s3/aws4_request,"
+                   " SignedHeaders=" SYNC_S3_SIGNED_HEADERS ","
+                   " Signature=%s",
+                   sc->access_key,
+                   amz_date,
+                   sc->region,
+                   signature);
+  headers = curl_slist_append (headers,
+                               hdr);
+  GNUNET_free (hdr);
+  /* curl would add these for PUT, but they are not needed */
+  headers = curl_slist_append (headers,
+                               "Expect:");
+  headers = curl_slist_append (headers,
+                               "Content-Type:");
+  GNUNET_assert (NULL != headers);
+
+  GNUNET_asprintf (&hdr,
+                   "%s%s",
+                   sc->endpoint,
+                   path);
+  GNUNET_free (path);
+  curl_easy_reset (sc->eh);
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (sc->eh,
+                                   CURLOPT_URL,
+                                   hdr));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (sc->eh,
+                                   CURLOPT_HTTPHEADER,
+                                   headers));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (sc->eh,
+                                   CURLOPT_CUSTOMREQUEST,
+                                   method));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (sc->eh,
+                                   CURLOPT_TIMEOUT_MS,
+                                   (long) (sc->timeout.rel_value_us
+                                           / 1000LL)));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (sc->eh,
+                                   CURLOPT_CONNECTTIMEOUT_MS,
+                                   S3_CONNECT_TIMEOUT_MS));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (sc->eh,
+                                   CURLOPT_WRITEFUNCTION,
+                                   &reply_cb));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (sc->eh,
+                                   CURLOPT_WRITEDATA,
+                                   reply));
+  if (NULL != body)
+  {
+    GNUNET_assert (CURLE_OK ==
+                   curl_easy_setopt (sc->eh,
+                                     CURLOPT_POSTFIELDS,
+                                     body));
+    GNUNET_assert (CURLE_OK ==
+                   curl_easy_setopt (sc->eh,
+                                     CURLOPT_POSTFIELDSIZE_LARGE,
+                                     (curl_off_t) body_size));
+  }
+  ec = curl_easy_perform (sc->eh);
+  if (CURLE_OK != ec)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "%s %s failed: %s\n",
+                method,
+                hdr,
+                curl_easy_strerror (ec));
+    sc->retry_after = GNUNET_TIME_relative_to_absolute (S3_RETRY_DELAY);
+  }
+  else
+    GNUNET_break (CURLE_OK ==
+                  curl_easy_getinfo (sc->eh,
+                                     CURLINFO_RESPONSE_CODE,
+                                     &http_status));
+  curl_slist_free_all (headers);
+  if ( (0 != http_status) &&
+       (2 != http_status / 100) &&
+       (404 != http_status) )
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "%s %s failed with HTTP status %ld\n",
+                method,
+                hdr,
+                http_status);
+  GNUNET_free (hdr);
+  return http_status;
+}
+
+
+/**
+ * Store a blob.
+ *
+ * @param cls closure
+ * @param blob_hash hash of @a blob
+ * @param blob_size number of bytes in @a blob
+ * @param blob data to store
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+s3_put_blob (void *cls,
+             const struct GNUNET_HashCode *blob_hash,
+             size_t blob_size,
+             const void *blob)
+{
+  struct S3Closure *sc = cls;
+  struct GNUNET_Buffer reply = { 0 };
+  long http_status;
+
+  http_status = s3_request (sc,
+                            "PUT",
+                            blob_hash,
+                            blob,
+                            blob_size,
+                            &reply);
+  GNUNET_buffer_clear (&reply);
+  return (200 == http_status)
+    ? GNUNET_OK
+    : GNUNET_SYSERR;
+}
+
+
+/**
+ * Retrieve a blob.
+ *
+ * @param cls closure
+ * @param blob_hash hash of the blob to retrieve
+ * @param[out] blob_size set to the number of bytes in @a blob
+ * @param[out] blob set to the data, caller MUST FREE
+ * @return #GNUNET_OK on success, #GNUNET_NO if we do not
+ *         have the blob, #GNUNET_SYSERR on errors
+ */
+static enum GNUNET_GenericReturnValue
+s3_get_blob (void *cls,
+             const struct GNUNET_HashCode *blob_hash,
+             size_t *blob_size,
+             void **blob)
+{
+  struct S3Closure *sc = cls;
+  struct GNUNET_Buffer reply = { 0 };
+  long http_status;
+
+  http_status = s3_request (sc,
+                            "GET",
+                            blob_hash,
+                            NULL,
+                            0,
+                            &reply);
+  switch (http_status)
+  {
+  case 200:
+    *blob = GNUNET_buffer_reap (&reply,
+                                blob_size);
+    return GNUNET_OK;
+  case 404:
+    GNUNET_buffer_clear (&reply);
+    return GNUNET_NO;
+  default:
+    GNUNET_buffer_clear (&reply);
+    return GNUNET_SYSERR;
+  }
+}
+
+
+/**
+ * Delete a blob.  S3 does not tell us whether the object
+ * existed, so we never return #GNUNET_NO.
+ *
+ * @param cls closure
+ * @param blob_hash hash of the blob to delete
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on errors
+ */
+static enum GNUNET_GenericReturnValue
+s3_delete_blob (void *cls,
+                const struct GNUNET_HashCode *blob_hash)
+{
+  struct S3Closure *sc = cls;
+  struct GNUNET_Buffer reply = { 0 };
+  long http_status;
+
+  http_status = s3_request (sc,
+                            "DELETE",
+                            blob_hash,
+                            NULL,
+                            0,
+                            &reply);
+  GNUNET_buffer_clear (&reply);
+  switch (http_status)
+  {
+  case 200:
+  case 204:
+    return GNUNET_OK;
+  case 404:
+    return GNUNET_NO;
+  default:
+    return GNUNET_SYSERR;
+  }
+}
+
+
+/**
+ * Free the configuration part of @a sc.
+ *
+ * @param[in] sc plugin context to clean up
+ */
+static void
+free_closure (struct S3Closure *sc)
+{
+  GNUNET_free (sc->endpoint);
+  GNUNET_free (sc->host);
+  GNUNET_free (sc->bucket);
+  GNUNET_free (sc->region);
+  GNUNET_free (sc->access_key);
+  GNUNET_free (sc->secret_key);
+  GNUNET_free (sc);
+}
+
+
+/**
+ * Initialize S3 blob store plugin.
+ *
+ * @param cls a configuration instance
+ * @return NULL on error, otherwise a `struct SYNC_BlobStorePlugin`
+ */
+void *
+libsync_plugin_blobstore_s3_init (void *cls)
+{
+  const struct GNUNET_CONFIGURATION_Handle *cfg = cls;
+  struct S3Closure *sc = GNUNET_new (struct S3Closure);
+  struct SYNC_BlobStorePlugin *plugin;
+  struct
+  {
+    const char *option;
+    char **value;
+  } options[] = {
+    { "ENDPOINT", &sc->endpoint },
+    { "BUCKET", &sc->bucket },
+    { "REGION", &sc->region },
+    { "ACCESS_KEY_ID", &sc->access_key },
+    { "SECRET_ACCESS_KEY", &sc->secret_key },
+    { NULL, NULL }
+  };
+  const char *host;
+  size_t len;
+
+  for (unsigned int i = 0; NULL != options[i].option; i++)
+  {
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_string (cfg,
+                                               "syncdb-blobstore-s3",
+                                               options[i].option,
+                                               options[i].value))
+    {
+      GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
+                                 "syncdb-blobstore-s3",
+                                 options[i].option);
+      free_closure (sc);
+      return NULL;
+    }
+  }
+  len = strlen (sc->endpoint);
+  while ( (len > 0) &&
+          ('/' == sc->endpoint[len - 1]) )
+    sc->endpoint[--len] = '\0';
+  host = strstr (sc->endpoint,
+                 "://");
+  if ( (NULL == host) ||
+       ('\0' == host[3]) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "syncdb-blobstore-s3",
+                               "ENDPOINT",
+                               "must be a URL like http://localhost:9000/");
+    free_closure (sc);
+    return NULL;
+  }
+  host += 3;
+  sc->host = GNUNET_strndup (host,
+                             strcspn (host,
+                                      "/"));
+  sc->timeout = S3_DEFAULT_TIMEOUT;
+  if ( (GNUNET_YES ==
+        GNUNET_CONFIGURATION_have_value (cfg,
+                                         "syncdb-blobstore-s3",
+                                         "TIMEOUT")) &&
+       ( (GNUNET_OK !=
+          GNUNET_CONFIGURATION_get_value_time (cfg,
+                                               "syncdb-blobstore-s3",
+                                               "TIMEOUT",
+                                               &sc->timeout)) ||
+         (sc->timeout.rel_value_us < 1000LL) ||
+         (GNUNET_TIME_relative_is_forever (sc->timeout)) ) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "syncdb-blobstore-s3",
+                               "TIMEOUT",
+                               "must be a finite relative time of at least 1 ms");
+    free_closure (sc);
+    return NULL;
+  }
+  if (CURLE_OK != curl_global_init (CURL_GLOBAL_DEFAULT))
+  {
+    GNUNET_break (0);
+    free_closure (sc);
+    return NULL;
+  }
+  sc->eh = curl_easy_init ();
+  if (NULL == sc->eh)
+  {
+    GNUNET_break (0);
+    curl_global_cleanup ();
+    free_closure (sc);
+    return NULL;
+  }
+  plugin = GNUNET_new (struct SYNC_BlobStorePlugin);
+  plugin->cls = sc;
+  plugin->put_blob = &s3_put_blob;
+  plugin->get_blob = &s3_get_blob;
+  plugin->delete_blob = &s3_delete_blob;
+  return plugin;
+}
+
+
+/**
+ * Shutdown S3 blob store plugin.
+ *
+ * @param cls the plugin
+ * @return NULL (always)
+ */
+void *
+libsync_plugin_blobstore_s3_done (void *cls)
+{
+  struct SYNC_BlobStorePlugin *plugin = cls;
+  struct S3Closure *sc = plugin->cls;
+
+  curl_easy_cleanup (sc->eh);
+  curl_global_cleanup ();
+  free_closure (sc);
+  GNUNET_free (plugin);
+  return NULL;
+}
+
+
+/* end of plugin_syncblob_s3.c */
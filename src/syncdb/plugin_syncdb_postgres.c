@@ -26,6 +26,24 @@
 #include "sync_database_plugin.h"
 #include "sync_database_lib.h"
 
+/**
+ * How often do we try to store a backup if the garbage
+ * collection removed its blob before we could reference it?
+ */
+#define MAX_BLOB_RETRIES 2
+
+/**
+ * How long do we wait before trying to connect to the read
+ * replica again after it failed?
+ */
+#define REPLICA_RETRY_DELAY GNUNET_TIME_UNIT_MINUTES
+
+/**
+ * How precisely do we track when a blob was last accessed?
+ * Coarse tracking avoids a write for every download.
+ */
+#define ACCESS_GRANULARITY GNUNET_TIME_UNIT_DAYS
+
 /**
  * Type of the "cls" argument given to each of the functions in
  * our API.
@@ -38,6 +56,21 @@ struct PostgresClosure
    */
   struct GNUNET_PQ_Context *conn;
 
+  /**
+   * Connection to the read replica, NULL if not connected.
+   */
+  struct GNUNET_PQ_Context *read_conn;
+
+  /**
+   * Connection string of the read replica, NULL if we have none.
+   */
+  char *read_config;
+
+  /**
+   * When may we try again to connect to the read replica?
+   */
+  struct GNUNET_TIME_Absolute read_retry;
+
   /**
    * Directory with SQL statements to run to create tables.
    */
@@ -58,6 +91,23 @@ struct PostgresClosure
    */
   char *currency;
 
+  /**
+   * Number of previous versions of each backup to keep.
+   */
+  unsigned long long history_size;
+
+  /**
+   * Where to keep the backup data, NULL to keep it in the database.
+   */
+  struct SYNC_BlobStorePlugin *blobstore;
+
+  /**
+   * How long after the last access may blobs be moved from the
+   * database to the @e blobstore?  Zero if all new blobs go to
+   * the @e blobstore right away.
+   */
+  struct GNUNET_TIME_Relative cold_after;
+
   /**
    * Did we initialize the prepared statements
    * for this session?
@@ -100,6 +150,83 @@ postgres_drop_tables (void *cls)
 }
 
 
+/**
+ * Prepare the statements we may also run on a read replica.
+ *
+ * @param conn connection to prepare the statements on
+ * @return #GNUNET_OK upon success; #GNUNET_SYSERR upon failure
+ */
+static enum GNUNET_GenericReturnValue
+prepare_read_statements (struct GNUNET_PQ_Context *conn)
+{
+  struct GNUNET_PQ_PreparedStatement ps[] = {
+    GNUNET_PQ_make_prepare ("account_select",
+                            "SELECT"
+                            " expiration_date "
+                            "FROM"
+                            " accounts "
+                            "WHERE"
+                            " account_pub=$1;"),
+    GNUNET_PQ_make_prepare ("payments_select_by_account",
+                            "SELECT"
+                            " timestamp"
+                            ",order_id"
+                            ",token"
+                            ",amount"
+                            " FROM payments"
+                            " WHERE"
+                            "  paid=FALSE"
+                            " AND"
+                            "  account_pub=$1;"),
+    GNUNET_PQ_make_prepare ("backup_select_hash",
+                            "SELECT "
+                            " backup_hash "
+                            "FROM"
+                            " backups "
+                            "WHERE"
+                            " account_pub=$1;"),
+    GNUNET_PQ_make_prepare ("backup_select",
+                            "SELECT "
+                            " account_sig"
+                            ",prev_hash"
+                            ",backup_hash"
+                            ",data "
+                            "FROM"
+                            " backups"
+                            " JOIN blobs USING (backup_hash) "
+                            "WHERE"
+                            " account_pub=$1;"),
+    GNUNET_PQ_make_prepare ("backup_select_meta",
+                            "SELECT "
+                            " account_sig"
+                            ",prev_hash"
+                            ",backup_hash "
+                            "FROM"
+                            " backups "
+                            "WHERE"
+                            " account_pub=$1;"),
+    GNUNET_PQ_make_prepare ("backup_select_range",
+                            "SELECT "
+                            " account_sig"
+                            ",prev_hash"
+                            ",backup_hash"
+                            ",COALESCE(octet_length(data),data_size)"
+                            "   AS total_size"
+                            ",data IS NULL AS external"
+                            ",substring(data FROM $2 FOR $3) AS data "
+                            "FROM"
+                            " backups"
+                            " JOIN blobs USING (backup_hash) "
+                            "WHERE"
+                            " account_pub=$1;"),
+    GNUNET_PQ_PREPARED_STATEMENT_END
+  };
+
+  return GNUNET_PQ_prepare_statements (conn,
+                                       ps);
+}
+
+
 /**
  * Establish connection to the database.
  *
@@ -142,13 +269,6 @@ prepare_statements (void *cls)
                             " expiration_date=$1 "
                             "WHERE"
                             " account_pub=$2;"),
-    GNUNET_PQ_make_prepare ("account_select",
-                            "SELECT"
-                            " expiration_date "
-                            "FROM"
-                            " accounts "
-                            "WHERE"
-                            " account_pub=$1;"),
     GNUNET_PQ_make_prepare ("payments_select",
                             "SELECT"
                             " account_pub"
@@ -156,17 +276,6 @@ prepare_statements (void *cls)
                             ",amount"
                             " FROM payments"
                             " WHERE paid=FALSE;"),
-    GNUNET_PQ_make_prepare ("payments_select_by_account",
-                            "SELECT"
-                            " timestamp"
-                            ",order_id"
-                            ",token"
-                            ",amount"
-                            " FROM payments"
-                            " WHERE"
-                            "  paid=FALSE"
-                            " AND"
-                            "  account_pub=$1;"),
     GNUNET_PQ_make_prepare ("gc_accounts",
                             "DELETE FROM accounts "
                             "WHERE"
@@ -177,49 +286,238 @@ prepare_statements (void *cls)
                             "  paid=FALSE"
                             " AND"
                             "  timestamp < $1;"),
+    GNUNET_PQ_make_prepare ("blob_select",
+                            "SELECT"
+                            " 1 AS present "
+                            "FROM"
+                            " blobs "
+                            "WHERE"
+                            " backup_hash=$1;"),
+    GNUNET_PQ_make_prepare ("blob_insert",
+                            "INSERT INTO blobs "
+                            "(backup_hash"
+                            ",data"
+                            ",data_size"
+                            ",last_access"
+                            ") VALUES "
+                            "($1,$2,$3,$4)"
+                            " ON CONFLICT DO NOTHING;"),
+    GNUNET_PQ_make_prepare ("blob_touch",
+                            "UPDATE blobs"
+                            " SET"
+                            " last_access=$2"
+                            " WHERE"
+                            "   backup_hash=$1"
+                            "  AND"
+                            "   last_access < $3;"),
+    GNUNET_PQ_make_prepare ("blob_rehydrate",
+                            "UPDATE blobs"
+                            " SET"
+                            " data=$2"
+                            ",data_size=NULL"
+                            ",last_access=$3"
+                            " WHERE"
+                            "   backup_hash=$1"
+                            "  AND"
+                            "   data IS NULL;"),
+    GNUNET_PQ_make_prepare ("blobs_select_cold",
+                            "SELECT"
+                            " backup_hash"
+                            ",data "
+                            "FROM"
+                            " blobs "
+                            "WHERE"
+                            "  data IS NOT NULL"
+                            " AND"
+                            "  last_access < $1"
+                            " AND"
+                            "  refcount > 0 "
+                            "ORDER BY last_access ASC "
+                            "LIMIT $2;"),
+    GNUNET_PQ_make_prepare ("blob_make_cold",
+                            "UPDATE blobs"
+                            " SET"
+                            " data=NULL"
+                            ",data_size=octet_length(data)"
+                            " WHERE"
+                            "   backup_hash=$1"
+                            "  AND"
+                            "   data IS NOT NULL"
+                            "  AND"
+                            "   last_access < $2;"),
+    GNUNET_PQ_make_prepare ("storage_stats",
+                            "SELECT"
+                            " COUNT(*) FILTER (WHERE data IS NOT NULL)"
+                            "   AS hot_blobs"
+                            ",COALESCE(SUM(octet_length(data)),0)::INT8"
+                            "   AS hot_bytes"
+                            ",COUNT(*) FILTER (WHERE data IS NULL)"
+                            "   AS cold_blobs"
+                            ",COALESCE(SUM(data_size) FILTER (WHERE data IS NULL),0)::INT8"
+                            "   AS cold_bytes "
+                            "FROM"
+                            " blobs;"),
+    GNUNET_PQ_make_prepare ("gc_blobs",
+                            "DELETE FROM blobs "
+                            "WHERE"
+                            "  refcount=0"
+                            " AND"
+                            "  data IS NOT NULL;"),
+    GNUNET_PQ_make_prepare ("gc_blobs_external",
+                            "DELETE FROM blobs "
+                            "WHERE"
+                            "  refcount=0"
+                            " AND"
+                            "  data IS NULL "
+                            "RETURNING backup_hash;"),
+    /* with a cold tier, hot blobs may still have a copy in
+       the blob store from before they were downloaded again */
+    GNUNET_PQ_make_prepare ("gc_blobs_tiered",
+                            "DELETE FROM blobs "
+                            "WHERE"
+                            " refcount=0 "
+                            "RETURNING backup_hash;"),
     GNUNET_PQ_make_prepare ("backup_insert",
                             "INSERT INTO backups "
                             "(account_pub"
                             ",account_sig"
                             ",prev_hash"
                             ",backup_hash"
-                            ",data"
                             ") VALUES "
-                            "($1,$2,$3,$4,$5);"),
+                            "($1,$2,$3,$4);"),
     GNUNET_PQ_make_prepare ("backup_update",
                             "UPDATE backups "
                             " SET"
                             " backup_hash=$1"
                             ",account_sig=$2"
                             ",prev_hash=$3"
-                            ",data=$4"
+                            ",generation=generation+1"
                             " WHERE"
-                            "   account_pub=$5"
+                            "   account_pub=$4"
                             "  AND"
-                            "   backup_hash=$6;"),
-    GNUNET_PQ_make_prepare ("backup_select_hash",
+                            "   backup_hash=$5;"),
+    /* Same as backup_update, but keeps the old version
+       in the backup_history */
+    GNUNET_PQ_make_prepare ("backup_update_keep",
+                            "WITH old AS ("
+                            "  SELECT"
+                            "   account_pub"
+                            "  ,generation"
+                            "  ,account_sig"
+                            "  ,prev_hash"
+                            "  ,backup_hash"
+                            "  FROM backups"
+                            "  WHERE"
+                            "    account_pub=$4"
+                            "   AND"
+                            "    backup_hash=$5"
+                            "  FOR UPDATE"
+                            "), hist AS ("
+                            "  INSERT INTO backup_history"
+                            "  (account_pub"
+                            "  ,generation"
+                            "  ,account_sig"
+                            "  ,prev_hash"
+                            "  ,backup_hash"
+                            "  ) SELECT * FROM old"
+                            "  ON CONFLICT DO NOTHING"
+                            ") "
+                            "UPDATE backups "
+                            " SET"
+                            " backup_hash=$1"
+                            ",account_sig=$2"
+                            ",prev_hash=$3"
+                            ",generation=generation+1"
+                            " WHERE"
+                            "   account_pub=$4"
+                            "  AND"
+                            "   backup_hash=$5;"),
+    GNUNET_PQ_make_prepare ("gc_history",
+                            "DELETE FROM backup_history h"
+                            " USING backups b"
+                            " WHERE"
+                            "   h.account_pub=b.account_pub"
+                            "  AND"
+                            "   h.generation < b.generation - $1;"),
+    GNUNET_PQ_make_prepare ("backup_select_version",
                             "SELECT "
-                            " backup_hash "
+                            " account_sig"
+                            ",prev_hash"
+                            ",data "
                             "FROM"
-                            " backups "
+                            " backups"
+                            " JOIN blobs USING (backup_hash) "
                             "WHERE"
-                            " account_pub=$1;"),
-    GNUNET_PQ_make_prepare ("backup_select",
+                            "  account_pub=$1"
+                            " AND"
+                            "  backup_hash=$2 "
+                            "UNION ALL "
                             "SELECT "
                             " account_sig"
                             ",prev_hash"
-                            ",backup_hash"
                             ",data "
                             "FROM"
-                            " backups "
+                            " backup_history"
+                            " JOIN blobs USING (backup_hash) "
                             "WHERE"
-                            " account_pub=$1;"),
+                            "  account_pub=$1"
+                            " AND"
+                            "  backup_hash=$2 "
+                            "LIMIT 1;"),
+    /* The size limit is applied here, so we never fetch the data
+       of backups that would not fit into the reply.  The first
+       backup with data is always returned. */
+    GNUNET_PQ_make_prepare ("backups_select_batch",
+                            "WITH r AS ("
+                            " SELECT"
+                            "  b.account_pub"
+                            " ,b.account_sig"
+                            " ,b.prev_hash"
+                            " ,b.backup_hash"
+                            " ,b.backup_hash = q.known_hash AS known"
+                            " ,q.ord"
+                            " ,(SELECT COALESCE(octet_length(data),data_size,0)"
+                            "     FROM blobs"
+                            "    WHERE blobs.backup_hash=b.backup_hash)"
+                            "    AS backup_size"
+                            " FROM"
+                            "  unnest($1::BYTEA[],$2::BYTEA[])"
+                            "    WITH ORDINALITY AS q(account_pub,known_hash,ord)"
+                            "  JOIN backups b"
+                            "    ON (b.account_pub=q.account_pub)"
+                            "), t AS ("
+                            " SELECT"
+                            "  r.*"
+                            " ,SUM(CASE WHEN known THEN 0 ELSE backup_size END)"
+                            "    OVER (ORDER BY ord)::INT8 AS total"
+                            " FROM r"
+                            ")"
+                            "SELECT"
+                            " account_pub"
+                            ",account_sig"
+                            ",prev_hash"
+                            ",backup_hash"
+                            ",known"
+                            ",backup_size::INT8 AS backup_size"
+                            ",(NOT known AND total > $3::INT8 AND total > backup_size)"
+                            "   AS omitted"
+                            ",CASE WHEN known OR (total > $3::INT8 AND total > backup_size)"
+                            "  THEN NULL"
+                            "  ELSE (SELECT data"
+                            "          FROM blobs"
+                            "         WHERE blobs.backup_hash=t.backup_hash)"
+                            " END AS data "
+                            "FROM t "
+                            "ORDER BY ord;"),
     GNUNET_PQ_make_prepare ("do_commit",
                             "COMMIT"),
     GNUNET_PQ_PREPARED_STATEMENT_END
   };
   enum GNUNET_GenericReturnValue ret;
 
+  ret = prepare_read_statements (pg->conn);
+  if (GNUNET_OK != ret)
+    return ret;
   ret = GNUNET_PQ_prepare_statements (pg->conn,
                                       ps);
   if (GNUNET_OK != ret)
@@ -351,6 +649,54 @@ check_connection (void *cls)
 }
 
 
+/**
+ * Get the connection to use for reads that may lag behind
+ * the primary.
+ *
+ * @param pg the plugin-specific state
+ * @return connection to the read replica, or to the primary if
+ *         we have no (working) replica
+ */
+static struct GNUNET_PQ_Context *
+get_read_conn (struct PostgresClosure *pg)
+{
+  if ( (NULL == pg->read_config) ||
+       (NULL != pg->transaction_name) )
+    return pg->conn;
+  if (NULL == pg->read_conn)
+  {
+    struct GNUNET_PQ_ExecuteStatement es[] = {
+      GNUNET_PQ_make_execute ("SET search_path TO sync;"),
+      GNUNET_PQ_EXECUTE_STATEMENT_END
+    };
+
+    if (GNUNET_TIME_absolute_is_future (pg->read_retry))
+      return pg->conn;
+    pg->read_conn = GNUNET_PQ_connect (pg->read_config,
+                                       NULL,
+                                       es,
+                                       NULL);
+    if ( (NULL != pg->read_conn) &&
+         (GNUNET_OK !=
+          prepare_read_statements (pg->read_conn)) )
+    {
+      GNUNET_PQ_disconnect (pg->read_conn);
+      pg->read_conn = NULL;
+    }
+    if (NULL == pg->read_conn)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Failed to connect to read replica, using primary\n");
+      pg->read_retry
+        = GNUNET_TIME_relative_to_absolute (REPLICA_RETRY_DELAY);
+      return pg->conn;
+    }
+  }
+  GNUNET_PQ_reconnect_if_down (pg->read_conn);
+  return pg->read_conn;
+}
+
+
 /**
  * Start a transaction.
  *
@@ -432,6 +778,90 @@ commit_transaction (void *cls)
 }
 
 
+/**
+ * Helper function for #gc_external_blobs().
+ * To be called with the results of a DELETE statement
+ * that has returned @a num_results results.
+ *
+ * @param cls our `struct PostgresClosure *`
+ * @param result the postgres result
+ * @param num_result the number of results in @a result
+ */
+static void
+gc_external_cb (void *cls,
+                PGresult *result,
+                unsigned int num_results)
+{
+  struct PostgresClosure *pg = cls;
+
+  for (unsigned int i = 0; i < num_results; i++)
+  {
+    struct GNUNET_HashCode backup_hash;
+    struct GNUNET_PQ_ResultSpec rs[] = {
+      GNUNET_PQ_result_spec_auto_from_type ("backup_hash",
+                                            &backup_hash),
+      GNUNET_PQ_result_spec_end
+    };
+
+    if (GNUNET_OK !=
+        GNUNET_PQ_extract_result (result,
+                                  rs,
+                                  i))
+    {
+      GNUNET_break (0);
+      continue;
+    }
+    /* failing to delete only leaks the blob, which is harmless */
+    if (GNUNET_SYSERR ==
+        pg->blobstore->delete_blob (pg->blobstore->cls,
+                                    &backup_hash))
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Failed to delete blob %s from blob store\n",
+                  GNUNET_h2s (&backup_hash));
+  }
+}
+
+
+/**
+ * Remove unreferenced blobs kept in the blob store.  The blobs
+ * are deleted from the blob store before the transaction that
+ * removes them from the database commits.  Thus, an upload that
+ * finds the blob missing in the database (and stores it again)
+ * cannot have its data deleted by us, while an upload that
+ * still found the blob blocks on our row locks and is retried
+ * once we are done.
+ *
+ * @param pg plugin context
+ * @param stmt statement deleting the blobs and returning their hashes
+ * @return transaction status
+ */
+static enum GNUNET_DB_QueryStatus
+gc_external_blobs (struct PostgresClosure *pg,
+                   const char *stmt)
+{
+  struct GNUNET_PQ_QueryParam no_params[] = {
+    GNUNET_PQ_query_param_end
+  };
+  enum GNUNET_DB_QueryStatus qs;
+
+  if (GNUNET_OK !=
+      begin_transaction (pg,
+                         stmt))
+    return GNUNET_DB_STATUS_HARD_ERROR;
+  qs = GNUNET_PQ_eval_prepared_multi_select (pg->conn,
+                                             stmt,
+                                             no_params,
+                                             &gc_external_cb,
+                                             pg);
+  if (qs < 0)
+  {
+    rollback (pg);
+    return qs;
+  }
+  return commit_transaction (pg);
+}
+
+
 /**
  * Function called to perform "garbage collection" on the
  * database, expiring records we no longer require.  Deletes
@@ -459,6 +889,14 @@ postgres_gc (void *cls,
     GNUNET_PQ_query_param_absolute_time (&expire_pending_payments),
     GNUNET_PQ_query_param_end
   };
+  uint64_t history_size = pg->history_size;
+  struct GNUNET_PQ_QueryParam params3[] = {
+    GNUNET_PQ_query_param_uint64 (&history_size),
+    GNUNET_PQ_query_param_end
+  };
+  struct GNUNET_PQ_QueryParam no_params[] = {
+    GNUNET_PQ_query_param_end
+  };
   enum GNUNET_DB_QueryStatus qs;
 
   check_connection (pg);
@@ -468,6 +906,34 @@ postgres_gc (void *cls,
                                            params);
   if (qs < 0)
     return qs;
+  /* pruning the history here keeps it off the upload path */
+  qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
+                                           "gc_history",
+                                           params3);
+  if (qs < 0)
+    return qs;
+  if (! GNUNET_TIME_relative_is_zero (pg->cold_after))
+  {
+    qs = gc_external_blobs (pg,
+                            "gc_blobs_tiered");
+    if (qs < 0)
+      return qs;
+  }
+  else
+  {
+    qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
+                                             "gc_blobs",
+                                             no_params);
+    if (qs < 0)
+      return qs;
+    if (NULL != pg->blobstore)
+    {
+      qs = gc_external_blobs (pg,
+                              "gc_blobs_external");
+      if (qs < 0)
+        return qs;
+    }
+  }
   return GNUNET_PQ_eval_prepared_non_select (pg->conn,
                                              "gc_pending_payments",
                                              params2);
@@ -475,12 +941,192 @@ postgres_gc (void *cls,
 
 
 /**
- * Store payment. Used to begin a payment, not indicative
- * that the payment actually was made. (That is done
- * when we increment the account's lifetime.)
- *
- * @param cls closure
- * @param account_pub account to store @a backup under
+ * Closure for #migrate_cb.
+ */
+struct MigrateContext
+{
+  /**
+   * Plugin context.
+   */
+  struct PostgresClosure *pg;
+
+  /**
+   * Only move blobs last accessed before this time.
+   */
+  struct GNUNET_TIME_Absolute cutoff;
+
+  /**
+   * Query status to return.
+   */
+  enum GNUNET_DB_QueryStatus qs;
+};
+
+
+/**
+ * Helper function for #postgres_migrate_cold().
+ * To be called with the results of a SELECT statement
+ * that has returned @a num_results results.
+ *
+ * @param cls closure of type `struct MigrateContext *`
+ * @param result the postgres result
+ * @param num_result the number of results in @a result
+ */
+static void
+migrate_cb (void *cls,
+            PGresult *result,
+            unsigned int num_results)
+{
+  struct MigrateContext *mc = cls;
+  struct PostgresClosure *pg = mc->pg;
+
+  for (unsigned int i = 0; i < num_results; i++)
+  {
+    struct GNUNET_HashCode backup_hash;
+    void *backup;
+    size_t backup_size;
+    struct GNUNET_PQ_ResultSpec rs[] = {
+      GNUNET_PQ_result_spec_auto_from_type ("backup_hash",
+                                            &backup_hash),
+      GNUNET_PQ_result_spec_variable_size ("data",
+                                           &backup,
+                                           &backup_size),
+      GNUNET_PQ_result_spec_end
+    };
+    struct GNUNET_PQ_QueryParam params[] = {
+      GNUNET_PQ_query_param_auto_from_type (&backup_hash),
+      GNUNET_PQ_query_param_absolute_time (&mc->cutoff),
+      GNUNET_PQ_query_param_end
+    };
+    enum GNUNET_DB_QueryStatus qs;
+
+    if (GNUNET_OK !=
+        GNUNET_PQ_extract_result (result,
+                                  rs,
+                                  i))
+    {
+      GNUNET_break (0);
+      mc->qs = GNUNET_DB_STATUS_HARD_ERROR;
+      return;
+    }
+    if (GNUNET_OK !=
+        pg->blobstore->put_blob (pg->blobstore->cls,
+                                 &backup_hash,
+                                 backup_size,
+                                 backup))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Failed to store blob %s in blob store\n",
+                  GNUNET_h2s (&backup_hash));
+      GNUNET_PQ_cleanup_result (rs);
+      mc->qs = GNUNET_DB_STATUS_HARD_ERROR;
+      return;
+    }
+    GNUNET_PQ_cleanup_result (rs);
+    /* does nothing if the blob was accessed meanwhile */
+    qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
+                                             "blob_make_cold",
+                                             params);
+    if (qs < 0)
+    {
+      mc->qs = qs;
+      return;
+    }
+    mc->qs += qs;
+  }
+}
+
+
+/**
+ * Move blobs that were not accessed since @a cutoff from the
+ * database to the blob store (the cold tier).  The data is
+ * stored in the blob store before it is removed from the
+ * database, so the blob is always readable from one of them.
+ *
+ * @param cls closure
+ * @param cutoff move blobs last accessed before this time
+ * @param limit maximum number of blobs to move
+ * @return transaction status, number of blobs moved on success
+ */
+static enum GNUNET_DB_QueryStatus
+postgres_migrate_cold (void *cls,
+                       struct GNUNET_TIME_Absolute cutoff,
+                       unsigned int limit)
+{
+  struct PostgresClosure *pg = cls;
+  struct MigrateContext mc = {
+    .pg = pg,
+    .cutoff = cutoff
+  };
+  uint64_t limit64 = limit;
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_absolute_time (&cutoff),
+    GNUNET_PQ_query_param_uint64 (&limit64),
+    GNUNET_PQ_query_param_end
+  };
+  enum GNUNET_DB_QueryStatus qs;
+
+  if (NULL == pg->blobstore)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Cannot move blobs to the cold tier without a BLOBSTORE\n");
+    return GNUNET_DB_STATUS_HARD_ERROR;
+  }
+  check_connection (pg);
+  postgres_preflight (pg);
+  qs = GNUNET_PQ_eval_prepared_multi_select (pg->conn,
+                                             "blobs_select_cold",
+                                             params,
+                                             &migrate_cb,
+                                             &mc);
+  if (qs <= 0)
+    return qs;
+  return mc.qs;
+}
+
+
+/**
+ * Obtain statistics about where the backup data is kept.
+ *
+ * @param cls closure
+ * @param[out] stats set to the statistics
+ * @return transaction status
+ */
+static enum GNUNET_DB_QueryStatus
+postgres_get_storage_stats (void *cls,
+                            struct SYNC_DB_StorageStats *stats)
+{
+  struct PostgresClosure *pg = cls;
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_end
+  };
+  struct GNUNET_PQ_ResultSpec rs[] = {
+    GNUNET_PQ_result_spec_uint64 ("hot_blobs",
+                                  &stats->hot_blobs),
+    GNUNET_PQ_result_spec_uint64 ("hot_bytes",
+                                  &stats->hot_bytes),
+    GNUNET_PQ_result_spec_uint64 ("cold_blobs",
+                                  &stats->cold_blobs),
+    GNUNET_PQ_result_spec_uint64 ("cold_bytes",
+                                  &stats->cold_bytes),
+    GNUNET_PQ_result_spec_end
+  };
+
+  check_connection (pg);
+  postgres_preflight (pg);
+  return GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
+                                                   "storage_stats",
+                                                   params,
+                                                   rs);
+}
+
+
+/**
+ * Store payment. Used to begin a payment, not indicative
+ * that the payment actually was made. (That is done
+ * when we increment the account's lifetime.)
+ *
+ * @param cls closure
+ * @param account_pub account to store @a backup under
  * @param order_id order we create
  * @param token claim token to use, NULL for none
  * @param amount how much we asked for
@@ -645,15 +1291,27 @@ postgres_lookup_pending_payments_by_account (void *cls,
     .it_cls = it_cls,
     .pg = pg
   };
+  struct GNUNET_PQ_Context *conn;
   enum GNUNET_DB_QueryStatus qs;
 
   check_connection (pg);
   postgres_preflight (pg);
-  qs = GNUNET_PQ_eval_prepared_multi_select (pg->conn,
+  conn = get_read_conn (pg);
+  qs = GNUNET_PQ_eval_prepared_multi_select (conn,
                                              "payments_select_by_account",
                                              params,
                                              &payment_by_account_cb,
                                              &pic);
+  if ( (conn != pg->conn) &&
+       (qs <= 0) )
+  {
+    /* the payment may have just been created, ask the primary */
+    qs = GNUNET_PQ_eval_prepared_multi_select (pg->conn,
+                                               "payments_select_by_account",
+                                               params,
+                                               &payment_by_account_cb,
+                                               &pic);
+  }
   if (qs > 0)
     return pic.qs;
   GNUNET_break (GNUNET_DB_STATUS_HARD_ERROR != qs);
@@ -661,6 +1319,186 @@ postgres_lookup_pending_payments_by_account (void *cls,
 }
 
 
+/**
+ * Note that the blob with @a backup_hash was accessed, so that
+ * it is not moved to the cold tier soon.  Only updates the
+ * database if the last access was longer ago than
+ * #ACCESS_GRANULARITY.  Errors are only logged, as the access
+ * time is merely a hint.
+ *
+ * @param pg plugin context
+ * @param backup_hash hash of the blob
+ */
+static void
+touch_blob (struct PostgresClosure *pg,
+            const struct GNUNET_HashCode *backup_hash)
+{
+  struct GNUNET_TIME_Absolute now;
+  struct GNUNET_TIME_Absolute recent;
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_auto_from_type (backup_hash),
+    GNUNET_PQ_query_param_absolute_time (&now),
+    GNUNET_PQ_query_param_absolute_time (&recent),
+    GNUNET_PQ_query_param_end
+  };
+
+  now = GNUNET_TIME_absolute_get ();
+  recent = GNUNET_TIME_absolute_subtract (now,
+                                          ACCESS_GRANULARITY);
+  if (0 >
+      GNUNET_PQ_eval_prepared_non_select (pg->conn,
+                                          "blob_touch",
+                                          params))
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Failed to update access time of blob %s\n",
+                GNUNET_h2s (backup_hash));
+}
+
+
+/**
+ * Note that the blob with @a backup_hash was downloaded.  If we
+ * have a cold tier, this keeps the blob in the database, or moves
+ * it back into the database if it was in the blob store.  The
+ * copy in the blob store is kept, as concurrent downloads may
+ * still read it; the garbage collection removes it eventually.
+ *
+ * @param pg plugin context
+ * @param backup_hash hash of the blob
+ * @param external true if the blob was in the blob store
+ * @param backup_size number of bytes in @a backup
+ * @param backup the data of the blob
+ */
+static void
+note_download (struct PostgresClosure *pg,
+               const struct GNUNET_HashCode *backup_hash,
+               bool external,
+               size_t backup_size,
+               const void *backup)
+{
+  struct GNUNET_TIME_Absolute now;
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_auto_from_type (backup_hash),
+    GNUNET_PQ_query_param_fixed_size (backup,
+                                      backup_size),
+    GNUNET_PQ_query_param_absolute_time (&now),
+    GNUNET_PQ_query_param_end
+  };
+
+  if (GNUNET_TIME_relative_is_zero (pg->cold_after))
+    return;
+  if (! external)
+  {
+    touch_blob (pg,
+                backup_hash);
+    return;
+  }
+  now = GNUNET_TIME_absolute_get ();
+  if (0 >
+      GNUNET_PQ_eval_prepared_non_select (pg->conn,
+                                          "blob_rehydrate",
+                                          params))
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Failed to move blob %s back into the database\n",
+                GNUNET_h2s (backup_hash));
+}
+
+
+/**
+ * Make sure the blob with @a backup is stored.  If we already
+ * have a blob with @a backup_hash, we do not even send @a backup
+ * to the database.  The blob must be referenced afterwards, or
+ * the garbage collection will remove it again.  If we have a
+ * blob store without a cold tier, the data is put there before
+ * the database learns about the blob, so a blob visible in the
+ * database always has its data.  With a cold tier, new blobs
+ * start out in the database.
+ *
+ * @param pg plugin context
+ * @param backup_hash hash of @a backup
+ * @param backup_size number of bytes in @a backup
+ * @param backup raw data to backup
+ * @return transaction status
+ */
+static enum GNUNET_DB_QueryStatus
+store_blob (struct PostgresClosure *pg,
+            const struct GNUNET_HashCode *backup_hash,
+            size_t backup_size,
+            const void *backup)
+{
+  enum GNUNET_DB_QueryStatus qs;
+  struct GNUNET_TIME_Absolute now;
+
+  {
+    uint32_t present;
+    struct GNUNET_PQ_QueryParam params[] = {
+      GNUNET_PQ_query_param_auto_from_type (backup_hash),
+      GNUNET_PQ_query_param_end
+    };
+    struct GNUNET_PQ_ResultSpec rs[] = {
+      GNUNET_PQ_result_spec_uint32 ("present",
+                                    &present),
+      GNUNET_PQ_result_spec_end
+    };
+
+    qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
+                                                   "blob_select",
+                                                   params,
+                                                   rs);
+  }
+  if (GNUNET_DB_STATUS_SUCCESS_ONE_RESULT == qs)
+  {
+    if (! GNUNET_TIME_relative_is_zero (pg->cold_after))
+      touch_blob (pg,
+                  backup_hash);
+    return qs;
+  }
+  if (GNUNET_DB_STATUS_SUCCESS_NO_RESULTS != qs)
+    return qs;
+  now = GNUNET_TIME_absolute_get ();
+  if ( (NULL != pg->blobstore) &&
+       (GNUNET_TIME_relative_is_zero (pg->cold_after)) )
+  {
+    uint64_t size = backup_size;
+    struct GNUNET_PQ_QueryParam params[] = {
+      GNUNET_PQ_query_param_auto_from_type (backup_hash),
+      GNUNET_PQ_query_param_null (),
+      GNUNET_PQ_query_param_uint64 (&size),
+      GNUNET_PQ_query_param_absolute_time (&now),
+      GNUNET_PQ_query_param_end
+    };
+
+    if (GNUNET_OK !=
+        pg->blobstore->put_blob (pg->blobstore->cls,
+                                 backup_hash,
+                                 backup_size,
+                                 backup))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Failed to store blob %s in blob store\n",
+                  GNUNET_h2s (backup_hash));
+      return GNUNET_DB_STATUS_HARD_ERROR;
+    }
+    return GNUNET_PQ_eval_prepared_non_select (pg->conn,
+                                               "blob_insert",
+                                               params);
+  }
+  {
+    struct GNUNET_PQ_QueryParam params[] = {
+      GNUNET_PQ_query_param_auto_from_type (backup_hash),
+      GNUNET_PQ_query_param_fixed_size (backup,
+                                        backup_size),
+      GNUNET_PQ_query_param_null (),
+      GNUNET_PQ_query_param_absolute_time (&now),
+      GNUNET_PQ_query_param_end
+    };
+
+    return GNUNET_PQ_eval_prepared_non_select (pg->conn,
+                                               "blob_insert",
+                                               params);
+  }
+}
+
+
 /**
  * Store backup. Only applicable for the FIRST backup under
  * an @a account_pub. Use @e update_backup_TR to update an
@@ -689,20 +1527,28 @@ postgres_store_backup (void *cls,
 
   check_connection (pg);
   postgres_preflight (pg);
+  for (unsigned int retries = 0; retries < MAX_BLOB_RETRIES; retries++)
   {
     struct GNUNET_PQ_QueryParam params[] = {
       GNUNET_PQ_query_param_auto_from_type (account_pub),
       GNUNET_PQ_query_param_auto_from_type (account_sig),
       GNUNET_PQ_query_param_auto_from_type (&no_previous_hash),
       GNUNET_PQ_query_param_auto_from_type (backup_hash),
-      GNUNET_PQ_query_param_fixed_size (backup,
-                                        backup_size),
       GNUNET_PQ_query_param_end
     };
 
+    qs = store_blob (pg,
+                     backup_hash,
+                     backup_size,
+                     backup);
+    if (qs < 0)
+      break;
     qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
                                              "backup_insert",
                                              params);
+    /* soft error if the blob was garbage collected meanwhile */
+    if (GNUNET_DB_STATUS_SOFT_ERROR != qs)
+      break;
   }
   switch (qs)
   {
@@ -828,21 +1674,31 @@ postgres_update_backup (void *cls,
 
   check_connection (pg);
   postgres_preflight (pg);
+  for (unsigned int retries = 0; retries < MAX_BLOB_RETRIES; retries++)
   {
     struct GNUNET_PQ_QueryParam params[] = {
       GNUNET_PQ_query_param_auto_from_type (backup_hash),
       GNUNET_PQ_query_param_auto_from_type (account_sig),
       GNUNET_PQ_query_param_auto_from_type (old_backup_hash),
-      GNUNET_PQ_query_param_fixed_size (backup,
-                                        backup_size),
       GNUNET_PQ_query_param_auto_from_type (account_pub),
       GNUNET_PQ_query_param_auto_from_type (old_backup_hash),
       GNUNET_PQ_query_param_end
     };
 
+    qs = store_blob (pg,
+                     backup_hash,
+                     backup_size,
+                     backup);
+    if (qs < 0)
+      break;
     qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "backup_update",
+                                             (0 != pg->history_size)
+                                             ? "backup_update_keep"
+                                             : "backup_update",
                                              params);
+    /* soft error if the blob was garbage collected meanwhile */
+    if (GNUNET_DB_STATUS_SOFT_ERROR != qs)
+      break;
   }
   switch (qs)
   {
@@ -949,27 +1805,24 @@ postgres_update_backup (void *cls,
 
 
 /**
- * Lookup an account and associated backup meta data.
+ * Lookup an account and associated backup meta data on @a conn.
  *
- * @param cls closure
+ * @param conn connection to use
  * @param account_pub account to store @a backup under
  * @param backup_hash[OUT] set to hash of @a backup
  * @return transaction status
  */
 static enum SYNC_DB_QueryStatus
-postgres_lookup_account (void *cls,
-                         const struct SYNC_AccountPublicKeyP *account_pub,
-                         struct GNUNET_HashCode *backup_hash)
+lookup_account (struct GNUNET_PQ_Context *conn,
+                const struct SYNC_AccountPublicKeyP *account_pub,
+                struct GNUNET_HashCode *backup_hash)
 {
-  struct PostgresClosure *pg = cls;
   enum GNUNET_DB_QueryStatus qs;
   struct GNUNET_PQ_QueryParam params[] = {
     GNUNET_PQ_query_param_auto_from_type (account_pub),
     GNUNET_PQ_query_param_end
   };
 
-  check_connection (pg);
-  postgres_preflight (pg);
   {
     struct GNUNET_PQ_ResultSpec rs[] = {
       GNUNET_PQ_result_spec_auto_from_type ("backup_hash",
@@ -977,7 +1830,7 @@ postgres_lookup_account (void *cls,
       GNUNET_PQ_result_spec_end
     };
 
-    qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
+    qs = GNUNET_PQ_eval_prepared_singleton_select (conn,
                                                    "backup_select_hash",
                                                    params,
                                                    rs);
@@ -1007,7 +1860,7 @@ postgres_lookup_account (void *cls,
       GNUNET_PQ_result_spec_end
     };
 
-    qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
+    qs = GNUNET_PQ_eval_prepared_singleton_select (conn,
                                                    "account_select",
                                                    params,
                                                    rs);
@@ -1033,60 +1886,428 @@ postgres_lookup_account (void *cls,
 
 
 /**
- * Obtain backup.
+ * Lookup an account and associated backup meta data.
  *
  * @param cls closure
  * @param account_pub account to store @a backup under
- * @param account_sig[OUT] set to signature affirming storage request
- * @param prev_hash[OUT] set to hash of previous @a backup, all zeros if none
+ * @param expected_hash hash the caller expects, NULL to
+ *        always ask the primary
  * @param backup_hash[OUT] set to hash of @a backup
- * @param backup_size[OUT] set to number of bytes in @a backup
- * @param backup[OUT] set to raw data to backup, caller MUST FREE
+ * @return transaction status
  */
 static enum SYNC_DB_QueryStatus
-postgres_lookup_backup (void *cls,
-                        const struct SYNC_AccountPublicKeyP *account_pub,
-                        struct SYNC_AccountSignatureP *account_sig,
-                        struct GNUNET_HashCode *prev_hash,
-                        struct GNUNET_HashCode *backup_hash,
-                        size_t *backup_size,
-                        void **backup)
+postgres_lookup_account (void *cls,
+                         const struct SYNC_AccountPublicKeyP *account_pub,
+                         const struct GNUNET_HashCode *expected_hash,
+                         struct GNUNET_HashCode *backup_hash)
 {
   struct PostgresClosure *pg = cls;
-  enum GNUNET_DB_QueryStatus qs;
-  struct GNUNET_PQ_QueryParam params[] = {
-    GNUNET_PQ_query_param_auto_from_type (account_pub),
-    GNUNET_PQ_query_param_end
-  };
-  struct GNUNET_PQ_ResultSpec rs[] = {
-    GNUNET_PQ_result_spec_auto_from_type ("account_sig",
-                                          account_sig),
-    GNUNET_PQ_result_spec_auto_from_type ("prev_hash",
-                                          prev_hash),
-    GNUNET_PQ_result_spec_auto_from_type ("backup_hash",
-                                          backup_hash),
-    GNUNET_PQ_result_spec_variable_size ("data",
-                                         backup,
-                                         backup_size),
-    GNUNET_PQ_result_spec_end
-  };
+  struct GNUNET_PQ_Context *conn;
+  enum SYNC_DB_QueryStatus qs;
 
   check_connection (pg);
   postgres_preflight (pg);
-  qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                 "backup_select",
-                                                 params,
-                                                 rs);
-  switch (qs)
-  {
-  case GNUNET_DB_STATUS_HARD_ERROR:
-    return SYNC_DB_HARD_ERROR;
-  case GNUNET_DB_STATUS_SOFT_ERROR:
-    GNUNET_break (0);
+  if (NULL == expected_hash)
+    return lookup_account (pg->conn,
+                           account_pub,
+                           backup_hash);
+  conn = get_read_conn (pg);
+  qs = lookup_account (conn,
+                       account_pub,
+                       backup_hash);
+  if ( (conn == pg->conn) ||
+       ( (SYNC_DB_ONE_RESULT == qs) &&
+         (0 == GNUNET_memcmp (expected_hash,
+                              backup_hash)) ) )
+    return qs;
+  /* replica may lag behind, ask the primary */
+  return lookup_account (pg->conn,
+                         account_pub,
+                         backup_hash);
+}
+
+
+/**
+ * Fetch the data of a blob kept in the blob store.
+ *
+ * @param pg plugin context
+ * @param backup_hash hash of the blob
+ * @param[out] backup_size set to number of bytes in @a backup
+ * @param[out] backup set to the data, caller MUST FREE
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+load_blob (struct PostgresClosure *pg,
+           const struct GNUNET_HashCode *backup_hash,
+           size_t *backup_size,
+           void **backup)
+{
+  enum GNUNET_GenericReturnValue ret;
+
+  if (NULL == pg->blobstore)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Blob %s is in a blob store, but no BLOBSTORE is configured\n",
+                GNUNET_h2s (backup_hash));
+    return GNUNET_SYSERR;
+  }
+  ret = pg->blobstore->get_blob (pg->blobstore->cls,
+                                 backup_hash,
+                                 backup_size,
+                                 backup);
+  if (GNUNET_NO == ret)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Blob %s missing in blob store\n",
+                GNUNET_h2s (backup_hash));
+    return GNUNET_SYSERR;
+  }
+  return ret;
+}
+
+
+/**
+ * Obtain backup from @a conn.
+ *
+ * @param pg plugin context
+ * @param conn connection to use
+ * @param account_pub account to store @a backup under
+ * @param account_sig[OUT] set to signature affirming storage request
+ * @param prev_hash[OUT] set to hash of previous @a backup, all zeros if none
+ * @param backup_hash[OUT] set to hash of @a backup
+ * @param backup_size[OUT] set to number of bytes in @a backup
+ * @param backup[OUT] set to raw data to backup, caller MUST FREE;
+ *        NULL to only fetch the meta data
+ */
+static enum SYNC_DB_QueryStatus
+lookup_backup (struct PostgresClosure *pg,
+               struct GNUNET_PQ_Context *conn,
+               const struct SYNC_AccountPublicKeyP *account_pub,
+               struct SYNC_AccountSignatureP *account_sig,
+               struct GNUNET_HashCode *prev_hash,
+               struct GNUNET_HashCode *backup_hash,
+               size_t *backup_size,
+               void **backup)
+{
+  enum GNUNET_DB_QueryStatus qs;
+  bool external;
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_auto_from_type (account_pub),
+    GNUNET_PQ_query_param_end
+  };
+  struct GNUNET_PQ_ResultSpec rs[] = {
+    GNUNET_PQ_result_spec_auto_from_type ("account_sig",
+                                          account_sig),
+    GNUNET_PQ_result_spec_auto_from_type ("prev_hash",
+                                          prev_hash),
+    GNUNET_PQ_result_spec_auto_from_type ("backup_hash",
+                                          backup_hash),
+    GNUNET_PQ_result_spec_allow_null (
+      GNUNET_PQ_result_spec_variable_size ("data",
+                                           backup,
+                                           backup_size),
+      &external),
+    GNUNET_PQ_result_spec_end
+  };
+
+  if (NULL == backup)
+  {
+    /* meta data only, do not touch the data or the blob store */
+    struct GNUNET_PQ_ResultSpec rs_meta[] = {
+      rs[0],
+      rs[1],
+      rs[2],
+      GNUNET_PQ_result_spec_end
+    };
+
+    *backup_size = 0;
+    qs = GNUNET_PQ_eval_prepared_singleton_select (conn,
+                                                   "backup_select_meta",
+                                                   params,
+                                                   rs_meta);
+    if (GNUNET_DB_STATUS_SUCCESS_ONE_RESULT == qs)
+      return SYNC_DB_ONE_RESULT;
+  }
+  else
+  {
+    qs = GNUNET_PQ_eval_prepared_singleton_select (conn,
+                                                   "backup_select",
+                                                   params,
+                                                   rs);
+  }
+  switch (qs)
+  {
+  case GNUNET_DB_STATUS_HARD_ERROR:
+    return SYNC_DB_HARD_ERROR;
+  case GNUNET_DB_STATUS_SOFT_ERROR:
+    GNUNET_break (0);
+    return SYNC_DB_SOFT_ERROR;
+  case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
+    return SYNC_DB_NO_RESULTS;
+  case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
+    if ( (external) &&
+         (GNUNET_OK !=
+          load_blob (pg,
+                     backup_hash,
+                     backup_size,
+                     backup)) )
+      return SYNC_DB_HARD_ERROR;
+    note_download (pg,
+                   backup_hash,
+                   external,
+                   *backup_size,
+                   *backup);
+    return SYNC_DB_ONE_RESULT;
+  default:
+    GNUNET_break (0);
+    return SYNC_DB_HARD_ERROR;
+  }
+}
+
+
+/**
+ * Obtain backup.
+ *
+ * @param cls closure
+ * @param account_pub account to store @a backup under
+ * @param expected_hash hash the caller expects, NULL to
+ *        always ask the primary
+ * @param account_sig[OUT] set to signature affirming storage request
+ * @param prev_hash[OUT] set to hash of previous @a backup, all zeros if none
+ * @param backup_hash[OUT] set to hash of @a backup
+ * @param backup_size[OUT] set to number of bytes in @a backup
+ * @param backup[OUT] set to raw data to backup, caller MUST FREE;
+ *        NULL to only fetch the meta data
+ */
+static enum SYNC_DB_QueryStatus
+postgres_lookup_backup (void *cls,
+                        const struct SYNC_AccountPublicKeyP *account_pub,
+                        const struct GNUNET_HashCode *expected_hash,
+                        struct SYNC_AccountSignatureP *account_sig,
+                        struct GNUNET_HashCode *prev_hash,
+                        struct GNUNET_HashCode *backup_hash,
+                        size_t *backup_size,
+                        void **backup)
+{
+  struct PostgresClosure *pg = cls;
+  struct GNUNET_PQ_Context *conn;
+  enum SYNC_DB_QueryStatus qs;
+
+  check_connection (pg);
+  postgres_preflight (pg);
+  if (NULL == expected_hash)
+    return lookup_backup (pg,
+                          pg->conn,
+                          account_pub,
+                          account_sig,
+                          prev_hash,
+                          backup_hash,
+                          backup_size,
+                          backup);
+  conn = get_read_conn (pg);
+  qs = lookup_backup (pg,
+                      conn,
+                      account_pub,
+                      account_sig,
+                      prev_hash,
+                      backup_hash,
+                      backup_size,
+                      backup);
+  if ( (conn == pg->conn) ||
+       ( (SYNC_DB_ONE_RESULT == qs) &&
+         (0 == GNUNET_memcmp (expected_hash,
+                              backup_hash)) ) )
+    return qs;
+  /* replica may lag behind, ask the primary */
+  if ( (SYNC_DB_ONE_RESULT == qs) &&
+       (NULL != backup) )
+    GNUNET_free (*backup);
+  return lookup_backup (pg,
+                        pg->conn,
+                        account_pub,
+                        account_sig,
+                        prev_hash,
+                        backup_hash,
+                        backup_size,
+                        backup);
+}
+
+
+/**
+ * Fetch part of the data of a blob kept in the blob store.
+ * Fetches the whole blob if the blob store cannot return parts.
+ *
+ * @param pg plugin context
+ * @param backup_hash hash of the blob
+ * @param offset offset of the first byte to fetch
+ * @param length maximum number of bytes to fetch
+ * @param[out] total_size set to the size of the whole blob
+ * @param[out] backup_size set to number of bytes in @a backup
+ * @param[out] backup set to the data, caller MUST FREE
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+load_blob_range (struct PostgresClosure *pg,
+                 const struct GNUNET_HashCode *backup_hash,
+                 uint64_t offset,
+                 uint64_t length,
+                 size_t *total_size,
+                 size_t *backup_size,
+                 void **backup)
+{
+  enum GNUNET_GenericReturnValue ret;
+  void *data;
+
+  if ( (NULL == pg->blobstore) ||
+       (NULL == pg->blobstore->get_blob_range) )
+  {
+    if (GNUNET_OK !=
+        load_blob (pg,
+                   backup_hash,
+                   total_size,
+                   &data))
+      return GNUNET_SYSERR;
+    if (offset >= *total_size)
+    {
+      *backup_size = 0;
+      *backup = NULL;
+    }
+    else
+    {
+      *backup_size = (size_t) GNUNET_MIN (length,
+                                          *total_size - offset);
+      *backup = GNUNET_memdup (((const char *) data) + offset,
+                               *backup_size);
+    }
+    GNUNET_free (data);
+    return GNUNET_OK;
+  }
+  ret = pg->blobstore->get_blob_range (pg->blobstore->cls,
+                                       backup_hash,
+                                       offset,
+                                       length,
+                                       total_size,
+                                       backup_size,
+                                       backup);
+  if (GNUNET_NO == ret)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Blob %s missing in blob store\n",
+                GNUNET_h2s (backup_hash));
+    return GNUNET_SYSERR;
+  }
+  return ret;
+}
+
+
+/**
+ * Obtain part of a backup from @a conn.
+ *
+ * @param pg plugin context
+ * @param conn connection to use
+ * @param account_pub account the backup is stored under
+ * @param offset offset of the first byte to return
+ * @param length maximum number of bytes to return
+ * @param account_sig[OUT] set to signature affirming storage request
+ * @param prev_hash[OUT] set to hash of previous @a backup, all zeros if none
+ * @param backup_hash[OUT] set to hash of the whole backup
+ * @param total_size[OUT] set to number of bytes in the whole backup
+ * @param backup_size[OUT] set to number of bytes in @a backup
+ * @param backup[OUT] set to the requested part, caller MUST FREE
+ */
+static enum SYNC_DB_QueryStatus
+lookup_backup_range (struct PostgresClosure *pg,
+                     struct GNUNET_PQ_Context *conn,
+                     const struct SYNC_AccountPublicKeyP *account_pub,
+                     uint64_t offset,
+                     uint64_t length,
+                     struct SYNC_AccountSignatureP *account_sig,
+                     struct GNUNET_HashCode *prev_hash,
+                     struct GNUNET_HashCode *backup_hash,
+                     size_t *total_size,
+                     size_t *backup_size,
+                     void **backup)
+{
+  enum GNUNET_DB_QueryStatus qs;
+  /* substring() counts from 1 and takes INT4 arguments */
+  uint32_t start = (uint32_t) GNUNET_MIN (offset,
+                                          INT32_MAX - 1) + 1;
+  uint32_t len = (uint32_t) GNUNET_MIN (length,
+                                        INT32_MAX);
+  uint64_t total = 0;
+  bool no_total;
+  bool external;
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_auto_from_type (account_pub),
+    GNUNET_PQ_query_param_uint32 (&start),
+    GNUNET_PQ_query_param_uint32 (&len),
+    GNUNET_PQ_query_param_end
+  };
+  struct GNUNET_PQ_ResultSpec rs[] = {
+    GNUNET_PQ_result_spec_auto_from_type ("account_sig",
+                                          account_sig),
+    GNUNET_PQ_result_spec_auto_from_type ("prev_hash",
+                                          prev_hash),
+    GNUNET_PQ_result_spec_auto_from_type ("backup_hash",
+                                          backup_hash),
+    GNUNET_PQ_result_spec_allow_null (
+      GNUNET_PQ_result_spec_uint64 ("total_size",
+                                    &total),
+      &no_total),
+    GNUNET_PQ_result_spec_bool ("external",
+                                &external),
+    GNUNET_PQ_result_spec_allow_null (
+      GNUNET_PQ_result_spec_variable_size ("data",
+                                           backup,
+                                           backup_size),
+      NULL),
+    GNUNET_PQ_result_spec_end
+  };
+
+  *backup = NULL;
+  *backup_size = 0;
+  qs = GNUNET_PQ_eval_prepared_singleton_select (conn,
+                                                 "backup_select_range",
+                                                 params,
+                                                 rs);
+  switch (qs)
+  {
+  case GNUNET_DB_STATUS_HARD_ERROR:
+    return SYNC_DB_HARD_ERROR;
+  case GNUNET_DB_STATUS_SOFT_ERROR:
+    GNUNET_break (0);
     return SYNC_DB_SOFT_ERROR;
   case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
     return SYNC_DB_NO_RESULTS;
   case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
+    if (external)
+    {
+      if (GNUNET_OK !=
+          load_blob_range (pg,
+                           backup_hash,
+                           offset,
+                           length,
+                           total_size,
+                           backup_size,
+                           backup))
+        return SYNC_DB_HARD_ERROR;
+      return SYNC_DB_ONE_RESULT;
+    }
+    GNUNET_break (! no_total);
+    *total_size = (size_t) total;
+    if (offset >= total)
+    {
+      /* substring() clamped the offset, return nothing */
+      GNUNET_free (*backup);
+      *backup = NULL;
+      *backup_size = 0;
+    }
+    /* partial reads of cold blobs do not move them back */
+    note_download (pg,
+                   backup_hash,
+                   false,
+                   0,
+                   NULL);
     return SYNC_DB_ONE_RESULT;
   default:
     GNUNET_break (0);
@@ -1095,6 +2316,356 @@ postgres_lookup_backup (void *cls,
 }
 
 
+/**
+ * Obtain part of a backup.
+ *
+ * @param cls closure
+ * @param account_pub account the backup is stored under
+ * @param expected_hash hash the caller expects, NULL to
+ *        always ask the primary
+ * @param offset offset of the first byte to return
+ * @param length maximum number of bytes to return
+ * @param account_sig[OUT] set to signature affirming storage request
+ * @param prev_hash[OUT] set to hash of previous @a backup, all zeros if none
+ * @param backup_hash[OUT] set to hash of the whole backup
+ * @param total_size[OUT] set to number of bytes in the whole backup
+ * @param backup_size[OUT] set to number of bytes in @a backup
+ * @param backup[OUT] set to the requested part, caller MUST FREE
+ */
+static enum SYNC_DB_QueryStatus
+postgres_lookup_backup_range (void *cls,
+                              const struct SYNC_AccountPublicKeyP *account_pub,
+                              const struct GNUNET_HashCode *expected_hash,
+                              uint64_t offset,
+                              uint64_t length,
+                              struct SYNC_AccountSignatureP *account_sig,
+                              struct GNUNET_HashCode *prev_hash,
+                              struct GNUNET_HashCode *backup_hash,
+                              size_t *total_size,
+                              size_t *backup_size,
+                              void **backup)
+{
+  struct PostgresClosure *pg = cls;
+  struct GNUNET_PQ_Context *conn;
+  enum SYNC_DB_QueryStatus qs;
+
+  check_connection (pg);
+  postgres_preflight (pg);
+  conn = (NULL == expected_hash)
+    ? pg->conn
+    : get_read_conn (pg);
+  qs = lookup_backup_range (pg,
+                            conn,
+                            account_pub,
+                            offset,
+                            length,
+                            account_sig,
+                            prev_hash,
+                            backup_hash,
+                            total_size,
+                            backup_size,
+                            backup);
+  if ( (conn == pg->conn) ||
+       ( (SYNC_DB_ONE_RESULT == qs) &&
+         (0 == GNUNET_memcmp (expected_hash,
+                              backup_hash)) ) )
+    return qs;
+  /* replica may lag behind, ask the primary */
+  if (SYNC_DB_ONE_RESULT == qs)
+    GNUNET_free (*backup);
+  return lookup_backup_range (pg,
+                              pg->conn,
+                              account_pub,
+                              offset,
+                              length,
+                              account_sig,
+                              prev_hash,
+                              backup_hash,
+                              total_size,
+                              backup_size,
+                              backup);
+}
+
+
+/**
+ * Obtain a specific version of the backup of an account,
+ * which may be the current backup or one from the history.
+ *
+ * @param cls closure
+ * @param account_pub account the backup is stored under
+ * @param backup_hash hash of the version to look up
+ * @param account_sig[OUT] set to signature affirming storage request
+ * @param prev_hash[OUT] set to hash of previous @a backup, all zeros if none
+ * @param backup_size[OUT] set to number of bytes in @a backup
+ * @param backup[OUT] set to raw data to backup, caller MUST FREE
+ */
+static enum SYNC_DB_QueryStatus
+postgres_lookup_backup_version (void *cls,
+                                const struct SYNC_AccountPublicKeyP *account_pub,
+                                const struct GNUNET_HashCode *backup_hash,
+                                struct SYNC_AccountSignatureP *account_sig,
+                                struct GNUNET_HashCode *prev_hash,
+                                size_t *backup_size,
+                                void **backup)
+{
+  struct PostgresClosure *pg = cls;
+  enum GNUNET_DB_QueryStatus qs;
+  bool external;
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_auto_from_type (account_pub),
+    GNUNET_PQ_query_param_auto_from_type (backup_hash),
+    GNUNET_PQ_query_param_end
+  };
+  struct GNUNET_PQ_ResultSpec rs[] = {
+    GNUNET_PQ_result_spec_auto_from_type ("account_sig",
+                                          account_sig),
+    GNUNET_PQ_result_spec_auto_from_type ("prev_hash",
+                                          prev_hash),
+    GNUNET_PQ_result_spec_allow_null (
+      GNUNET_PQ_result_spec_variable_size ("data",
+                                           backup,
+                                           backup_size),
+      &external),
+    GNUNET_PQ_result_spec_end
+  };
+
+  check_connection (pg);
+  postgres_preflight (pg);
+  qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
+                                                 "backup_select_version",
+                                                 params,
+                                                 rs);
+  switch (qs)
+  {
+  case GNUNET_DB_STATUS_HARD_ERROR:
+    return SYNC_DB_HARD_ERROR;
+  case GNUNET_DB_STATUS_SOFT_ERROR:
+    GNUNET_break (0);
+    return SYNC_DB_SOFT_ERROR;
+  case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
+    return SYNC_DB_NO_RESULTS;
+  case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
+    if ( (external) &&
+         (GNUNET_OK !=
+          load_blob (pg,
+                     backup_hash,
+                     backup_size,
+                     backup)) )
+      return SYNC_DB_HARD_ERROR;
+    note_download (pg,
+                   backup_hash,
+                   external,
+                   *backup_size,
+                   *backup);
+    return SYNC_DB_ONE_RESULT;
+  default:
+    GNUNET_break (0);
+    return SYNC_DB_HARD_ERROR;
+  }
+}
+
+
+/**
+ * Closure for #backups_cb.
+ */
+struct BackupIteratorContext
+{
+  /**
+   * Plugin context.
+   */
+  struct PostgresClosure *pg;
+
+  /**
+   * Function to call on each result
+   */
+  SYNC_DB_BackupIterator it;
+
+  /**
+   * Closure for @e it.
+   */
+  void *it_cls;
+
+  /**
+   * Query status to return.
+   */
+  enum GNUNET_DB_QueryStatus qs;
+
+};
+
+
+/**
+ * Helper function for #postgres_lookup_backups().
+ * To be called with the results of a SELECT statement
+ * that has returned @a num_results results.
+ *
+ * @param cls closure of type `struct BackupIteratorContext *`
+ * @param result the postgres result
+ * @param num_result the number of results in @a result
+ */
+static void
+backups_cb (void *cls,
+            PGresult *result,
+            unsigned int num_results)
+{
+  struct BackupIteratorContext *bic = cls;
+
+  for (unsigned int i = 0; i < num_results; i++)
+  {
+    struct SYNC_AccountPublicKeyP account_pub;
+    struct SYNC_AccountSignatureP account_sig;
+    struct GNUNET_HashCode prev_hash;
+    struct GNUNET_HashCode backup_hash;
+    bool known;
+    bool omitted;
+    bool external;
+    uint64_t total_size;
+    void *backup = NULL;
+    void *loaded = NULL;
+    size_t backup_size = 0;
+    struct GNUNET_PQ_ResultSpec rs[] = {
+      GNUNET_PQ_result_spec_auto_from_type ("account_pub",
+                                            &account_pub),
+      GNUNET_PQ_result_spec_auto_from_type ("account_sig",
+                                            &account_sig),
+      GNUNET_PQ_result_spec_auto_from_type ("prev_hash",
+                                            &prev_hash),
+      GNUNET_PQ_result_spec_auto_from_type ("backup_hash",
+                                            &backup_hash),
+      GNUNET_PQ_result_spec_bool ("known",
+                                  &known),
+      GNUNET_PQ_result_spec_uint64 ("backup_size",
+                                    &total_size),
+      GNUNET_PQ_result_spec_bool ("omitted",
+                                  &omitted),
+      GNUNET_PQ_result_spec_allow_null (
+        GNUNET_PQ_result_spec_variable_size ("data",
+                                             &backup,
+                                             &backup_size),
+        &external),
+      GNUNET_PQ_result_spec_end
+    };
+
+    if (GNUNET_OK !=
+        GNUNET_PQ_extract_result (result,
+                                  rs,
+                                  i))
+    {
+      GNUNET_break (0);
+      bic->qs = GNUNET_DB_STATUS_HARD_ERROR;
+      return;
+    }
+    bic->qs = i + 1;
+    if (omitted)
+    {
+      bic->it (bic->it_cls,
+               &account_pub,
+               &account_sig,
+               &prev_hash,
+               &backup_hash,
+               true,
+               (size_t) total_size,
+               NULL);
+      GNUNET_PQ_cleanup_result (rs);
+      continue;
+    }
+    if ( (external) &&
+         (! known) )
+    {
+      if (GNUNET_OK !=
+          load_blob (bic->pg,
+                     &backup_hash,
+                     &backup_size,
+                     &loaded))
+      {
+        GNUNET_PQ_cleanup_result (rs);
+        bic->qs = GNUNET_DB_STATUS_HARD_ERROR;
+        return;
+      }
+    }
+    if (! known)
+      note_download (bic->pg,
+                     &backup_hash,
+                     external,
+                     backup_size,
+                     (NULL != loaded) ? loaded : backup);
+    bic->it (bic->it_cls,
+             &account_pub,
+             &account_sig,
+             &prev_hash,
+             &backup_hash,
+             false,
+             backup_size,
+             (NULL != loaded) ? loaded : backup);
+    GNUNET_free (loaded);
+    GNUNET_PQ_cleanup_result (rs);
+  }
+}
+
+
+/**
+ * Obtain the backups of multiple accounts with a single query.
+ *
+ * @param cls closure
+ * @param num_accounts length of the @a accounts and @a known_hashes arrays
+ * @param accounts accounts to look up backups for
+ * @param known_hashes for each account, hash of the backup the caller
+ *        already has, all zeros for none
+ * @param max_total_size limit for the total size of the backups
+ *        returned with their data
+ * @param it iterator to call on all backups found
+ * @param it_cls closure for @a it
+ * @return transaction status
+ */
+static enum GNUNET_DB_QueryStatus
+postgres_lookup_backups (void *cls,
+                         unsigned int num_accounts,
+                         const struct SYNC_AccountPublicKeyP *accounts,
+                         const struct GNUNET_HashCode *known_hashes,
+                         uint64_t max_total_size,
+                         SYNC_DB_BackupIterator it,
+                         void *it_cls)
+{
+  struct PostgresClosure *pg = cls;
+  struct BackupIteratorContext bic = {
+    .pg = pg,
+    .it = it,
+    .it_cls = it_cls
+  };
+  enum GNUNET_DB_QueryStatus qs;
+
+  /* the limit is compared as a signed INT8 */
+  if (max_total_size > INT64_MAX)
+    max_total_size = INT64_MAX;
+  check_connection (pg);
+  postgres_preflight (pg);
+  {
+    struct GNUNET_PQ_QueryParam params[] = {
+      GNUNET_PQ_query_param_array_bytes_same_size (num_accounts,
+                                                   accounts,
+                                                   sizeof (*accounts),
+                                                   pg->conn),
+      GNUNET_PQ_query_param_array_bytes_same_size (num_accounts,
+                                                   known_hashes,
+                                                   sizeof (*known_hashes),
+                                                   pg->conn),
+      GNUNET_PQ_query_param_uint64 (&max_total_size),
+      GNUNET_PQ_query_param_end
+    };
+
+    qs = GNUNET_PQ_eval_prepared_multi_select (pg->conn,
+                                               "backups_select_batch",
+                                               params,
+                                               &backups_cb,
+                                               &bic);
+    GNUNET_PQ_cleanup_query_params_closures (params);
+  }
+  if (qs > 0)
+    return bic.qs;
+  GNUNET_break (GNUNET_DB_STATUS_HARD_ERROR != qs);
+  return qs;
+}
+
+
 /**
  * Increment account lifetime.
  *
@@ -1276,6 +2847,58 @@ postgres_create_tables (void *cls)
 }
 
 
+/**
+ * Hash-partition the tables by account into @a num_partitions
+ * partitions.
+ *
+ * @param cls the `struct PostgresClosure` with the plugin-specific state
+ * @param num_partitions number of partitions to create
+ * @return #GNUNET_OK upon success; #GNUNET_SYSERR upon failure
+ */
+static enum GNUNET_GenericReturnValue
+postgres_partition_tables (void *cls,
+                           uint32_t num_partitions)
+{
+  struct PostgresClosure *pg = cls;
+  struct GNUNET_PQ_Context *conn;
+  enum GNUNET_GenericReturnValue ret;
+  char *sql;
+
+  if (NULL != pg->conn)
+  {
+    GNUNET_PQ_disconnect (pg->conn);
+    pg->conn = NULL;
+    pg->init = false;
+  }
+  GNUNET_asprintf (&sql,
+                   "SELECT sync.partition_tables(%u);",
+                   (unsigned int) num_partitions);
+  {
+    struct GNUNET_PQ_ExecuteStatement es[] = {
+      GNUNET_PQ_make_execute ("SET search_path TO sync;"),
+      GNUNET_PQ_make_execute (sql),
+      GNUNET_PQ_EXECUTE_STATEMENT_END
+    };
+
+    conn = GNUNET_PQ_connect_with_cfg (pg->cfg,
+                                       "syncdb-postgres",
+                                       NULL,
+                                       NULL,
+                                       NULL);
+    if (NULL == conn)
+    {
+      GNUNET_free (sql);
+      return GNUNET_SYSERR;
+    }
+    ret = GNUNET_PQ_exec_statements (conn,
+                                     es);
+  }
+  GNUNET_PQ_disconnect (conn);
+  GNUNET_free (sql);
+  return ret;
+}
+
+
 /**
  * Initialize Postgres database subsystem.
  *
@@ -1316,10 +2939,86 @@ libsync_plugin_db_postgres_init (void *cls)
     GNUNET_free (pg);
     return NULL;
   }
+  if ( (GNUNET_YES ==
+        GNUNET_CONFIGURATION_have_value (cfg,
+                                         "syncdb-postgres",
+                                         "HISTORY_SIZE")) &&
+       (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_number (cfg,
+                                               "syncdb-postgres",
+                                               "HISTORY_SIZE",
+                                               &pg->history_size)) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "syncdb-postgres",
+                               "HISTORY_SIZE",
+                               "must be a number");
+    GNUNET_free (pg->currency);
+    GNUNET_free (pg->sql_dir);
+    GNUNET_free (pg);
+    return NULL;
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_string (cfg,
+                                             "syncdb-postgres",
+                                             "READ_CONFIG",
+                                             &pg->read_config))
+    pg->read_config = NULL; /* no replica, read from primary */
+  {
+    char *name;
+
+    if (GNUNET_OK ==
+        GNUNET_CONFIGURATION_get_value_string (cfg,
+                                               "syncdb-postgres",
+                                               "BLOBSTORE",
+                                               &name))
+    {
+      pg->blobstore = SYNC_BLOBSTORE_plugin_load (cfg,
+                                                  name);
+      if (NULL == pg->blobstore)
+      {
+        GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                                   "syncdb-postgres",
+                                   "BLOBSTORE",
+                                   "failed to load blob store");
+        GNUNET_free (name);
+        GNUNET_free (pg->read_config);
+        GNUNET_free (pg->currency);
+        GNUNET_free (pg->sql_dir);
+        GNUNET_free (pg);
+        return NULL;
+      }
+      GNUNET_free (name);
+    }
+  }
+  if ( (GNUNET_YES ==
+        GNUNET_CONFIGURATION_have_value (cfg,
+                                         "syncdb-postgres",
+                                         "COLD_AFTER")) &&
+       ( (GNUNET_OK !=
+          GNUNET_CONFIGURATION_get_value_time (cfg,
+                                               "syncdb-postgres",
+                                               "COLD_AFTER",
+                                               &pg->cold_after)) ||
+         (NULL == pg->blobstore) ) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "syncdb-postgres",
+                               "COLD_AFTER",
+                               "must be a relative time and requires a BLOBSTORE");
+    SYNC_BLOBSTORE_plugin_unload (pg->blobstore);
+    GNUNET_free (pg->read_config);
+    GNUNET_free (pg->currency);
+    GNUNET_free (pg->sql_dir);
+    GNUNET_free (pg);
+    return NULL;
+  }
   if (GNUNET_OK !=
       internal_setup (pg,
                       true))
   {
+    SYNC_BLOBSTORE_plugin_unload (pg->blobstore);
+    GNUNET_free (pg->read_config);
     GNUNET_free (pg->currency);
     GNUNET_free (pg->sql_dir);
     GNUNET_free (pg);
@@ -1329,14 +3028,20 @@ libsync_plugin_db_postgres_init (void *cls)
   plugin->cls = pg;
   plugin->create_tables = &postgres_create_tables;
   plugin->drop_tables = &postgres_drop_tables;
+  plugin->partition_tables = &postgres_partition_tables;
   plugin->preflight = &postgres_preflight;
   plugin->gc = &postgres_gc;
+  plugin->migrate_cold = &postgres_migrate_cold;
+  plugin->get_storage_stats = &postgres_get_storage_stats;
   plugin->store_payment_TR = &postgres_store_payment;
   plugin->lookup_pending_payments_by_account_TR =
     &postgres_lookup_pending_payments_by_account;
   plugin->store_backup_TR = &postgres_store_backup;
   plugin->lookup_account_TR = &postgres_lookup_account;
   plugin->lookup_backup_TR = &postgres_lookup_backup;
+  plugin->lookup_backup_range_TR = &postgres_lookup_backup_range;
+  plugin->lookup_backup_version_TR = &postgres_lookup_backup_version;
+  plugin->lookup_backups_TR = &postgres_lookup_backups;
   plugin->update_backup_TR = &postgres_update_backup;
   plugin->increment_lifetime_TR = &postgres_increment_lifetime;
   return plugin;
@@ -1356,6 +3061,10 @@ libsync_plugin_db_postgres_done (void *cls)
   struct PostgresClosure *pg = plugin->cls;
 
   GNUNET_PQ_disconnect (pg->conn);
+  if (NULL != pg->read_conn)
+    GNUNET_PQ_disconnect (pg->read_conn);
+  SYNC_BLOBSTORE_plugin_unload (pg->blobstore);
+  GNUNET_free (pg->read_config);
   GNUNET_free (pg->currency);
   GNUNET_free (pg->sql_dir);
   GNUNET_free (pg);
@@ -0,0 +1,63 @@
+--
+-- This file is part of TALER
+-- Copyright (C) 2024 Taler Systems SA
+--
+-- TALER is free software; you can redistribute it and/or modify it under the
+-- terms of the GNU General Public License as published by the Free Software
+-- Foundation; either version 3, or (at your option) any later version.
+--
+-- TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+-- WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+-- A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License along with
+-- TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+--
+
+-- Everything in one big transaction
+BEGIN;
+
+-- Check patch versioning is in place.
+SELECT _v.register_patch('sync-0002', NULL, NULL);
+
+SET search_path TO sync;
+
+ALTER TABLE backups
+  ADD COLUMN generation INT8 NOT NULL DEFAULT 0;
+COMMENT ON COLUMN backups.generation
+  IS 'Number of times the backup of the account was replaced';
+
+CREATE TABLE IF NOT EXISTS backup_history
+  (account_pub BYTEA NOT NULL REFERENCES accounts (account_pub) ON DELETE CASCADE
+  ,generation INT8 NOT NULL
+  ,account_sig BYTEA NOT NULL CHECK (length(account_sig)=64)
+  ,prev_hash BYTEA NOT NULL CHECK (length(prev_hash)=64)
+  ,backup_hash BYTEA NOT NULL CHECK (length(backup_hash)=64)
+  ,data BYTEA NOT NULL
+  ,PRIMARY KEY (account_pub, generation)
+  ) PARTITION BY HASH (account_pub);
+COMMENT ON TABLE backup_history
+  IS 'Previous versions of backups, pruned to the configured number of versions per account by the garbage collection';
+COMMENT ON COLUMN backup_history.generation
+  IS 'Value of backups.generation when this version was the current backup';
+
+CREATE INDEX IF NOT EXISTS backup_history_by_hash ON
+  backup_history (account_pub, backup_hash);
+
+-- Pruning deletes old versions from many accounts; with partitions,
+-- each partition is vacuumed (and its indices maintained) separately.
+DO $$
+BEGIN
+  FOR i IN 0..7 LOOP
+    EXECUTE format(
+      'CREATE TABLE IF NOT EXISTS backup_history_%s'
+      ' PARTITION OF backup_history'
+      ' FOR VALUES WITH (MODULUS 8, REMAINDER %s)',
+      i,
+      i);
+  END LOOP;
+END
+$$;
+
+-- Complete transaction
+COMMIT;
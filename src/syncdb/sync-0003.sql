@@ -0,0 +1,106 @@
+--
+-- This file is part of TALER
+-- Copyright (C) 2024 Taler Systems SA
+--
+-- TALER is free software; you can redistribute it and/or modify it under the
+-- terms of the GNU General Public License as published by the Free Software
+-- Foundation; either version 3, or (at your option) any later version.
+--
+-- TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+-- WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+-- A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License along with
+-- TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+--
+
+-- Everything in one big transaction
+BEGIN;
+
+-- Check patch versioning is in place.
+SELECT _v.register_patch('sync-0003', NULL, NULL);
+
+SET search_path TO sync;
+
+CREATE TABLE IF NOT EXISTS blobs
+  (backup_hash BYTEA PRIMARY KEY CHECK (length(backup_hash)=64)
+  ,data BYTEA NOT NULL
+  ,refcount INT8 NOT NULL DEFAULT 0);
+COMMENT ON TABLE blobs
+  IS 'Backup data, shared by all backups (and previous versions) with the same hash';
+COMMENT ON COLUMN blobs.refcount
+  IS 'Number of rows in backups and backup_history referencing this blob, maintained by triggers; blobs with a refcount of zero are removed by the garbage collection';
+
+CREATE INDEX IF NOT EXISTS blobs_unreferenced ON
+  blobs (backup_hash)
+  WHERE refcount=0;
+
+-- Move existing data into the blobs table.
+INSERT INTO blobs
+  (backup_hash
+  ,data
+  ,refcount)
+  SELECT DISTINCT ON (backup_hash)
+    backup_hash
+   ,data
+   ,0
+  FROM (SELECT backup_hash, data FROM backups
+        UNION ALL
+        SELECT backup_hash, data FROM backup_history) AS v;
+
+UPDATE blobs
+   SET refcount=c.cnt
+  FROM (SELECT backup_hash, COUNT(*) AS cnt
+          FROM (SELECT backup_hash FROM backups
+                UNION ALL
+                SELECT backup_hash FROM backup_history) AS v
+         GROUP BY backup_hash) AS c
+ WHERE blobs.backup_hash=c.backup_hash;
+
+ALTER TABLE backups
+  DROP COLUMN data;
+ALTER TABLE backup_history
+  DROP COLUMN data;
+
+
+CREATE OR REPLACE FUNCTION blob_refcount_trigger()
+  RETURNS TRIGGER
+  LANGUAGE plpgsql
+AS $$
+BEGIN
+  IF TG_OP IN ('UPDATE', 'DELETE')
+  THEN
+    UPDATE blobs
+       SET refcount=refcount-1
+     WHERE backup_hash=OLD.backup_hash;
+  END IF;
+  IF TG_OP IN ('INSERT', 'UPDATE')
+  THEN
+    UPDATE blobs
+       SET refcount=refcount+1
+     WHERE backup_hash=NEW.backup_hash;
+    IF NOT FOUND
+    THEN
+      -- Blob was garbage collected between storing it and
+      -- referencing it; have the caller retry.
+      RAISE EXCEPTION 'blob missing'
+        USING ERRCODE = 'serialization_failure';
+    END IF;
+  END IF;
+  RETURN NULL;
+END $$;
+COMMENT ON FUNCTION blob_refcount_trigger
+  IS 'Maintains the refcount of blobs referenced from backups and backup_history';
+
+CREATE TRIGGER backups_blob_refcount
+  AFTER INSERT OR DELETE OR UPDATE OF backup_hash
+  ON backups
+  FOR EACH ROW EXECUTE FUNCTION blob_refcount_trigger();
+
+CREATE TRIGGER backup_history_blob_refcount
+  AFTER INSERT OR DELETE
+  ON backup_history
+  FOR EACH ROW EXECUTE FUNCTION blob_refcount_trigger();
+
+-- Complete transaction
+COMMIT;
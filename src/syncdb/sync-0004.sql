@@ -0,0 +1,183 @@
+--
+-- This file is part of TALER
+-- Copyright (C) 2024 Taler Systems SA
+--
+-- TALER is free software; you can redistribute it and/or modify it under the
+-- terms of the GNU General Public License as published by the Free Software
+-- Foundation; either version 3, or (at your option) any later version.
+--
+-- TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+-- WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+-- A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License along with
+-- TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+--
+
+-- Everything in one big transaction
+BEGIN;
+
+-- Check patch versioning is in place.
+SELECT _v.register_patch('sync-0004', NULL, NULL);
+
+SET search_path TO sync;
+
+
+CREATE OR REPLACE FUNCTION partition_tables(
+  IN in_partitions INT4)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+  tbl TEXT;
+BEGIN
+  IF in_partitions < 1
+  THEN
+    RAISE EXCEPTION 'number of partitions must be positive';
+  END IF;
+  LOCK TABLE accounts, payments, backups, backup_history
+    IN ACCESS EXCLUSIVE MODE;
+  -- The partitions are keyed by account, so we cannot keep
+  -- payments without one.  sync-httpd never creates them.
+  IF EXISTS (SELECT 1
+               FROM payments
+              WHERE account_pub IS NULL)
+  THEN
+    RAISE EXCEPTION 'payments without account_pub cannot be partitioned, delete them first';
+  END IF;
+
+  CREATE TABLE accounts_new
+    (account_pub BYTEA PRIMARY KEY CHECK (length(account_pub)=32)
+    ,expiration_date INT8 NOT NULL
+    ) PARTITION BY HASH (account_pub);
+  CREATE TABLE payments_new
+    (account_pub BYTEA NOT NULL CHECK (length(account_pub)=32)
+    ,order_id TEXT NOT NULL
+    ,token BYTEA CHECK (length(token)=16)
+    ,timestamp INT8 NOT NULL
+    ,amount taler_amount NOT NULL
+    ,paid BOOLEAN NOT NULL DEFAULT FALSE
+    ,PRIMARY KEY (account_pub, order_id)
+    ) PARTITION BY HASH (account_pub);
+  CREATE TABLE backups_new
+    (account_pub BYTEA PRIMARY KEY
+    ,account_sig BYTEA NOT NULL CHECK (length(account_sig)=64)
+    ,prev_hash BYTEA NOT NULL CHECK (length(prev_hash)=64)
+    ,backup_hash BYTEA NOT NULL CHECK (length(backup_hash)=64)
+    ,generation INT8 NOT NULL DEFAULT 0
+    ) PARTITION BY HASH (account_pub);
+  CREATE TABLE backup_history_new
+    (account_pub BYTEA NOT NULL
+    ,generation INT8 NOT NULL
+    ,account_sig BYTEA NOT NULL CHECK (length(account_sig)=64)
+    ,prev_hash BYTEA NOT NULL CHECK (length(prev_hash)=64)
+    ,backup_hash BYTEA NOT NULL CHECK (length(backup_hash)=64)
+    ,PRIMARY KEY (account_pub, generation)
+    ) PARTITION BY HASH (account_pub);
+
+  FOREACH tbl IN ARRAY ARRAY['accounts', 'payments', 'backups', 'backup_history']
+  LOOP
+    FOR i IN 0..in_partitions-1
+    LOOP
+      EXECUTE format(
+        'CREATE TABLE %I PARTITION OF %I'
+        ' FOR VALUES WITH (MODULUS %s, REMAINDER %s)',
+        tbl || '_new_' || i,
+        tbl || '_new',
+        in_partitions,
+        i);
+    END LOOP;
+  END LOOP;
+
+  -- Copy before creating secondary indices, foreign keys and
+  -- triggers; the copy must not change the refcount of the blobs.
+  INSERT INTO accounts_new
+    (account_pub
+    ,expiration_date)
+    SELECT account_pub
+          ,expiration_date
+      FROM accounts;
+  INSERT INTO payments_new
+    (account_pub
+    ,order_id
+    ,token
+    ,timestamp
+    ,amount
+    ,paid)
+    SELECT account_pub
+          ,order_id
+          ,token
+          ,timestamp
+          ,amount
+          ,paid
+      FROM payments;
+  INSERT INTO backups_new
+    (account_pub
+    ,account_sig
+    ,prev_hash
+    ,backup_hash
+    ,generation)
+    SELECT account_pub
+          ,account_sig
+          ,prev_hash
+          ,backup_hash
+          ,generation
+      FROM backups;
+  INSERT INTO backup_history_new
+    (account_pub
+    ,generation
+    ,account_sig
+    ,prev_hash
+    ,backup_hash)
+    SELECT account_pub
+          ,generation
+          ,account_sig
+          ,prev_hash
+          ,backup_hash
+      FROM backup_history;
+
+  -- Dropping does not fire the refcount triggers.
+  DROP TABLE backup_history, backups, payments, accounts;
+
+  FOREACH tbl IN ARRAY ARRAY['accounts', 'payments', 'backups', 'backup_history']
+  LOOP
+    EXECUTE format('ALTER TABLE %I RENAME TO %I',
+                   tbl || '_new',
+                   tbl);
+    EXECUTE format('ALTER INDEX %I RENAME TO %I',
+                   tbl || '_new_pkey',
+                   tbl || '_pkey');
+    FOR i IN 0..in_partitions-1
+    LOOP
+      EXECUTE format('ALTER TABLE %I RENAME TO %I',
+                     tbl || '_new_' || i,
+                     tbl || '_' || i);
+    END LOOP;
+  END LOOP;
+
+  CREATE INDEX accounts_expire ON
+    accounts (expiration_date);
+  CREATE INDEX payments_timestamp ON
+    payments (paid,timestamp);
+  CREATE INDEX backup_history_by_hash ON
+    backup_history (account_pub, backup_hash);
+  ALTER TABLE backups
+    ADD FOREIGN KEY (account_pub)
+    REFERENCES accounts (account_pub) ON DELETE CASCADE;
+  ALTER TABLE backup_history
+    ADD FOREIGN KEY (account_pub)
+    REFERENCES accounts (account_pub) ON DELETE CASCADE;
+  CREATE TRIGGER backups_blob_refcount
+    AFTER INSERT OR DELETE OR UPDATE OF backup_hash
+    ON backups
+    FOR EACH ROW EXECUTE FUNCTION blob_refcount_trigger();
+  CREATE TRIGGER backup_history_blob_refcount
+    AFTER INSERT OR DELETE
+    ON backup_history
+    FOR EACH ROW EXECUTE FUNCTION blob_refcount_trigger();
+END $$;
+COMMENT ON FUNCTION partition_tables
+  IS 'Rebuilds the accounts, payments, backups and backup_history tables hash-partitioned by account_pub into the given number of partitions.  Rewrites all data, so sync-httpd should be stopped while this runs.';
+
+-- Complete transaction
+COMMIT;
@@ -0,0 +1,34 @@
+--
+-- This file is part of TALER
+-- Copyright (C) 2024 Taler Systems SA
+--
+-- TALER is free software; you can redistribute it and/or modify it under the
+-- terms of the GNU General Public License as published by the Free Software
+-- Foundation; either version 3, or (at your option) any later version.
+--
+-- TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+-- WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+-- A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License along with
+-- TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+--
+
+-- Everything in one big transaction
+BEGIN;
+
+-- Check patch versioning is in place.
+SELECT _v.register_patch('sync-0005', NULL, NULL);
+
+SET search_path TO sync;
+
+
+ALTER TABLE blobs
+  ALTER COLUMN data DROP NOT NULL;
+
+COMMENT ON COLUMN blobs.data
+  IS 'The backup data, NULL if the data is kept in the blob store configured in the BLOBSTORE option';
+
+
+-- Complete transaction
+COMMIT;
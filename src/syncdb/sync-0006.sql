@@ -0,0 +1,44 @@
+--
+-- This file is part of TALER
+-- Copyright (C) 2024 Taler Systems SA
+--
+-- TALER is free software; you can redistribute it and/or modify it under the
+-- terms of the GNU General Public License as published by the Free Software
+-- Foundation; either version 3, or (at your option) any later version.
+--
+-- TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+-- WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+-- A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License along with
+-- TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+--
+
+-- Everything in one big transaction
+BEGIN;
+
+-- Check patch versioning is in place.
+SELECT _v.register_patch('sync-0006', NULL, NULL);
+
+SET search_path TO sync;
+
+
+ALTER TABLE blobs
+  ADD COLUMN last_access INT8 NOT NULL
+    DEFAULT (EXTRACT(EPOCH FROM CURRENT_TIMESTAMP) * 1000000)::INT8
+ ,ADD COLUMN data_size INT8 DEFAULT NULL;
+
+COMMENT ON COLUMN blobs.last_access
+  IS 'When the blob was last uploaded or downloaded, in microseconds since the epoch; only updated with a granularity of about a day';
+COMMENT ON COLUMN blobs.data_size
+  IS 'Size of the data if it is kept in the blob store, NULL if the data is in the database or the size is unknown';
+
+CREATE INDEX IF NOT EXISTS blobs_hot_by_access ON
+  blobs (last_access)
+  WHERE data IS NOT NULL;
+COMMENT ON INDEX blobs_hot_by_access
+  IS 'Used to find blobs to move to the cold tier';
+
+
+-- Complete transaction
+COMMIT;
@@ -0,0 +1,233 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/sync-dbcopy.c
+ * @brief dump format shared by sync-dbexport and sync-dbimport
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "sync-dbcopy.h"
+
+
+const struct SYNC_DBCOPY_Table SYNC_DBCOPY_tables[] = {
+  {
+    .name = "blobs",
+    .columns = "backup_hash,data,data_size",
+    .split = "backup_hash",
+    /* unreferenced blobs would only be garbage collected */
+    .filter = "refcount > 0 AND data IS NOT NULL",
+    .part = SYNC_DBCOPY_PART_BLOBS
+  },
+  {
+    .name = "blobs",
+    .columns = "backup_hash,data,data_size",
+    .split = "backup_hash",
+    .filter = "refcount > 0 AND data IS NULL",
+    .part = SYNC_DBCOPY_PART_BLOBS,
+    .external = true
+  },
+  {
+    .name = "accounts",
+    .columns = "account_pub,expiration_date",
+    .split = "account_pub",
+    .part = SYNC_DBCOPY_PART_ACCOUNTS
+  },
+  {
+    .name = "payments",
+    .columns = "account_pub,order_id,token,timestamp,amount,paid",
+    .split = "account_pub",
+    .part = SYNC_DBCOPY_PART_ACCOUNTS
+  },
+  {
+    .name = "backups",
+    .columns = "account_pub,account_sig,prev_hash,backup_hash,generation",
+    .split = "account_pub",
+    .part = SYNC_DBCOPY_PART_ACCOUNTS
+  },
+  {
+    .name = "backup_history",
+    .columns = "account_pub,generation,account_sig,prev_hash,backup_hash",
+    .split = "account_pub",
+    .part = SYNC_DBCOPY_PART_ACCOUNTS
+  },
+  {
+    .name = NULL
+  }
+};
+
+
+char *
+SYNC_DBCOPY_filename (const char *dir,
+                      enum SYNC_DBCOPY_Part part,
+                      unsigned int off)
+{
+  char *fn;
+
+  GNUNET_asprintf (&fn,
+                   "%s/%s-%u.sdump",
+                   dir,
+                   (SYNC_DBCOPY_PART_BLOBS == part)
+                   ? "blobs"
+                   : "accounts",
+                   off);
+  return fn;
+}
+
+
+PGconn *
+SYNC_DBCOPY_connect (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  char *config;
+  PGconn *conn;
+
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_string (cfg,
+                                             "syncdb-postgres",
+                                             "CONFIG",
+                                             &config))
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
+                               "syncdb-postgres",
+                               "CONFIG");
+    return NULL;
+  }
+  conn = PQconnectdb (config);
+  if (CONNECTION_OK != PQstatus (conn))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to connect to `%s': %s\n",
+                config,
+                PQerrorMessage (conn));
+    PQfinish (conn);
+    GNUNET_free (config);
+    return NULL;
+  }
+  GNUNET_free (config);
+  if (GNUNET_OK !=
+      SYNC_DBCOPY_exec (conn,
+                        "SET search_path TO sync;"))
+  {
+    PQfinish (conn);
+    return NULL;
+  }
+  return conn;
+}
+
+
+enum GNUNET_GenericReturnValue
+SYNC_DBCOPY_exec (PGconn *conn,
+                  const char *sql)
+{
+  PGresult *res;
+  enum GNUNET_GenericReturnValue ret;
+
+  res = PQexec (conn,
+                sql);
+  ret = (PGRES_COMMAND_OK == PQresultStatus (res))
+    ? GNUNET_OK
+    : GNUNET_SYSERR;
+  if (GNUNET_OK != ret)
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to run `%s': %s\n",
+                sql,
+                PQresultErrorMessage (res));
+  PQclear (res);
+  return ret;
+}
+
+
+enum GNUNET_GenericReturnValue
+SYNC_DBCOPY_write (FILE *f,
+                   struct GNUNET_HashContext *hc,
+                   const void *data,
+                   size_t size)
+{
+  if (0 == size)
+    return GNUNET_OK;
+  if (size !=
+      fwrite (data,
+              1,
+              size,
+              f))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "fwrite");
+    return GNUNET_SYSERR;
+  }
+  if (NULL != hc)
+    GNUNET_CRYPTO_hash_context_read (hc,
+                                     data,
+                                     size);
+  return GNUNET_OK;
+}
+
+
+enum GNUNET_GenericReturnValue
+SYNC_DBCOPY_write_chunk (FILE *f,
+                         struct GNUNET_HashContext *hc,
+                         uint32_t table,
+                         const void *data,
+                         uint32_t size)
+{
+  struct SYNC_DBCOPY_ChunkHeaderP ch = {
+    .table = htonl (table),
+    .size = htonl (size)
+  };
+
+  if (GNUNET_OK !=
+      SYNC_DBCOPY_write (f,
+                         hc,
+                         &ch,
+                         sizeof (ch)))
+    return GNUNET_SYSERR;
+  return SYNC_DBCOPY_write (f,
+                            hc,
+                            data,
+                            size);
+}
+
+
+enum GNUNET_GenericReturnValue
+SYNC_DBCOPY_read (FILE *f,
+                  struct GNUNET_HashContext *hc,
+                  void *buf,
+                  size_t size)
+{
+  if (0 == size)
+    return GNUNET_OK;
+  if (size !=
+      fread (buf,
+             1,
+             size,
+             f))
+  {
+    if (ferror (f))
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "fread");
+    else
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Dump file is truncated\n");
+    return GNUNET_SYSERR;
+  }
+  if (NULL != hc)
+    GNUNET_CRYPTO_hash_context_read (hc,
+                                     buf,
+                                     size);
+  return GNUNET_OK;
+}
+
+
+/* end of sync-dbcopy.c */
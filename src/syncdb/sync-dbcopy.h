@@ -0,0 +1,227 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/sync-dbcopy.h
+ * @brief dump format shared by sync-dbexport and sync-dbimport
+ * @author Christian Grothoff
+ *
+ * A dump is a directory with two files per export worker:
+ * "blobs-$N.sdump" with the backup data and "accounts-$N.sdump"
+ * with the accounts, payments and backup meta data whose
+ * account_pub falls into the prefix range of worker $N.
+ *
+ * Blobs whose data is in a blob store are written with their data
+ * fetched from the blob store, unless the dump was made for a
+ * database sharing the blob store, in which case their data is NULL.
+ *
+ * Each file starts with #SYNC_DBCOPY_MAGIC, followed by chunks
+ * of PostgreSQL binary COPY data, each preceded by a
+ * `struct SYNC_DBCOPY_ChunkHeaderP`.  An empty chunk ends the
+ * data of a table.  The file ends with a chunk for table
+ * #SYNC_DBCOPY_TABLE_END holding the SHA-512 hash over all
+ * preceding bytes of the file, including the chunk header.
+ */
+#ifndef SYNC_DBCOPY_H
+#define SYNC_DBCOPY_H
+
+#include <gnunet/gnunet_util_lib.h>
+#include <libpq-fe.h>
+
+
+/**
+ * Magic number at the beginning of each dump file.
+ */
+#define SYNC_DBCOPY_MAGIC "SYNCDMP2"
+
+/**
+ * Table number of the chunk with the checksum at the end of a file.
+ */
+#define SYNC_DBCOPY_TABLE_END UINT32_MAX
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a chunk in a dump file.
+ */
+struct SYNC_DBCOPY_ChunkHeaderP
+{
+  /**
+   * Index of the table in #SYNC_DBCOPY_tables, in NBO.
+   */
+  uint32_t table GNUNET_PACKED;
+
+  /**
+   * Number of bytes following the header, in NBO.
+   */
+  uint32_t size GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * Files of a dump.
+ */
+enum SYNC_DBCOPY_Part
+{
+  /**
+   * File with the blobs table.
+   */
+  SYNC_DBCOPY_PART_BLOBS = 0,
+
+  /**
+   * File with the accounts, payments, backups and
+   * backup_history tables.
+   */
+  SYNC_DBCOPY_PART_ACCOUNTS = 1
+};
+
+
+/**
+ * Description of a table we dump.
+ */
+struct SYNC_DBCOPY_Table
+{
+  /**
+   * Name of the table, NULL to terminate the array.
+   */
+  const char *name;
+
+  /**
+   * Comma-separated list of the columns we dump.
+   */
+  const char *columns;
+
+  /**
+   * Column we split the table by between workers.
+   */
+  const char *split;
+
+  /**
+   * Additional condition rows must satisfy to be exported, NULL for none.
+   */
+  const char *filter;
+
+  /**
+   * File the table is stored in.
+   */
+  enum SYNC_DBCOPY_Part part;
+
+  /**
+   * True for the rows of the blobs table whose data is
+   * in the blob store.
+   */
+  bool external;
+};
+
+
+/**
+ * Tables we dump, in the order in which they must be imported.
+ */
+extern const struct SYNC_DBCOPY_Table SYNC_DBCOPY_tables[];
+
+
+/**
+ * Get the name of a file of a dump.
+ *
+ * @param dir directory with the dump
+ * @param part which file
+ * @param off number of the worker that wrote the file
+ * @return file name, to be freed by the caller
+ */
+char *
+SYNC_DBCOPY_filename (const char *dir,
+                      enum SYNC_DBCOPY_Part part,
+                      unsigned int off);
+
+
+/**
+ * Connect to the database given by the "CONFIG" option in
+ * the "[syncdb-postgres]" section of @a cfg and select the
+ * "sync" schema.
+ *
+ * @param cfg configuration to use
+ * @return NULL on error
+ */
+PGconn *
+SYNC_DBCOPY_connect (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Execute @a sql on @a conn, which must not return any rows.
+ *
+ * @param conn connection to use
+ * @param sql statement to run
+ * @return #GNUNET_OK on success
+ */
+enum GNUNET_GenericReturnValue
+SYNC_DBCOPY_exec (PGconn *conn,
+                  const char *sql);
+
+
+/**
+ * Write @a size bytes to a dump file.
+ *
+ * @param f file to write to
+ * @param hc hash over the file so far, updated; NULL to not hash
+ * @param data data to write
+ * @param size number of bytes in @a data
+ * @return #GNUNET_OK on success
+ */
+enum GNUNET_GenericReturnValue
+SYNC_DBCOPY_write (FILE *f,
+                   struct GNUNET_HashContext *hc,
+                   const void *data,
+                   size_t size);
+
+
+/**
+ * Write a chunk to a dump file.
+ *
+ * @param f file to write to
+ * @param hc hash over the file so far, updated
+ * @param table index of the table the chunk belongs to
+ * @param data data of the chunk, can be NULL if @a size is 0
+ * @param size number of bytes in @a data
+ * @return #GNUNET_OK on success
+ */
+enum GNUNET_GenericReturnValue
+SYNC_DBCOPY_write_chunk (FILE *f,
+                         struct GNUNET_HashContext *hc,
+                         uint32_t table,
+                         const void *data,
+                         uint32_t size);
+
+
+/**
+ * Read exactly @a size bytes from a dump file.
+ *
+ * @param f file to read from
+ * @param hc hash over the file so far, updated; NULL to not hash
+ * @param[out] buf where to write the data
+ * @param size number of bytes to read
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on
+ *         read errors or if the file is truncated
+ */
+enum GNUNET_GenericReturnValue
+SYNC_DBCOPY_read (FILE *f,
+                  struct GNUNET_HashContext *hc,
+                  void *buf,
+                  size_t size);
+
+
+#endif
@@ -0,0 +1,770 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/sync-dbexport.c
+ * @brief Export the sync database into a dump directory.
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <pthread.h>
+#include "sync_util.h"
+#include "sync_database_lib.h"
+#include "sync-dbcopy.h"
+
+
+/**
+ * State of an export worker.
+ */
+struct Worker
+{
+  /**
+   * Thread of the worker.
+   */
+  pthread_t thread;
+
+  /**
+   * Number of bytes of COPY data the worker exported.
+   */
+  unsigned long long bytes;
+
+  /**
+   * Blob store to fetch external blobs from, NULL if none is
+   * configured or the dump is for a database sharing it.  Each
+   * worker has its own, as blob stores need not be thread-safe.
+   */
+  struct SYNC_BlobStorePlugin *blobstore;
+
+  /**
+   * Index of the worker, determines the account_pub
+   * prefix range it exports.
+   */
+  unsigned int off;
+
+  /**
+   * Set to #GNUNET_OK if the worker succeeded.
+   */
+  enum GNUNET_GenericReturnValue ret;
+};
+
+
+/**
+ * Return value from main().
+ */
+static int global_ret;
+
+/**
+ * -d option: directory to write the dump to
+ */
+static char *dump_dir;
+
+/**
+ * -j option: number of parallel workers
+ */
+static unsigned int num_workers = 1;
+
+/**
+ * -s option: leave data in the blob store instead of copying it
+ * into the dump
+ */
+static int shared_blobstore;
+
+/**
+ * Our configuration.
+ */
+static const struct GNUNET_CONFIGURATION_Handle *my_cfg;
+
+/**
+ * Snapshot all workers export, so that the dump is consistent.
+ */
+static char *snapshot;
+
+
+/**
+ * Build the condition selecting the rows of worker @a off
+ * by the first byte of @a column.  Rows where @a column is
+ * NULL (payments of old databases without an account) go to
+ * the first worker, as NULL never matches a comparison.
+ *
+ * @param column column to split by
+ * @param off index of the worker
+ * @return SQL condition, to be freed by the caller
+ */
+static char *
+build_range (const char *column,
+             unsigned int off)
+{
+  unsigned int lo = off * 256 / num_workers;
+  unsigned int hi = (off + 1) * 256 / num_workers;
+  char *cond;
+
+  if ( (0 == lo) &&
+       (256 == hi) )
+    return GNUNET_strdup ("TRUE");
+  if (0 == lo)
+    GNUNET_asprintf (&cond,
+                     "(%s IS NULL OR %s < '\\x%02x'::BYTEA)",
+                     column,
+                     column,
+                     hi);
+  else if (256 == hi)
+    GNUNET_asprintf (&cond,
+                     "%s >= '\\x%02x'::BYTEA",
+                     column,
+                     lo);
+  else
+    GNUNET_asprintf (&cond,
+                     "%s >= '\\x%02x'::BYTEA AND %s < '\\x%02x'::BYTEA",
+                     column,
+                     lo,
+                     column,
+                     hi);
+  return cond;
+}
+
+
+/**
+ * Write one row of the blobs table in the PostgreSQL binary COPY
+ * format as a chunk to @a f.
+ *
+ * @param f file to write to
+ * @param hc hash over @a f, updated
+ * @param table index of the table in #SYNC_DBCOPY_tables
+ * @param backup_hash hash of the blob
+ * @param data_size number of bytes in @a data
+ * @param data the blob
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+write_blob_row (FILE *f,
+                struct GNUNET_HashContext *hc,
+                uint32_t table,
+                const struct GNUNET_HashCode *backup_hash,
+                size_t data_size,
+                const void *data)
+{
+  uint16_t num_fields = htons (3);
+  uint32_t hash_len = htonl (sizeof (*backup_hash));
+  uint32_t data_len = htonl ((uint32_t) data_size);
+  uint32_t size_len = htonl (sizeof (uint64_t));
+  uint64_t size_nbo = GNUNET_htonll (data_size);
+  size_t row_size;
+  char *row;
+  char *pos;
+  enum GNUNET_GenericReturnValue ret;
+
+  if (data_size > INT32_MAX - 128)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Blob %s is too large for the dump\n",
+                GNUNET_h2s (backup_hash));
+    return GNUNET_SYSERR;
+  }
+  row_size = sizeof (num_fields)
+             + sizeof (hash_len) + sizeof (*backup_hash)
+             + sizeof (data_len) + data_size
+             + sizeof (size_len) + sizeof (size_nbo);
+  row = GNUNET_malloc_large (row_size);
+  if (NULL == row)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "malloc");
+    return GNUNET_SYSERR;
+  }
+  pos = row;
+  GNUNET_memcpy (pos, &num_fields, sizeof (num_fields));
+  pos += sizeof (num_fields);
+  GNUNET_memcpy (pos, &hash_len, sizeof (hash_len));
+  pos += sizeof (hash_len);
+  GNUNET_memcpy (pos, backup_hash, sizeof (*backup_hash));
+  pos += sizeof (*backup_hash);
+  GNUNET_memcpy (pos, &data_len, sizeof (data_len));
+  pos += sizeof (data_len);
+  GNUNET_memcpy (pos, data, data_size);
+  pos += data_size;
+  GNUNET_memcpy (pos, &size_len, sizeof (size_len));
+  pos += sizeof (size_len);
+  GNUNET_memcpy (pos, &size_nbo, sizeof (size_nbo));
+  ret = SYNC_DBCOPY_write_chunk (f,
+                                 hc,
+                                 table,
+                                 row,
+                                 (uint32_t) row_size);
+  GNUNET_free (row);
+  return ret;
+}
+
+
+/**
+ * Export the blobs of worker @a w whose data is in the blob store,
+ * fetching the data from the blob store.  We produce the binary
+ * COPY format ourselves, so that the import treats these rows like
+ * all other blobs (and checks their hash).
+ *
+ * @param w the worker
+ * @param conn database connection of the worker
+ * @param f file to write to
+ * @param hc hash over @a f, updated
+ * @param table index of the table in #SYNC_DBCOPY_tables
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+export_external (struct Worker *w,
+                 PGconn *conn,
+                 FILE *f,
+                 struct GNUNET_HashContext *hc,
+                 uint32_t table)
+{
+  /* signature, flags and length of the header extension */
+  static const char copy_header[19] = "PGCOPY\n\377\r\n";
+  uint16_t copy_trailer = htons (UINT16_MAX);
+  const struct SYNC_DBCOPY_Table *t = &SYNC_DBCOPY_tables[table];
+  enum GNUNET_GenericReturnValue ret;
+  PGresult *res;
+  char *range;
+  char *sql;
+  int num_rows;
+
+  range = build_range (t->split,
+                       w->off);
+  GNUNET_asprintf (&sql,
+                   "SELECT backup_hash FROM %s WHERE %s AND %s",
+                   t->name,
+                   range,
+                   t->filter);
+  GNUNET_free (range);
+  res = PQexecParams (conn,
+                      sql,
+                      0,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      1 /* binary results */);
+  if (PGRES_TUPLES_OK != PQresultStatus (res))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to run `%s': %s\n",
+                sql,
+                PQresultErrorMessage (res));
+    PQclear (res);
+    GNUNET_free (sql);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (sql);
+  num_rows = PQntuples (res);
+  if ( (0 != num_rows) &&
+       (NULL == w->blobstore) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "%d blobs are in a blob store, but no BLOBSTORE is configured\n",
+                num_rows);
+    PQclear (res);
+    return GNUNET_SYSERR;
+  }
+  ret = SYNC_DBCOPY_write_chunk (f,
+                                 hc,
+                                 table,
+                                 copy_header,
+                                 sizeof (copy_header));
+  for (int i = 0; (GNUNET_OK == ret) && (i < num_rows); i++)
+  {
+    struct GNUNET_HashCode backup_hash;
+    size_t data_size;
+    void *data;
+
+    if (sizeof (backup_hash) !=
+        PQgetlength (res,
+                     i,
+                     0))
+    {
+      GNUNET_break (0);
+      ret = GNUNET_SYSERR;
+      break;
+    }
+    GNUNET_memcpy (&backup_hash,
+                   PQgetvalue (res,
+                               i,
+                               0),
+                   sizeof (backup_hash));
+    if (GNUNET_OK !=
+        w->blobstore->get_blob (w->blobstore->cls,
+                                &backup_hash,
+                                &data_size,
+                                &data))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Failed to fetch blob %s from the blob store\n",
+                  GNUNET_h2s (&backup_hash));
+      ret = GNUNET_SYSERR;
+      break;
+    }
+    ret = write_blob_row (f,
+                          hc,
+                          table,
+                          &backup_hash,
+                          data_size,
+                          data);
+    w->bytes += data_size;
+    GNUNET_free (data);
+  }
+  PQclear (res);
+  if (GNUNET_OK == ret)
+    ret = SYNC_DBCOPY_write_chunk (f,
+                                   hc,
+                                   table,
+                                   &copy_trailer,
+                                   sizeof (copy_trailer));
+  if (GNUNET_OK != ret)
+    return ret;
+  /* empty chunk marks the end of the table */
+  return SYNC_DBCOPY_write_chunk (f,
+                                  hc,
+                                  table,
+                                  NULL,
+                                  0);
+}
+
+
+/**
+ * Export the rows of table @a table belonging to worker @a w.
+ *
+ * @param w the worker
+ * @param conn database connection of the worker
+ * @param f file to write to
+ * @param hc hash over @a f, updated
+ * @param table index of the table in #SYNC_DBCOPY_tables
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+export_table (struct Worker *w,
+              PGconn *conn,
+              FILE *f,
+              struct GNUNET_HashContext *hc,
+              uint32_t table)
+{
+  const struct SYNC_DBCOPY_Table *t = &SYNC_DBCOPY_tables[table];
+  enum GNUNET_GenericReturnValue ret = GNUNET_OK;
+  PGresult *res;
+  char *range;
+  char *sql;
+  char *buf;
+  int len;
+
+  if ( (t->external) &&
+       (! shared_blobstore) )
+    return export_external (w,
+                            conn,
+                            f,
+                            hc,
+                            table);
+  range = build_range (t->split,
+                       w->off);
+  GNUNET_asprintf (&sql,
+                   "COPY (SELECT %s FROM %s WHERE %s%s%s)"
+                   " TO STDOUT (FORMAT binary)",
+                   t->columns,
+                   t->name,
+                   range,
+                   (NULL == t->filter) ? "" : " AND ",
+                   (NULL == t->filter) ? "" : t->filter);
+  GNUNET_free (range);
+  res = PQexec (conn,
+                sql);
+  if (PGRES_COPY_OUT != PQresultStatus (res))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to run `%s': %s\n",
+                sql,
+                PQresultErrorMessage (res));
+    PQclear (res);
+    GNUNET_free (sql);
+    return GNUNET_SYSERR;
+  }
+  PQclear (res);
+  GNUNET_free (sql);
+  while (0 < (len = PQgetCopyData (conn,
+                                   &buf,
+                                   0)))
+  {
+    if ( (GNUNET_OK == ret) &&
+         (GNUNET_OK !=
+          SYNC_DBCOPY_write_chunk (f,
+                                   hc,
+                                   table,
+                                   buf,
+                                   (uint32_t) len)) )
+      ret = GNUNET_SYSERR; /* keep draining the COPY */
+    w->bytes += len;
+    PQfreemem (buf);
+  }
+  if (-2 == len)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "COPY of table `%s' failed: %s\n",
+                t->name,
+                PQerrorMessage (conn));
+    ret = GNUNET_SYSERR;
+  }
+  while (NULL != (res = PQgetResult (conn)))
+  {
+    if (PGRES_COMMAND_OK != PQresultStatus (res))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "COPY of table `%s' failed: %s\n",
+                  t->name,
+                  PQresultErrorMessage (res));
+      ret = GNUNET_SYSERR;
+    }
+    PQclear (res);
+  }
+  if (GNUNET_OK != ret)
+    return ret;
+  /* empty chunk marks the end of the table */
+  return SYNC_DBCOPY_write_chunk (f,
+                                  hc,
+                                  table,
+                                  NULL,
+                                  0);
+}
+
+
+/**
+ * Write the file @a part of worker @a w.
+ *
+ * @param w the worker
+ * @param conn database connection of the worker
+ * @param part which file to write
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+export_part (struct Worker *w,
+             PGconn *conn,
+             enum SYNC_DBCOPY_Part part)
+{
+  struct GNUNET_HashContext *hc;
+  struct GNUNET_HashCode h;
+  enum GNUNET_GenericReturnValue ret = GNUNET_OK;
+  char *fn;
+  FILE *f;
+
+  fn = SYNC_DBCOPY_filename (dump_dir,
+                             part,
+                             w->off);
+  f = fopen (fn,
+             "wb");
+  if (NULL == f)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "fopen",
+                              fn);
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  ret = SYNC_DBCOPY_write (f,
+                           hc,
+                           SYNC_DBCOPY_MAGIC,
+                           strlen (SYNC_DBCOPY_MAGIC));
+  for (uint32_t i = 0;
+       (GNUNET_OK == ret) &&
+       (NULL != SYNC_DBCOPY_tables[i].name);
+       i++)
+  {
+    if (part != SYNC_DBCOPY_tables[i].part)
+      continue;
+    ret = export_table (w,
+                        conn,
+                        f,
+                        hc,
+                        i);
+  }
+  if (GNUNET_OK == ret)
+  {
+    struct SYNC_DBCOPY_ChunkHeaderP ch = {
+      .table = htonl (SYNC_DBCOPY_TABLE_END),
+      .size = htonl (sizeof (h))
+    };
+
+    ret = SYNC_DBCOPY_write (f,
+                             hc,
+                             &ch,
+                             sizeof (ch));
+  }
+  GNUNET_CRYPTO_hash_context_finish (hc,
+                                     &h);
+  if (GNUNET_OK == ret)
+    ret = SYNC_DBCOPY_write (f,
+                             NULL,
+                             &h,
+                             sizeof (h));
+  if (0 != fclose (f))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "fclose",
+                              fn);
+    ret = GNUNET_SYSERR;
+  }
+  GNUNET_free (fn);
+  return ret;
+}
+
+
+/**
+ * Main function of an export worker.
+ *
+ * @param cls a `struct Worker`
+ * @return NULL
+ */
+static void *
+export_worker (void *cls)
+{
+  struct Worker *w = cls;
+  PGconn *conn;
+  char *sql;
+
+  w->ret = GNUNET_SYSERR;
+  conn = SYNC_DBCOPY_connect (my_cfg);
+  if (NULL == conn)
+    return NULL;
+  GNUNET_asprintf (&sql,
+                   "SET TRANSACTION SNAPSHOT '%s';",
+                   snapshot);
+  if ( (GNUNET_OK ==
+        SYNC_DBCOPY_exec (conn,
+                          "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY;"))
+       &&
+       (GNUNET_OK ==
+        SYNC_DBCOPY_exec (conn,
+                          sql)) &&
+       (GNUNET_OK ==
+        export_part (w,
+                     conn,
+                     SYNC_DBCOPY_PART_BLOBS)) &&
+       (GNUNET_OK ==
+        export_part (w,
+                     conn,
+                     SYNC_DBCOPY_PART_ACCOUNTS)) &&
+       (GNUNET_OK ==
+        SYNC_DBCOPY_exec (conn,
+                          "COMMIT;")) )
+    w->ret = GNUNET_OK;
+  GNUNET_free (sql);
+  PQfinish (conn);
+  return NULL;
+}
+
+
+/**
+ * Main function that will be run.
+ *
+ * @param cls closure
+ * @param args remaining command-line arguments
+ * @param cfgfile name of the configuration file used (for saving, can be NULL!)
+ * @param cfg configuration
+ */
+static void
+run (void *cls,
+     char *const *args,
+     const char *cfgfile,
+     const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  struct Worker *workers;
+  char *blobstore_name = NULL;
+  unsigned int started;
+  struct GNUNET_TIME_Absolute start;
+  unsigned long long bytes = 0;
+  PGconn *conn;
+  PGresult *res;
+
+  my_cfg = cfg;
+  if ( (0 == num_workers) ||
+       (256 < num_workers) )
+  {
+    fprintf (stderr,
+             "Number of workers must be between 1 and 256.\n");
+    global_ret = EXIT_INVALIDARGUMENT;
+    return;
+  }
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create (dump_dir))
+  {
+    fprintf (stderr,
+             "Failed to create directory `%s'.\n",
+             dump_dir);
+    global_ret = EXIT_FAILURE;
+    return;
+  }
+  conn = SYNC_DBCOPY_connect (cfg);
+  if (NULL == conn)
+  {
+    global_ret = EXIT_NOTCONFIGURED;
+    return;
+  }
+  /* Keep a transaction open while the workers run, so that
+     they can all use its snapshot. */
+  if (GNUNET_OK !=
+      SYNC_DBCOPY_exec (conn,
+                        "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY;"))
+  {
+    global_ret = EXIT_FAILURE;
+    PQfinish (conn);
+    return;
+  }
+  res = PQexec (conn,
+                "SELECT pg_export_snapshot();");
+  if ( (PGRES_TUPLES_OK != PQresultStatus (res)) ||
+       (1 != PQntuples (res)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to export snapshot: %s\n",
+                PQresultErrorMessage (res));
+    PQclear (res);
+    global_ret = EXIT_FAILURE;
+    PQfinish (conn);
+    return;
+  }
+  snapshot = GNUNET_strdup (PQgetvalue (res,
+                                        0,
+                                        0));
+  PQclear (res);
+  start = GNUNET_TIME_absolute_get ();
+  workers = GNUNET_new_array (num_workers,
+                              struct Worker);
+  if (! shared_blobstore)
+    (void) GNUNET_CONFIGURATION_get_value_string (cfg,
+                                                  "syncdb-postgres",
+                                                  "BLOBSTORE",
+                                                  &blobstore_name);
+  /* load the blob stores before starting any worker, as loading
+     plugins is not thread-safe */
+  for (unsigned int i = 0;
+       (NULL != blobstore_name) && (i<num_workers);
+       i++)
+  {
+    workers[i].blobstore = SYNC_BLOBSTORE_plugin_load (cfg,
+                                                       blobstore_name);
+    if (NULL == workers[i].blobstore)
+    {
+      GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                                 "syncdb-postgres",
+                                 "BLOBSTORE",
+                                 "failed to load blob store");
+      global_ret = EXIT_NOTCONFIGURED;
+      break;
+    }
+  }
+  for (started = 0;
+       (EXIT_SUCCESS == global_ret) && (started<num_workers);
+       started++)
+  {
+    workers[started].off = started;
+    workers[started].ret = GNUNET_SYSERR;
+    if (0 != pthread_create (&workers[started].thread,
+                             NULL,
+                             &export_worker,
+                             &workers[started]))
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "pthread_create");
+      global_ret = EXIT_FAILURE;
+      break;
+    }
+  }
+  for (unsigned int i = 0; i<started; i++)
+  {
+    GNUNET_assert (0 ==
+                   pthread_join (workers[i].thread,
+                                 NULL));
+    if (GNUNET_OK != workers[i].ret)
+      global_ret = EXIT_FAILURE;
+    bytes += workers[i].bytes;
+  }
+  for (unsigned int i = 0; i<num_workers; i++)
+    SYNC_BLOBSTORE_plugin_unload (workers[i].blobstore);
+  GNUNET_free (workers);
+  GNUNET_free (blobstore_name);
+  GNUNET_break (GNUNET_OK ==
+                SYNC_DBCOPY_exec (conn,
+                                  "COMMIT;"));
+  PQfinish (conn);
+  GNUNET_free (snapshot);
+  if (EXIT_SUCCESS != global_ret)
+  {
+    fprintf (stderr,
+             "Export failed, the dump in `%s' is incomplete.\n",
+             dump_dir);
+    return;
+  }
+  fprintf (stdout,
+           "Exported %llu bytes to `%s' in %s\n",
+           bytes,
+           dump_dir,
+           GNUNET_TIME_relative2s (GNUNET_TIME_absolute_get_duration (start),
+                                   true));
+}
+
+
+/**
+ * The main function of the database export tool.
+ *
+ * @param argc number of arguments from the command line
+ * @param argv command line arguments
+ * @return 0 ok, non-zero on error
+ */
+int
+main (int argc,
+      char *const *argv)
+{
+  struct GNUNET_GETOPT_CommandLineOption options[] = {
+    GNUNET_GETOPT_option_mandatory (
+      GNUNET_GETOPT_option_filename ('d',
+                                     "directory",
+                                     "DIRECTORY",
+                                     "write the dump into DIRECTORY",
+                                     &dump_dir)),
+    GNUNET_GETOPT_option_uint ('j',
+                               "jobs",
+                               "NUMBER",
+                               "export with NUMBER parallel workers, each exporting a range of account public keys (default: 1)",
+                               &num_workers),
+    GNUNET_GETOPT_option_flag ('s',
+                               "shared-blobstore",
+                               "do not copy data that is in the blob store into the dump, the database the dump is imported into must use the same blob store",
+                               &shared_blobstore),
+    GNUNET_GETOPT_OPTION_END
+  };
+  enum GNUNET_GenericReturnValue ret;
+
+  /* FIRST get the libtalerutil initialization out
+     of the way. Then throw that one away, and force
+     the SYNC defaults to be used! */
+  (void) TALER_project_data_default ();
+  GNUNET_OS_init (SYNC_project_data_default ());
+  ret = GNUNET_PROGRAM_run (argc, argv,
+                            "sync-dbexport",
+                            "Export sync database",
+                            options,
+                            &run, NULL);
+  if (GNUNET_SYSERR == ret)
+    return EXIT_INVALIDARGUMENT;
+  if (GNUNET_NO == ret)
+    return EXIT_SUCCESS;
+  return global_ret;
+}
+
+
+/* end of sync-dbexport.c */
@@ -0,0 +1,706 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/sync-dbimport.c
+ * @brief Import a dump written by sync-dbexport into the sync database.
+ * @author Christian Grothoff
+ *
+ * Each file is imported in its own transaction, which is only
+ * committed if the checksum of the file matches.  All blob files
+ * are imported first, as the backups reference the blobs.  Blobs
+ * are loaded into a temporary table first, so that we can check
+ * that the data matches the backup hash and merge them with blobs
+ * that may already exist in the database.
+ *
+ * Blobs without data (dumped with "sync-dbexport -s") are only
+ * accepted with "-s", as their data must already be in the blob
+ * store of this database.
+ *
+ * Until the accounts are imported, the blobs are not referenced
+ * by any backup, so the garbage collection ("sync-dbinit -g")
+ * would delete them.  It must not run during an import.
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <pthread.h>
+#include "sync_util.h"
+#include "sync-dbcopy.h"
+
+
+/**
+ * State of an import worker.
+ */
+struct Worker
+{
+  /**
+   * Thread of the worker.
+   */
+  pthread_t thread;
+
+  /**
+   * Number of bytes of COPY data the worker imported.
+   */
+  unsigned long long bytes;
+
+  /**
+   * Set to #GNUNET_OK if the worker succeeded.
+   */
+  enum GNUNET_GenericReturnValue ret;
+};
+
+
+/**
+ * Return value from main().
+ */
+static int global_ret;
+
+/**
+ * -d option: directory to read the dump from
+ */
+static char *dump_dir;
+
+/**
+ * -j option: number of parallel workers
+ */
+static unsigned int num_workers = 1;
+
+/**
+ * -s option: accept blobs whose data is in the blob store
+ */
+static int shared_blobstore;
+
+/**
+ * Our configuration.
+ */
+static const struct GNUNET_CONFIGURATION_Handle *my_cfg;
+
+/**
+ * Part of the dump we are currently importing.
+ */
+static enum SYNC_DBCOPY_Part current_part;
+
+/**
+ * Number of files per part in the dump.
+ */
+static unsigned int num_files;
+
+/**
+ * Next file of the #current_part to import.
+ */
+static unsigned int next_file;
+
+/**
+ * Set if any worker failed, so the others stop early.
+ */
+static bool failed;
+
+/**
+ * Lock for #next_file and #failed.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * Abort the COPY in progress on @a conn.
+ *
+ * @param conn connection with a COPY in progress
+ */
+static void
+abort_copy (PGconn *conn)
+{
+  PGresult *res;
+
+  (void) PQputCopyEnd (conn,
+                       "import aborted");
+  while (NULL != (res = PQgetResult (conn)))
+    PQclear (res);
+}
+
+
+/**
+ * Import the rows of table @a table from @a f, up to and
+ * including the empty chunk that ends the table.
+ *
+ * @param w the worker
+ * @param conn database connection of the worker
+ * @param f file to read from
+ * @param hc hash over @a f, updated
+ * @param table index of the table in #SYNC_DBCOPY_tables
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+import_table (struct Worker *w,
+              PGconn *conn,
+              FILE *f,
+              struct GNUNET_HashContext *hc,
+              uint32_t table)
+{
+  const struct SYNC_DBCOPY_Table *t = &SYNC_DBCOPY_tables[table];
+  enum GNUNET_GenericReturnValue ret = GNUNET_OK;
+  PGresult *res;
+  char *sql;
+  char *buf = NULL;
+  size_t buf_size = 0;
+
+  GNUNET_asprintf (&sql,
+                   "COPY %s%s (%s) FROM STDIN (FORMAT binary)",
+                   t->name,
+                   (SYNC_DBCOPY_PART_BLOBS == t->part)
+                   ? "_import"
+                   : "",
+                   t->columns);
+  res = PQexec (conn,
+                sql);
+  if (PGRES_COPY_IN != PQresultStatus (res))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to run `%s': %s\n",
+                sql,
+                PQresultErrorMessage (res));
+    PQclear (res);
+    GNUNET_free (sql);
+    return GNUNET_SYSERR;
+  }
+  PQclear (res);
+  GNUNET_free (sql);
+  while (1)
+  {
+    struct SYNC_DBCOPY_ChunkHeaderP ch;
+    uint32_t size;
+
+    if (GNUNET_OK !=
+        SYNC_DBCOPY_read (f,
+                          hc,
+                          &ch,
+                          sizeof (ch)))
+    {
+      ret = GNUNET_SYSERR;
+      break;
+    }
+    if (table != ntohl (ch.table))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Dump file is malformed (unexpected table %u)\n",
+                  (unsigned int) ntohl (ch.table));
+      ret = GNUNET_SYSERR;
+      break;
+    }
+    size = ntohl (ch.size);
+    if (0 == size)
+      break;
+    if (size > buf_size)
+    {
+      GNUNET_free (buf);
+      buf_size = size;
+      buf = GNUNET_malloc_large (buf_size);
+      if (NULL == buf)
+      {
+        GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                             "malloc");
+        buf_size = 0;
+        ret = GNUNET_SYSERR;
+        break;
+      }
+    }
+    if (GNUNET_OK !=
+        SYNC_DBCOPY_read (f,
+                          hc,
+                          buf,
+                          size))
+    {
+      ret = GNUNET_SYSERR;
+      break;
+    }
+    if (1 != PQputCopyData (conn,
+                            buf,
+                            (int) size))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "COPY into table `%s' failed: %s\n",
+                  t->name,
+                  PQerrorMessage (conn));
+      ret = GNUNET_SYSERR;
+      break;
+    }
+    w->bytes += size;
+  }
+  GNUNET_free (buf);
+  if (GNUNET_OK != ret)
+  {
+    abort_copy (conn);
+    return ret;
+  }
+  if (1 != PQputCopyEnd (conn,
+                         NULL))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "COPY into table `%s' failed: %s\n",
+                t->name,
+                PQerrorMessage (conn));
+    abort_copy (conn);
+    return GNUNET_SYSERR;
+  }
+  while (NULL != (res = PQgetResult (conn)))
+  {
+    if (PGRES_COMMAND_OK != PQresultStatus (res))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "COPY into table `%s' failed: %s\n",
+                  t->name,
+                  PQresultErrorMessage (res));
+      ret = GNUNET_SYSERR;
+    }
+    PQclear (res);
+  }
+  return ret;
+}
+
+
+/**
+ * Check that the data of all blobs we just imported into the
+ * temporary table matches their hash, and merge them into the
+ * blobs table.
+ *
+ * @param conn database connection with the imported blobs
+ * @param fn name of the file the blobs came from, for logging
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+merge_blobs (PGconn *conn,
+             const char *fn)
+{
+  PGresult *res;
+  unsigned long long bad;
+  unsigned long long external;
+
+  res = PQexec (conn,
+                "SELECT"
+                " COUNT(*) FILTER (WHERE sha512(data) <> backup_hash)"
+                ",COUNT(*) FILTER (WHERE data IS NULL)"
+                " FROM blobs_import;");
+  if ( (PGRES_TUPLES_OK != PQresultStatus (res)) ||
+       (1 != PQntuples (res)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to verify blobs: %s\n",
+                PQresultErrorMessage (res));
+    PQclear (res);
+    return GNUNET_SYSERR;
+  }
+  bad = strtoull (PQgetvalue (res,
+                              0,
+                              0),
+                  NULL,
+                  10);
+  external = strtoull (PQgetvalue (res,
+                                   0,
+                                   1),
+                       NULL,
+                       10);
+  PQclear (res);
+  if (0 != bad)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "%llu blobs in `%s' do not match their backup hash\n",
+                bad,
+                fn);
+    return GNUNET_SYSERR;
+  }
+  if ( (0 != external) &&
+       (! shared_blobstore) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "%llu blobs in `%s' have their data in the blob store of the exporting database; use -s if this database uses the same blob store\n",
+                external,
+                fn);
+    return GNUNET_SYSERR;
+  }
+  /* blobs may already exist if we merge into a live database */
+  return SYNC_DBCOPY_exec (conn,
+                           "INSERT INTO blobs"
+                           " (backup_hash"
+                           " ,data"
+                           " ,data_size)"
+                           " SELECT backup_hash"
+                           "       ,data"
+                           "       ,data_size"
+                           "   FROM blobs_import"
+                           " ON CONFLICT DO NOTHING;");
+}
+
+
+/**
+ * Import file @a fn of the #current_part in one transaction.
+ *
+ * @param w the worker
+ * @param conn database connection of the worker
+ * @param fn name of the file to import
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+import_file (struct Worker *w,
+             PGconn *conn,
+             const char *fn)
+{
+  struct GNUNET_HashContext *hc;
+  struct GNUNET_HashCode h;
+  struct GNUNET_HashCode want;
+  enum GNUNET_GenericReturnValue ret;
+  char magic[sizeof (SYNC_DBCOPY_MAGIC) - 1];
+  FILE *f;
+
+  f = fopen (fn,
+             "rb");
+  if (NULL == f)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "fopen",
+                              fn);
+    return GNUNET_SYSERR;
+  }
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  ret = SYNC_DBCOPY_read (f,
+                          hc,
+                          magic,
+                          sizeof (magic));
+  if ( (GNUNET_OK == ret) &&
+       (0 != memcmp (magic,
+                     SYNC_DBCOPY_MAGIC,
+                     sizeof (magic))) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "`%s' is not a sync database dump\n",
+                fn);
+    ret = GNUNET_SYSERR;
+  }
+  if (GNUNET_OK == ret)
+    ret = SYNC_DBCOPY_exec (conn,
+                            "BEGIN;");
+  if ( (GNUNET_OK == ret) &&
+       (SYNC_DBCOPY_PART_BLOBS == current_part) )
+    ret = SYNC_DBCOPY_exec (conn,
+                            "CREATE TEMPORARY TABLE blobs_import"
+                            " (backup_hash BYTEA NOT NULL"
+                            " ,data BYTEA"
+                            " ,data_size INT8)"
+                            " ON COMMIT DROP;");
+  for (uint32_t i = 0;
+       (GNUNET_OK == ret) &&
+       (NULL != SYNC_DBCOPY_tables[i].name);
+       i++)
+  {
+    if (current_part != SYNC_DBCOPY_tables[i].part)
+      continue;
+    ret = import_table (w,
+                        conn,
+                        f,
+                        hc,
+                        i);
+  }
+  if (GNUNET_OK == ret)
+  {
+    struct SYNC_DBCOPY_ChunkHeaderP ch;
+
+    ret = SYNC_DBCOPY_read (f,
+                            hc,
+                            &ch,
+                            sizeof (ch));
+    if ( (GNUNET_OK == ret) &&
+         ( (SYNC_DBCOPY_TABLE_END != ntohl (ch.table)) ||
+           (sizeof (want) != ntohl (ch.size)) ) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Dump file `%s' is malformed (missing checksum)\n",
+                  fn);
+      ret = GNUNET_SYSERR;
+    }
+  }
+  GNUNET_CRYPTO_hash_context_finish (hc,
+                                     &h);
+  if (GNUNET_OK == ret)
+    ret = SYNC_DBCOPY_read (f,
+                            NULL,
+                            &want,
+                            sizeof (want));
+  if ( (GNUNET_OK == ret) &&
+       (0 != GNUNET_memcmp (&h,
+                            &want)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Checksum of dump file `%s' does not match\n",
+                fn);
+    ret = GNUNET_SYSERR;
+  }
+  GNUNET_break (0 == fclose (f));
+  if ( (GNUNET_OK == ret) &&
+       (SYNC_DBCOPY_PART_BLOBS == current_part) )
+    ret = merge_blobs (conn,
+                       fn);
+  if (GNUNET_OK == ret)
+    ret = SYNC_DBCOPY_exec (conn,
+                            "COMMIT;");
+  if (GNUNET_OK != ret)
+    (void) SYNC_DBCOPY_exec (conn,
+                             "ROLLBACK;");
+  return ret;
+}
+
+
+/**
+ * Main function of an import worker.  Imports files of the
+ * #current_part until none are left.
+ *
+ * @param cls a `struct Worker`
+ * @return NULL
+ */
+static void *
+import_worker (void *cls)
+{
+  struct Worker *w = cls;
+  PGconn *conn;
+
+  w->ret = GNUNET_SYSERR;
+  conn = SYNC_DBCOPY_connect (my_cfg);
+  if (NULL == conn)
+  {
+    GNUNET_assert (0 == pthread_mutex_lock (&lock));
+    failed = true;
+    GNUNET_assert (0 == pthread_mutex_unlock (&lock));
+    return NULL;
+  }
+  w->ret = GNUNET_OK;
+  while (1)
+  {
+    unsigned int off;
+    char *fn;
+
+    GNUNET_assert (0 == pthread_mutex_lock (&lock));
+    off = next_file++;
+    if (failed)
+      off = num_files;
+    GNUNET_assert (0 == pthread_mutex_unlock (&lock));
+    if (off >= num_files)
+      break;
+    fn = SYNC_DBCOPY_filename (dump_dir,
+                               current_part,
+                               off);
+    if (GNUNET_OK !=
+        import_file (w,
+                     conn,
+                     fn))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Failed to import `%s'\n",
+                  fn);
+      w->ret = GNUNET_SYSERR;
+      GNUNET_assert (0 == pthread_mutex_lock (&lock));
+      failed = true;
+      GNUNET_assert (0 == pthread_mutex_unlock (&lock));
+    }
+    GNUNET_free (fn);
+  }
+  PQfinish (conn);
+  return NULL;
+}
+
+
+/**
+ * Import all files of @a part with #num_workers workers.
+ *
+ * @param part which files to import
+ * @param[in,out] bytes incremented by the number of bytes imported
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+import_part (enum SYNC_DBCOPY_Part part,
+             unsigned long long *bytes)
+{
+  struct Worker *workers;
+  unsigned int started;
+  enum GNUNET_GenericReturnValue ret = GNUNET_OK;
+
+  current_part = part;
+  next_file = 0;
+  workers = GNUNET_new_array (num_workers,
+                              struct Worker);
+  for (started = 0; started<num_workers; started++)
+  {
+    if (0 != pthread_create (&workers[started].thread,
+                             NULL,
+                             &import_worker,
+                             &workers[started]))
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "pthread_create");
+      ret = GNUNET_SYSERR;
+      break;
+    }
+  }
+  if (0 == started)
+  {
+    GNUNET_free (workers);
+    return GNUNET_SYSERR;
+  }
+  for (unsigned int i = 0; i<started; i++)
+  {
+    GNUNET_assert (0 ==
+                   pthread_join (workers[i].thread,
+                                 NULL));
+    if (GNUNET_OK != workers[i].ret)
+      ret = GNUNET_SYSERR;
+    *bytes += workers[i].bytes;
+  }
+  GNUNET_free (workers);
+  return ret;
+}
+
+
+/**
+ * Main function that will be run.
+ *
+ * @param cls closure
+ * @param args remaining command-line arguments
+ * @param cfgfile name of the configuration file used (for saving, can be NULL!)
+ * @param cfg configuration
+ */
+static void
+run (void *cls,
+     char *const *args,
+     const char *cfgfile,
+     const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  struct GNUNET_TIME_Absolute start;
+  unsigned long long bytes = 0;
+
+  my_cfg = cfg;
+  if (0 == num_workers)
+  {
+    fprintf (stderr,
+             "Number of workers must be positive.\n");
+    global_ret = EXIT_INVALIDARGUMENT;
+    return;
+  }
+  /* the export wrote one pair of files per export worker */
+  while (1)
+  {
+    char *fn;
+    bool have_blobs;
+    bool have_accounts;
+
+    fn = SYNC_DBCOPY_filename (dump_dir,
+                               SYNC_DBCOPY_PART_BLOBS,
+                               num_files);
+    have_blobs = (GNUNET_YES ==
+                  GNUNET_DISK_file_test_read (fn));
+    GNUNET_free (fn);
+    fn = SYNC_DBCOPY_filename (dump_dir,
+                               SYNC_DBCOPY_PART_ACCOUNTS,
+                               num_files);
+    have_accounts = (GNUNET_YES ==
+                     GNUNET_DISK_file_test_read (fn));
+    GNUNET_free (fn);
+    if (have_blobs != have_accounts)
+    {
+      fprintf (stderr,
+               "Dump in `%s' is incomplete.\n",
+               dump_dir);
+      global_ret = EXIT_FAILURE;
+      return;
+    }
+    if (! have_blobs)
+      break;
+    num_files++;
+  }
+  if (0 == num_files)
+  {
+    fprintf (stderr,
+             "No dump found in `%s'.\n",
+             dump_dir);
+    global_ret = EXIT_INVALIDARGUMENT;
+    return;
+  }
+  start = GNUNET_TIME_absolute_get ();
+  if ( (GNUNET_OK !=
+        import_part (SYNC_DBCOPY_PART_BLOBS,
+                     &bytes)) ||
+       (GNUNET_OK !=
+        import_part (SYNC_DBCOPY_PART_ACCOUNTS,
+                     &bytes)) )
+  {
+    fprintf (stderr,
+             "Import failed, files that were not imported completely were rolled back.\n");
+    global_ret = EXIT_FAILURE;
+    return;
+  }
+  fprintf (stdout,
+           "Imported %llu bytes from `%s' in %s\n",
+           bytes,
+           dump_dir,
+           GNUNET_TIME_relative2s (GNUNET_TIME_absolute_get_duration (start),
+                                   true));
+}
+
+
+/**
+ * The main function of the database import tool.
+ *
+ * @param argc number of arguments from the command line
+ * @param argv command line arguments
+ * @return 0 ok, non-zero on error
+ */
+int
+main (int argc,
+      char *const *argv)
+{
+  struct GNUNET_GETOPT_CommandLineOption options[] = {
+    GNUNET_GETOPT_option_mandatory (
+      GNUNET_GETOPT_option_filename ('d',
+                                     "directory",
+                                     "DIRECTORY",
+                                     "read the dump from DIRECTORY",
+                                     &dump_dir)),
+    GNUNET_GETOPT_option_uint ('j',
+                               "jobs",
+                               "NUMBER",
+                               "import with NUMBER parallel workers (default: 1)",
+                               &num_workers),
+    GNUNET_GETOPT_option_flag ('s',
+                               "shared-blobstore",
+                               "accept a dump made with sync-dbexport -s, this database must use the same blob store as the exported one",
+                               &shared_blobstore),
+    GNUNET_GETOPT_OPTION_END
+  };
+  enum GNUNET_GenericReturnValue ret;
+
+  /* FIRST get the libtalerutil initialization out
+     of the way. Then throw that one away, and force
+     the SYNC defaults to be used! */
+  (void) TALER_project_data_default ();
+  GNUNET_OS_init (SYNC_project_data_default ());
+  ret = GNUNET_PROGRAM_run (argc, argv,
+                            "sync-dbimport",
+                            "Import sync database dump (run sync-dbinit first, and do not run sync-dbinit -g during the import)",
+                            options,
+                            &run, NULL);
+  if (GNUNET_SYSERR == ret)
+    return EXIT_INVALIDARGUMENT;
+  if (GNUNET_NO == ret)
+    return EXIT_SUCCESS;
+  return global_ret;
+}
+
+
+/* end of sync-dbimport.c */
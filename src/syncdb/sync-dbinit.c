@@ -24,6 +24,12 @@
 #include "sync_database_lib.h"
 
 
+/**
+ * How many blobs do we move to the cold tier per database query?
+ */
+#define MIGRATE_BATCH_SIZE 64
+
+
 /**
  * Return value from main().
  */
@@ -39,6 +45,67 @@ static int reset_db;
  */
 static int gc_db;
 
+/**
+ * -P option: number of partitions to split the tables into,
+ * 0 to leave the tables as they are
+ */
+static unsigned int num_partitions;
+
+/**
+ * -m option: move cold blobs to the blob store
+ */
+static int migrate_cold;
+
+/**
+ * -s option: show where the backup data is kept
+ */
+static int show_stats;
+
+
+/**
+ * Move blobs not accessed for the "COLD_AFTER" time to the
+ * blob store, in batches to bound our memory consumption.
+ *
+ * @param cfg configuration
+ * @param plugin database plugin
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+do_migrate_cold (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                 struct SYNC_DatabasePlugin *plugin)
+{
+  struct GNUNET_TIME_Relative cold_after;
+  struct GNUNET_TIME_Absolute cutoff;
+  enum GNUNET_DB_QueryStatus qs;
+  unsigned long long total = 0;
+
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+                                           "syncdb-postgres",
+                                           "COLD_AFTER",
+                                           &cold_after))
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
+                               "syncdb-postgres",
+                               "COLD_AFTER");
+    return GNUNET_SYSERR;
+  }
+  cutoff = GNUNET_TIME_absolute_subtract (GNUNET_TIME_absolute_get (),
+                                          cold_after);
+  do {
+    qs = plugin->migrate_cold (plugin->cls,
+                               cutoff,
+                               MIGRATE_BATCH_SIZE);
+    if (qs < 0)
+      return GNUNET_SYSERR;
+    total += qs;
+  } while (MIGRATE_BATCH_SIZE == qs);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Moved %llu blobs to the cold tier\n",
+              total);
+  return GNUNET_OK;
+}
+
 
 /**
  * Main function that will be run.
@@ -79,6 +146,49 @@ run (void *cls,
     SYNC_DB_plugin_unload (plugin);
     return;
   }
+  if ( (0 != num_partitions) &&
+       (GNUNET_OK !=
+        plugin->partition_tables (plugin->cls,
+                                  num_partitions)) )
+  {
+    fprintf (stderr,
+             "Failed to partition tables.\n");
+    global_ret = EXIT_FAILURE;
+    SYNC_DB_plugin_unload (plugin);
+    return;
+  }
+  if ( (migrate_cold) &&
+       (GNUNET_OK !=
+        do_migrate_cold (cfg,
+                         plugin)) )
+  {
+    fprintf (stderr,
+             "Moving blobs to the cold tier failed!\n");
+    global_ret = EXIT_FAILURE;
+  }
+  if (show_stats)
+  {
+    struct SYNC_DB_StorageStats stats;
+
+    if (0 >
+        plugin->get_storage_stats (plugin->cls,
+                                   &stats))
+    {
+      fprintf (stderr,
+               "Failed to obtain storage statistics!\n");
+      global_ret = EXIT_FAILURE;
+    }
+    else
+    {
+      fprintf (stdout,
+               "hot: %llu blobs, %llu bytes\n"
+               "cold: %llu blobs, %llu bytes\n",
+               (unsigned long long) stats.hot_blobs,
+               (unsigned long long) stats.hot_bytes,
+               (unsigned long long) stats.cold_blobs,
+               (unsigned long long) stats.cold_bytes);
+    }
+  }
   if (gc_db)
   {
     struct GNUNET_TIME_Absolute now;
@@ -124,6 +234,19 @@ main (int argc,
                                "garbagecollect",
                                "remove state data from database",
                                &gc_db),
+    GNUNET_GETOPT_option_flag ('m',
+                               "migrate-cold",
+                               "move backup data not accessed for the COLD_AFTER time from the database to the blob store",
+                               &migrate_cold),
+    GNUNET_GETOPT_option_flag ('s',
+                               "stats",
+                               "show how much backup data is kept in the database and in the blob store",
+                               &show_stats),
+    GNUNET_GETOPT_option_uint ('P',
+                               "partition",
+                               "NUMBER",
+                               "hash-partition tables into NUMBER partitions, or change the number of partitions (rewrites all tables, stop sync-httpd first!)",
+                               &num_partitions),
     GNUNET_GETOPT_OPTION_END
   };
   enum GNUNET_GenericReturnValue ret;
@@ -21,6 +21,7 @@
  */
 #include "platform.h"
 #include "sync_database_plugin.h"
+#include "sync_database_lib.h"
 #include <ltdl.h>
 
 
@@ -81,6 +82,40 @@ SYNC_DB_plugin_unload (struct SYNC_DatabasePlugin *plugin)
 }
 
 
+struct SYNC_BlobStorePlugin *
+SYNC_BLOBSTORE_plugin_load (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                            const char *name)
+{
+  char *lib_name;
+  struct SYNC_BlobStorePlugin *plugin;
+
+  (void) GNUNET_asprintf (&lib_name,
+                          "libsync_plugin_blobstore_%s",
+                          name);
+  plugin = GNUNET_PLUGIN_load (lib_name,
+                               (void *) cfg);
+  if (NULL != plugin)
+    plugin->library_name = lib_name;
+  else
+    GNUNET_free (lib_name);
+  return plugin;
+}
+
+
+void
+SYNC_BLOBSTORE_plugin_unload (struct SYNC_BlobStorePlugin *plugin)
+{
+  char *lib_name;
+
+  if (NULL == plugin)
+    return;
+  lib_name = plugin->library_name;
+  GNUNET_assert (NULL == GNUNET_PLUGIN_unload (lib_name,
+                                               plugin));
+  GNUNET_free (lib_name);
+}
+
+
 /**
  * Libtool search path before we started.
  */
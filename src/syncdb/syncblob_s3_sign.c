@@ -0,0 +1,182 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Lesser General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/syncblob_s3_sign.c
+ * @brief AWS signature version 4 for the S3 blob store
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gcrypt.h>
+#include "syncblob_s3_sign.h"
+
+
+/**
+ * Length of a SHA-256 hash.
+ */
+#define SHA256_LEN 32
+
+
+/**
+ * Hex-encode @a size bytes of @a data into @a out.
+ *
+ * @param data data to encode
+ * @param size number of bytes in @a data
+ * @param[out] out where to write the encoding, must have
+ *             space for 2 * @a size + 1 characters
+ */
+static void
+hex_encode (const void *data,
+            size_t size,
+            char *out)
+{
+  const uint8_t *d = data;
+
+  for (size_t i = 0; i<size; i++)
+    sprintf (&out[2 * i],
+             "%02x",
+             (unsigned int) d[i]);
+}
+
+
+/**
+ * Compute HMAC-SHA256 of @a msg under @a key.
+ *
+ * @param key key to use
+ * @param key_size number of bytes in @a key
+ * @param msg 0-terminated message to authenticate
+ * @param[out] out where to write the result
+ */
+static void
+hmac_sha256 (const void *key,
+             size_t key_size,
+             const char *msg,
+             uint8_t out[SHA256_LEN])
+{
+  gcry_md_hd_t md;
+
+  GNUNET_assert (0 ==
+                 gcry_md_open (&md,
+                               GCRY_MD_SHA256,
+                               GCRY_MD_FLAG_HMAC));
+  GNUNET_assert (0 ==
+                 gcry_md_setkey (md,
+                                 key,
+                                 key_size));
+  gcry_md_write (md,
+                 msg,
+                 strlen (msg));
+  memcpy (out,
+          gcry_md_read (md,
+                        GCRY_MD_SHA256),
+          SHA256_LEN);
+  gcry_md_close (md);
+}
+
+
+void
+SYNC_S3_sha256_hex (const void *data,
+                    size_t size,
+                    char out[SYNC_S3_HEX_SIZE])
+{
+  uint8_t h[SHA256_LEN];
+
+  gcry_md_hash_buffer (GCRY_MD_SHA256,
+                       h,
+                       data,
+                       size);
+  hex_encode (h,
+              sizeof (h),
+              out);
+}
+
+
+void
+SYNC_S3_sign (const char *method,
+              const char *path,
+              const char *query,
+              const char *host,
+              const char *payload_hash,
+              const char *amz_date,
+              const char *region,
+              const char *secret_key,
+              char signature[SYNC_S3_HEX_SIZE])
+{
+  char creq_hash[SYNC_S3_HEX_SIZE];
+  char date[sizeof ("YYYYMMDD")];
+  uint8_t k[SHA256_LEN];
+  char *creq;
+  char *sts;
+  char *secret;
+
+  GNUNET_assert (strlen (amz_date) >= sizeof (date) - 1);
+  memcpy (date,
+          amz_date,
+          sizeof (date) - 1);
+  date[sizeof (date) - 1] = '\0';
+  GNUNET_asprintf (&creq,
+                   "%s\n%s\n%s\n"
+                   "host:%s\nx-amz-content-sha256:%s\nx-amz-date:%s\n\n"
+                   "%s\n%s",
+                   method,
+                   path,
+                   query,
+                   host,
+                   payload_hash,
+                   amz_date,
+                   SYNC_S3_SIGNED_HEADERS,
+                   payload_hash);
+  SYNC_S3_sha256_hex (creq,
+                      strlen (creq),
+                      creq_hash);
+  GNUNET_free (creq);
+  GNUNET_asprintf (&sts,
+                   "AWS4-HMAC-SHA256\n%s\n%s/%s/s3/aws4_request\n%s",
+                   amz_date,
+                   date,
+                   region,
+                   creq_hash);
+  GNUNET_asprintf (&secret,
+                   "AWS4%s",
+                   secret_key);
+  hmac_sha256 (secret,
+               strlen (secret),
+               date,
+               k);
+  GNUNET_free (secret);
+  hmac_sha256 (k,
+               sizeof (k),
+               region,
+               k);
+  hmac_sha256 (k,
+               sizeof (k),
+               "s3",
+               k);
+  hmac_sha256 (k,
+               sizeof (k),
+               "aws4_request",
+               k);
+  hmac_sha256 (k,
+               sizeof (k),
+               sts,
+               k);
+  GNUNET_free (sts);
+  hex_encode (k,
+              sizeof (k),
+              signature);
+}
+
+
+/* end of syncblob_s3_sign.c */
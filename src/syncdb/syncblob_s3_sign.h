@@ -0,0 +1,79 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Lesser General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/syncblob_s3_sign.h
+ * @brief AWS signature version 4 for the S3 blob store
+ * @author Christian Grothoff
+ */
+#ifndef SYNCBLOB_S3_SIGN_H
+#define SYNCBLOB_S3_SIGN_H
+
+#include <gnunet/gnunet_util_lib.h>
+
+
+/**
+ * Length of a hex-encoded SHA-256 hash, including the 0-terminator.
+ */
+#define SYNC_S3_HEX_SIZE (2 * 32 + 1)
+
+/**
+ * Headers covered by the signatures we compute.  Requests must
+ * include exactly these headers.
+ */
+#define SYNC_S3_SIGNED_HEADERS "host;x-amz-content-sha256;x-amz-date"
+
+
+/**
+ * Compute the hex-encoded SHA-256 hash of @a data, as needed
+ * for the "x-amz-content-sha256" header.
+ *
+ * @param data data to hash
+ * @param size number of bytes in @a data
+ * @param[out] out where to write the result
+ */
+void
+SYNC_S3_sha256_hex (const void *data,
+                    size_t size,
+                    char out[SYNC_S3_HEX_SIZE]);
+
+
+/**
+ * Compute the AWS signature version 4 of a request signing the
+ * #SYNC_S3_SIGNED_HEADERS.
+ *
+ * @param method HTTP method of the request
+ * @param path URI-encoded path of the request
+ * @param query canonical query string, "" for none
+ * @param host value of the "Host" header
+ * @param payload_hash value of the "x-amz-content-sha256" header
+ * @param amz_date value of the "x-amz-date" header, "YYYYMMDDTHHMMSSZ"
+ * @param region region of the bucket
+ * @param secret_key secret access key
+ * @param[out] signature set to the hex-encoded signature
+ */
+void
+SYNC_S3_sign (const char *method,
+              const char *path,
+              const char *query,
+              const char *host,
+              const char *payload_hash,
+              const char *amz_date,
+              const char *region,
+              const char *secret_key,
+              char signature[SYNC_S3_HEX_SIZE]);
+
+
+#endif
@@ -48,6 +48,43 @@ static int result;
  */
 static struct SYNC_DatabasePlugin *plugin;
 
+/**
+ * Handle to the database the plugin uses as its read replica.
+ * We write to it directly to simulate a replica lagging behind.
+ */
+static struct SYNC_DatabasePlugin *replica;
+
+
+/**
+ * Load the plugin for the read replica of @a cfg.
+ *
+ * @param cfg configuration of the plugin under test
+ * @return NULL on error
+ */
+static struct SYNC_DatabasePlugin *
+load_replica (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  struct GNUNET_CONFIGURATION_Handle *rcfg;
+  struct SYNC_DatabasePlugin *rp;
+  char *read_config;
+
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_string (cfg,
+                                             "syncdb-postgres",
+                                             "READ_CONFIG",
+                                             &read_config))
+    return NULL;
+  rcfg = GNUNET_CONFIGURATION_dup (cfg);
+  GNUNET_CONFIGURATION_set_value_string (rcfg,
+                                         "syncdb-postgres",
+                                         "CONFIG",
+                                         read_config);
+  GNUNET_free (read_config);
+  rp = SYNC_DB_plugin_load (rcfg);
+  GNUNET_CONFIGURATION_destroy (rcfg);
+  return rp;
+}
+
 
 /**
  * Function called on all pending payments for an account.
@@ -71,6 +108,78 @@ payment_it (void *cls,
 }
 
 
+/**
+ * Result of a batch lookup.
+ */
+struct BatchResult
+{
+  /**
+   * Number of backups returned with data.
+   */
+  unsigned int with_data;
+
+  /**
+   * Number of backups returned without data.
+   */
+  unsigned int without_data;
+
+  /**
+   * Number of backups omitted because of the size limit.
+   */
+  unsigned int omitted;
+
+  /**
+   * Account of the last backup returned with data.
+   */
+  struct SYNC_AccountPublicKeyP account_pub;
+};
+
+
+/**
+ * Function called on backups found by a batch lookup.
+ *
+ * @param cls a `struct BatchResult`
+ * @param account_pub account the backup is stored under
+ * @param account_sig signature affirming storage request
+ * @param prev_hash hash of the previous backup
+ * @param backup_hash hash of @a backup
+ * @param omitted true if the data was omitted due to the size limit
+ * @param backup_size number of bytes in @a backup
+ * @param backup raw backup data, NULL if known or omitted
+ */
+static void
+backup_it (void *cls,
+           const struct SYNC_AccountPublicKeyP *account_pub,
+           const struct SYNC_AccountSignatureP *account_sig,
+           const struct GNUNET_HashCode *prev_hash,
+           const struct GNUNET_HashCode *backup_hash,
+           bool omitted,
+           size_t backup_size,
+           const void *backup)
+{
+  struct BatchResult *br = cls;
+
+  if (omitted)
+  {
+    GNUNET_assert (NULL == backup);
+    GNUNET_assert (4 == backup_size);
+    br->omitted++;
+    return;
+  }
+  if (NULL == backup)
+  {
+    br->without_data++;
+    return;
+  }
+  br->with_data++;
+  br->account_pub = *account_pub;
+  GNUNET_assert (4 == backup_size);
+  GNUNET_assert (0 == memcmp (backup,
+                              "DATA",
+                              4));
+}
+
+
 /**
  * Main function that will be run by the scheduler.
  *
@@ -90,15 +199,49 @@ run (void *cls)
   struct GNUNET_HashCode r;
   struct GNUNET_HashCode r2;
   struct GNUNET_TIME_Absolute ts;
+  struct SYNC_DB_StorageStats stats;
+  struct SYNC_DB_StorageStats stats2;
   struct TALER_ClaimTokenP token;
   size_t bs;
+  size_t total;
   void *b = NULL;
+  struct SYNC_AccountPublicKeyP accounts[2];
+  struct GNUNET_HashCode known[2];
+  struct BatchResult br;
+  bool have_blobstore;
+  bool have_cold_tier;
 
+  have_blobstore = (GNUNET_YES ==
+                    GNUNET_CONFIGURATION_have_value (cfg,
+                                                     "syncdb-postgres",
+                                                     "BLOBSTORE"));
+  have_cold_tier = (GNUNET_YES ==
+                    GNUNET_CONFIGURATION_have_value (cfg,
+                                                     "syncdb-postgres",
+                                                     "COLD_AFTER"));
   if (NULL == (plugin = SYNC_DB_plugin_load (cfg)))
   {
     result = 77;
     return;
   }
+  if (NULL == (replica = load_replica (cfg)))
+  {
+    /* the plugin falls back to the primary, test everything else */
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Failed to connect to the replica database, skipping replica checks\n");
+  }
+  else
+  {
+    /* the replica must have its tables before the plugin first
+       uses it, otherwise the plugin falls back to the primary */
+    (void) replica->drop_tables (replica->cls);
+    if (GNUNET_OK !=
+        replica->create_tables (replica->cls))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                  "Creating replica tables failed\n");
+    }
+  }
   if (GNUNET_OK !=
       plugin->drop_tables (plugin->cls))
   {
@@ -111,6 +254,10 @@ run (void *cls)
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
                 "Creating tables failed\n");
   }
+  /* run the rest of the test on partitioned tables */
+  FAILIF (GNUNET_OK !=
+          plugin->partition_tables (plugin->cls,
+                                    4));
   GNUNET_assert (GNUNET_OK ==
                  plugin->preflight (plugin->cls));
   memset (&account_pub, 1, sizeof (account_pub));
@@ -174,12 +321,14 @@ run (void *cls)
   FAILIF (SYNC_DB_ONE_RESULT !=
           plugin->lookup_account_TR (plugin->cls,
                                      &account_pub,
+                                     &h,
                                      &r));
   FAILIF (0 != GNUNET_memcmp (&r,
                               &h2));
   FAILIF (SYNC_DB_ONE_RESULT !=
           plugin->lookup_backup_TR (plugin->cls,
                                     &account_pub,
+                                    &h2,
                                     &account_sig2,
                                     &r,
                                     &r2,
@@ -197,6 +346,170 @@ run (void *cls)
                        4));
   GNUNET_free (b);
   b = NULL;
+  if (NULL != replica)
+  {
+    /* the replica only has the first backup of the account */
+    FAILIF (SYNC_DB_ONE_RESULT !=
+            replica->store_payment_TR (replica->cls,
+                                       &account_pub,
+                                       "fake-order",
+                                       &token,
+                                       &amount));
+    FAILIF (SYNC_DB_ONE_RESULT !=
+            replica->increment_lifetime_TR (replica->cls,
+                                            &account_pub,
+                                            "fake-order",
+                                            GNUNET_TIME_UNIT_MINUTES));
+    FAILIF (SYNC_DB_ONE_RESULT !=
+            replica->store_backup_TR (replica->cls,
+                                      &account_pub,
+                                      &account_sig,
+                                      &h,
+                                      4,
+                                      "data"));
+    /* a client expecting the old backup is answered by the replica */
+    FAILIF (SYNC_DB_ONE_RESULT !=
+            plugin->lookup_account_TR (plugin->cls,
+                                       &account_pub,
+                                       &h,
+                                       &r));
+    FAILIF (0 != GNUNET_memcmp (&r,
+                                &h));
+  }
+  /* a client expecting the new backup gets it from the primary */
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->lookup_account_TR (plugin->cls,
+                                     &account_pub,
+                                     &h2,
+                                     &r));
+  FAILIF (0 != GNUNET_memcmp (&r,
+                              &h2));
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->lookup_backup_TR (plugin->cls,
+                                    &account_pub,
+                                    &h2,
+                                    &account_sig2,
+                                    &r,
+                                    &r2,
+                                    &bs,
+                                    &b));
+  FAILIF (0 != GNUNET_memcmp (&r2,
+                              &h2));
+  FAILIF (bs != 4);
+  FAILIF (0 != memcmp (b,
+                       "DATA",
+                       4));
+  GNUNET_free (b);
+  b = NULL;
+  accounts[0] = account_pub;
+  memset (&accounts[1], 7, sizeof (accounts[1]));
+  memset (known, 0, sizeof (known));
+  memset (&br, 0, sizeof (br));
+  FAILIF (1 !=
+          plugin->lookup_backups_TR (plugin->cls,
+                                     2,
+                                     accounts,
+                                     known,
+                                     UINT64_MAX,
+                                     &backup_it,
+                                     &br));
+  FAILIF (1 != br.with_data);
+  known[0] = h2;
+  memset (&br, 0, sizeof (br));
+  FAILIF (1 !=
+          plugin->lookup_backups_TR (plugin->cls,
+                                     2,
+                                     accounts,
+                                     known,
+                                     UINT64_MAX,
+                                     &backup_it,
+                                     &br));
+  FAILIF (1 != br.without_data);
+  FAILIF (0 != br.with_data);
+  /* a second account with the same backup; the client only
+     knows the backup of the first account */
+  memset (&accounts[1], 8, sizeof (accounts[1]));
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->store_payment_TR (plugin->cls,
+                                    &accounts[1],
+                                    "fake-order-3",
+                                    &token,
+                                    &amount));
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->increment_lifetime_TR (plugin->cls,
+                                         &accounts[1],
+                                         "fake-order-3",
+                                         GNUNET_TIME_UNIT_MINUTES));
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->store_backup_TR (plugin->cls,
+                                   &accounts[1],
+                                   &account_sig,
+                                   &h2,
+                                   4,
+                                   "DATA"));
+  memset (&br, 0, sizeof (br));
+  FAILIF (2 !=
+          plugin->lookup_backups_TR (plugin->cls,
+                                     2,
+                                     accounts,
+                                     known,
+                                     UINT64_MAX,
+                                     &backup_it,
+                                     &br));
+  FAILIF (1 != br.without_data);
+  FAILIF (1 != br.with_data);
+  FAILIF (0 != GNUNET_memcmp (&br.account_pub,
+                              &accounts[1]));
+  /* with a size limit, only the first backup comes with its data */
+  memset (known, 0, sizeof (known));
+  memset (&br, 0, sizeof (br));
+  FAILIF (2 !=
+          plugin->lookup_backups_TR (plugin->cls,
+                                     2,
+                                     accounts,
+                                     known,
+                                     4,
+                                     &backup_it,
+                                     &br));
+  FAILIF (1 != br.with_data);
+  FAILIF (1 != br.omitted);
+  FAILIF (0 != GNUNET_memcmp (&br.account_pub,
+                              &accounts[0]));
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->lookup_backup_version_TR (plugin->cls,
+                                            &account_pub,
+                                            &h,
+                                            &account_sig2,
+                                            &r,
+                                            &bs,
+                                            &b));
+  FAILIF (! GNUNET_is_zero (&r));
+  FAILIF (bs != 4);
+  FAILIF (0 != memcmp (b,
+                       "data",
+                       4));
+  GNUNET_free (b);
+  b = NULL;
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->lookup_backup_version_TR (plugin->cls,
+                                            &account_pub,
+                                            &h2,
+                                            &account_sig2,
+                                            &r,
+                                            &bs,
+                                            &b));
+  FAILIF (0 != GNUNET_memcmp (&r,
+                              &h));
+  GNUNET_free (b);
+  b = NULL;
+  FAILIF (SYNC_DB_NO_RESULTS !=
+          plugin->lookup_backup_version_TR (plugin->cls,
+                                            &account_pub,
+                                            &h3,
+                                            &account_sig2,
+                                            &r,
+                                            &bs,
+                                            &b));
   FAILIF (0 !=
           plugin->lookup_pending_payments_by_account_TR (plugin->cls,
                                                          &account_pub,
@@ -234,15 +547,134 @@ run (void *cls)
                                     &h2,
                                     4,
                                     "DATA"));
+  /* same content as the previous version of the first account */
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->store_backup_TR (plugin->cls,
+                                   &account_pub,
+                                   &account_sig,
+                                   &h,
+                                   4,
+                                   "data"));
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->lookup_backup_TR (plugin->cls,
+                                    &account_pub,
+                                    NULL,
+                                    &account_sig2,
+                                    &r,
+                                    &r2,
+                                    &bs,
+                                    &b));
+  FAILIF (bs != 4);
+  FAILIF (0 != memcmp (b,
+                       "data",
+                       4));
+  GNUNET_free (b);
+  b = NULL;
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->lookup_backup_range_TR (plugin->cls,
+                                          &account_pub,
+                                          NULL,
+                                          1,
+                                          2,
+                                          &account_sig2,
+                                          &r,
+                                          &r2,
+                                          &total,
+                                          &bs,
+                                          &b));
+  FAILIF (total != 4);
+  FAILIF (bs != 2);
+  FAILIF (0 != memcmp (b,
+                       "at",
+                       2));
+  GNUNET_free (b);
+  b = NULL;
+  /* move all backups to the cold tier, then download one */
+  ts = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_HOURS);
+  if (have_cold_tier)
+    FAILIF (0 >=
+            plugin->migrate_cold (plugin->cls,
+                                  ts,
+                                  64));
+  else if (have_blobstore)
+    /* all data is in the blob store already */
+    FAILIF (0 !=
+            plugin->migrate_cold (plugin->cls,
+                                  ts,
+                                  64));
+  else
+    FAILIF (GNUNET_DB_STATUS_HARD_ERROR !=
+            plugin->migrate_cold (plugin->cls,
+                                  ts,
+                                  64));
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->lookup_backup_range_TR (plugin->cls,
+                                          &account_pub,
+                                          NULL,
+                                          2,
+                                          UINT64_MAX,
+                                          &account_sig2,
+                                          &r,
+                                          &r2,
+                                          &total,
+                                          &bs,
+                                          &b));
+  FAILIF (total != 4);
+  FAILIF (bs != 2);
+  FAILIF (0 != memcmp (b,
+                       "ta",
+                       2));
+  GNUNET_free (b);
+  b = NULL;
+  FAILIF (0 >=
+          plugin->get_storage_stats (plugin->cls,
+                                     &stats));
+  if (have_blobstore)
+  {
+    /* without a cold tier, no data is ever kept in the database */
+    FAILIF ( (! have_cold_tier) &&
+             (0 != stats.hot_blobs) );
+    FAILIF (0 == stats.cold_blobs);
+    FAILIF (0 == stats.cold_bytes);
+  }
+  else
+  {
+    FAILIF (0 == stats.hot_blobs);
+    FAILIF (0 == stats.hot_bytes);
+    FAILIF (0 != stats.cold_blobs);
+  }
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          plugin->lookup_backup_TR (plugin->cls,
+                                    &account_pub,
+                                    NULL,
+                                    &account_sig2,
+                                    &r,
+                                    &r2,
+                                    &bs,
+                                    &b));
+  FAILIF (bs != 4);
+  FAILIF (0 != memcmp (b,
+                       "data",
+                       4));
+  GNUNET_free (b);
+  b = NULL;
+  FAILIF (0 >=
+          plugin->get_storage_stats (plugin->cls,
+                                     &stats2));
+  /* only the cold tier moves downloaded blobs back */
+  FAILIF (stats2.hot_blobs !=
+          stats.hot_blobs + (have_cold_tier ? 1 : 0));
   ts = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_YEARS);
   FAILIF (0 >
           plugin->gc (plugin->cls,
                       ts,
                       ts));
   memset (&account_pub, 1, sizeof (account_pub));
+  /* ask the primary, the replica (if any) still has the old account */
   FAILIF (SYNC_DB_NO_RESULTS !=
           plugin->lookup_backup_TR (plugin->cls,
                                     &account_pub,
+                                    NULL,
                                     &account_sig2,
                                     &r,
                                     &r2,
@@ -256,6 +688,13 @@ drop:
                 plugin->drop_tables (plugin->cls));
   SYNC_DB_plugin_unload (plugin);
   plugin = NULL;
+  if (NULL != replica)
+  {
+    GNUNET_break (GNUNET_OK ==
+                  replica->drop_tables (replica->cls));
+    SYNC_DB_plugin_unload (replica);
+    replica = NULL;
+  }
 }
 
 
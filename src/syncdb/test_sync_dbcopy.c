@@ -0,0 +1,549 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Lesser General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/test_sync_dbcopy.c
+ * @brief testcase for sync-dbexport and sync-dbimport
+ * @author Christian Grothoff
+ *
+ * Fills one database, exports it with several workers, imports the
+ * dump into a second database and compares the two, including a
+ * payment without an account.  Then checks that dumps with a
+ * corrupted checksum or with data that does not match its backup
+ * hash are rejected.
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <taler/taler_util.h>
+#include "sync_service.h"
+#include "sync_database_plugin.h"
+#include "sync_database_lib.h"
+#include "sync_util.h"
+#include "sync-dbcopy.h"
+
+
+#define FAILIF(cond)                            \
+  do {                                          \
+    if (! (cond)) { break;}                       \
+    GNUNET_break (0);                           \
+    goto drop;                                     \
+  } while (0)
+
+/**
+ * Configuration of the database we export.
+ */
+#define EXPORT_CONFIG "test_sync_dbcopy_export.conf"
+
+/**
+ * Configuration of the database we import into.
+ */
+#define IMPORT_CONFIG "test_sync_dbcopy_import.conf"
+
+/**
+ * Number of accounts we store in the exported database.
+ */
+#define NUM_ACCOUNTS 8
+
+/**
+ * Global return value for the test.
+ */
+static int result;
+
+/**
+ * Plugin for the database we export.
+ */
+static struct SYNC_DatabasePlugin *src;
+
+/**
+ * Plugin for the database we import into.
+ */
+static struct SYNC_DatabasePlugin *dst;
+
+
+/**
+ * Run @a binary with the configuration @a cfg_file on the
+ * dump in @a dir, using @a jobs workers.
+ *
+ * @param binary "sync-dbexport" or "sync-dbimport"
+ * @param cfg_file configuration file to use
+ * @param dir dump directory
+ * @param jobs number of workers
+ * @return exit code of @a binary, -1 if it could not be run
+ */
+static int
+run_tool (const char *binary,
+          const char *cfg_file,
+          const char *dir,
+          const char *jobs)
+{
+  struct GNUNET_OS_Process *proc;
+  enum GNUNET_OS_ProcessStatusType type;
+  unsigned long code;
+
+  proc = GNUNET_OS_start_process (GNUNET_OS_INHERIT_STD_ALL,
+                                  NULL, NULL, NULL,
+                                  binary,
+                                  binary,
+                                  "-c", cfg_file,
+                                  "-d", dir,
+                                  "-j", jobs,
+                                  NULL);
+  if (NULL == proc)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to run %s. Check your PATH.\n",
+                binary);
+    return -1;
+  }
+  if (GNUNET_OK !=
+      GNUNET_OS_process_wait_status (proc,
+                                     &type,
+                                     &code))
+  {
+    GNUNET_OS_process_destroy (proc);
+    return -1;
+  }
+  GNUNET_OS_process_destroy (proc);
+  if (GNUNET_OS_PROCESS_EXITED != type)
+    return -1;
+  return (int) code;
+}
+
+
+/**
+ * Flip a bit in the last byte of file @a fn, which is part
+ * of the checksum of a dump file.
+ *
+ * @param fn file to corrupt
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+corrupt_file (const char *fn)
+{
+  FILE *f;
+  int c;
+
+  f = fopen (fn,
+             "r+b");
+  if (NULL == f)
+    return GNUNET_SYSERR;
+  if ( (0 != fseek (f,
+                    -1,
+                    SEEK_END)) ||
+       (EOF == (c = fgetc (f))) ||
+       (0 != fseek (f,
+                    -1,
+                    SEEK_END)) ||
+       (EOF == fputc (c ^ 1,
+                      f)) )
+  {
+    GNUNET_break (0 == fclose (f));
+    return GNUNET_SYSERR;
+  }
+  if (0 != fclose (f))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Run @a sql on the database of the configuration @a cfg_file.
+ *
+ * @param cfg_file configuration file to use
+ * @param sql statement to run
+ * @return number of rows returned, -1 on error
+ */
+static int
+run_sql (const char *cfg_file,
+         const char *sql)
+{
+  struct GNUNET_CONFIGURATION_Handle *cfg;
+  PGconn *conn;
+  PGresult *res;
+  int ret;
+
+  cfg = GNUNET_CONFIGURATION_create ();
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_parse (cfg,
+                                  cfg_file))
+  {
+    GNUNET_CONFIGURATION_destroy (cfg);
+    return -1;
+  }
+  conn = SYNC_DBCOPY_connect (cfg);
+  GNUNET_CONFIGURATION_destroy (cfg);
+  if (NULL == conn)
+    return -1;
+  res = PQexec (conn,
+                sql);
+  switch (PQresultStatus (res))
+  {
+  case PGRES_COMMAND_OK:
+  case PGRES_TUPLES_OK:
+    ret = PQntuples (res);
+    break;
+  default:
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to run `%s': %s\n",
+                sql,
+                PQresultErrorMessage (res));
+    ret = -1;
+    break;
+  }
+  PQclear (res);
+  PQfinish (conn);
+  return ret;
+}
+
+
+/**
+ * (Re)create the tables of the database we import into.
+ *
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+reset_dst (void)
+{
+  (void) dst->drop_tables (dst->cls);
+  return dst->create_tables (dst->cls);
+}
+
+
+/**
+ * Function called on the pending payments of an imported account.
+ *
+ * @param cls pointer to the number of payments found
+ * @param timestamp for how long have we been waiting
+ * @param order_id order id in the backend
+ * @param token claim token, or NULL for none
+ * @param amount how much is the order for
+ */
+static void
+payment_it (void *cls,
+            struct GNUNET_TIME_Timestamp timestamp,
+            const char *order_id,
+            const struct TALER_ClaimTokenP *token,
+            const struct TALER_Amount *amount)
+{
+  unsigned int *found = cls;
+
+  GNUNET_assert (0 == strcmp (order_id,
+                              "pending-order"));
+  (*found)++;
+}
+
+
+/**
+ * Main function that will be run by the scheduler.
+ *
+ * @param cls NULL
+ */
+static void
+run (void *cls)
+{
+  struct GNUNET_CONFIGURATION_Handle *src_cfg;
+  struct GNUNET_CONFIGURATION_Handle *dst_cfg;
+  struct SYNC_AccountPublicKeyP accounts[NUM_ACCOUNTS];
+  struct SYNC_AccountPublicKeyP bad_account;
+  struct SYNC_AccountSignatureP account_sig;
+  struct TALER_ClaimTokenP token;
+  struct TALER_Amount amount;
+  struct GNUNET_HashCode h;
+  char *tmpdir;
+  char *good_dir = NULL;
+  char *bad_dir = NULL;
+  char *fn;
+  void *b = NULL;
+  unsigned int found;
+
+  (void) cls;
+  src_cfg = GNUNET_CONFIGURATION_create ();
+  dst_cfg = GNUNET_CONFIGURATION_create ();
+  if ( (GNUNET_OK !=
+        GNUNET_CONFIGURATION_parse (src_cfg,
+                                    EXPORT_CONFIG)) ||
+       (GNUNET_OK !=
+        GNUNET_CONFIGURATION_parse (dst_cfg,
+                                    IMPORT_CONFIG)) )
+  {
+    GNUNET_break (0);
+    GNUNET_CONFIGURATION_destroy (src_cfg);
+    GNUNET_CONFIGURATION_destroy (dst_cfg);
+    result = EXIT_NOTCONFIGURED;
+    return;
+  }
+  src = SYNC_DB_plugin_load (src_cfg);
+  dst = SYNC_DB_plugin_load (dst_cfg);
+  GNUNET_CONFIGURATION_destroy (src_cfg);
+  GNUNET_CONFIGURATION_destroy (dst_cfg);
+  if ( (NULL == src) ||
+       (NULL == dst) )
+  {
+    if (NULL != src)
+      SYNC_DB_plugin_unload (src);
+    if (NULL != dst)
+      SYNC_DB_plugin_unload (dst);
+    src = NULL;
+    dst = NULL;
+    result = 77;
+    return;
+  }
+  tmpdir = GNUNET_DISK_mkdtemp ("test-sync-dbcopy");
+  GNUNET_assert (NULL != tmpdir);
+  GNUNET_asprintf (&good_dir,
+                   "%s/good",
+                   tmpdir);
+  GNUNET_asprintf (&bad_dir,
+                   "%s/bad",
+                   tmpdir);
+  (void) src->drop_tables (src->cls);
+  FAILIF (GNUNET_OK !=
+          src->create_tables (src->cls));
+  FAILIF (GNUNET_OK !=
+          reset_dst ());
+  memset (&account_sig, 2, sizeof (account_sig));
+  memset (&token, 3, sizeof (token));
+  GNUNET_assert (GNUNET_OK ==
+                 TALER_string_to_amount ("EUR:1",
+                                         &amount));
+  /* spread the accounts over the prefix ranges of the workers */
+  for (unsigned int i = 0; i<NUM_ACCOUNTS; i++)
+  {
+    char data[16];
+    char order_id[16];
+
+    memset (&accounts[i],
+            (int) (i * 32 + 1),
+            sizeof (accounts[i]));
+    GNUNET_snprintf (data,
+                     sizeof (data),
+                     "backup-%u",
+                     i);
+    /* order IDs are unique unless the tables are partitioned */
+    GNUNET_snprintf (order_id,
+                     sizeof (order_id),
+                     "paid-order-%u",
+                     i);
+    GNUNET_CRYPTO_hash (data,
+                        strlen (data),
+                        &h);
+    FAILIF (SYNC_DB_ONE_RESULT !=
+            src->store_payment_TR (src->cls,
+                                   &accounts[i],
+                                   order_id,
+                                   &token,
+                                   &amount));
+    FAILIF (SYNC_DB_ONE_RESULT !=
+            src->increment_lifetime_TR (src->cls,
+                                        &accounts[i],
+                                        order_id,
+                                        GNUNET_TIME_UNIT_YEARS));
+    FAILIF (SYNC_DB_ONE_RESULT !=
+            src->store_backup_TR (src->cls,
+                                  &accounts[i],
+                                  &account_sig,
+                                  &h,
+                                  strlen (data),
+                                  data));
+  }
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          src->store_payment_TR (src->cls,
+                                 &accounts[0],
+                                 "pending-order",
+                                 NULL,
+                                 &amount));
+  /* sync-httpd never creates payments without an account, but
+     old databases may have them and dumps must not lose them */
+  FAILIF (0 != run_sql (EXPORT_CONFIG,
+                        "INSERT INTO payments"
+                        " (account_pub,order_id,timestamp,amount)"
+                        " VALUES"
+                        " (NULL,'orphan-order',0,'(1,0)'::taler_amount);"));
+
+  /* round trip with a different number of workers on each side */
+  FAILIF (0 != run_tool ("sync-dbexport",
+                         EXPORT_CONFIG,
+                         good_dir,
+                         "3"));
+  FAILIF (0 != run_tool ("sync-dbimport",
+                         IMPORT_CONFIG,
+                         good_dir,
+                         "2"));
+  for (unsigned int i = 0; i<NUM_ACCOUNTS; i++)
+  {
+    struct SYNC_AccountSignatureP sig1;
+    struct SYNC_AccountSignatureP sig2;
+    struct GNUNET_HashCode prev1;
+    struct GNUNET_HashCode prev2;
+    struct GNUNET_HashCode h1;
+    struct GNUNET_HashCode h2;
+    size_t bs1;
+    size_t bs2;
+    void *b1;
+
+    FAILIF (SYNC_DB_ONE_RESULT !=
+            src->lookup_backup_TR (src->cls,
+                                   &accounts[i],
+                                   NULL,
+                                   &sig1,
+                                   &prev1,
+                                   &h1,
+                                   &bs1,
+                                   &b1));
+    b = b1;
+    FAILIF (SYNC_DB_ONE_RESULT !=
+            dst->lookup_backup_TR (dst->cls,
+                                   &accounts[i],
+                                   NULL,
+                                   &sig2,
+                                   &prev2,
+                                   &h2,
+                                   &bs2,
+                                   &b1));
+    FAILIF ( (0 != GNUNET_memcmp (&sig1,
+                                  &sig2)) ||
+             (0 != GNUNET_memcmp (&prev1,
+                                  &prev2)) ||
+             (0 != GNUNET_memcmp (&h1,
+                                  &h2)) ||
+             (bs1 != bs2) ||
+             (0 != memcmp (b,
+                           b1,
+                           bs1)) );
+    GNUNET_free (b1);
+    GNUNET_free (b);
+    b = NULL;
+  }
+  found = 0;
+  FAILIF (0 >
+          dst->lookup_pending_payments_by_account_TR (dst->cls,
+                                                      &accounts[0],
+                                                      &payment_it,
+                                                      &found));
+  FAILIF (1 != found);
+  FAILIF (1 != run_sql (IMPORT_CONFIG,
+                        "SELECT order_id FROM payments"
+                        " WHERE account_pub IS NULL"
+                        "   AND order_id='orphan-order';"));
+
+  /* a dump with a corrupted checksum is rejected */
+  fn = SYNC_DBCOPY_filename (good_dir,
+                             SYNC_DBCOPY_PART_ACCOUNTS,
+                             0);
+  if (GNUNET_OK !=
+      corrupt_file (fn))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "corrupt",
+                              fn);
+    GNUNET_free (fn);
+    GNUNET_break (0);
+    goto drop;
+  }
+  GNUNET_free (fn);
+  FAILIF (GNUNET_OK !=
+          reset_dst ());
+  FAILIF (0 == run_tool ("sync-dbimport",
+                         IMPORT_CONFIG,
+                         good_dir,
+                         "2"));
+
+  /* a dump with data that does not match its backup hash is rejected */
+  memset (&bad_account, 42, sizeof (bad_account));
+  GNUNET_CRYPTO_hash ("expected",
+                      strlen ("expected"),
+                      &h);
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          src->store_payment_TR (src->cls,
+                                 &bad_account,
+                                 "paid-order",
+                                 &token,
+                                 &amount));
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          src->increment_lifetime_TR (src->cls,
+                                      &bad_account,
+                                      "paid-order",
+                                      GNUNET_TIME_UNIT_YEARS));
+  FAILIF (SYNC_DB_ONE_RESULT !=
+          src->store_backup_TR (src->cls,
+                                &bad_account,
+                                &account_sig,
+                                &h,
+                                strlen ("tampered"),
+                                "tampered"));
+  FAILIF (0 != run_tool ("sync-dbexport",
+                         EXPORT_CONFIG,
+                         bad_dir,
+                         "1"));
+  FAILIF (GNUNET_OK !=
+          reset_dst ());
+  FAILIF (0 == run_tool ("sync-dbimport",
+                         IMPORT_CONFIG,
+                         bad_dir,
+                         "1"));
+  {
+    struct SYNC_AccountSignatureP sig;
+    struct GNUNET_HashCode prev;
+    struct GNUNET_HashCode h1;
+    size_t bs;
+
+    FAILIF (SYNC_DB_NO_RESULTS !=
+            dst->lookup_backup_TR (dst->cls,
+                                   &bad_account,
+                                   NULL,
+                                   &sig,
+                                   &prev,
+                                   &h1,
+                                   &bs,
+                                   &b));
+  }
+
+  result = 0;
+drop:
+  GNUNET_free (b);
+  GNUNET_break (GNUNET_OK ==
+                src->drop_tables (src->cls));
+  GNUNET_break (GNUNET_OK ==
+                dst->drop_tables (dst->cls));
+  SYNC_DB_plugin_unload (src);
+  SYNC_DB_plugin_unload (dst);
+  src = NULL;
+  dst = NULL;
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_directory_remove (tmpdir));
+  GNUNET_free (tmpdir);
+  GNUNET_free (good_dir);
+  GNUNET_free (bad_dir);
+}
+
+
+int
+main (int argc,
+      char *const argv[])
+{
+  (void) argc;
+  result = EXIT_FAILURE;
+  GNUNET_log_setup (argv[0],
+                    "WARNING",
+                    NULL);
+  (void) TALER_project_data_default ();
+  GNUNET_OS_init (SYNC_project_data_default ());
+  GNUNET_SCHEDULER_run (&run,
+                        NULL);
+  return result;
+}
+
+
+/* end of test_sync_dbcopy.c */
@@ -0,0 +1,165 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Lesser General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/test_syncblob_s3.c
+ * @brief test the S3 blob store against a local object store,
+ *        such as MinIO; skipped if none is running
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <curl/curl.h>
+#include "sync_database_lib.h"
+#include "sync_util.h"
+
+
+#define FAILIF(cond)                            \
+  do {                                          \
+    if (! (cond)) { break;}                       \
+    GNUNET_break (0);                           \
+    goto end;                                   \
+  } while (0)
+
+
+/**
+ * Check if we can connect to the object store at @a endpoint.
+ *
+ * @param endpoint URL of the object store
+ * @return true if the object store accepts connections
+ */
+static bool
+have_object_store (const char *endpoint)
+{
+  CURL *eh;
+  CURLcode ec;
+
+  eh = curl_easy_init ();
+  if (NULL == eh)
+    return false;
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_URL,
+                                   endpoint));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_CONNECT_ONLY,
+                                   1L));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_CONNECTTIMEOUT_MS,
+                                   1000L));
+  ec = curl_easy_perform (eh);
+  curl_easy_cleanup (eh);
+  return (CURLE_OK == ec);
+}
+
+
+int
+main (int argc,
+      char *const argv[])
+{
+  struct GNUNET_CONFIGURATION_Handle *cfg;
+  struct SYNC_BlobStorePlugin *bs = NULL;
+  struct GNUNET_HashCode h;
+  char *endpoint;
+  char data[1024];
+  void *blob = NULL;
+  size_t blob_size;
+  int ret = 1;
+
+  (void) argc;
+  GNUNET_log_setup (argv[0],
+                    "WARNING",
+                    NULL);
+  (void) TALER_project_data_default ();
+  GNUNET_OS_init (SYNC_project_data_default ());
+  cfg = GNUNET_CONFIGURATION_create ();
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_parse (cfg,
+                                  "test_syncblob_s3.conf"))
+  {
+    GNUNET_break (0);
+    GNUNET_CONFIGURATION_destroy (cfg);
+    return 77;
+  }
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_get_value_string (cfg,
+                                                        "syncdb-blobstore-s3",
+                                                        "ENDPOINT",
+                                                        &endpoint));
+  if (! have_object_store (endpoint))
+  {
+    fprintf (stderr,
+             "No object store running at %s, skipping test\n",
+             endpoint);
+    GNUNET_free (endpoint);
+    GNUNET_CONFIGURATION_destroy (cfg);
+    return 77;
+  }
+  GNUNET_free (endpoint);
+  bs = SYNC_BLOBSTORE_plugin_load (cfg,
+                                   "s3");
+  FAILIF (NULL == bs);
+  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                              data,
+                              sizeof (data));
+  GNUNET_CRYPTO_hash (data,
+                      sizeof (data),
+                      &h);
+  FAILIF (GNUNET_NO !=
+          bs->get_blob (bs->cls,
+                        &h,
+                        &blob_size,
+                        &blob));
+  FAILIF (GNUNET_OK !=
+          bs->put_blob (bs->cls,
+                        &h,
+                        sizeof (data),
+                        data));
+  /* storing the same blob again is fine */
+  FAILIF (GNUNET_OK !=
+          bs->put_blob (bs->cls,
+                        &h,
+                        sizeof (data),
+                        data));
+  FAILIF (GNUNET_OK !=
+          bs->get_blob (bs->cls,
+                        &h,
+                        &blob_size,
+                        &blob));
+  FAILIF (sizeof (data) != blob_size);
+  FAILIF (0 != memcmp (blob,
+                       data,
+                       sizeof (data)));
+  GNUNET_free (blob);
+  FAILIF (GNUNET_SYSERR ==
+          bs->delete_blob (bs->cls,
+                           &h));
+  FAILIF (GNUNET_NO !=
+          bs->get_blob (bs->cls,
+                        &h,
+                        &blob_size,
+                        &blob));
+  ret = 0;
+end:
+  GNUNET_free (blob);
+  SYNC_BLOBSTORE_plugin_unload (bs);
+  GNUNET_CONFIGURATION_destroy (cfg);
+  return ret;
+}
+
+
+/* end of test_syncblob_s3.c */
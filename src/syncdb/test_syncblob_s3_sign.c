@@ -0,0 +1,76 @@
+/*
+  This file is part of TALER
+  Copyright (C) 2024 Taler Systems SA
+
+  TALER is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Lesser General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  TALER is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with
+  TALER; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file syncdb/test_syncblob_s3_sign.c
+ * @brief test AWS signature version 4 against the examples from
+ *        the Amazon S3 API reference
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include "syncblob_s3_sign.h"
+
+
+/**
+ * Secret key used in the examples of the S3 API reference.
+ */
+#define EXAMPLE_SECRET_KEY "wJalrXUtnFEMI/K7MDENG/bPxRfiCYEXAMPLEKEY"
+
+
+int
+main (int argc,
+      char *const argv[])
+{
+  char payload_hash[SYNC_S3_HEX_SIZE];
+  char signature[SYNC_S3_HEX_SIZE];
+
+  (void) argc;
+  GNUNET_log_setup (argv[0],
+                    "WARNING",
+                    NULL);
+  SYNC_S3_sha256_hex ("",
+                      0,
+                      payload_hash);
+  if (0 != strcmp (payload_hash,
+                   "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"))
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  /* "GET Bucket Lifecycle" example of the S3 API reference,
+     which signs exactly the headers we sign */
+  SYNC_S3_sign ("GET",
+                "/",
+                "lifecycle=",
+                "examplebucket.s3.amazonaws.com",
+                payload_hash,
+                "20130524T000000Z",
+                "us-east-1",
+                EXAMPLE_SECRET_KEY,
+                signature);
+  if (0 != strcmp (signature,
+                   "fea454ca298b7da1c68078a5d1bdbfbbe0d65c699e0f91ac7a200a0136783543"))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Wrong signature %s\n",
+                signature);
+    return 1;
+  }
+  return 0;
+}
+
+
+/* end of test_syncblob_s3_sign.c */
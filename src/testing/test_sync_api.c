@@ -92,6 +92,11 @@ static const char *merchant_url = "http://localhost:8080/";
  */
 static const char *sync_url = "http://localhost:8084/";
 
+/**
+ * Directory of the download cache.
+ */
+static char *cache_dir;
+
 
 /**
  * Execute the taler-exchange-wirewatch command with
@@ -231,6 +236,83 @@ run (void *cls,
                                       sync_url,
                                       MHD_HTTP_OK,
                                       "backup-upload-3"),
+    /* Partial downloads of "Test-3" */
+    SYNC_TESTING_cmd_backup_get ("get-range-3",
+                                 sync_url,
+                                 "backup-upload-3",
+                                 "bytes=1-3",
+                                 NULL,
+                                 NULL,
+                                 MHD_HTTP_PARTIAL_CONTENT,
+                                 "est",
+                                 strlen ("est")),
+    SYNC_TESTING_cmd_backup_get ("get-range-open-3",
+                                 sync_url,
+                                 "backup-upload-3",
+                                 "bytes=2-",
+                                 NULL,
+                                 NULL,
+                                 MHD_HTTP_PARTIAL_CONTENT,
+                                 "st-3",
+                                 strlen ("st-3")),
+    SYNC_TESTING_cmd_backup_get ("get-range-unsatisfiable-3",
+                                 sync_url,
+                                 "backup-upload-3",
+                                 "bytes=6-",
+                                 NULL,
+                                 NULL,
+                                 MHD_HTTP_RANGE_NOT_SATISFIABLE,
+                                 NULL,
+                                 0),
+    SYNC_TESTING_cmd_backup_get ("get-if-range-3",
+                                 sync_url,
+                                 "backup-upload-3",
+                                 "bytes=1-3",
+                                 "backup-upload-3",
+                                 NULL,
+                                 MHD_HTTP_PARTIAL_CONTENT,
+                                 "est",
+                                 strlen ("est")),
+    /* backup changed since upload 2, so we get all of it */
+    SYNC_TESTING_cmd_backup_get ("get-if-range-stale-3",
+                                 sync_url,
+                                 "backup-upload-3",
+                                 "bytes=1-3",
+                                 "backup-upload-2",
+                                 NULL,
+                                 MHD_HTTP_OK,
+                                 "Test-3",
+                                 strlen ("Test-3")),
+    SYNC_TESTING_cmd_backup_get ("get-not-modified-3",
+                                 sync_url,
+                                 "backup-upload-3",
+                                 NULL,
+                                 NULL,
+                                 "backup-upload-3",
+                                 MHD_HTTP_NOT_MODIFIED,
+                                 NULL,
+                                 0),
+    SYNC_TESTING_cmd_backup_get ("get-modified-3",
+                                 sync_url,
+                                 "backup-upload-3",
+                                 NULL,
+                                 NULL,
+                                 "backup-upload-2",
+                                 MHD_HTTP_OK,
+                                 "Test-3",
+                                 strlen ("Test-3")),
+    /* First cached download fills the cache, the second one
+       is answered with 304 and served from the cache */
+    SYNC_TESTING_cmd_backup_download_cached ("download-cached-3",
+                                             sync_url,
+                                             cache_dir,
+                                             MHD_HTTP_OK,
+                                             "backup-upload-3"),
+    SYNC_TESTING_cmd_backup_download_cached ("download-cached-3b",
+                                             sync_url,
+                                             cache_dir,
+                                             MHD_HTTP_OK,
+                                             "backup-upload-3"),
     /* now updated upload should fail (conflict) */
     SYNC_TESTING_cmd_backup_upload ("backup-upload-3b",
                                     sync_url,
@@ -254,6 +336,56 @@ run (void *cls,
                                       sync_url,
                                       MHD_HTTP_OK,
                                       "backup-upload-3"),
+    /* Same backup, streamed to the application and to a file */
+    SYNC_TESTING_cmd_backup_download_stream ("download-stream-3",
+                                             sync_url,
+                                             false,
+                                             MHD_HTTP_OK,
+                                             "backup-upload-3"),
+    SYNC_TESTING_cmd_backup_download_stream ("download-stream-abort-3",
+                                             sync_url,
+                                             true,
+                                             0,
+                                             "backup-upload-3"),
+    SYNC_TESTING_cmd_backup_download_fd ("download-fd-3",
+                                         sync_url,
+                                         MHD_HTTP_OK,
+                                         "backup-upload-3"),
+    /* upload from a file */
+    SYNC_TESTING_cmd_backup_upload ("backup-upload-5",
+                                    sync_url,
+                                    "backup-upload-3",
+                                    NULL,
+                                    SYNC_TESTING_UO_FROM_FILE,
+                                    MHD_HTTP_NO_CONTENT,
+                                    "Test-5",
+                                    strlen ("Test-5")),
+    SYNC_TESTING_cmd_backup_download ("download-5",
+                                      sync_url,
+                                      MHD_HTTP_OK,
+                                      "backup-upload-5"),
+    /* a conflicting upload from a file gets the current backup */
+    SYNC_TESTING_cmd_backup_upload ("backup-upload-5b",
+                                    sync_url,
+                                    "backup-upload-3",
+                                    "backup-upload-5",
+                                    SYNC_TESTING_UO_FROM_FILE,
+                                    MHD_HTTP_CONFLICT,
+                                    "Test-5b",
+                                    strlen ("Test-5b")),
+    /* upload to two providers, one of which does not exist */
+    SYNC_TESTING_cmd_backup_upload_multi ("backup-upload-multi-6",
+                                          sync_url,
+                                          "http://localhost:8084/nx/",
+                                          "backup-upload-5",
+                                          MHD_HTTP_NO_CONTENT,
+                                          MHD_HTTP_NOT_FOUND,
+                                          "Test-6",
+                                          strlen ("Test-6")),
+    SYNC_TESTING_cmd_backup_download ("download-6",
+                                      sync_url,
+                                      MHD_HTTP_OK,
+                                      "backup-upload-multi-6"),
 
     TALER_TESTING_cmd_end ()
   };
@@ -267,6 +399,8 @@ int
 main (int argc,
       char *const *argv)
 {
+  int ret;
+
   (void) argc;
   payer_payto =
     "payto://x-taler-bank/localhost/" USER_ACCOUNT_NAME "?receiver-name=user";
@@ -276,14 +410,24 @@ main (int argc,
   merchant_payto =
     "payto://x-taler-bank/localhost/" MERCHANT_ACCOUNT_NAME
     "?receiver-name=merchant";
-  return TALER_TESTING_main (argv,
-                             "DEBUG",
-                             CONFIG_FILE,
-                             "exchange-account-exchange",
-                             TALER_TESTING_BS_FAKEBANK,
-                             &cred,
-                             &run,
-                             NULL);
+  cache_dir = GNUNET_DISK_mkdtemp ("test-sync-api-cache");
+  if (NULL == cache_dir)
+  {
+    GNUNET_break (0);
+    return 77;
+  }
+  ret = TALER_TESTING_main (argv,
+                            "DEBUG",
+                            CONFIG_FILE,
+                            "exchange-account-exchange",
+                            TALER_TESTING_BS_FAKEBANK,
+                            &cred,
+                            &run,
+                            NULL);
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_directory_remove (cache_dir));
+  GNUNET_free (cache_dir);
+  return ret;
 }
 
 
@@ -27,6 +27,35 @@
 #include <taler/taler_util.h>
 #include <taler/taler_testing_lib.h>
 
+
+/**
+ * How a "backup download" CMD downloads the backup.
+ */
+enum DownloadMode
+{
+  /**
+   * Download into memory with #SYNC_download().
+   */
+  DM_BUFFER = 0,
+
+  /**
+   * Stream the backup with #SYNC_download_stream().
+   */
+  DM_STREAM,
+
+  /**
+   * Stream the backup with #SYNC_download_stream(), but abort
+   * the download from the chunk callback.
+   */
+  DM_STREAM_ABORT,
+
+  /**
+   * Download into a file with #SYNC_download_fd().
+   */
+  DM_FD
+};
+
+
 /**
  * State for a "backup download" CMD.
  */
@@ -68,6 +97,31 @@ struct BackupDownloadState
    */
   const char *upload_reference;
 
+  /**
+   * Download cache to use, NULL for none.
+   */
+  const char *cache_dir;
+
+  /**
+   * Hash over the chunks we got in #DM_STREAM mode.
+   */
+  struct GNUNET_HashContext *hc;
+
+  /**
+   * File we download to in #DM_FD mode, NULL otherwise.
+   */
+  char *fn;
+
+  /**
+   * Open descriptor of @e fn.
+   */
+  int fd;
+
+  /**
+   * How we download the backup.
+   */
+  enum DownloadMode mode;
+
   /**
    * Expected status code.
    */
@@ -76,6 +130,75 @@ struct BackupDownloadState
 };
 
 
+/**
+ * Compute the hash of the backup the application got in
+ * #DM_STREAM or #DM_FD mode.
+ *
+ * @param bds command state
+ * @param backup_size number of bytes in the backup
+ * @param[out] h set to the hash of the backup
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+hash_streamed (struct BackupDownloadState *bds,
+               size_t backup_size,
+               struct GNUNET_HashCode *h)
+{
+  void *buf;
+
+  if (DM_STREAM == bds->mode)
+  {
+    if (NULL == bds->hc)
+      bds->hc = GNUNET_CRYPTO_hash_context_start ();
+    GNUNET_CRYPTO_hash_context_finish (bds->hc,
+                                       h);
+    bds->hc = NULL;
+    return GNUNET_OK;
+  }
+  buf = GNUNET_malloc (backup_size + 1);
+  if ((ssize_t) backup_size !=
+      pread (bds->fd,
+             buf,
+             backup_size + 1,
+             0))
+  {
+    GNUNET_free (buf);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_CRYPTO_hash (buf,
+                      backup_size,
+                      h);
+  GNUNET_free (buf);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Function called with each chunk of a streamed backup.
+ *
+ * @param cls our `struct BackupDownloadState`
+ * @param data next chunk of the backup
+ * @param data_size number of bytes in @a data
+ * @return #GNUNET_OK to continue, #GNUNET_SYSERR to abort
+ */
+static enum GNUNET_GenericReturnValue
+backup_chunk_cb (void *cls,
+                 const void *data,
+                 size_t data_size)
+{
+  struct BackupDownloadState *bds = cls;
+
+  if (DM_STREAM_ABORT == bds->mode)
+    return GNUNET_SYSERR;
+  if (NULL == bds->hc)
+    bds->hc = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (bds->hc,
+                                   data,
+                                   data_size);
+  return GNUNET_OK;
+}
+
+
 /**
  * Function called with the results of a #SYNC_download().
  *
@@ -96,6 +219,26 @@ backup_download_cb (void *cls,
                                      bds->http_status);
     return;
   }
+  if ( (MHD_HTTP_OK == dd->http_status) &&
+       ( (DM_STREAM == bds->mode) ||
+         (DM_FD == bds->mode) ) )
+  {
+    struct GNUNET_HashCode h;
+
+    /* the application got the backup, not the callback */
+    if ( (NULL != dd->details.ok.backup) ||
+         (GNUNET_OK !=
+          hash_streamed (bds,
+                         dd->details.ok.backup_size,
+                         &h)) ||
+         (0 != GNUNET_memcmp (&h,
+                              &dd->details.ok.curr_backup_hash)) )
+    {
+      GNUNET_break (0);
+      TALER_TESTING_interpreter_fail (bds->is);
+      return;
+    }
+  }
   if (NULL != bds->upload_reference)
   {
     if ( (MHD_HTTP_OK == dd->http_status) &&
@@ -177,11 +320,63 @@ backup_download_run (void *cls,
     }
     bds->sync_pub = *sync_pub;
   }
-  bds->download = SYNC_download (TALER_TESTING_interpreter_get_context (is),
-                                 bds->sync_url,
-                                 &bds->sync_pub,
-                                 &backup_download_cb,
-                                 bds);
+  switch (bds->mode)
+  {
+  case DM_BUFFER:
+    if (NULL != bds->cache_dir)
+      bds->download = SYNC_download_cached (
+        TALER_TESTING_interpreter_get_context (is),
+        bds->sync_url,
+        &bds->sync_pub,
+        bds->cache_dir,
+        &backup_download_cb,
+        bds);
+    else
+      bds->download = SYNC_download (TALER_TESTING_interpreter_get_context (
+                                       is),
+                                     bds->sync_url,
+                                     &bds->sync_pub,
+                                     &backup_download_cb,
+                                     bds);
+    break;
+  case DM_STREAM:
+  case DM_STREAM_ABORT:
+    bds->download = SYNC_download_stream (
+      TALER_TESTING_interpreter_get_context (is),
+      bds->sync_url,
+      &bds->sync_pub,
+      &backup_chunk_cb,
+      bds,
+      &backup_download_cb,
+      bds);
+    break;
+  case DM_FD:
+    bds->fn = GNUNET_DISK_mktemp ("sync-download");
+    if (NULL == bds->fn)
+    {
+      GNUNET_break (0);
+      TALER_TESTING_interpreter_fail (bds->is);
+      return;
+    }
+    bds->fd = open (bds->fn,
+                    O_RDWR | O_TRUNC);
+    if (-1 == bds->fd)
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "open",
+                                bds->fn);
+      TALER_TESTING_interpreter_fail (bds->is);
+      return;
+    }
+    bds->download = SYNC_download_fd (TALER_TESTING_interpreter_get_context (
+                                        is),
+                                      bds->sync_url,
+                                      &bds->sync_pub,
+                                      bds->fd,
+                                      &backup_download_cb,
+                                      bds);
+    break;
+  }
   if (NULL == bds->download)
   {
     GNUNET_break (0);
@@ -212,6 +407,18 @@ backup_download_cleanup (void *cls,
     SYNC_download_cancel (bds->download);
     bds->download = NULL;
   }
+  if (NULL != bds->hc)
+  {
+    GNUNET_CRYPTO_hash_context_abort (bds->hc);
+    bds->hc = NULL;
+  }
+  if (NULL != bds->fn)
+  {
+    if (-1 != bds->fd)
+      GNUNET_break (0 == close (bds->fd));
+    GNUNET_break (0 == unlink (bds->fn));
+    GNUNET_free (bds->fn);
+  }
   GNUNET_free (bds);
 }
 
@@ -252,6 +459,93 @@ SYNC_TESTING_cmd_backup_download (const char *label,
 }
 
 
+/**
+ * Make the "backup download" command using a download cache.
+ *
+ * @param label command label
+ * @param sync_url base URL of the sync serving
+ *        the policy store request.
+ * @param cache_dir directory of the download cache
+ * @param http_status expected HTTP status.
+ * @param upload_ref reference to upload command
+ * @return the command
+ */
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_download_cached (const char *label,
+                                         const char *sync_url,
+                                         const char *cache_dir,
+                                         unsigned int http_status,
+                                         const char *upload_ref)
+{
+  struct TALER_TESTING_Command cmd;
+
+  cmd = SYNC_TESTING_cmd_backup_download (label,
+                                          sync_url,
+                                          http_status,
+                                          upload_ref);
+  ((struct BackupDownloadState *) cmd.cls)->cache_dir = cache_dir;
+  return cmd;
+}
+
+
+/**
+ * Make the "backup download" command streaming the backup.
+ *
+ * @param label command label
+ * @param sync_url base URL of the sync serving
+ *        the policy store request.
+ * @param abort_download true to abort the download from the
+ *        chunk callback
+ * @param http_status expected HTTP status.
+ * @param upload_ref reference to upload command
+ * @return the command
+ */
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_download_stream (const char *label,
+                                         const char *sync_url,
+                                         bool abort_download,
+                                         unsigned int http_status,
+                                         const char *upload_ref)
+{
+  struct TALER_TESTING_Command cmd;
+
+  cmd = SYNC_TESTING_cmd_backup_download (label,
+                                          sync_url,
+                                          http_status,
+                                          upload_ref);
+  ((struct BackupDownloadState *) cmd.cls)->mode
+    = abort_download ? DM_STREAM_ABORT : DM_STREAM;
+  return cmd;
+}
+
+
+/**
+ * Make the "backup download" command writing the backup to a file.
+ *
+ * @param label command label
+ * @param sync_url base URL of the sync serving
+ *        the policy store request.
+ * @param http_status expected HTTP status.
+ * @param upload_ref reference to upload command
+ * @return the command
+ */
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_download_fd (const char *label,
+                                     const char *sync_url,
+                                     unsigned int http_status,
+                                     const char *upload_ref)
+{
+  struct TALER_TESTING_Command cmd;
+
+  cmd = SYNC_TESTING_cmd_backup_download (label,
+                                          sync_url,
+                                          http_status,
+                                          upload_ref);
+  ((struct BackupDownloadState *) cmd.cls)->mode = DM_FD;
+  return cmd;
+}
+
+
 /**
  * Make the "backup download" command for a non-existent upload.
  *
@@ -0,0 +1,345 @@
+/*
+  This file is part of SYNC
+  Copyright (C) 2024 Taler Systems SA
+
+  SYNC is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 3, or
+  (at your option) any later version.
+
+  SYNC is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with SYNC; see the file COPYING.  If not, see
+  <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file testing/testing_api_cmd_backup_get.c
+ * @brief command for conditional and range requests for a backup
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "sync_service.h"
+#include "sync_testing_lib.h"
+#include <gnunet/gnunet_curl_lib.h>
+#include <taler/taler_util.h>
+#include <taler/taler_testing_lib.h>
+
+
+/**
+ * State for a "backup get" CMD.
+ */
+struct BackupGetState
+{
+
+  /**
+   * The GET operation handle.
+   */
+  struct GNUNET_CURL_Job *job;
+
+  /**
+   * URL of the sync backend.
+   */
+  const char *sync_url;
+
+  /**
+   * The interpreter state.
+   */
+  struct TALER_TESTING_Interpreter *is;
+
+  /**
+   * Reference to the upload command of the account.
+   */
+  const char *upload_reference;
+
+  /**
+   * Value for the "Range" header, NULL for none.
+   */
+  const char *range;
+
+  /**
+   * Reference to the upload command whose hash we send in the
+   * "If-Range" header, NULL for none.
+   */
+  const char *if_range_reference;
+
+  /**
+   * Reference to the upload command whose hash we send in the
+   * "If-None-Match" header, NULL for none.
+   */
+  const char *if_none_match_reference;
+
+  /**
+   * Expected body, NULL to not check the body.
+   */
+  const void *body;
+
+  /**
+   * Number of bytes in @e body.
+   */
+  size_t body_size;
+
+  /**
+   * Expected status code.
+   */
+  unsigned int http_status;
+
+};
+
+
+/**
+ * Function called when we got the reply.
+ *
+ * @param cls our `struct BackupGetState`
+ * @param response_code HTTP status of the reply, 0 on error
+ * @param body body of the reply
+ * @param body_size number of bytes in @a body
+ */
+static void
+backup_get_cb (void *cls,
+               long response_code,
+               const void *body,
+               size_t body_size)
+{
+  struct BackupGetState *bgs = cls;
+
+  bgs->job = NULL;
+  if (bgs->http_status != (unsigned int) response_code)
+  {
+    TALER_TESTING_unexpected_status (bgs->is,
+                                     (unsigned int) response_code,
+                                     bgs->http_status);
+    return;
+  }
+  if ( (NULL != bgs->body) &&
+       ( (bgs->body_size != body_size) ||
+         (0 != memcmp (bgs->body,
+                       body,
+                       body_size)) ) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Unexpected body `%.*s'\n",
+                (int) body_size,
+                (const char *) body);
+    GNUNET_break (0);
+    TALER_TESTING_interpreter_fail (bgs->is);
+    return;
+  }
+  TALER_TESTING_interpreter_next (bgs->is);
+}
+
+
+/**
+ * Add header @a name with the quoted hash of the upload of
+ * command @a ref to @a headers.
+ *
+ * @param is interpreter state
+ * @param name name of the header
+ * @param ref label of the upload command
+ * @param[in,out] headers headers to extend
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+add_etag_header (struct TALER_TESTING_Interpreter *is,
+                 const char *name,
+                 const char *ref,
+                 struct curl_slist **headers)
+{
+  const struct TALER_TESTING_Command *cmd;
+  const struct GNUNET_HashCode *h;
+  struct curl_slist *ext;
+  char *val;
+  char *hdr;
+
+  cmd = TALER_TESTING_interpreter_lookup_command (is,
+                                                  ref);
+  if ( (NULL == cmd) ||
+       (GNUNET_OK !=
+        SYNC_TESTING_get_trait_hash (cmd,
+                                     SYNC_TESTING_TRAIT_HASH_CURRENT,
+                                     &h)) )
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  val = GNUNET_STRINGS_data_to_string_alloc (h,
+                                             sizeof (*h));
+  GNUNET_asprintf (&hdr,
+                   "%s: \"%s\"",
+                   name,
+                   val);
+  GNUNET_free (val);
+  ext = curl_slist_append (*headers,
+                           hdr);
+  GNUNET_free (hdr);
+  if (NULL == ext)
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  *headers = ext;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Run a "backup get" CMD.
+ *
+ * @param cls closure.
+ * @param cmd command currently being run.
+ * @param is interpreter state.
+ */
+static void
+backup_get_run (void *cls,
+                const struct TALER_TESTING_Command *cmd,
+                struct TALER_TESTING_Interpreter *is)
+{
+  struct BackupGetState *bgs = cls;
+  const struct TALER_TESTING_Command *upload_cmd;
+  const struct SYNC_AccountPublicKeyP *sync_pub;
+  struct curl_slist *headers = NULL;
+  char *pub_str;
+  char *url;
+  CURL *eh;
+
+  bgs->is = is;
+  upload_cmd = TALER_TESTING_interpreter_lookup_command (is,
+                                                         bgs->upload_reference);
+  if ( (NULL == upload_cmd) ||
+       (GNUNET_OK !=
+        SYNC_TESTING_get_trait_account_pub (upload_cmd,
+                                            0,
+                                            &sync_pub)) )
+  {
+    GNUNET_break (0);
+    TALER_TESTING_interpreter_fail (bgs->is);
+    return;
+  }
+  if (NULL != bgs->range)
+  {
+    char *hdr;
+
+    GNUNET_asprintf (&hdr,
+                     "%s: %s",
+                     MHD_HTTP_HEADER_RANGE,
+                     bgs->range);
+    headers = curl_slist_append (headers,
+                                 hdr);
+    GNUNET_free (hdr);
+    GNUNET_assert (NULL != headers);
+  }
+  if ( ( (NULL != bgs->if_range_reference) &&
+         (GNUNET_OK !=
+          add_etag_header (is,
+                           MHD_HTTP_HEADER_IF_RANGE,
+                           bgs->if_range_reference,
+                           &headers)) ) ||
+       ( (NULL != bgs->if_none_match_reference) &&
+         (GNUNET_OK !=
+          add_etag_header (is,
+                           MHD_HTTP_HEADER_IF_NONE_MATCH,
+                           bgs->if_none_match_reference,
+                           &headers)) ) )
+  {
+    curl_slist_free_all (headers);
+    TALER_TESTING_interpreter_fail (bgs->is);
+    return;
+  }
+  pub_str = GNUNET_STRINGS_data_to_string_alloc (sync_pub,
+                                                 sizeof (*sync_pub));
+  GNUNET_asprintf (&url,
+                   "%s%sbackups/%s",
+                   bgs->sync_url,
+                   '/' == bgs->sync_url[strlen (bgs->sync_url) - 1]
+                   ? ""
+                   : "/",
+                   pub_str);
+  GNUNET_free (pub_str);
+  eh = curl_easy_init ();
+  GNUNET_assert (NULL != eh);
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_URL,
+                                   url));
+  GNUNET_free (url);
+  bgs->job = GNUNET_CURL_job_add_raw (TALER_TESTING_interpreter_get_context (
+                                        is),
+                                      eh,
+                                      headers,
+                                      &backup_get_cb,
+                                      bgs);
+  curl_slist_free_all (headers);
+  if (NULL == bgs->job)
+  {
+    GNUNET_break (0);
+    TALER_TESTING_interpreter_fail (bgs->is);
+    return;
+  }
+}
+
+
+/**
+ * Free the state of a "backup get" CMD, and possibly
+ * cancel it if it did not complete.
+ *
+ * @param cls closure.
+ * @param cmd command being freed.
+ */
+static void
+backup_get_cleanup (void *cls,
+                    const struct TALER_TESTING_Command *cmd)
+{
+  struct BackupGetState *bgs = cls;
+
+  if (NULL != bgs->job)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Command '%s' did not complete (backup get)\n",
+                cmd->label);
+    GNUNET_CURL_job_cancel (bgs->job);
+    bgs->job = NULL;
+  }
+  GNUNET_free (bgs);
+}
+
+
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_get (const char *label,
+                             const char *sync_url,
+                             const char *upload_ref,
+                             const char *range,
+                             const char *if_range_ref,
+                             const char *if_none_match_ref,
+                             unsigned int http_status,
+                             const void *body,
+                             size_t body_size)
+{
+  struct BackupGetState *bgs;
+
+  GNUNET_assert (NULL != upload_ref);
+  bgs = GNUNET_new (struct BackupGetState);
+  bgs->sync_url = sync_url;
+  bgs->upload_reference = upload_ref;
+  bgs->range = range;
+  bgs->if_range_reference = if_range_ref;
+  bgs->if_none_match_reference = if_none_match_ref;
+  bgs->http_status = http_status;
+  bgs->body = body;
+  bgs->body_size = body_size;
+  {
+    struct TALER_TESTING_Command cmd = {
+      .cls = bgs,
+      .label = label,
+      .run = &backup_get_run,
+      .cleanup = &backup_get_cleanup
+    };
+
+    return cmd;
+  }
+}
+
+
+/* end of testing_api_cmd_backup_get.c */
@@ -119,6 +119,17 @@ struct BackupUploadState
    */
   enum SYNC_TESTING_UploadOption uopt;
 
+  /**
+   * File with the backup if #SYNC_TESTING_UO_FROM_FILE is set,
+   * otherwise NULL.
+   */
+  char *fn;
+
+  /**
+   * Open descriptor of @e fn.
+   */
+  int fd;
+
 };
 
 
@@ -229,6 +240,7 @@ backup_upload_run (void *cls,
                    struct TALER_TESTING_Interpreter *is)
 {
   struct BackupUploadState *bus = cls;
+  const struct GNUNET_HashCode *prev_hash = NULL;
 
   bus->is = is;
   if (NULL != bus->prev_upload)
@@ -317,24 +329,57 @@ backup_upload_run (void *cls,
   GNUNET_CRYPTO_hash (bus->backup,
                       bus->backup_size,
                       &bus->curr_hash);
-  bus->uo = SYNC_upload (TALER_TESTING_interpreter_get_context (is),
-                         bus->sync_url,
-                         &bus->sync_priv,
-                         ( ( (NULL != bus->prev_upload) &&
-                             (GNUNET_NO == GNUNET_is_zero (
-                                &bus->prev_hash)) ) ||
-                           (0 != (SYNC_TESTING_UO_PREV_HASH_WRONG
-                                  & bus->uopt)) )
-                         ? &bus->prev_hash
-                         : NULL,
-                         bus->backup_size,
-                         bus->backup,
-                         (0 != (SYNC_TESTING_UO_REQUEST_PAYMENT & bus->uopt))
-                         ? SYNC_PO_FORCE_PAYMENT
-                         : SYNC_PO_NONE,
-                         bus->payment_order_req,
-                         &backup_upload_cb,
-                         bus);
+  if ( ( (NULL != bus->prev_upload) &&
+         (GNUNET_NO == GNUNET_is_zero (&bus->prev_hash)) ) ||
+       (0 != (SYNC_TESTING_UO_PREV_HASH_WRONG & bus->uopt)) )
+    prev_hash = &bus->prev_hash;
+  if (0 != (SYNC_TESTING_UO_FROM_FILE & bus->uopt))
+  {
+    bus->fn = GNUNET_DISK_mktemp ("sync-upload");
+    if ( (NULL == bus->fn) ||
+         (GNUNET_OK !=
+          GNUNET_DISK_fn_write (bus->fn,
+                                bus->backup,
+                                bus->backup_size,
+                                GNUNET_DISK_PERM_USER_READ
+                                | GNUNET_DISK_PERM_USER_WRITE)) ||
+         (-1 == (bus->fd = open (bus->fn,
+                                 O_RDONLY))) )
+    {
+      GNUNET_break (0);
+      TALER_TESTING_interpreter_fail (bus->is);
+      return;
+    }
+    /* let the library hash the file */
+    bus->uo = SYNC_upload_fd (TALER_TESTING_interpreter_get_context (is),
+                              bus->sync_url,
+                              &bus->sync_priv,
+                              prev_hash,
+                              bus->fd,
+                              NULL,
+                              (0 != (SYNC_TESTING_UO_REQUEST_PAYMENT
+                                     & bus->uopt))
+                              ? SYNC_PO_FORCE_PAYMENT
+                              : SYNC_PO_NONE,
+                              bus->payment_order_req,
+                              &backup_upload_cb,
+                              bus);
+  }
+  else
+  {
+    bus->uo = SYNC_upload (TALER_TESTING_interpreter_get_context (is),
+                           bus->sync_url,
+                           &bus->sync_priv,
+                           prev_hash,
+                           bus->backup_size,
+                           bus->backup,
+                           (0 != (SYNC_TESTING_UO_REQUEST_PAYMENT & bus->uopt))
+                           ? SYNC_PO_FORCE_PAYMENT
+                           : SYNC_PO_NONE,
+                           bus->payment_order_req,
+                           &backup_upload_cb,
+                           bus);
+  }
   if (NULL == bus->uo)
   {
     GNUNET_break (0);
@@ -365,6 +410,13 @@ backup_upload_cleanup (void *cls,
     SYNC_upload_cancel (bus->uo);
     bus->uo = NULL;
   }
+  if (NULL != bus->fn)
+  {
+    if (-1 != bus->fd)
+      GNUNET_break (0 == close (bus->fd));
+    GNUNET_break (0 == unlink (bus->fn));
+    GNUNET_free (bus->fn);
+  }
   GNUNET_free (bus);
 }
 
@@ -454,6 +506,7 @@ SYNC_TESTING_cmd_backup_upload (const char *label,
   bus->sync_url = sync_url;
   bus->backup = backup_data;
   bus->backup_size = backup_data_size;
+  bus->fd = -1;
   {
     struct TALER_TESTING_Command cmd = {
       .cls = bus,
@@ -0,0 +1,324 @@
+/*
+  This file is part of SYNC
+  Copyright (C) 2024 Taler Systems SA
+
+  SYNC is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 3, or
+  (at your option) any later version.
+
+  SYNC is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with SYNC; see the file COPYING.  If not, see
+  <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file testing/testing_api_cmd_backup_upload_multi.c
+ * @brief command to upload a backup to two providers at once
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "sync_service.h"
+#include "sync_testing_lib.h"
+#include <taler/taler_util.h>
+#include <taler/taler_testing_lib.h>
+
+
+/**
+ * State for a "backup upload multi" CMD.
+ */
+struct BackupUploadMultiState
+{
+
+  /**
+   * Eddsa private key.
+   */
+  struct SYNC_AccountPrivateKeyP sync_priv;
+
+  /**
+   * Eddsa public key.
+   */
+  struct SYNC_AccountPublicKeyP sync_pub;
+
+  /**
+   * Hash of the previous upload.
+   */
+  struct GNUNET_HashCode prev_hash;
+
+  /**
+   * Hash of the current upload.
+   */
+  struct GNUNET_HashCode curr_hash;
+
+  /**
+   * The upload operation handle.
+   */
+  struct SYNC_UploadMultiOperation *umo;
+
+  /**
+   * URL of the sync backend.
+   */
+  const char *sync_url;
+
+  /**
+   * URL of the second provider.
+   */
+  const char *other_url;
+
+  /**
+   * Previous upload of the account.
+   */
+  const char *prev_upload;
+
+  /**
+   * The interpreter state.
+   */
+  struct TALER_TESTING_Interpreter *is;
+
+  /**
+   * The backup data we are uploading.
+   */
+  const void *backup;
+
+  /**
+   * Number of bytes in @e backup.
+   */
+  size_t backup_size;
+
+  /**
+   * Expected status code from @e sync_url.
+   */
+  unsigned int http_status;
+
+  /**
+   * Expected status code from @e other_url.
+   */
+  unsigned int other_http_status;
+
+};
+
+
+/**
+ * Function called with the results of a #SYNC_upload_multi().
+ *
+ * @param cls closure
+ * @param num_results length of the @a results array
+ * @param results results per provider
+ */
+static void
+backup_upload_multi_cb (void *cls,
+                        unsigned int num_results,
+                        const struct SYNC_UploadMultiResult *results)
+{
+  struct BackupUploadMultiState *bums = cls;
+  unsigned int expected[] = {
+    bums->http_status,
+    bums->other_http_status
+  };
+
+  /* cancelling from the callback must be harmless */
+  SYNC_upload_multi_cancel (bums->umo);
+  bums->umo = NULL;
+  GNUNET_assert (2 == num_results);
+  for (unsigned int i = 0; i<num_results; i++)
+  {
+    if (results[i].ud.http_status != expected[i])
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Upload to `%s' failed\n",
+                  results[i].base_url);
+      TALER_TESTING_unexpected_status (bums->is,
+                                       results[i].ud.http_status,
+                                       expected[i]);
+      return;
+    }
+  }
+  if ( (MHD_HTTP_NO_CONTENT == results[0].ud.http_status) &&
+       (0 != GNUNET_memcmp (&bums->curr_hash,
+                            results[0].ud.details.success.curr_backup_hash)) )
+  {
+    GNUNET_break (0);
+    TALER_TESTING_interpreter_fail (bums->is);
+    return;
+  }
+  TALER_TESTING_interpreter_next (bums->is);
+}
+
+
+/**
+ * Run a "backup upload multi" CMD.
+ *
+ * @param cls closure.
+ * @param cmd command currently being run.
+ * @param is interpreter state.
+ */
+static void
+backup_upload_multi_run (void *cls,
+                         const struct TALER_TESTING_Command *cmd,
+                         struct TALER_TESTING_Interpreter *is)
+{
+  struct BackupUploadMultiState *bums = cls;
+  const struct TALER_TESTING_Command *ref;
+  const struct GNUNET_HashCode *h;
+  const struct SYNC_AccountPrivateKeyP *priv;
+  const struct SYNC_AccountPublicKeyP *pub;
+
+  bums->is = is;
+  ref = TALER_TESTING_interpreter_lookup_command (is,
+                                                  bums->prev_upload);
+  if ( (NULL == ref) ||
+       (GNUNET_OK !=
+        SYNC_TESTING_get_trait_hash (ref,
+                                     SYNC_TESTING_TRAIT_HASH_CURRENT,
+                                     &h)) ||
+       (GNUNET_OK !=
+        SYNC_TESTING_get_trait_account_priv (ref,
+                                             0,
+                                             &priv)) ||
+       (GNUNET_OK !=
+        SYNC_TESTING_get_trait_account_pub (ref,
+                                            0,
+                                            &pub)) )
+  {
+    GNUNET_break (0);
+    TALER_TESTING_interpreter_fail (bums->is);
+    return;
+  }
+  bums->prev_hash = *h;
+  bums->sync_priv = *priv;
+  bums->sync_pub = *pub;
+  GNUNET_CRYPTO_hash (bums->backup,
+                      bums->backup_size,
+                      &bums->curr_hash);
+  {
+    struct SYNC_UploadTarget targets[] = {
+      {
+        .base_url = bums->sync_url,
+        .prev_backup_hash = &bums->prev_hash,
+        .po = SYNC_PO_NONE
+      },
+      {
+        .base_url = bums->other_url,
+        .prev_backup_hash = &bums->prev_hash,
+        .po = SYNC_PO_NONE
+      }
+    };
+
+    bums->umo = SYNC_upload_multi (TALER_TESTING_interpreter_get_context (is),
+                                   &bums->sync_priv,
+                                   2,
+                                   targets,
+                                   bums->backup_size,
+                                   bums->backup,
+                                   &backup_upload_multi_cb,
+                                   bums);
+  }
+  if (NULL == bums->umo)
+  {
+    GNUNET_break (0);
+    TALER_TESTING_interpreter_fail (bums->is);
+    return;
+  }
+}
+
+
+/**
+ * Free the state of a "backup upload multi" CMD, and possibly
+ * cancel it if it did not complete.
+ *
+ * @param cls closure.
+ * @param cmd command being freed.
+ */
+static void
+backup_upload_multi_cleanup (void *cls,
+                             const struct TALER_TESTING_Command *cmd)
+{
+  struct BackupUploadMultiState *bums = cls;
+
+  if (NULL != bums->umo)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Command '%s' did not complete (backup upload multi)\n",
+                cmd->label);
+    SYNC_upload_multi_cancel (bums->umo);
+    bums->umo = NULL;
+  }
+  GNUNET_free (bums);
+}
+
+
+/**
+ * Offer internal data to other commands.
+ *
+ * @param cls closure
+ * @param ret[out] result (could be anything)
+ * @param trait name of the trait
+ * @param index index number of the object to extract.
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+backup_upload_multi_traits (void *cls,
+                            const void **ret,
+                            const char *trait,
+                            unsigned int index)
+{
+  struct BackupUploadMultiState *bums = cls;
+  struct TALER_TESTING_Trait traits[] = {
+    SYNC_TESTING_make_trait_hash (SYNC_TESTING_TRAIT_HASH_CURRENT,
+                                  &bums->curr_hash),
+    SYNC_TESTING_make_trait_hash (SYNC_TESTING_TRAIT_HASH_PREVIOUS,
+                                  &bums->prev_hash),
+    SYNC_TESTING_make_trait_account_pub (0,
+                                         &bums->sync_pub),
+    SYNC_TESTING_make_trait_account_priv (0,
+                                          &bums->sync_priv),
+    TALER_TESTING_trait_end ()
+  };
+
+  return TALER_TESTING_get_trait (traits,
+                                  ret,
+                                  trait,
+                                  index);
+}
+
+
+struct TALER_TESTING_Command
+SYNC_TESTING_cmd_backup_upload_multi (const char *label,
+                                      const char *sync_url,
+                                      const char *other_url,
+                                      const char *prev_upload,
+                                      unsigned int http_status,
+                                      unsigned int other_http_status,
+                                      const void *backup_data,
+                                      size_t backup_data_size)
+{
+  struct BackupUploadMultiState *bums;
+
+  GNUNET_assert (NULL != prev_upload);
+  bums = GNUNET_new (struct BackupUploadMultiState);
+  bums->sync_url = sync_url;
+  bums->other_url = other_url;
+  bums->prev_upload = prev_upload;
+  bums->http_status = http_status;
+  bums->other_http_status = other_http_status;
+  bums->backup = backup_data;
+  bums->backup_size = backup_data_size;
+  {
+    struct TALER_TESTING_Command cmd = {
+      .cls = bums,
+      .label = label,
+      .run = &backup_upload_multi_run,
+      .cleanup = &backup_upload_multi_cleanup,
+      .traits = &backup_upload_multi_traits
+    };
+
+    return cmd;
+  }
+}
+
+
+/* end of testing_api_cmd_backup_upload_multi.c */